@@ -0,0 +1,437 @@
+#include <ctype.h>
+
+#include "batch.h"
+
+#ifdef BATCH_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+typedef enum {
+    JOB_PASSED,             // The output matched.
+    JOB_RAN,                // Ran to the end, with no expected output to check.
+    JOB_WRONG_OUTPUT,
+    JOB_RUNTIME_ERROR,
+    JOB_COMPILE_ERROR,
+    JOB_INVALID_PROGRAM,
+    JOB_MISSING_FILE,
+    JOB_NO_MEMORY,
+} JobStatus;
+
+static const char* statusNames[] = {
+    "passed", "ran", "wrong-output", "runtime-error", "compile-error", "invalid-program", "missing-file", "no-memory",
+};
+
+typedef struct {
+    char* name;             // The source file as the manifest gives it.
+    char* source;           // Paths resolved against the manifest's directory.
+    char* input;            // NULL for no input.
+    char* expected;         // NULL if the output is not checked.
+} Job;
+
+typedef struct {
+    JobStatus status;
+    double ms;
+    unsigned long long instructions;
+    unsigned long long peakCells;
+    char* diagnostics;      // The job's compile and runtime errors, or NULL if it had none.
+} JobResult;
+
+// The jobs [next, end) a worker has left. The owner takes from next, thieves from end.
+typedef struct {
+#ifdef BATCH_THREADS
+    pthread_mutex_t lock;
+#endif
+    int next;
+    int end;
+} WorkRange;
+
+typedef struct {
+    Job* jobs;
+    JobResult* results;
+    int count;
+    int capacity;
+    WorkRange* ranges;
+    int workers;
+    PseudoOptions options;
+} Batch;
+
+typedef struct {
+    Batch* batch;
+    int id;
+} Worker;
+
+static double now() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static bool isAbsolute(const char* path) {
+    return path[0] == '/' || path[0] == '\\' || (isalpha((unsigned char)path[0]) && path[1] == ':');
+}
+
+// path as seen from the directory dirLength characters of base name, or NULL for "-".
+static char* resolvePath(const char* base, size_t dirLength, const char* path) {
+    if (strcmp(path, "-") == 0) return NULL;
+    if (isAbsolute(path)) dirLength = 0;
+
+    size_t length = strlen(path);
+    char* resolved = (char*)malloc(dirLength + length + 1);
+    if (resolved == NULL) return NULL;
+
+    memcpy(resolved, base, dirLength);
+    memcpy(resolved + dirLength, path, length + 1);
+    return resolved;
+}
+
+static void freeJob(Job* job) {
+    free(job->name);
+    free(job->source);
+    free(job->input);
+    free(job->expected);
+}
+
+static void freeJobs(Batch* batch) {
+    for (int i = 0; i < batch->count; i++) freeJob(&batch->jobs[i]);
+    free(batch->jobs);
+    batch->jobs = NULL;
+    batch->count = 0;
+    batch->capacity = 0;
+}
+
+static bool addJob(Batch* batch, const char* manifestPath, size_t dirLength, char* fields[3], int fieldCount) {
+    if (batch->count == batch->capacity) {
+        int capacity = batch->capacity < 8 ? 8 : batch->capacity * 2;
+        Job* jobs = (Job*)realloc(batch->jobs, (size_t)capacity * sizeof(Job));
+        if (jobs == NULL) return false;
+        batch->jobs = jobs;
+        batch->capacity = capacity;
+    }
+
+    Job* job = &batch->jobs[batch->count];
+    job->name = resolvePath("", 0, fields[0]);
+    job->source = resolvePath(manifestPath, dirLength, fields[0]);
+    job->input = fieldCount > 1 ? resolvePath(manifestPath, dirLength, fields[1]) : NULL;
+    job->expected = fieldCount > 2 ? resolvePath(manifestPath, dirLength, fields[2]) : NULL;
+
+    if (job->name == NULL || job->source == NULL || (fieldCount > 1 && job->input == NULL && strcmp(fields[1], "-") != 0) ||
+        (fieldCount > 2 && job->expected == NULL && strcmp(fields[2], "-") != 0)) {
+        freeJob(job);
+        return false;
+    }
+
+    batch->count++;
+    return true;
+}
+
+static bool readManifest(Batch* batch, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open manifest \"%s\".\n", path);
+        return false;
+    }
+
+    // Relative paths in the manifest start from its own directory.
+    size_t dirLength = 0;
+    for (size_t i = 0; path[i] != '\0'; i++) {
+        if (path[i] == '/' || path[i] == '\\') dirLength = i + 1;
+    }
+
+    char line[4096];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+
+        char* fields[4];
+        int fieldCount = 0;
+        char* c = line;
+        while (fieldCount < 4) {
+            while (isspace((unsigned char)*c)) c++;
+            if (*c == '\0' || *c == '#') break;
+
+            fields[fieldCount++] = c;
+            while (*c != '\0' && !isspace((unsigned char)*c)) c++;
+            if (*c != '\0') *c++ = '\0';
+        }
+
+        if (fieldCount == 0) continue;
+        if (fieldCount > 3 || strcmp(fields[0], "-") == 0) {
+            fprintf(stderr, "%s:%d: expected <source> [<input> [<expected output>]].\n", path, lineNumber);
+            fclose(file);
+            return false;
+        }
+        if (!addJob(batch, path, dirLength, fields, fieldCount)) {
+            fprintf(stderr, "Not enough memory for the batch.\n");
+            fclose(file);
+            return false;
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+// True if the rest of output is exactly the contents of the file at path.
+static bool sameOutput(FILE* output, const char* path) {
+    FILE* expected = fopen(path, "rb");
+    if (expected == NULL) return false;
+
+    rewind(output);
+    int a, b;
+    do {
+        a = fgetc(output);
+        b = fgetc(expected);
+    } while (a == b && a != EOF);
+
+    fclose(expected);
+    return a == b;
+}
+
+// Everything written to the stream, as a string, or NULL if nothing was.
+static char* readBack(FILE* stream) {
+    long length = ftell(stream);
+    if (length <= 0) return NULL;
+
+    char* text = (char*)malloc((size_t)length + 1);
+    if (text == NULL) return NULL;
+
+    rewind(stream);
+    size_t got = fread(text, 1, (size_t)length, stream);
+    text[got] = '\0';
+    return text;
+}
+
+// Writes a job's diagnostics to stderr with each non-empty line prefixed by the job's source file, so
+// they can be told apart from other jobs'.
+static void printDiagnostics(const char* name, const char* text) {
+    while (*text != '\0') {
+        const char* end = strchr(text, '\n');
+        int length = end != NULL ? (int)(end - text) : (int)strlen(text);
+        if (length > 0) fprintf(stderr, "%s: %.*s\n", name, length, text);
+        text += end != NULL ? length + 1 : length;
+    }
+}
+
+static void compileAndRun(Batch* batch, Job* job, JobResult* result) {
+    char* source = readSource(job->source);
+    if (source == NULL) {
+        fprintf(diagnostics(), "Could not open file \"%s\".\n", job->source);
+        result->status = JOB_MISSING_FILE;
+        return;
+    }
+
+    PseudoProgram* program = pseudoCompile(source, &batch->options);
+    free(source);
+    if (program == NULL) {
+        result->status = JOB_COMPILE_ERROR;
+        return;
+    }
+
+    // A job without input reads from an empty file rather than from the batch's stdin.
+    FILE* in = job->input != NULL ? fopen(job->input, "rb") : tmpfile();
+    FILE* out = tmpfile();
+    PseudoVM* vm = in != NULL && out != NULL ? pseudoNewVM(program, &batch->options) : NULL;
+
+    if (in == NULL && job->input != NULL) {
+        fprintf(diagnostics(), "Could not open file \"%s\".\n", job->input);
+        result->status = JOB_MISSING_FILE;
+    } else if (vm == NULL) {
+        result->status = JOB_NO_MEMORY;
+    } else {
+        PseudoResult ran = pseudoRun(vm, in, out);
+        PseudoStats stats;
+        pseudoGetStats(vm, &stats);
+        result->instructions = stats.instructions;
+        result->peakCells = stats.peakHeapCells;
+
+        if (ran == PSEUDO_INVALID_PROGRAM) result->status = JOB_INVALID_PROGRAM;
+        else if (ran == PSEUDO_RUNTIME_ERROR) result->status = JOB_RUNTIME_ERROR;
+        else if (job->expected == NULL) result->status = JOB_RAN;
+        else result->status = sameOutput(out, job->expected) ? JOB_PASSED : JOB_WRONG_OUTPUT;
+    }
+
+    pseudoFreeVM(vm);
+    if (in != NULL) fclose(in);
+    if (out != NULL) fclose(out);
+    pseudoFreeProgram(program);
+}
+
+static void runJob(Batch* batch, int index) {
+    Job* job = &batch->jobs[index];
+    JobResult* result = &batch->results[index];
+    double start = now();
+
+    result->instructions = 0;
+    result->peakCells = 0;
+    result->diagnostics = NULL;
+
+    // Workers run jobs side by side, so each job's errors are held back until its record is
+    // printed. Without a temporary file they go straight to stderr.
+    FILE* errors = tmpfile();
+    pseudoSetDiagnostics(errors);
+    compileAndRun(batch, job, result);
+    pseudoSetDiagnostics(NULL);
+
+    if (errors != NULL) {
+        result->diagnostics = readBack(errors);
+        fclose(errors);
+    }
+    result->ms = now() - start;
+}
+
+// The next job for worker id: the front of its own range, or else the back half of the first
+// other range that has jobs left, which becomes its own. -1 once every range is empty.
+static int takeJob(Batch* batch, int id) {
+    WorkRange* own = &batch->ranges[id];
+    int job = -1;
+
+#ifdef BATCH_THREADS
+    pthread_mutex_lock(&own->lock);
+    if (own->next < own->end) job = own->next++;
+    pthread_mutex_unlock(&own->lock);
+    if (job >= 0) return job;
+
+    // Only one lock is held at a time, so thieves cannot deadlock each other.
+    for (int i = 1; i < batch->workers; i++) {
+        WorkRange* victim = &batch->ranges[(id + i) % batch->workers];
+
+        pthread_mutex_lock(&victim->lock);
+        int left = victim->end - victim->next;
+        int from = victim->end - (left + 1) / 2;
+        int to = victim->end;
+        if (left > 0) victim->end = from;
+        pthread_mutex_unlock(&victim->lock);
+
+        if (left > 0) {
+            pthread_mutex_lock(&own->lock);
+            own->next = from + 1;
+            own->end = to;
+            pthread_mutex_unlock(&own->lock);
+            return from;
+        }
+    }
+#else
+    if (own->next < own->end) job = own->next++;
+#endif
+
+    return job;
+}
+
+static void* workerMain(void* arg) {
+    Worker* worker = (Worker*)arg;
+
+    int job;
+    while ((job = takeJob(worker->batch, worker->id)) >= 0) {
+        runJob(worker->batch, job);
+    }
+    return NULL;
+}
+
+static int processorCount() {
+#ifdef BATCH_THREADS
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#else
+    return 1;
+#endif
+}
+
+// Runs every job on the given number of workers, the calling thread being one of them.
+static bool runWorkers(Batch* batch) {
+    Worker workers[MAX_BATCH_THREADS];
+
+    batch->ranges = (WorkRange*)malloc((size_t)batch->workers * sizeof(WorkRange));
+    if (batch->ranges == NULL) return false;
+
+    // Contiguous, even shares to begin with.
+    for (int i = 0; i < batch->workers; i++) {
+        batch->ranges[i].next = (int)((long long)batch->count * i / batch->workers);
+        batch->ranges[i].end = (int)((long long)batch->count * (i + 1) / batch->workers);
+#ifdef BATCH_THREADS
+        pthread_mutex_init(&batch->ranges[i].lock, NULL);
+#endif
+        workers[i].batch = batch;
+        workers[i].id = i;
+    }
+
+#ifdef BATCH_THREADS
+    pthread_t threads[MAX_BATCH_THREADS];
+    int started = 1;
+    while (started < batch->workers && pthread_create(&threads[started], NULL, workerMain, &workers[started]) == 0) {
+        started++;
+    }
+
+    // Ranges of workers that failed to start are stolen by the ones that did.
+    workerMain(&workers[0]);
+    for (int i = 1; i < started; i++) pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < batch->workers; i++) pthread_mutex_destroy(&batch->ranges[i].lock);
+#else
+    workerMain(&workers[0]);
+#endif
+
+    free(batch->ranges);
+    batch->ranges = NULL;
+    return true;
+}
+
+bool runBatch(const char* manifestPath, const PseudoOptions* options, int threads) {
+    Batch batch;
+    batch.jobs = NULL;
+    batch.results = NULL;
+    batch.count = 0;
+    batch.capacity = 0;
+    batch.ranges = NULL;
+    batch.options = *options;
+    // The records report instructions executed, so the JIT is off for every job.
+    batch.options.countInstructions = true;
+
+    if (!readManifest(&batch, manifestPath)) {
+        freeJobs(&batch);
+        return false;
+    }
+    if (batch.count == 0) {
+        fprintf(stderr, "The manifest \"%s\" lists no jobs.\n", manifestPath);
+        freeJobs(&batch);
+        return false;
+    }
+
+    batch.workers = threads > 0 ? threads : processorCount();
+#ifndef BATCH_THREADS
+    batch.workers = 1;
+#endif
+    if (batch.workers > MAX_BATCH_THREADS) batch.workers = MAX_BATCH_THREADS;
+    if (batch.workers > batch.count) batch.workers = batch.count;
+
+    batch.results = (JobResult*)malloc((size_t)batch.count * sizeof(JobResult));
+    double start = now();
+    if (batch.results == NULL || !runWorkers(&batch)) {
+        fprintf(stderr, "Not enough memory for the batch.\n");
+        free(batch.results);
+        freeJobs(&batch);
+        return false;
+    }
+    double elapsed = now() - start;
+
+    int passed = 0;
+    for (int i = 0; i < batch.count; i++) {
+        JobResult* result = &batch.results[i];
+        printf("%d\t%s\t%s\t%.3f\t%llu\t%llu\n", i + 1, batch.jobs[i].name, statusNames[result->status],
+               result->ms, result->instructions, result->peakCells);
+        if (result->diagnostics != NULL) {
+            fflush(stdout);
+            printDiagnostics(batch.jobs[i].name, result->diagnostics);
+            free(result->diagnostics);
+        }
+        if (result->status == JOB_PASSED || result->status == JOB_RAN) passed++;
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "%d of %d jobs passed, %.1f ms on %d threads.\n", passed, batch.count, elapsed, batch.workers);
+    bool allPassed = passed == batch.count;
+
+    free(batch.results);
+    freeJobs(&batch);
+    return allPassed;
+}
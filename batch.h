@@ -0,0 +1,38 @@
+#ifndef PSEUDOCOMPILER_BATCH_H
+#define PSEUDOCOMPILER_BATCH_H
+
+#include "common.h"
+#include "pseudo.h"
+
+// Batch mode for -batch: compiles and runs many small programs in one process, each against
+// its own input, and checks their output. The manifest lists one job per line:
+//
+//     <source file> [<input file> [<expected output file>]]
+//
+// with "-" for no input or for output that is not checked. Blank lines and lines starting
+// with # are skipped, and relative paths are taken from the manifest's directory.
+//
+// Jobs are shared out as contiguous ranges, one per worker thread. A worker takes jobs from
+// the front of its range and, once it is empty, steals the back half of another worker's, so
+// a few slow programs do not leave the other threads idle. Each job prints one record, in
+// manifest order, with tab-separated fields:
+//
+//     <job number> <source file> <status> <wall ms> <instructions executed> <peak heap cells>
+//
+// The wall time covers compiling and running. The status is passed, ran (no expected output to
+// check), wrong-output, runtime-error, compile-error, invalid-program, missing-file or
+// no-memory. A job's compile and runtime errors follow its
+// record on stderr, each line prefixed with its source file. With a maxInstructions option, a
+// job that runs past it stops with a runtime error, so one that never ends cannot hold up the
+// batch. Without POSIX threads the jobs run one after another.
+#if defined(__unix__) || defined(__APPLE__)
+#define BATCH_THREADS
+#endif
+
+#define MAX_BATCH_THREADS   256
+
+// Threads is the number of workers, or 0 for one per processor. True if every job ran and
+// produced its expected output.
+bool runBatch(const char* manifestPath, const PseudoOptions* options, int threads);
+
+#endif //PSEUDOCOMPILER_BATCH_H
@@ -0,0 +1,210 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Benchmark runner for the programs in this directory: scaled-up versions of the examples in
+// PseudocodeLanguageSpecs.md, plus ones that stress strings and BYREF calls. Each program is
+// compiled to bytecode once, run once with --stats for its instruction count and peak heap use,
+// then run the given number of times for its median and fastest wall times, which include
+// starting the process. A program reads its fixed input from the .in file next to it, and its
+// output from the --stats run must match the .expected file next to it when there is one.
+//
+// Usage: pseudo-bench [--runs=<n>] [VM options...] <pseudo executable> <program.pc>...
+// VM options such as --no-jit or --register are passed on to every compile and run. The
+// bytecode, output and files the programs write go to the current directory.
+
+#ifdef _WIN32
+#define NULL_DEVICE     "NUL"
+#else
+#define NULL_DEVICE     "/dev/null"
+#endif
+
+#define DEFAULT_RUNS    5
+#define MAX_RUNS        100
+#define COMMAND_SIZE    4096
+
+typedef struct {
+    char name[256];
+    double median;          // Milliseconds.
+    double fastest;
+    unsigned long long instructions;
+    unsigned long long peakCells;
+} Result;
+
+static double now() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static int compareTimes(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static bool fileExists(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return false;
+    fclose(file);
+    return true;
+}
+
+// Program name without its directory or extension.
+static void programName(const char* path, char* name, size_t size) {
+    const char* base = path;
+    for (const char* c = path; *c != '\0'; c++) {
+        if (*c == '/' || *c == '\\') base = c + 1;
+    }
+
+    snprintf(name, size, "%s", base);
+    char* dot = strrchr(name, '.');
+    if (dot != NULL && dot != name) *dot = '\0';
+}
+
+// Whether two files hold the same bytes.
+static bool sameContents(const char* pathA, const char* pathB) {
+    FILE* a = fopen(pathA, "rb");
+    FILE* b = fopen(pathB, "rb");
+    bool same = a != NULL && b != NULL;
+
+    while (same) {
+        int x = fgetc(a);
+        int y = fgetc(b);
+        if (x != y) same = false;
+        if (x == EOF || y == EOF) break;
+    }
+
+    if (a != NULL) fclose(a);
+    if (b != NULL) fclose(b);
+    return same;
+}
+
+static bool runCommand(const char* command) {
+    return system(command) == 0;
+}
+
+// Reads the --stats report, failing if the program stopped with a runtime error.
+static bool readStats(const char* path, Result* result) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) return false;
+
+    char line[512];
+    bool sawInstructions = false;
+    bool failed = false;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "Instructions executed: %llu", &result->instructions) == 1) sawInstructions = true;
+        sscanf(line, "Peak heap cells: %llu", &result->peakCells);
+        if (strncmp(line, "Runtime error", 13) == 0) {
+            fprintf(stderr, "%s: %s", result->name, line);
+            failed = true;
+        }
+    }
+
+    fclose(file);
+    return sawInstructions && !failed;
+}
+
+static bool benchmark(const char* exe, const char* options, const char* path, int runs, Result* result) {
+    char command[COMMAND_SIZE];
+    char input[COMMAND_SIZE];
+    char expected[COMMAND_SIZE];
+    char stats[512];
+    char output[512];
+    double times[MAX_RUNS];
+
+    programName(path, result->name, sizeof(result->name));
+    result->instructions = 0;
+    result->peakCells = 0;
+
+    // Fixed input from <program>.in, or none.
+    snprintf(input, sizeof(input), "%.*s.in", (int)(strlen(path) - 3), path);
+    if (!fileExists(input)) snprintf(input, sizeof(input), "%s", NULL_DEVICE);
+
+    snprintf(command, sizeof(command), "\"%s\" -c \"%s\" \"%s\" %s > %s", exe, path, result->name, options, NULL_DEVICE);
+    if (!runCommand(command)) {
+        fprintf(stderr, "%s: could not compile \"%s\".\n", result->name, path);
+        return false;
+    }
+
+    snprintf(stats, sizeof(stats), "%s.stats", result->name);
+    snprintf(command, sizeof(command), "\"%s\" -r \"%s.pcbc\" --stats %s < \"%s\" > \"%s.out\" 2> \"%s\"",
+             exe, result->name, options, input, result->name, stats);
+    if (!runCommand(command) || !readStats(stats, result)) {
+        fprintf(stderr, "%s: the --stats run failed, see %s and %s.out.\n", result->name, stats, result->name);
+        return false;
+    }
+
+    snprintf(expected, sizeof(expected), "%.*s.expected", (int)(strlen(path) - 3), path);
+    snprintf(output, sizeof(output), "%s.out", result->name);
+    if (fileExists(expected) && !sameContents(output, expected)) {
+        fprintf(stderr, "%s: %s differs from %s.\n", result->name, output, expected);
+        return false;
+    }
+
+    snprintf(command, sizeof(command), "\"%s\" -r \"%s.pcbc\" %s < \"%s\" > %s",
+             exe, result->name, options, input, NULL_DEVICE);
+    for (int i = 0; i < runs; i++) {
+        double start = now();
+        if (!runCommand(command)) {
+            fprintf(stderr, "%s: run %d failed.\n", result->name, i + 1);
+            return false;
+        }
+        times[i] = now() - start;
+    }
+
+    qsort(times, runs, sizeof(double), compareTimes);
+    result->fastest = times[0];
+    result->median = runs % 2 == 1 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2.0;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int runs = DEFAULT_RUNS;
+    char options[COMMAND_SIZE] = "";
+    const char* exe = NULL;
+    int first = argc;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--runs=", 7) == 0) {
+            runs = atoi(argv[i] + 7);
+            if (runs < 1 || runs > MAX_RUNS) {
+                fprintf(stderr, "--runs must be between 1 and %d.\n", MAX_RUNS);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            size_t used = strlen(options);
+            snprintf(options + used, sizeof(options) - used, "%s%s", used > 0 ? " " : "", argv[i]);
+        } else {
+            exe = argv[i];
+            first = i + 1;
+            break;
+        }
+    }
+
+    if (exe == NULL || first >= argc) {
+        fprintf(stderr, "Usage: pseudo-bench [--runs=<n>] [VM options...] <pseudo executable> <program.pc>...\n");
+        return 1;
+    }
+
+    printf("%d timed runs per program%s%s\n\n", runs, options[0] != '\0' ? ", options: " : "", options);
+    printf("%-16s %12s %12s %16s %12s\n", "program", "median ms", "fastest ms", "instructions", "peak cells");
+
+    int failures = 0;
+    for (int i = first; i < argc; i++) {
+        Result result;
+        if (!benchmark(exe, options, argv[i], runs, &result)) {
+            printf("%-16s %12s\n", result.name, "FAILED");
+            failures++;
+            continue;
+        }
+
+        printf("%-16s %12.1f %12.1f %16llu %12llu\n", result.name, result.median, result.fastest,
+               result.instructions, result.peakCells);
+        fflush(stdout);
+    }
+
+    return failures > 0 ? 1 : 0;
+}
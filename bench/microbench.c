@@ -0,0 +1,387 @@
+#include <time.h>
+
+#include "common.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "vm.h"
+
+// Microbenchmarks for single VM instructions. Each case is a short, stack-neutral sequence
+// built straight into a BytecodeStream, repeated UNROLL times inside a counted loop and run
+// through the VM API with the JIT off. The time of the same loop with an empty body is
+// subtracted, so what remains is the cost of the sequence itself, operands included.
+//
+// Usage: pseudo-microbench [--iterations=<n>] [--runs=<n>] [case name...]
+
+#define UNROLL              16
+#define DEFAULT_ITERATIONS  (1 << 20)
+#define DEFAULT_RUNS        5
+#define MAX_RUNS            100
+
+// Slots the main program sets up before calling the benchmark procedure.
+#define GLOBAL_INT          0
+#define GLOBAL_STRING       1
+#define GLOBAL_OTHER_STRING 2
+#define GLOBAL_ARRAY        3
+#define ARRAY_LENGTH        64
+
+// Locals of the benchmark procedure.
+#define LOCAL_COUNTER       0
+#define LOCAL_INT           1
+#define LOCALS              2
+
+typedef void (*EmitFn)(BytecodeStream* bs);
+
+typedef struct {
+    const char* name;
+    const char* sequence;
+    int leftOnStack;        // Values the setup pushes for the body to work on.
+    EmitFn setup;
+    EmitFn body;
+} Case;
+
+// Subroutines the call cases use, set when the program is built.
+static int procedureStart;
+static int functionStart;
+
+static void addInt(BytecodeStream* bs, int value) {
+    byte4 bits;
+    memcpy(&bits, &value, sizeof(int));
+    addBytecode(bs, (byte)(bits >> 24));
+    addBytecode(bs, (byte)(bits >> 16));
+    addBytecode(bs, (byte)(bits >> 8));
+    addBytecode(bs, (byte)bits);
+}
+
+static void addReal(BytecodeStream* bs, double value) {
+    byte8 bits;
+    memcpy(&bits, &value, sizeof(double));
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        addBytecode(bs, (byte)(bits >> shift));
+    }
+}
+
+static void addOpInt(BytecodeStream* bs, Instruction op, int value) {
+    addInstruction(bs, op);
+    addInt(bs, value);
+}
+
+static void addString(BytecodeStream* bs, const char* chars) {
+    int length = (int)strlen(chars);
+    addOpInt(bs, LOAD_STRING, length);
+    for (int i = 0; i < length; i++) {
+        addBytecode(bs, (byte)chars[i]);
+    }
+}
+
+static void patchInt(BytecodeStream* bs, int pos, int value) {
+    byte4 bits;
+    memcpy(&bits, &value, sizeof(int));
+    bs->stream[pos] = (byte)(bits >> 24);
+    bs->stream[pos + 1] = (byte)(bits >> 16);
+    bs->stream[pos + 2] = (byte)(bits >> 8);
+    bs->stream[pos + 3] = (byte)bits;
+}
+
+static void noSetup(BytecodeStream* bs) { (void)bs; }
+static void emptyBody(BytecodeStream* bs) { (void)bs; }
+
+static void setupInt(BytecodeStream* bs) { addOpInt(bs, LOAD_INT, 0); }
+static void setupOne(BytecodeStream* bs) { addOpInt(bs, LOAD_INT, 1); }
+static void setupReal(BytecodeStream* bs) {
+    addInstruction(bs, LOAD_REAL);
+    addReal(bs, 1.0);
+}
+
+static void addIntBody(BytecodeStream* bs) {
+    addOpInt(bs, LOAD_INT, 1);
+    addInstruction(bs, ADD_INT);
+}
+
+static void multIntBody(BytecodeStream* bs) {
+    addOpInt(bs, LOAD_INT, 1);
+    addInstruction(bs, MULT_INT);
+}
+
+static void modIntBody(BytecodeStream* bs) {
+    addOpInt(bs, LOAD_INT, 7);
+    addInstruction(bs, ADD_INT);
+    addOpInt(bs, LOAD_INT, 1000);
+    addInstruction(bs, MOD_INT);
+}
+
+static void addRealBody(BytecodeStream* bs) {
+    addInstruction(bs, LOAD_REAL);
+    addReal(bs, 0.5);
+    addInstruction(bs, ADD_REAL);
+}
+
+static void multRealBody(BytecodeStream* bs) {
+    addInstruction(bs, LOAD_REAL);
+    addReal(bs, 1.0000001);
+    addInstruction(bs, MULT_REAL);
+}
+
+static void fetchBody(BytecodeStream* bs) {
+    addOpInt(bs, LOAD_INT, GLOBAL_INT);
+    addInstruction(bs, FETCH_INT);
+    addInstruction(bs, POP);
+}
+
+static void storeBody(BytecodeStream* bs) {
+    addOpInt(bs, LOAD_INT, 7);
+    addOpInt(bs, LOAD_INT, GLOBAL_INT);
+    addInstruction(bs, STORE_INT);
+    addInstruction(bs, POP);
+}
+
+static void globalIntBody(BytecodeStream* bs) {
+    addOpInt(bs, FETCH_GLOBAL_INT, GLOBAL_INT);
+    addOpInt(bs, STORE_GLOBAL_INT_DISCARD, GLOBAL_INT);
+}
+
+static void rfetchBody(BytecodeStream* bs) {
+    addOpInt(bs, LOAD_INT, LOCAL_INT);
+    addInstruction(bs, RFETCH_INT);
+    addInstruction(bs, POP);
+}
+
+static void rstoreBody(BytecodeStream* bs) {
+    addOpInt(bs, LOAD_INT, 7);
+    addOpInt(bs, LOAD_INT, LOCAL_INT);
+    addInstruction(bs, RSTORE_INT);
+    addInstruction(bs, POP);
+}
+
+static void localIntBody(BytecodeStream* bs) {
+    addOpInt(bs, FETCH_LOCAL_INT, LOCAL_INT);
+    addOpInt(bs, STORE_LOCAL_INT_DISCARD, LOCAL_INT);
+}
+
+static void fetchArrayBody(BytecodeStream* bs) {
+    addOpInt(bs, LOAD_INT, GLOBAL_ARRAY);
+    addInstruction(bs, FETCH_REF);
+    addOpInt(bs, LOAD_INT, ARRAY_LENGTH / 2);
+    addOpInt(bs, LOAD_INT, 0);
+    addInstruction(bs, FETCH_ARRAY_ELEM);
+    addInstruction(bs, POP);
+}
+
+static void storeArrayBody(BytecodeStream* bs) {
+    addOpInt(bs, LOAD_INT, 7);
+    addOpInt(bs, LOAD_INT, GLOBAL_ARRAY);
+    addInstruction(bs, FETCH_REF);
+    addOpInt(bs, LOAD_INT, ARRAY_LENGTH / 2);
+    addOpInt(bs, LOAD_INT, 0);
+    addInstruction(bs, STORE_ARRAY_ELEM);
+    addInstruction(bs, POP);
+}
+
+static void fetchStrings(BytecodeStream* bs) {
+    addOpInt(bs, LOAD_INT, GLOBAL_STRING);
+    addInstruction(bs, FETCH_REF);
+    addOpInt(bs, LOAD_INT, GLOBAL_OTHER_STRING);
+    addInstruction(bs, FETCH_REF);
+}
+
+static void concatBody(BytecodeStream* bs) {
+    fetchStrings(bs);
+    addInstruction(bs, CONCAT);
+    addInstruction(bs, POP);
+}
+
+static void eqStringBody(BytecodeStream* bs) {
+    fetchStrings(bs);
+    addInstruction(bs, EQ_STRING);
+    addInstruction(bs, POP);
+}
+
+static void callProcedureBody(BytecodeStream* bs) {
+    addOpInt(bs, DO_CALL, procedureStart);
+    addInt(bs, 0);
+}
+
+static void callFunctionBody(BytecodeStream* bs) {
+    addOpInt(bs, FETCH_LOCAL_INT, LOCAL_INT);
+    addOpInt(bs, DO_CALL, functionStart);
+    addInt(bs, 1);
+    addInstruction(bs, POP);
+}
+
+static const Case cases[] = {
+    {"empty", "(loop overhead only)", 0, noSetup, emptyBody},
+    {"ADD_INT", "LOAD_INT ADD_INT", 1, setupInt, addIntBody},
+    {"MULT_INT", "LOAD_INT MULT_INT", 1, setupOne, multIntBody},
+    {"MOD_INT", "LOAD_INT ADD_INT LOAD_INT MOD_INT", 1, setupInt, modIntBody},
+    {"ADD_REAL", "LOAD_REAL ADD_REAL", 1, setupReal, addRealBody},
+    {"MULT_REAL", "LOAD_REAL MULT_REAL", 1, setupReal, multRealBody},
+    {"FETCH_INT", "LOAD_INT FETCH_INT POP", 0, noSetup, fetchBody},
+    {"STORE_INT", "LOAD_INT LOAD_INT STORE_INT POP", 0, noSetup, storeBody},
+    {"GLOBAL_INT", "FETCH_GLOBAL_INT STORE_GLOBAL_INT_DISCARD", 0, noSetup, globalIntBody},
+    {"RFETCH_INT", "LOAD_INT RFETCH_INT POP", 0, noSetup, rfetchBody},
+    {"RSTORE_INT", "LOAD_INT LOAD_INT RSTORE_INT POP", 0, noSetup, rstoreBody},
+    {"LOCAL_INT", "FETCH_LOCAL_INT STORE_LOCAL_INT_DISCARD", 0, noSetup, localIntBody},
+    {"FETCH_ARRAY_ELEM", "LOAD_INT FETCH_REF LOAD_INT LOAD_INT FETCH_ARRAY_ELEM POP", 0, noSetup, fetchArrayBody},
+    {"STORE_ARRAY_ELEM", "LOAD_INT LOAD_INT FETCH_REF LOAD_INT LOAD_INT STORE_ARRAY_ELEM POP", 0, noSetup, storeArrayBody},
+    {"CONCAT", "LOAD_INT FETCH_REF LOAD_INT FETCH_REF CONCAT POP", 0, noSetup, concatBody},
+    {"EQ_STRING", "LOAD_INT FETCH_REF LOAD_INT FETCH_REF EQ_STRING POP", 0, noSetup, eqStringBody},
+    {"CALL_PROCEDURE", "DO_CALL (ENTER RETURN_NIL)", 0, noSetup, callProcedureBody},
+    {"CALL_FUNCTION", "FETCH_LOCAL_INT DO_CALL (ENTER FETCH_LOCAL_INT RETURN) POP", 0, noSetup, callFunctionBody},
+};
+
+#define CASE_COUNT  ((int)(sizeof(cases) / sizeof(cases[0])))
+
+// Main sets up the global slots and calls a procedure that runs the case's body UNROLL times
+// per iteration, counting down a local register.
+static void buildProgram(BytecodeStream* bs, const Case* c, int iterations) {
+    addOpInt(bs, BRANCH, 0);
+    int mainJump = getNextPos(bs) - 4;
+
+    procedureStart = getNextPos(bs);
+    addOpInt(bs, ENTER, 0);
+    addInstruction(bs, RETURN_NIL);
+
+    functionStart = getNextPos(bs);
+    addOpInt(bs, ENTER, 0);
+    addOpInt(bs, FETCH_LOCAL_INT, 0);
+    addInstruction(bs, RETURN);
+
+    int benchStart = getNextPos(bs);
+    addOpInt(bs, ENTER, LOCALS);
+    addOpInt(bs, LOADK_INT_R, REG_OPERAND(LOCAL_COUNTER, true));
+    addInt(bs, iterations);
+    c->setup(bs);
+
+    int loop = getNextPos(bs);
+    for (int i = 0; i < UNROLL; i++) {
+        c->body(bs);
+    }
+    addOpInt(bs, MINUS_INT_RK, REG_OPERAND(LOCAL_COUNTER, true));
+    addInt(bs, REG_OPERAND(LOCAL_COUNTER, true));
+    addInt(bs, 1);
+    addOpInt(bs, BGT_INT_RK, REG_OPERAND(LOCAL_COUNTER, true));
+    addInt(bs, 0);
+    addInt(bs, loop);
+
+    for (int i = 0; i < c->leftOnStack; i++) {
+        addInstruction(bs, POP);
+    }
+    addInstruction(bs, RETURN_NIL);
+
+    patchInt(bs, mainJump, getNextPos(bs));
+    addOpInt(bs, LOAD_INT, 0);
+    addString(bs, "pseudocode");
+    addString(bs, "benchmark");
+    addOpInt(bs, LOAD_INT, 1);
+    addOpInt(bs, LOAD_INT, ARRAY_LENGTH);
+    addOpInt(bs, LOAD_INT, 0);
+    addOpInt(bs, LOAD_INT, 0);
+    addOpInt(bs, LOAD_INT, 4);
+    addInstruction(bs, CREATE_ARRAY);
+    addOpInt(bs, DO_CALL, benchStart);
+    addInt(bs, 0);
+    addInstruction(bs, EXIT);
+}
+
+static double now() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int compareTimes(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Median wall time of a run of the case, in nanoseconds, or a negative value if it failed.
+static double timeCase(const Case* c, int iterations, int runs) {
+    double times[MAX_RUNS];
+
+    for (int r = 0; r < runs; r++) {
+        BytecodeStream bs;
+        initBytecodeStream(&bs);
+        buildProgram(&bs, c, iterations);
+
+        VM vm;
+        if (!initVM(&vm, DEFAULT_HEAP_CELLS, DEFAULT_STACK_SLOTS, DEFAULT_CALL_FRAMES, &bs)) {
+            freeBytecodeStream(&bs);
+            return -1.0;
+        }
+        configureJit(&vm.jit, false, DEFAULT_JIT_THRESHOLD);
+
+        double start = now();
+        bool ok = run(&vm, false) && !vm.hadRuntimeError;
+        times[r] = now() - start;
+
+        freeVM(&vm);
+        freeBytecodeStream(&bs);
+
+        if (!ok) {
+            fprintf(stderr, "%s: the benchmark program failed.\n", c->name);
+            return -1.0;
+        }
+    }
+
+    qsort(times, runs, sizeof(double), compareTimes);
+    return runs % 2 == 1 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2.0;
+}
+
+static bool selected(const Case* c, int argc, char* argv[]) {
+    bool any = false;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) == 0) continue;
+        any = true;
+        if (strcmp(argv[i], c->name) == 0) return true;
+    }
+    return !any;
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = DEFAULT_ITERATIONS;
+    int runs = DEFAULT_RUNS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--iterations=", 13) == 0) {
+            iterations = atoi(argv[i] + 13);
+            if (iterations < 1) {
+                fprintf(stderr, "--iterations must be at least 1.\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--runs=", 7) == 0) {
+            runs = atoi(argv[i] + 7);
+            if (runs < 1 || runs > MAX_RUNS) {
+                fprintf(stderr, "--runs must be between 1 and %d.\n", MAX_RUNS);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Usage: pseudo-microbench [--iterations=<n>] [--runs=<n>] [case name...]\n");
+            return 1;
+        }
+    }
+
+    double overhead = timeCase(&cases[0], iterations, runs);
+    if (overhead < 0) return 1;
+
+    double executions = (double)iterations * UNROLL;
+    printf("%d x %d executions per case, median of %d runs, loop overhead %.2f ns per iteration\n\n",
+           iterations, UNROLL, runs, overhead / iterations);
+    printf("%-18s %10s  %s\n", "case", "ns/op", "sequence");
+
+    int failures = 0;
+    for (int i = 1; i < CASE_COUNT; i++) {
+        if (!selected(&cases[i], argc, argv)) continue;
+
+        double time = timeCase(&cases[i], iterations, runs);
+        if (time < 0) {
+            printf("%-18s %10s  %s\n", cases[i].name, "FAILED", cases[i].sequence);
+            failures++;
+            continue;
+        }
+
+        printf("%-18s %10.2f  %s\n", cases[i].name, (time - overhead) / executions, cases[i].sequence);
+        fflush(stdout);
+    }
+
+    return failures > 0 ? 1 : 0;
+}
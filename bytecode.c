@@ -11,17 +11,174 @@
 #define READ_BOOL(var, idx) {var = *(bool*)(&READ_BYTE(idx));}
 #define READ_REF(var, idx)  {byte8 temp = READ_8BYTE(idx); var = *(void**)(&temp);}
 
+static const char* instructionNames[] = {
+    [NOP] = "NOP",
+    [LOAD_INT] = "LOAD_INT", [LOAD_REAL] = "LOAD_REAL", [LOAD_CHAR] = "LOAD_CHAR", [LOAD_BOOL] = "LOAD_BOOL",
+    [LOAD_STRING] = "LOAD_STRING",
+    [CREATE_ARRAY] = "CREATE_ARRAY",
+    [STORE_INT] = "STORE_INT", [STORE_REAL] = "STORE_REAL", [STORE_CHAR] = "STORE_CHAR",
+    [STORE_BOOL] = "STORE_BOOL", [STORE_REF] = "STORE_REF",
+    [FETCH_INT] = "FETCH_INT", [FETCH_REAL] = "FETCH_REAL", [FETCH_CHAR] = "FETCH_CHAR",
+    [FETCH_BOOL] = "FETCH_BOOL", [FETCH_REF] = "FETCH_REF",
+    [ENTER] = "ENTER", [DO_CALL] = "DO_CALL", [TAIL_CALL] = "TAIL_CALL", [RETURN] = "RETURN",
+    [RETURN_NIL] = "RETURN_NIL",
+    [CALL_BUILTIN] = "CALL_BUILTIN",
+    [RSTORE_INT] = "RSTORE_INT", [RSTORE_REAL] = "RSTORE_REAL", [RSTORE_CHAR] = "RSTORE_CHAR",
+    [RSTORE_BOOL] = "RSTORE_BOOL", [RSTORE_REF] = "RSTORE_REF",
+    [RFETCH_INT] = "RFETCH_INT", [RFETCH_REAL] = "RFETCH_REAL", [RFETCH_CHAR] = "RFETCH_CHAR",
+    [RFETCH_BOOL] = "RFETCH_BOOL", [RFETCH_REF] = "RFETCH_REF",
+    [FETCH_ARRAY_ELEM] = "FETCH_ARRAY_ELEM", [STORE_ARRAY_ELEM] = "STORE_ARRAY_ELEM",
+    [STORE_REF_INT] = "STORE_REF_INT", [STORE_REF_REAL] = "STORE_REF_REAL",
+    [STORE_REF_CHAR] = "STORE_REF_CHAR", [STORE_REF_BOOL] = "STORE_REF_BOOL",
+    [FETCH_REF_INT] = "FETCH_REF_INT", [FETCH_REF_REAL] = "FETCH_REF_REAL",
+    [FETCH_REF_CHAR] = "FETCH_REF_CHAR", [FETCH_REF_BOOL] = "FETCH_REF_BOOL",
+    [CAST_INT_REAL] = "CAST_INT_REAL", [CAST_INT_CHAR] = "CAST_INT_CHAR", [CAST_CHAR_INT] = "CAST_CHAR_INT",
+    [ADD_INT] = "ADD_INT", [ADD_REAL] = "ADD_REAL", [MINUS_INT] = "MINUS_INT", [MINUS_REAL] = "MINUS_REAL",
+    [MULT_INT] = "MULT_INT", [MULT_REAL] = "MULT_REAL", [DIV_INT] = "DIV_INT", [DIV_REAL] = "DIV_REAL",
+    [MOD_INT] = "MOD_INT", [MOD_REAL] = "MOD_REAL", [FDIV_INT] = "FDIV_INT", [FDIV_REAL] = "FDIV_REAL",
+    [POW_INT] = "POW_INT", [POW_REAL] = "POW_REAL",
+    [CONCAT] = "CONCAT",
+    [EQ_INT] = "EQ_INT", [EQ_REAL] = "EQ_REAL", [EQ_BOOL] = "EQ_BOOL", [EQ_REF] = "EQ_REF",
+    [EQ_STRING] = "EQ_STRING",
+    [LESS_INT] = "LESS_INT", [LESS_REAL] = "LESS_REAL", [LESS_BOOL] = "LESS_BOOL", [LESS_REF] = "LESS_REF",
+    [LESS_STRING] = "LESS_STRING",
+    [LESS_EQ_INT] = "LESS_EQ_INT", [LESS_EQ_REAL] = "LESS_EQ_REAL", [LESS_EQ_BOOL] = "LESS_EQ_BOOL",
+    [LESS_EQ_REF] = "LESS_EQ_REF", [LESS_EQ_STRING] = "LESS_EQ_STRING",
+    [NEQ_INT] = "NEQ_INT", [NEQ_REAL] = "NEQ_REAL", [NEQ_BOOL] = "NEQ_BOOL", [NEQ_REF] = "NEQ_REF",
+    [NEQ_STRING] = "NEQ_STRING",
+    [GREATER_INT] = "GREATER_INT", [GREATER_REAL] = "GREATER_REAL", [GREATER_BOOL] = "GREATER_BOOL",
+    [GREATER_REF] = "GREATER_REF", [GREATER_STRING] = "GREATER_STRING",
+    [GREATER_EQ_INT] = "GREATER_EQ_INT", [GREATER_EQ_REAL] = "GREATER_EQ_REAL",
+    [GREATER_EQ_BOOL] = "GREATER_EQ_BOOL", [GREATER_EQ_REF] = "GREATER_EQ_REF",
+    [GREATER_EQ_STRING] = "GREATER_EQ_STRING",
+    [AND] = "AND", [OR] = "OR",
+    [NEG_INT] = "NEG_INT", [NEG_REAL] = "NEG_REAL", [NOT] = "NOT",
+    [POP] = "POP",
+    [COPY_INT] = "COPY_INT",
+    [INPUT_INT] = "INPUT_INT", [INPUT_REAL] = "INPUT_REAL", [INPUT_CHAR] = "INPUT_CHAR",
+    [INPUT_BOOL] = "INPUT_BOOL", [INPUT_STRING] = "INPUT_STRING",
+    [OUTPUT_INT] = "OUTPUT_INT", [OUTPUT_REAL] = "OUTPUT_REAL", [OUTPUT_CHAR] = "OUTPUT_CHAR",
+    [OUTPUT_BOOL] = "OUTPUT_BOOL", [OUTPUT_REF] = "OUTPUT_REF", [OUTPUT_STRING] = "OUTPUT_STRING",
+    [OUTPUT_NL] = "OUTPUT_NL",
+    [READ_LINE] = "READ_LINE", [WRITE_INT] = "WRITE_INT", [WRITE_REAL] = "WRITE_REAL",
+    [WRITE_CHAR] = "WRITE_CHAR", [WRITE_BOOL] = "WRITE_BOOL", [WRITE_REF] = "WRITE_REF",
+    [WRITE_STRING] = "WRITE_STRING", [WRITE_NL] = "WRITE_NL",
+    [CLEAR_FILE] = "CLEAR_FILE", [OPENFILE] = "OPENFILE", [CLOSEFILE] = "CLOSEFILE",
+    [B_FALSE] = "B_FALSE", [BRANCH] = "BRANCH",
+    [GET_REF] = "GET_REF", [RGET_REF] = "RGET_REF",
+    [FETCH_LOCAL_INT] = "FETCH_LOCAL_INT", [FETCH_GLOBAL_INT] = "FETCH_GLOBAL_INT",
+    [STORE_LOCAL_INT_DISCARD] = "STORE_LOCAL_INT_DISCARD",
+    [STORE_GLOBAL_INT_DISCARD] = "STORE_GLOBAL_INT_DISCARD",
+    [BEQ_INT] = "BEQ_INT", [BNE_INT] = "BNE_INT", [BLT_INT] = "BLT_INT", [BLE_INT] = "BLE_INT",
+    [BGT_INT] = "BGT_INT", [BGE_INT] = "BGE_INT",
+    [LOAD_ZEROS] = "LOAD_ZEROS",
+    [MOVE_R] = "MOVE_R", [LOADK_INT_R] = "LOADK_INT_R",
+    [ADD_INT_RR] = "ADD_INT_RR", [MINUS_INT_RR] = "MINUS_INT_RR", [MULT_INT_RR] = "MULT_INT_RR",
+    [MOD_INT_RR] = "MOD_INT_RR", [FDIV_INT_RR] = "FDIV_INT_RR",
+    [ADD_INT_RK] = "ADD_INT_RK", [MINUS_INT_RK] = "MINUS_INT_RK", [MULT_INT_RK] = "MULT_INT_RK",
+    [MOD_INT_RK] = "MOD_INT_RK", [FDIV_INT_RK] = "FDIV_INT_RK",
+    [ADD_REAL_RR] = "ADD_REAL_RR", [MINUS_REAL_RR] = "MINUS_REAL_RR", [MULT_REAL_RR] = "MULT_REAL_RR",
+    [DIV_REAL_RR] = "DIV_REAL_RR",
+    [BEQ_INT_RR] = "BEQ_INT_RR", [BNE_INT_RR] = "BNE_INT_RR", [BLT_INT_RR] = "BLT_INT_RR",
+    [BLE_INT_RR] = "BLE_INT_RR", [BGT_INT_RR] = "BGT_INT_RR", [BGE_INT_RR] = "BGE_INT_RR",
+    [BEQ_INT_RK] = "BEQ_INT_RK", [BNE_INT_RK] = "BNE_INT_RK", [BLT_INT_RK] = "BLT_INT_RK",
+    [BLE_INT_RK] = "BLE_INT_RK", [BGT_INT_RK] = "BGT_INT_RK", [BGE_INT_RK] = "BGE_INT_RK",
+    [EXIT] = "EXIT",
+};
+
+const char* getInstructionName(Instruction op) {
+    if ((int)op < 0 || op > EXIT || instructionNames[op] == NULL) return "UNKNOWN";
+    return instructionNames[op];
+}
+
 void initBytecodeStream(BytecodeStream* bs) {
     bs->stream = NULL;
     bs->capacity = 0;
     bs->count = 0;
+    bs->lines.entries = NULL;
+    bs->lines.count = 0;
+    bs->lines.capacity = 0;
+    bs->lines.names = NULL;
+    bs->lines.nameCount = 0;
+    bs->lines.nameCapacity = 0;
+}
+
+static void freeLineTable(LineTable* lines) {
+    for (int i = 0; i < lines->nameCount; i++) {
+        free(lines->names[i]);
+    }
+    free(lines->names);
+    free(lines->entries);
 }
 
 void freeBytecodeStream(BytecodeStream* bs) {
     free(bs->stream);
+    freeLineTable(&bs->lines);
     initBytecodeStream(bs);
 }
 
+void addLineEntry(BytecodeStream* bs, int offset, int line, int col, int subroutine) {
+    LineTable* lines = &bs->lines;
+
+    if (lines->count > 0 && lines->entries[lines->count - 1].offset >= offset) {
+        lines->count--;
+    } else if (lines->count == lines->capacity) {
+        int capacity = lines->capacity < 32 ? 32 : lines->capacity * 2;
+        LineEntry* entries = (LineEntry*) realloc(lines->entries, capacity * sizeof(LineEntry));
+        if (entries == NULL) return;
+        lines->entries = entries;
+        lines->capacity = capacity;
+    }
+
+    LineEntry* entry = &lines->entries[lines->count++];
+    entry->offset = offset;
+    entry->line = line;
+    entry->col = col;
+    entry->subroutine = subroutine;
+}
+
+int addSubroutineName(BytecodeStream* bs, const char* start, int length) {
+    LineTable* lines = &bs->lines;
+
+    if (lines->nameCount == lines->nameCapacity) {
+        int capacity = lines->nameCapacity < 8 ? 8 : lines->nameCapacity * 2;
+        char** names = (char**) realloc(lines->names, capacity * sizeof(char*));
+        if (names == NULL) return -1;
+        lines->names = names;
+        lines->nameCapacity = capacity;
+    }
+
+    char* name = extractNullTerminatedString(start, length);
+    if (name == NULL) return -1;
+
+    lines->names[lines->nameCount] = name;
+    return lines->nameCount++;
+}
+
+const LineEntry* findLineEntry(BytecodeStream* bs, int offset) {
+    LineTable* lines = &bs->lines;
+    int low = 0;
+    int high = lines->count - 1;
+    const LineEntry* found = NULL;
+
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        if (lines->entries[mid].offset <= offset) {
+            found = &lines->entries[mid];
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    return found;
+}
+
+const char* getSubroutineName(BytecodeStream* bs, int subroutine) {
+    if (subroutine < 0 || subroutine >= bs->lines.nameCount) return "main";
+    return bs->lines.names[subroutine];
+}
+
 void addBytecode(BytecodeStream* bs, byte b) {
     if (bs->count + 1 >= bs->capacity) {
         if (bs->capacity < 32) {
@@ -55,6 +212,68 @@ int getNextPos(BytecodeStream* bs) {
     return bs->count;
 }
 
+int getInstructionLength(BytecodeStream* bs, int idx) {
+    Instruction op = bs->stream[idx];
+
+    switch (op) {
+        case LOAD_INT:
+        case ENTER:
+        case CALL_BUILTIN:
+        case B_FALSE:
+        case BRANCH:
+        case FETCH_LOCAL_INT: case FETCH_GLOBAL_INT: case STORE_LOCAL_INT_DISCARD: case STORE_GLOBAL_INT_DISCARD:
+        case BEQ_INT: case BNE_INT: case BLT_INT: case BLE_INT: case BGT_INT: case BGE_INT:
+        case LOAD_ZEROS:
+            return 5;
+        case LOAD_REAL:
+        case DO_CALL:
+        case TAIL_CALL:
+            return 9;
+        case MOVE_R:
+        case LOADK_INT_R:
+            return 9;
+        case ADD_INT_RR: case MINUS_INT_RR: case MULT_INT_RR: case MOD_INT_RR: case FDIV_INT_RR:
+        case ADD_INT_RK: case MINUS_INT_RK: case MULT_INT_RK: case MOD_INT_RK: case FDIV_INT_RK:
+        case ADD_REAL_RR: case MINUS_REAL_RR: case MULT_REAL_RR: case DIV_REAL_RR:
+        case BEQ_INT_RR: case BNE_INT_RR: case BLT_INT_RR: case BLE_INT_RR: case BGT_INT_RR: case BGE_INT_RR:
+        case BEQ_INT_RK: case BNE_INT_RK: case BLT_INT_RK: case BLE_INT_RK: case BGT_INT_RK: case BGE_INT_RK:
+            return 13;
+        case LOAD_CHAR:
+        case LOAD_BOOL:
+            return 2;
+        case LOAD_STRING: {
+            if (idx + 5 > bs->count) return -1;
+            int length;
+            READ_INT(length, idx + 1);
+            if (length < 0) return -1;
+            return 5 + length;
+        }
+        default:
+            return op <= EXIT ? 1 : -1;
+    }
+}
+
+static void printRegister(int reg) {
+    printf("%c%d", REG_IS_RELATIVE(reg) ? 'L' : 'G', REG_POS(reg));
+}
+
+// Prints "NAME -> " followed by count register or immediate operands, the last immediateFrom
+// onwards printed as plain integers.
+static int printRegisterInstruction(BytecodeStream* bs, int idx, const char* name, int count, int immediateFrom) {
+    printf("%s -> ", name);
+    for (int i = 0; i < count; i++) {
+        int operand;
+        READ_INT(operand, idx + 1 + 4 * i);
+        if (i > 0) printf(", ");
+        if (i >= immediateFrom) {
+            printf("%d", operand);
+        } else {
+            printRegister(operand);
+        }
+    }
+    return 1 + 4 * count;
+}
+
 static int printInstruction(BytecodeStream* bs, int idx) {
     Instruction op = bs->stream[idx];
 
@@ -148,23 +367,34 @@ static int printInstruction(BytecodeStream* bs, int idx) {
             printf("FETCH_REF");
             return 1;
         }
-        case CALL_SUB: {
-            printf("CALL_SUB");
-            return 1;
+        case ENTER: {
+            printf("ENTER -> ");
+            int count;
+            READ_INT(count, idx + 1);
+            printf("%d", count);
+            return 5;
         }
         case DO_CALL: {
             printf("DO_CALL -> ");
             int pos;
             READ_INT(pos, idx + 1);
-            printf("%d", pos);
-            return 5;
+            int argc;
+            READ_INT(argc, idx + 5);
+            printf("%d, %d", pos, argc);
+            return 9;
+        }
+        case TAIL_CALL: {
+            printf("TAIL_CALL -> ");
+            int pos;
+            READ_INT(pos, idx + 1);
+            int argc;
+            READ_INT(argc, idx + 5);
+            printf("%d, %d", pos, argc);
+            return 9;
         }
         case RETURN: {
-            printf("RETURN -> ");
-            int size;
-            size = (int)READ_BYTE(idx + 1);
-            printf("%d Bytes", size);
-            return 2;
+            printf("RETURN");
+            return 1;
         }
         case RETURN_NIL: {
             printf("RETURN_NIL");
@@ -467,16 +697,8 @@ static int printInstruction(BytecodeStream* bs, int idx) {
             return 1;
         }
 
-        case POP_1B: {
-            printf("POP_1B");
-            return 1;
-        }
-        case POP_4B: {
-            printf("POP_4B");
-            return 1;
-        }
-        case POP_8B: {
-            printf("POP_8B");
+        case POP: {
+            printf("POP");
             return 1;
         }
 
@@ -624,6 +846,139 @@ static int printInstruction(BytecodeStream* bs, int idx) {
             printf("RGET_REF -> ");
             return 1;
         }
+        case FETCH_LOCAL_INT: {
+            printf("FETCH_LOCAL_INT -> ");
+            int operand;
+            READ_INT(operand, idx + 1);
+            printf("%d", operand);
+            return 5;
+        }
+        case FETCH_GLOBAL_INT: {
+            printf("FETCH_GLOBAL_INT -> ");
+            int operand;
+            READ_INT(operand, idx + 1);
+            printf("%d", operand);
+            return 5;
+        }
+        case STORE_LOCAL_INT_DISCARD: {
+            printf("STORE_LOCAL_INT_DISCARD -> ");
+            int operand;
+            READ_INT(operand, idx + 1);
+            printf("%d", operand);
+            return 5;
+        }
+        case STORE_GLOBAL_INT_DISCARD: {
+            printf("STORE_GLOBAL_INT_DISCARD -> ");
+            int operand;
+            READ_INT(operand, idx + 1);
+            printf("%d", operand);
+            return 5;
+        }
+        case BEQ_INT: {
+            printf("BEQ_INT -> ");
+            int operand;
+            READ_INT(operand, idx + 1);
+            printf("%d", operand);
+            return 5;
+        }
+        case BNE_INT: {
+            printf("BNE_INT -> ");
+            int operand;
+            READ_INT(operand, idx + 1);
+            printf("%d", operand);
+            return 5;
+        }
+        case BLT_INT: {
+            printf("BLT_INT -> ");
+            int operand;
+            READ_INT(operand, idx + 1);
+            printf("%d", operand);
+            return 5;
+        }
+        case BLE_INT: {
+            printf("BLE_INT -> ");
+            int operand;
+            READ_INT(operand, idx + 1);
+            printf("%d", operand);
+            return 5;
+        }
+        case BGT_INT: {
+            printf("BGT_INT -> ");
+            int operand;
+            READ_INT(operand, idx + 1);
+            printf("%d", operand);
+            return 5;
+        }
+        case BGE_INT: {
+            printf("BGE_INT -> ");
+            int operand;
+            READ_INT(operand, idx + 1);
+            printf("%d", operand);
+            return 5;
+        }
+        case LOAD_ZEROS: {
+            printf("LOAD_ZEROS -> ");
+            int count;
+            READ_INT(count, idx + 1);
+            printf("%d", count);
+            return 5;
+        }
+        case MOVE_R:
+            return printRegisterInstruction(bs, idx, "MOVE_R", 2, 2);
+        case LOADK_INT_R:
+            return printRegisterInstruction(bs, idx, "LOADK_INT_R", 2, 1);
+        case ADD_INT_RR:
+            return printRegisterInstruction(bs, idx, "ADD_INT_RR", 3, 3);
+        case MINUS_INT_RR:
+            return printRegisterInstruction(bs, idx, "MINUS_INT_RR", 3, 3);
+        case MULT_INT_RR:
+            return printRegisterInstruction(bs, idx, "MULT_INT_RR", 3, 3);
+        case MOD_INT_RR:
+            return printRegisterInstruction(bs, idx, "MOD_INT_RR", 3, 3);
+        case FDIV_INT_RR:
+            return printRegisterInstruction(bs, idx, "FDIV_INT_RR", 3, 3);
+        case ADD_INT_RK:
+            return printRegisterInstruction(bs, idx, "ADD_INT_RK", 3, 2);
+        case MINUS_INT_RK:
+            return printRegisterInstruction(bs, idx, "MINUS_INT_RK", 3, 2);
+        case MULT_INT_RK:
+            return printRegisterInstruction(bs, idx, "MULT_INT_RK", 3, 2);
+        case MOD_INT_RK:
+            return printRegisterInstruction(bs, idx, "MOD_INT_RK", 3, 2);
+        case FDIV_INT_RK:
+            return printRegisterInstruction(bs, idx, "FDIV_INT_RK", 3, 2);
+        case ADD_REAL_RR:
+            return printRegisterInstruction(bs, idx, "ADD_REAL_RR", 3, 3);
+        case MINUS_REAL_RR:
+            return printRegisterInstruction(bs, idx, "MINUS_REAL_RR", 3, 3);
+        case MULT_REAL_RR:
+            return printRegisterInstruction(bs, idx, "MULT_REAL_RR", 3, 3);
+        case DIV_REAL_RR:
+            return printRegisterInstruction(bs, idx, "DIV_REAL_RR", 3, 3);
+        case BEQ_INT_RR:
+            return printRegisterInstruction(bs, idx, "BEQ_INT_RR", 3, 2);
+        case BNE_INT_RR:
+            return printRegisterInstruction(bs, idx, "BNE_INT_RR", 3, 2);
+        case BLT_INT_RR:
+            return printRegisterInstruction(bs, idx, "BLT_INT_RR", 3, 2);
+        case BLE_INT_RR:
+            return printRegisterInstruction(bs, idx, "BLE_INT_RR", 3, 2);
+        case BGT_INT_RR:
+            return printRegisterInstruction(bs, idx, "BGT_INT_RR", 3, 2);
+        case BGE_INT_RR:
+            return printRegisterInstruction(bs, idx, "BGE_INT_RR", 3, 2);
+        case BEQ_INT_RK:
+            return printRegisterInstruction(bs, idx, "BEQ_INT_RK", 3, 1);
+        case BNE_INT_RK:
+            return printRegisterInstruction(bs, idx, "BNE_INT_RK", 3, 1);
+        case BLT_INT_RK:
+            return printRegisterInstruction(bs, idx, "BLT_INT_RK", 3, 1);
+        case BLE_INT_RK:
+            return printRegisterInstruction(bs, idx, "BLE_INT_RK", 3, 1);
+        case BGT_INT_RK:
+            return printRegisterInstruction(bs, idx, "BGT_INT_RK", 3, 1);
+        case BGE_INT_RK:
+            return printRegisterInstruction(bs, idx, "BGE_INT_RK", 3, 1);
     }
 
     return 0;
@@ -639,6 +994,70 @@ void printBytestream(BytecodeStream* bs) {
     }
 }
 
+// The line table follows the code as an optional section: a magic tag, the subroutine names
+// (each a length and its characters), then the entries. Integers are stored like the code
+// size before them. Readers that predate the section stop after the code.
+static const char lineTableTag[4] = { 'P', 'C', 'L', 'N' };
+
+static void writeLineTable(LineTable* lines, FILE* file) {
+    fwrite(lineTableTag, 1, sizeof(lineTableTag), file);
+
+    fwrite(&lines->nameCount, sizeof(int), 1, file);
+    for (int i = 0; i < lines->nameCount; i++) {
+        int length = (int)strlen(lines->names[i]);
+        fwrite(&length, sizeof(int), 1, file);
+        fwrite(lines->names[i], 1, length, file);
+    }
+
+    fwrite(&lines->count, sizeof(int), 1, file);
+    for (int i = 0; i < lines->count; i++) {
+        LineEntry* entry = &lines->entries[i];
+        int fields[4] = { entry->offset, entry->line, entry->col, entry->subroutine };
+        fwrite(fields, sizeof(int), 4, file);
+    }
+}
+
+// Reads the section if the file has one. A damaged table is dropped rather than failing the
+// load, since the program runs the same without it.
+static void readLineTable(BytecodeStream* bs, FILE* file) {
+    char tag[sizeof(lineTableTag)];
+    if (fread(tag, 1, sizeof(tag), file) != sizeof(tag) || memcmp(tag, lineTableTag, sizeof(tag)) != 0) return;
+
+    int nameCount;
+    if (fread(&nameCount, sizeof(int), 1, file) != 1 || nameCount < 0) return;
+
+    for (int i = 0; i < nameCount; i++) {
+        int length;
+        if (fread(&length, sizeof(int), 1, file) != 1 || length < 0 || length > 4096) goto damaged;
+
+        char name[4096];
+        if (fread(name, 1, length, file) != (size_t)length) goto damaged;
+        if (addSubroutineName(bs, name, length) < 0) goto damaged;
+    }
+
+    int count;
+    if (fread(&count, sizeof(int), 1, file) != 1 || count < 0) goto damaged;
+
+    for (int i = 0; i < count; i++) {
+        int fields[4];
+        if (fread(fields, sizeof(int), 4, file) != 4) goto damaged;
+        if (fields[0] < 0 || fields[0] > bs->count || fields[3] < -1 || fields[3] >= nameCount) goto damaged;
+        if (bs->lines.count > 0 && fields[0] <= bs->lines.entries[bs->lines.count - 1].offset) goto damaged;
+
+        addLineEntry(bs, fields[0], fields[1], fields[2], fields[3]);
+    }
+    return;
+
+damaged:
+    freeLineTable(&bs->lines);
+    bs->lines.entries = NULL;
+    bs->lines.count = 0;
+    bs->lines.capacity = 0;
+    bs->lines.names = NULL;
+    bs->lines.nameCount = 0;
+    bs->lines.nameCapacity = 0;
+}
+
 bool genBinFile(BytecodeStream* bs, const char* fileName) {
     FILE* filePtr;
 
@@ -676,6 +1095,8 @@ bool genBinFile(BytecodeStream* bs, const char* fileName) {
 
     fwrite(bs->stream, sizeof(byte), bs->count, filePtr);
 
+    if (bs->lines.count > 0) writeLineTable(&bs->lines, filePtr);
+
     fclose(filePtr);
 
     return true;
@@ -690,7 +1111,7 @@ bool readBinFile(BytecodeStream* bs, const char* fileName, bool addExtension) {
         const char* extension = ".pcbc";
         name = malloc(strlen(fileName) + strlen(extension) + 1);
         if (name == NULL) {
-            printf("Problem allocating memory for filename.\n");
+            fprintf(diagnostics(), "Problem allocating memory for filename.\n");
             return false;
         }
 
@@ -706,21 +1127,41 @@ bool readBinFile(BytecodeStream* bs, const char* fileName, bool addExtension) {
     }
 
     if (filePtr == NULL) {
-        printf("Problem opening file.\n");
+        fprintf(diagnostics(), "Problem opening file.\n");
         return false;
     }
 
-    fread(&bs->count, sizeof(bs->count), 1, filePtr);
+    // The code size must fit in what the file holds after it, or the file is cut short.
+    long fileSize = -1;
+    if (fseek(filePtr, 0, SEEK_END) == 0) fileSize = ftell(filePtr);
+    rewind(filePtr);
 
-    bs->capacity = bs->count;
-    bs->stream = malloc(bs->capacity * sizeof(byte));
+    int count;
+    if (fread(&count, sizeof(count), 1, filePtr) != 1 || count < 0 || fileSize < 0
+        || (long)count > fileSize - (long)sizeof(count)) {
+        fprintf(diagnostics(), "The bytecode file is damaged or incomplete.\n");
+        fclose(filePtr);
+        return false;
+    }
+
+    bs->stream = malloc(count > 0 ? count * sizeof(byte) : 1);
 
     if (bs->stream == NULL) {
-        printf("Error allocating memory for bytecode stream.\n");
+        fprintf(diagnostics(), "Error allocating memory for bytecode stream.\n");
+        fclose(filePtr);
+        return false;
+    }
+
+    bs->count = count;
+    bs->capacity = count;
+
+    if (fread(bs->stream, sizeof(byte), count, filePtr) != (size_t)count) {
+        fprintf(diagnostics(), "The bytecode file is damaged or incomplete.\n");
+        fclose(filePtr);
         return false;
     }
 
-    fread(bs->stream, sizeof(byte), bs->count, filePtr);
+    readLineTable(bs, filePtr);
 
     fclose(filePtr);
 
@@ -12,7 +12,10 @@ typedef enum {
     STORE_INT, STORE_REAL, STORE_CHAR, STORE_BOOL, STORE_REF,
     FETCH_INT, FETCH_REAL, FETCH_CHAR, FETCH_BOOL, FETCH_REF,
 
-    CALL_SUB, DO_CALL, RETURN, RETURN_NIL,
+    // DO_CALL <target> <argument count>. The callee's first instruction is ENTER <locals>,
+    // which reserves and zeroes the rest of its frame. TAIL_CALL takes the same operands but
+    // moves the arguments down over the current frame and reuses it.
+    ENTER, DO_CALL, TAIL_CALL, RETURN, RETURN_NIL,
 
     CALL_BUILTIN,
 
@@ -42,7 +45,7 @@ typedef enum {
 
     NEG_INT, NEG_REAL, NOT,
 
-    POP_1B, POP_4B, POP_8B,
+    POP,
 
     COPY_INT,
 
@@ -56,13 +59,53 @@ typedef enum {
 
     GET_REF, RGET_REF,
 
+    // Fused forms of the most common stack sequences. The FETCH and STORE forms copy whole
+    // slots, so the optimizer also uses them for REAL, CHAR and BOOLEAN variables.
+    FETCH_LOCAL_INT, FETCH_GLOBAL_INT, STORE_LOCAL_INT_DISCARD, STORE_GLOBAL_INT_DISCARD,
+    BEQ_INT, BNE_INT, BLT_INT, BLE_INT, BGT_INT, BGE_INT,
+    LOAD_ZEROS,
+
+    // Register forms: operands name stack slots directly (see REG_OPERAND) instead of popping.
+    MOVE_R, LOADK_INT_R,
+    ADD_INT_RR, MINUS_INT_RR, MULT_INT_RR, MOD_INT_RR, FDIV_INT_RR,
+    ADD_INT_RK, MINUS_INT_RK, MULT_INT_RK, MOD_INT_RK, FDIV_INT_RK,
+    ADD_REAL_RR, MINUS_REAL_RR, MULT_REAL_RR, DIV_REAL_RR,
+    BEQ_INT_RR, BNE_INT_RR, BLT_INT_RR, BLE_INT_RR, BGT_INT_RR, BGE_INT_RR,
+    BEQ_INT_RK, BNE_INT_RK, BLT_INT_RK, BLE_INT_RK, BGT_INT_RK, BGE_INT_RK,
+
     EXIT
 } Instruction;
 
+// A register operand is a slot position tagged with whether it is relative to the current
+// call frame (locals and parameters) or absolute (globals).
+#define REG_OPERAND(pos, isRelative)    (((pos) << 1) | ((isRelative) ? 1 : 0))
+#define REG_POS(reg)                    ((reg) >> 1)
+#define REG_IS_RELATIVE(reg)            ((reg) & 1)
+
+// Source position of the code from offset up to the next entry. Entries are sorted by offset.
+typedef struct {
+    int offset;
+    int line;
+    int col;
+    int subroutine;         // Index into LineTable.names, -1 for the main program.
+} LineEntry;
+
+// Maps bytecode back to the source it was compiled from, for runtime errors and profiles. Saved
+// in .pcbc files after the code. Optional: streams loaded from .pcbc files written before it existed have no entries.
+typedef struct {
+    LineEntry* entries;
+    int count;
+    int capacity;
+    char** names;           // PROCEDURE and FUNCTION names.
+    int nameCount;
+    int nameCapacity;
+} LineTable;
+
 typedef struct {
     byte* stream;
     int count;
     int capacity;
+    LineTable lines;
 } BytecodeStream;
 
 void initBytecodeStream(BytecodeStream* bs);
@@ -74,9 +117,18 @@ void addInstruction(BytecodeStream* bs, Instruction op);
 void insertAtPos(BytecodeStream* bs, byte b, int pos);
 
 int getNextPos(BytecodeStream* bs);
+int getInstructionLength(BytecodeStream* bs, int idx);
+const char* getInstructionName(Instruction op);
 
 void printBytestream(BytecodeStream* bs);
 
+// Starts a new entry at offset, replacing the last one if no code was emitted since.
+void addLineEntry(BytecodeStream* bs, int offset, int line, int col, int subroutine);
+int addSubroutineName(BytecodeStream* bs, const char* start, int length);
+// The entry covering offset, or NULL if there is none.
+const LineEntry* findLineEntry(BytecodeStream* bs, int offset);
+const char* getSubroutineName(BytecodeStream* bs, int subroutine);
+
 bool genBinFile(BytecodeStream* bs, const char* fileName);
 bool readBinFile(BytecodeStream* bs, const char* fileName, bool addExtension);
 
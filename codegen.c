@@ -0,0 +1,1233 @@
+#include <stdarg.h>
+#include <math.h>
+
+#include "codegen.h"
+
+typedef struct {
+    char* chars;
+    int count;
+    int capacity;
+} CBuffer;
+
+// What a name refers to in the generated code. access is an lvalue for the variable, address
+// a pointer to it for BYREF arguments.
+typedef struct {
+    char* name;
+    char* access;
+    char* address;
+    DataType type;
+    DataType elemType;          // For arrays.
+    ASTNode* subroutine;        // Non-NULL for subroutines.
+    bool closed;                // Files after CLOSEFILE.
+} Binding;
+
+typedef struct {
+    CBuffer decls;
+    CBuffer body;
+    int rootCount;
+    bool isMain;
+    DataType returnType;
+    ASTNode* subroutine;        // The subroutine being generated, NULL for the main program.
+    char** params;              // C names of its parameters.
+    int base;                   // Its first binding after the subroutine itself.
+    bool tailCalls;             // A tail call jumps back to the start of its body.
+} Function;
+
+typedef struct {
+    CBuffer globals;
+    CBuffer prototypes;
+    CBuffer functions;
+    Binding* bindings;          // In declaration order, so lookups search from the end.
+    int bindingCount;
+    int bindingCapacity;
+    Function* function;
+    int globalRoots;            // Slots of the globals root array, for variables and literals.
+    int nextId;
+    int depth;
+    bool usedTemps;             // The statement being generated keeps objects as temporaries.
+    bool inTail;                // The next statement ends the procedure, as in the compiler.
+    bool hadError;
+} Generator;
+
+static void initBuffer(CBuffer* buffer) {
+    buffer->chars = NULL;
+    buffer->count = 0;
+    buffer->capacity = 0;
+}
+
+static void freeBuffer(CBuffer* buffer) {
+    free(buffer->chars);
+    initBuffer(buffer);
+}
+
+static void appendArgs(CBuffer* buffer, const char* fmt, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    if (length < 0) return;
+
+    if (buffer->count + length + 1 > buffer->capacity) {
+        int capacity = buffer->capacity < 256 ? 256 : buffer->capacity;
+        while (capacity < buffer->count + length + 1) capacity *= 2;
+
+        char* chars = (char*) realloc(buffer->chars, capacity);
+        if (chars == NULL) {
+            fprintf(stderr, "Not enough memory to generate C code.\n");
+            exit(74);
+        }
+
+        buffer->chars = chars;
+        buffer->capacity = capacity;
+    }
+
+    vsnprintf(buffer->chars + buffer->count, length + 1, fmt, args);
+    buffer->count += length;
+}
+
+static void append(CBuffer* buffer, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    appendArgs(buffer, fmt, args);
+    va_end(args);
+}
+
+static char* takeBuffer(CBuffer* buffer) {
+    if (buffer->chars == NULL) append(buffer, "");
+    return buffer->chars;
+}
+
+static char* format(const char* fmt, ...) {
+    CBuffer buffer;
+    initBuffer(&buffer);
+
+    va_list args;
+    va_start(args, fmt);
+    appendArgs(&buffer, fmt, args);
+    va_end(args);
+
+    return takeBuffer(&buffer);
+}
+
+static void initFunction(Function* function, bool isMain, DataType returnType) {
+    initBuffer(&function->decls);
+    initBuffer(&function->body);
+    function->rootCount = 0;
+    function->isMain = isMain;
+    function->returnType = returnType;
+    function->subroutine = NULL;
+    function->params = NULL;
+    function->base = 0;
+    function->tailCalls = false;
+}
+
+static void freeFunction(Function* function) {
+    int count = function->subroutine != NULL ? function->subroutine->as.SubroutineStmt.parameters.count : 0;
+    for (int i = 0; function->params != NULL && i < count; i++) {
+        free(function->params[i]);
+    }
+    free(function->params);
+
+    freeBuffer(&function->decls);
+    freeBuffer(&function->body);
+}
+
+static void line(Generator* gen, const char* fmt, ...) {
+    CBuffer* body = &gen->function->body;
+    for (int i = 0; i <= gen->depth; i++) {
+        append(body, "    ");
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    appendArgs(body, fmt, args);
+    va_end(args);
+
+    append(body, "\n");
+}
+
+static void internalError(Generator* gen, const char* message) {
+    if (!gen->hadError) fprintf(stderr, "C generation failed: %s\n", message);
+    gen->hadError = true;
+}
+
+static bool isRefType(DataType type) {
+    return type == TYPE_STRING || type == TYPE_ARRAY || type == TYPE_FILE;
+}
+
+static const char* cType(DataType type) {
+    switch (type) {
+        case TYPE_INTEGER: return "int";
+        case TYPE_REAL: return "double";
+        case TYPE_CHAR: return "char";
+        case TYPE_BOOLEAN: return "bool";
+        case TYPE_STRING:
+        case TYPE_ARRAY:
+        case TYPE_FILE: return "Obj*";
+        default: return "void";
+    }
+}
+
+static const char* zeroValue(DataType type) {
+    switch (type) {
+        case TYPE_REAL: return "0.0";
+        case TYPE_BOOLEAN: return "false";
+        case TYPE_STRING:
+        case TYPE_ARRAY:
+        case TYPE_FILE: return "NULL";
+        default: return "0";
+    }
+}
+
+static int elementSize(DataType type) {
+    switch (type) {
+        case TYPE_INTEGER: return 4;
+        case TYPE_REAL:
+        case TYPE_STRING:
+        case TYPE_ARRAY: return 8;
+        default: return 1;
+    }
+}
+
+static char* tokenName(Token* token) {
+    return extractNullTerminatedString(token->start, token->length);
+}
+
+static void addBinding(Generator* gen, char* name, char* access, char* address, DataType type, DataType elemType, ASTNode* subroutine) {
+    if (gen->bindingCount == gen->bindingCapacity) {
+        int capacity = gen->bindingCapacity < 16 ? 16 : gen->bindingCapacity * 2;
+        Binding* bindings = (Binding*) realloc(gen->bindings, capacity * sizeof(Binding));
+        if (bindings == NULL) {
+            fprintf(stderr, "Not enough memory to generate C code.\n");
+            exit(74);
+        }
+
+        gen->bindings = bindings;
+        gen->bindingCapacity = capacity;
+    }
+
+    Binding* binding = &gen->bindings[gen->bindingCount++];
+    binding->name = name;
+    binding->access = access;
+    binding->address = address;
+    binding->type = type;
+    binding->elemType = elemType;
+    binding->subroutine = subroutine;
+    binding->closed = false;
+}
+
+// Later declarations of a name hide earlier ones, as in the compiler's symbol tables.
+static Binding* findBinding(Generator* gen, const char* name) {
+    for (int i = gen->bindingCount - 1; i >= 0; i--) {
+        if (strcmp(gen->bindings[i].name, name) == 0) {
+            return gen->bindings[i].closed ? NULL : &gen->bindings[i];
+        }
+    }
+
+    return NULL;
+}
+
+static Binding* findToken(Generator* gen, Token* token) {
+    char* name = tokenName(token);
+    Binding* binding = findBinding(gen, name);
+    free(name);
+
+    if (binding == NULL) internalError(gen, "symbol not in scope.");
+    return binding;
+}
+
+static void truncateBindings(Generator* gen, int count) {
+    while (gen->bindingCount > count) {
+        Binding* binding = &gen->bindings[--gen->bindingCount];
+        free(binding->name);
+        free(binding->access);
+        free(binding->address);
+    }
+}
+
+// Reference variables live in root slots the collector scans, everything else in plain C
+// variables: file scope for the main program, since subroutines can read them.
+static Binding* newVariable(Generator* gen, char* name, DataType type, DataType elemType) {
+    Function* fn = gen->function;
+    char* access;
+
+    if (isRefType(type)) {
+        access = fn->isMain ? format("globals[%d]", gen->globalRoots++) : format("roots[%d]", fn->rootCount++);
+    } else {
+        access = format("v%d_%s", gen->nextId++, name);
+        if (fn->isMain) {
+            append(&gen->globals, "static %s %s;\n", cType(type), access);
+        } else {
+            append(&fn->decls, "    %s %s = %s;\n", cType(type), access, zeroValue(type));
+        }
+    }
+
+    addBinding(gen, name, access, format("&%s", access), type, elemType, NULL);
+    return &gen->bindings[gen->bindingCount - 1];
+}
+
+static char* newTemp(Generator* gen, DataType type) {
+    char* temp = format("t%d", gen->nextId++);
+    append(&gen->function->decls, "    %s %s;\n", cType(type), temp);
+    return temp;
+}
+
+static char* cString(const char* chars, int length) {
+    CBuffer buffer;
+    initBuffer(&buffer);
+    append(&buffer, "\"");
+
+    for (int i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)chars[i];
+
+        if (c == '"' || c == '\\' || c == '?') {
+            append(&buffer, "\\%c", c);
+        } else if (c >= 32 && c < 127) {
+            append(&buffer, "%c", c);
+        } else {
+            append(&buffer, "\\%03o", c);
+        }
+    }
+
+    append(&buffer, "\"");
+    return takeBuffer(&buffer);
+}
+
+// Literal tokens keep their quotes.
+static char* literalValue(Generator* gen, Token* token, DataType type) {
+    switch (type) {
+        case TYPE_INTEGER: {
+            char* text = tokenName(token);
+            int n = atoi(text);
+            free(text);
+            return format("%d", n);
+        }
+        case TYPE_REAL: {
+            char* text = tokenName(token);
+            double n = strtod(text, NULL);
+            free(text);
+
+            if (isinf(n)) return format("HUGE_VAL");
+
+            char* value = format("%.17g", n);
+            if (strpbrk(value, ".en") == NULL) {
+                char* real = format("%s.0", value);
+                free(value);
+                return real;
+            }
+            return value;
+        }
+        case TYPE_CHAR:
+            return format("((char)%d)", (int)token->start[1]);
+        case TYPE_BOOLEAN:
+            return format(token->start[0] == 'T' ? "true" : "false");
+        case TYPE_STRING: {
+            char* chars = cString(token->start + 1, (int)token->length - 2);
+            char* value = format("RT_LITERAL(globals[%d], %s, %d)", gen->globalRoots++, chars, (int)token->length - 2);
+            free(chars);
+            return value;
+        }
+        default:
+            return format("0");
+    }
+}
+
+static bool isBuiltin(const char* name, const char* builtin) {
+    return strcmp(name, builtin) == 0;
+}
+
+// True if evaluating the expression can change state another operand reads: assignments,
+// calls to subroutines, and the builtins that reseed the random generator.
+static bool hasEffects(Generator* gen, ASTNode* node) {
+    if (node == NULL) return false;
+
+    switch (node->type) {
+        case EXPR_ASSIGN:
+            return true;
+        case EXPR_GROUP:
+            return hasEffects(gen, node->as.GroupExpr.subExpr);
+        case EXPR_UNARY:
+            return hasEffects(gen, node->as.UnaryExpr.right);
+        case EXPR_BINARY:
+            return hasEffects(gen, node->as.BinaryExpr.left) || hasEffects(gen, node->as.BinaryExpr.right);
+        case EXPR_ARRAY_ACCESS:
+            return hasEffects(gen, node->as.ArrayAccessExpr.indices[0]) || hasEffects(gen, node->as.ArrayAccessExpr.indices[1]);
+        case EXPR_CALL: {
+            char* name = tokenName(node->as.CallExpr.name);
+            Binding* callable = findBinding(gen, name);
+            bool effects = (callable != NULL && callable->subroutine != NULL) ||
+                           isBuiltin(name, "RND") || isBuiltin(name, "RANDOMBETWEEN");
+            free(name);
+
+            for (int i = 0; i < node->as.CallExpr.arguments.count && !effects; i++) {
+                effects = hasEffects(gen, node->as.CallExpr.arguments.start[i]);
+            }
+            return effects;
+        }
+        default:
+            return false;
+    }
+}
+
+// Operands are evaluated left to right, as in the VM. C leaves the order unspecified, so when
+// any operand has side effects all but the last are copied to temporaries first. Returns the
+// assignments, as the start of a comma expression. Operands of type TYPE_NONE are left alone.
+static char* sequence(Generator* gen, char** values, const DataType* types, int count, bool effects) {
+    CBuffer prefix;
+    initBuffer(&prefix);
+
+    for (int i = 0; effects && i < count - 1; i++) {
+        if (types[i] == TYPE_NONE) continue;
+
+        char* temp = newTemp(gen, types[i]);
+        if (isRefType(types[i])) {
+            append(&prefix, "%s = rtKeep(%s), ", temp, values[i]);
+            gen->usedTemps = true;
+        } else {
+            append(&prefix, "%s = %s, ", temp, values[i]);
+        }
+
+        free(values[i]);
+        values[i] = temp;
+    }
+
+    return takeBuffer(&prefix);
+}
+
+static char* genExpr(Generator* gen, ASTNode* node);
+
+static char* genCall(Generator* gen, Token* nameToken, ASTNodeArray* arguments) {
+    char* name = tokenName(nameToken);
+    Binding* callable = findBinding(gen, name);
+    int count = arguments->count;
+
+    char* values[count > 0 ? count : 1];
+    DataType types[count > 0 ? count : 1];
+    bool effects = false;
+    values[0] = NULL;
+    types[0] = TYPE_NONE;
+
+    for (int i = 0; i < count; i++) {
+        ASTNode* arg = arguments->start[i];
+        ASTNode* param = callable != NULL && callable->subroutine != NULL ?
+                         callable->subroutine->as.SubroutineStmt.parameters.start[i] : NULL;
+
+        if (param != NULL && param->as.Parameter.byref) {
+            Binding* var = findToken(gen, arg->as.VariableExpr.name);
+            values[i] = format("%s", var != NULL ? var->address : "NULL");
+            types[i] = TYPE_NONE;
+        } else {
+            values[i] = genExpr(gen, arg);
+            types[i] = arg->as.Expr.resultType;
+            effects |= hasEffects(gen, arg);
+        }
+    }
+
+    char* prefix = sequence(gen, values, types, count, effects);
+    char* result;
+
+#define ARG(i) (i < count ? values[i] : "0")
+    if (callable != NULL && callable->subroutine != NULL) {
+        CBuffer args;
+        initBuffer(&args);
+        for (int i = 0; i < count; i++) {
+            append(&args, i > 0 ? ", %s" : "%s", values[i]);
+        }
+
+        DataType returnType = callable->subroutine->as.SubroutineStmt.subroutineType == TYPE_FUNCTION ?
+                              callable->subroutine->as.SubroutineStmt.returnValue : TYPE_NONE;
+
+        // The callee's temporaries are gone once it returns, so the caller keeps the result.
+        if (isRefType(returnType)) {
+            result = format("(%srtKeep(%s(%s)))", prefix, callable->access, takeBuffer(&args));
+            gen->usedTemps = true;
+        } else {
+            result = format("(%s%s(%s))", prefix, callable->access, takeBuffer(&args));
+        }
+        freeBuffer(&args);
+    } else if (isBuiltin(name, "SUBSTRING")) {
+        result = format("(%srtSubstring(%s, %s, %s))", prefix, ARG(0), ARG(1), ARG(2));
+        gen->usedTemps = true;
+    } else if (isBuiltin(name, "LENGTH")) {
+        result = format("(%srtLength(%s))", prefix, ARG(0));
+    } else if (isBuiltin(name, "LCASE")) {
+        result = format("(%srtLcase(%s))", prefix, ARG(0));
+        gen->usedTemps = true;
+    } else if (isBuiltin(name, "UCASE")) {
+        result = format("(%srtUcase(%s))", prefix, ARG(0));
+        gen->usedTemps = true;
+    } else if (isBuiltin(name, "RANDOMBETWEEN")) {
+        result = format("(%srtRandomBetween(%s, %s))", prefix, ARG(0), ARG(1));
+    } else if (isBuiltin(name, "RND")) {
+        result = format("rtRnd()");
+    } else if (isBuiltin(name, "INT")) {
+        result = format("((int)%s)", ARG(0));
+    } else if (isBuiltin(name, "EOF")) {
+        result = format("rtEof(%s)", ARG(0));
+    } else if (isBuiltin(name, "CHARAT")) {
+        result = format("(%srtCharAt(%s, %s))", prefix, ARG(0), ARG(1));
+    } else {
+        internalError(gen, "unknown subroutine.");
+        result = format("0");
+    }
+#undef ARG
+
+    for (int i = 0; i < count; i++) {
+        free(values[i]);
+    }
+    free(prefix);
+    free(name);
+    return result;
+}
+
+// A call in tail position to the subroutine being generated rebinds its parameters and jumps
+// back to the start of its body, so tail recursion runs in constant stack as TAIL_CALL does in
+// the VM. As there, a BYREF argument that points into the current frame keeps it a normal call.
+// Calls to other subroutines stay C calls. Returns whether the jump was generated.
+static bool genTailCall(Generator* gen, Token* nameToken, ASTNodeArray* arguments) {
+    Function* fn = gen->function;
+    if (fn->subroutine == NULL) return false;
+
+    char* name = tokenName(nameToken);
+    Binding* callable = findBinding(gen, name);
+    free(name);
+    if (callable == NULL || callable->subroutine != fn->subroutine) return false;
+
+    ASTNodeArray* parameters = &fn->subroutine->as.SubroutineStmt.parameters;
+    for (int i = 0; i < arguments->count; i++) {
+        if (!parameters->start[i]->as.Parameter.byref) continue;
+
+        // Variables of this frame are passed by taking their address, BYREF parameters pass on
+        // the pointer they hold.
+        Binding* var = findToken(gen, arguments->start[i]->as.VariableExpr.name);
+        if (var == NULL) return false;
+        if (var - gen->bindings >= fn->base && var->address[0] == '&') return false;
+    }
+
+    // Every argument is evaluated before any parameter changes, since they may read them.
+    char* values[arguments->count > 0 ? arguments->count : 1];
+    line(gen, "{");
+    gen->depth++;
+
+    for (int i = 0; i < arguments->count; i++) {
+        ASTNode* arg = arguments->start[i];
+        ASTNode* param = parameters->start[i];
+        DataType type = param->as.Parameter.isArray ? TYPE_ARRAY : param->as.Parameter.type;
+        values[i] = format("t%d", gen->nextId++);
+
+        if (param->as.Parameter.byref) {
+            Binding* var = findToken(gen, arg->as.VariableExpr.name);
+            line(gen, "%s* %s = %s;", cType(type), values[i], var->address);
+        } else {
+            char* value = genExpr(gen, arg);
+            line(gen, isRefType(type) ? "%s %s = rtKeep(%s);" : "%s %s = %s;", cType(type), values[i], value);
+            free(value);
+        }
+    }
+
+    for (int i = 0; i < arguments->count; i++) {
+        line(gen, "%s = %s;", fn->params[i], values[i]);
+        free(values[i]);
+    }
+
+    // Nothing allocates before the parameters are copied to their root slots again.
+    line(gen, "rtRelease(&frame);");
+    line(gen, "goto tail_call;");
+    gen->depth--;
+    line(gen, "}");
+
+    gen->usedTemps = false;
+    fn->tailCalls = true;
+    return true;
+}
+
+static char* genElement(Generator* gen, ASTNode* node, char** prefixOut) {
+    Binding* array = findToken(gen, node->as.ArrayAccessExpr.name);
+    ASTNode* x = node->as.ArrayAccessExpr.indices[0];
+    ASTNode* y = node->as.ArrayAccessExpr.indices[1];
+
+    char* values[3] = {
+        format("%s", array != NULL ? array->access : "NULL"),
+        genExpr(gen, x),
+        y != NULL ? genExpr(gen, y) : format("0")
+    };
+    DataType types[3] = { TYPE_ARRAY, TYPE_INTEGER, TYPE_INTEGER };
+
+    *prefixOut = sequence(gen, values, types, 3, hasEffects(gen, x) || hasEffects(gen, y));
+
+    char* element = format("*(%s*)rtElement(%s, %s, %s)", cType(node->as.ArrayAccessExpr.resultType), values[0], values[1], values[2]);
+    for (int i = 0; i < 3; i++) {
+        free(values[i]);
+    }
+    return element;
+}
+
+// Stores value, already evaluated in full before the target's indices as the VM does.
+static char* genAssign(Generator* gen, ASTNode* target, char* value, DataType valueType, bool effects) {
+    if (target->type == EXPR_VARIABLE) {
+        Binding* var = findToken(gen, target->as.VariableExpr.name);
+        return format("(%s = %s)", var != NULL ? var->access : "t0", value);
+    }
+
+    ASTNode* x = target->as.ArrayAccessExpr.indices[0];
+    ASTNode* y = target->as.ArrayAccessExpr.indices[1];
+
+    char* valuePrefix;
+    if (effects || hasEffects(gen, x) || hasEffects(gen, y)) {
+        char* temp = newTemp(gen, valueType);
+        valuePrefix = format("%s = %s, ", temp, value);
+        value = temp;
+    } else {
+        valuePrefix = format("");
+        value = format("%s", value);
+    }
+
+    char* prefix;
+    char* element = genElement(gen, target, &prefix);
+    char* result = format("(%s%s%s = %s)", valuePrefix, prefix, element, value);
+
+    free(valuePrefix);
+    free(prefix);
+    free(element);
+    free(value);
+    return result;
+}
+
+static bool isNumeric(DataType type) {
+    return type == TYPE_INTEGER || type == TYPE_REAL || type == TYPE_CHAR;
+}
+
+static const char* comparison(Operation op) {
+    switch (op) {
+        case LOGIC_EQUAL: return "==";
+        case LOGIC_NOT_EQUAL: return "!=";
+        case LOGIC_LESS: return "<";
+        case LOGIC_LESS_EQUAL: return "<=";
+        case LOGIC_GREATER: return ">";
+        case LOGIC_GREATER_EQUAL: return ">=";
+        default: return NULL;
+    }
+}
+
+static char* genBinary(Generator* gen, ASTNode* node) {
+    ASTNode* left = node->as.BinaryExpr.left;
+    ASTNode* right = node->as.BinaryExpr.right;
+    DataType leftType = node->as.BinaryExpr.leftType;
+    DataType rightType = node->as.BinaryExpr.rightType;
+    Operation op = node->as.BinaryExpr.op;
+
+    // CHAR operands take part as their codes, like CAST_CHAR_INT.
+    char* values[2] = { genExpr(gen, left), genExpr(gen, right) };
+    DataType types[2] = { leftType == TYPE_CHAR ? TYPE_INTEGER : leftType, rightType == TYPE_CHAR ? TYPE_INTEGER : rightType };
+    bool rightEffects = hasEffects(gen, right);
+    char* prefix = sequence(gen, values, types, 2, hasEffects(gen, left) || rightEffects);
+
+    DataType type = types[0];
+    if (type == TYPE_INTEGER && types[1] == TYPE_REAL) type = TYPE_REAL;
+
+    char* l = values[0];
+    char* r = values[1];
+    char* expr;
+
+    if (comparison(op) != NULL) {
+        if (leftType != rightType && !(isNumeric(leftType) && isNumeric(rightType))) {
+            // The analyser warns that these always compare FALSE.
+            expr = format("(void)%s, (void)%s, false", l, r);
+        } else if (type == TYPE_STRING) {
+            expr = format("rtCompare(%s, %s) %s 0", l, r, comparison(op));
+        } else {
+            expr = format("%s %s %s", l, comparison(op), r);
+        }
+    } else {
+        switch (op) {
+            case BIN_ADD: expr = format("%s + %s", l, r); break;
+            case BIN_MINUS: expr = format("%s - %s", l, r); break;
+            case BIN_MULT: expr = format("%s * %s", l, r); break;
+            case BIN_DIV: expr = format("(double)%s / %s", l, r); break;
+            case BIN_MOD:
+                expr = type == TYPE_REAL ? format("rtMod(%s, %s)", l, r) : format("rtIntMod(%s, %s)", l, r);
+                break;
+            case BIN_FDIV:
+                expr = type == TYPE_REAL ? format("(int)(%s / %s)", l, r) : format("rtIntDiv(%s, %s)", l, r);
+                break;
+            case BIN_POWER: expr = format("pow(%s, %s)", l, r); break;
+            case BIN_CONCAT:
+                expr = format("rtConcat(%s, %s)", l, r);
+                gen->usedTemps = true;
+                break;
+            // Both operands are always evaluated, so side effects on the right still happen.
+            case LOGIC_AND: expr = format(rightEffects ? "%s & %s" : "%s && %s", l, r); break;
+            case LOGIC_OR: expr = format(rightEffects ? "%s | %s" : "%s || %s", l, r); break;
+            default:
+                internalError(gen, "unknown binary operation.");
+                expr = format("0");
+                break;
+        }
+    }
+
+    char* result = format("(%s%s)", prefix, expr);
+    free(prefix);
+    free(expr);
+    free(l);
+    free(r);
+    return result;
+}
+
+static char* genExpr(Generator* gen, ASTNode* node) {
+    if (node == NULL) return format("0");
+
+    switch (node->type) {
+        case EXPR_LITERAL:
+            return literalValue(gen, node->as.LiteralExpr.value, node->as.LiteralExpr.resultType);
+        case EXPR_GROUP: {
+            char* sub = genExpr(gen, node->as.GroupExpr.subExpr);
+            char* result = format("(%s)", sub);
+            free(sub);
+            return result;
+        }
+        case EXPR_VARIABLE: {
+            Binding* var = findToken(gen, node->as.VariableExpr.name);
+            return format("%s", var != NULL ? var->access : "0");
+        }
+        case EXPR_ARRAY_ACCESS: {
+            char* prefix;
+            char* element = genElement(gen, node, &prefix);
+            char* result = format("(%s%s)", prefix, element);
+            free(prefix);
+            free(element);
+            return result;
+        }
+        case EXPR_UNARY: {
+            char* right = genExpr(gen, node->as.UnaryExpr.right);
+            char* result;
+            switch (node->as.UnaryExpr.op) {
+                case UNARY_NEG: result = format("(-%s)", right); break;
+                case UNARY_NOT: result = format("(!%s)", right); break;
+                default: result = format("%s", right); break;
+            }
+            free(right);
+            return result;
+        }
+        case EXPR_BINARY:
+            return genBinary(gen, node);
+        case EXPR_ASSIGN: {
+            ASTNode* right = node->as.AssignmentExpr.right;
+            char* value = genExpr(gen, right);
+            char* result = genAssign(gen, node->as.AssignmentExpr.left, value, right->as.Expr.resultType, hasEffects(gen, right));
+            free(value);
+            return result;
+        }
+        case EXPR_CALL:
+            return genCall(gen, node->as.CallExpr.name, &node->as.CallExpr.arguments);
+        default:
+            internalError(gen, "unexpected expression.");
+            return format("0");
+    }
+}
+
+// Ends a simple statement, dropping the temporaries it kept.
+static void endStatement(Generator* gen) {
+    if (gen->usedTemps) line(gen, "rtRelease(&frame);");
+    gen->usedTemps = false;
+}
+
+static char* genCondition(Generator* gen, ASTNode* node) {
+    gen->usedTemps = false;
+    char* value = genExpr(gen, node);
+
+    if (gen->usedTemps) {
+        char* tested = format("rtTest(&frame, %s)", value);
+        free(value);
+        value = tested;
+    }
+
+    gen->usedTemps = false;
+    return value;
+}
+
+static void genStmt(Generator* gen, ASTNode* node);
+
+static void genBlock(Generator* gen, ASTNode* node) {
+    gen->depth++;
+    genStmt(gen, node);
+    gen->depth--;
+}
+
+static void genSubroutine(Generator* gen, ASTNode* node) {
+    bool isFunction = node->as.SubroutineStmt.subroutineType == TYPE_FUNCTION;
+    DataType returnType = isFunction ? node->as.SubroutineStmt.returnValue : TYPE_NONE;
+    char* name = tokenName(node->as.SubroutineStmt.name);
+
+    // Added before the body so the subroutine can call itself.
+    addBinding(gen, format("%s", name), format("s_%s", name), format("NULL"), TYPE_SUBROUTINE, TYPE_NONE, node);
+    int base = gen->bindingCount;
+
+    Function fn;
+    initFunction(&fn, false, returnType);
+    fn.subroutine = node;
+    fn.base = base;
+    fn.params = (char**) malloc((node->as.SubroutineStmt.parameters.count + 1) * sizeof(char*));
+    if (fn.params == NULL) {
+        fprintf(stderr, "Not enough memory to generate C code.\n");
+        exit(74);
+    }
+    Function* outer = gen->function;
+    int outerDepth = gen->depth;
+    gen->function = &fn;
+    gen->depth = 0;
+
+    CBuffer params;
+    initBuffer(&params);
+
+    for (int i = 0; i < node->as.SubroutineStmt.parameters.count; i++) {
+        ASTNode* param = node->as.SubroutineStmt.parameters.start[i];
+        char* paramName = tokenName(param->as.Parameter.name);
+        DataType type = param->as.Parameter.isArray ? TYPE_ARRAY : param->as.Parameter.type;
+        DataType elemType = param->as.Parameter.isArray ? param->as.Parameter.type : TYPE_NONE;
+        char* cName = format("p%d_%s", gen->nextId++, paramName);
+        char* access;
+        char* address;
+
+        if (param->as.Parameter.byref) {
+            append(&params, "%s%s* %s", i > 0 ? ", " : "", cType(type), cName);
+            access = format("(*%s)", cName);
+            address = format("%s", cName);
+        } else if (isRefType(type)) {
+            // Copied into a root slot so the collector sees it while the call runs.
+            append(&params, "%s%s %s", i > 0 ? ", " : "", cType(type), cName);
+            access = format("roots[%d]", fn.rootCount++);
+            address = format("&%s", access);
+            line(gen, "%s = %s;", access, cName);
+        } else {
+            append(&params, "%s%s %s", i > 0 ? ", " : "", cType(type), cName);
+            access = format("%s", cName);
+            address = format("&%s", cName);
+        }
+
+        addBinding(gen, paramName, access, address, type, elemType, NULL);
+        fn.params[i] = cName;
+    }
+
+    char* signature = format("static %s s_%s(%s)", cType(returnType), name, params.count > 0 ? params.chars : "void");
+    append(&gen->prototypes, "%s;\n", signature);
+
+    gen->inTail = !isFunction;
+    genStmt(gen, node->as.SubroutineStmt.body);
+
+    line(gen, "rtLeave(&frame);");
+    if (isFunction) line(gen, "return %s;", zeroValue(returnType));
+
+    append(&gen->functions, "%s {\n", signature);
+    if (fn.rootCount > 0) append(&gen->functions, "    Obj* roots[%d] = { NULL };\n", fn.rootCount);
+    if (fn.decls.count > 0) append(&gen->functions, "%s", fn.decls.chars);
+    append(&gen->functions, "    RtFrame frame;\n");
+    append(&gen->functions, "    rtEnter(&frame, %s, %d);\n", fn.rootCount > 0 ? "roots" : "NULL", fn.rootCount);
+    if (fn.tailCalls) append(&gen->functions, "tail_call:\n");
+    if (fn.body.count > 0) append(&gen->functions, "%s", fn.body.chars);
+    append(&gen->functions, "}\n\n");
+
+    truncateBindings(gen, base);
+    gen->function = outer;
+    gen->depth = outerDepth;
+
+    free(signature);
+    freeBuffer(&params);
+    freeFunction(&fn);
+    free(name);
+}
+
+static void collectCaseLines(ASTNode* node, ASTNode*** lines, int* count, int* capacity) {
+    if (node == NULL) return;
+
+    switch (node->type) {
+        case STMT_CASE_BLOCK:
+            collectCaseLines(node->as.CaseBlockStmt.body, lines, count, capacity);
+            break;
+        case STMT_BLOCK:
+            for (int i = 0; i < node->as.BlockStmt.body.count; i++) {
+                collectCaseLines(node->as.BlockStmt.body.start[i], lines, count, capacity);
+            }
+            break;
+        case STMT_CASE_LINE:
+            if (*count == *capacity) {
+                *capacity = *capacity < 8 ? 8 : *capacity * 2;
+                *lines = (ASTNode**) realloc(*lines, *capacity * sizeof(ASTNode*));
+                if (*lines == NULL) {
+                    fprintf(stderr, "Not enough memory to generate C code.\n");
+                    exit(74);
+                }
+            }
+            (*lines)[(*count)++] = node;
+            break;
+        default: break;
+    }
+}
+
+static void genCase(Generator* gen, ASTNode* node) {
+    gen->usedTemps = false;
+    char* selector = genExpr(gen, node->as.CaseStmt.expr);
+    char* value = newTemp(gen, TYPE_INTEGER);
+    line(gen, "%s = %s;", value, selector);
+    endStatement(gen);
+    free(selector);
+
+    ASTNode** lines = NULL;
+    int count = 0;
+    int capacity = 0;
+    collectCaseLines(node->as.CaseStmt.body, &lines, &count, &capacity);
+
+    // Lines are tried in order and only the first match runs. OTHERWISE always matches.
+    bool opened = false;
+    for (int i = 0; i < count; i++) {
+        ASTNode* caseLine = lines[i];
+
+        if (caseLine->as.CaseLineStmt.value == NULL) {
+            line(gen, opened ? "} else {" : "{");
+            genBlock(gen, caseLine->as.CaseLineStmt.result);
+            opened = true;
+            break;
+        }
+
+        gen->usedTemps = false;
+        char* test = genExpr(gen, caseLine->as.CaseLineStmt.value);
+        char* cond = format(gen->usedTemps ? "rtTest(&frame, %s == %s)" : "%s == %s", value, test);
+        gen->usedTemps = false;
+
+        line(gen, opened ? "} else if (%s) {" : "if (%s) {", cond);
+        genBlock(gen, caseLine->as.CaseLineStmt.result);
+        opened = true;
+
+        free(test);
+        free(cond);
+    }
+
+    if (opened) line(gen, "}");
+
+    free(lines);
+    free(value);
+}
+
+static void genFor(Generator* gen, ASTNode* node) {
+    int mark = gen->bindingCount;
+
+    char* name = tokenName(node->as.ForStmt.counterName);
+    Binding* counter = findBinding(gen, name);
+    if (counter == NULL || counter->subroutine != NULL) {
+        counter = newVariable(gen, name, TYPE_INTEGER, TYPE_NONE);
+        line(gen, "%s = 0;", counter->access);
+    } else {
+        free(name);
+    }
+    char* access = format("%s", counter->access);
+
+    gen->usedTemps = false;
+    char* init = genExpr(gen, node->as.ForStmt.init);
+    line(gen, "%s = %s;", access, init);
+    endStatement(gen);
+    free(init);
+
+    int sign = 1;
+    int step = 1;
+
+    if (node->as.ForStmt.step != NULL) {
+        ASTNode* curr = node->as.ForStmt.step;
+        while (curr->type != EXPR_LITERAL) {
+            if (curr->as.UnaryExpr.op == UNARY_NEG) {
+                sign *= -1;
+            }
+            curr = curr->as.UnaryExpr.right;
+        }
+
+        char* stepStr = tokenName(curr->as.LiteralExpr.value);
+        step = atoi(stepStr);
+        free(stepStr);
+    }
+
+    step *= sign;
+
+    // The final value is evaluated again before every iteration.
+    char* end = genCondition(gen, node->as.ForStmt.end);
+
+    line(gen, "for (; %s %s %s; %s += %d) {", access, step < 0 ? ">=" : "<=", end, access, step);
+    genBlock(gen, node->as.ForStmt.body);
+    line(gen, "}");
+
+    truncateBindings(gen, mark);
+    free(access);
+    free(end);
+}
+
+static const char* typeSuffix(DataType type) {
+    switch (type) {
+        case TYPE_INTEGER: return "Int";
+        case TYPE_REAL: return "Real";
+        case TYPE_CHAR: return "Char";
+        case TYPE_BOOLEAN: return "Bool";
+        case TYPE_STRING: return "String";
+        default: return "Ref";
+    }
+}
+
+static void genStmt(Generator* gen, ASTNode* node) {
+    if (node == NULL || gen->hadError) return;
+
+    gen->usedTemps = false;
+
+    // Only blocks and IF pass the tail position on to the statements they end with.
+    bool tail = gen->inTail;
+    gen->inTail = false;
+
+    switch (node->type) {
+        case STMT_PROGRAM:
+            for (int i = 0; i < node->as.ProgramStmt.body.count; i++) {
+                genStmt(gen, node->as.ProgramStmt.body.start[i]);
+            }
+            break;
+        case STMT_BLOCK:
+            for (int i = 0; i < node->as.BlockStmt.body.count; i++) {
+                gen->inTail = tail && i == node->as.BlockStmt.body.count - 1;
+                genStmt(gen, node->as.BlockStmt.body.start[i]);
+            }
+            break;
+        case STMT_EXPR: {
+            ASTNode* expr = node->as.ExprStmt.expr;
+            char* value = genExpr(gen, expr);
+            line(gen, expr->type == EXPR_ASSIGN || expr->type == EXPR_CALL ? "%s;" : "(void)%s;", value);
+            endStatement(gen);
+            free(value);
+            break;
+        }
+        case STMT_SUBROUTINE:
+            genSubroutine(gen, node);
+            break;
+        case STMT_IF: {
+            char* cond = genCondition(gen, node->as.IfStmt.condition);
+            line(gen, "if (%s) {", cond);
+            gen->inTail = tail;
+            genBlock(gen, node->as.IfStmt.thenBranch);
+            if (node->as.IfStmt.elseBranch != NULL) {
+                line(gen, "} else {");
+                gen->inTail = tail;
+                genBlock(gen, node->as.IfStmt.elseBranch);
+            }
+            line(gen, "}");
+            free(cond);
+            break;
+        }
+        case STMT_OUTPUT:
+            for (int i = 0; i < node->as.OutputStmt.expressions.count; i++) {
+                ASTNode* expr = node->as.OutputStmt.expressions.start[i];
+                char* value = genExpr(gen, expr);
+                line(gen, "rtOutput%s(%s);", typeSuffix(expr->as.Expr.resultType), value);
+                free(value);
+            }
+            line(gen, "rtOutputNewline();");
+            endStatement(gen);
+            break;
+        case STMT_INPUT: {
+            DataType type = node->as.InputStmt.expectedType;
+            char* input = format("rtInput%s()", typeSuffix(type));
+            char* store = genAssign(gen, node->as.InputStmt.varAccess, input, type, true);
+            if (type == TYPE_STRING) gen->usedTemps = true;
+            line(gen, "%s;", store);
+            endStatement(gen);
+            free(input);
+            free(store);
+            break;
+        }
+        case STMT_RETURN: {
+            if (gen->function->isMain) break;
+
+            if (node->as.ReturnStmt.expr == NULL) {
+                line(gen, "rtLeave(&frame);");
+                line(gen, "return;");
+                break;
+            }
+
+            ASTNode* expr = node->as.ReturnStmt.expr;
+            while (expr->type == EXPR_GROUP) expr = expr->as.GroupExpr.subExpr;
+            if (expr->type == EXPR_CALL && genTailCall(gen, expr->as.CallExpr.name, &expr->as.CallExpr.arguments)) break;
+
+            char* value = genExpr(gen, node->as.ReturnStmt.expr);
+            line(gen, "{");
+            line(gen, "    %s result = %s;", cType(gen->function->returnType), value);
+            line(gen, "    rtLeave(&frame);");
+            line(gen, "    return result;");
+            line(gen, "}");
+            gen->usedTemps = false;
+            free(value);
+            break;
+        }
+        case STMT_WHILE: {
+            char* cond = genCondition(gen, node->as.WhileStmt.condition);
+            line(gen, "while (%s) {", cond);
+            genBlock(gen, node->as.WhileStmt.body);
+            line(gen, "}");
+            free(cond);
+            break;
+        }
+        case STMT_REPEAT: {
+            line(gen, "do {");
+            genBlock(gen, node->as.RepeatStmt.body);
+            char* cond = genCondition(gen, node->as.RepeatStmt.condition);
+            line(gen, "} while (!%s);", cond);
+            free(cond);
+            break;
+        }
+        case STMT_VAR_DECLARE: {
+            DataType type = node->as.VarDeclareStmt.type;
+            Binding* var = newVariable(gen, tokenName(node->as.VarDeclareStmt.name), type, TYPE_NONE);
+            line(gen, "%s = %s;", var->access, zeroValue(type));
+            break;
+        }
+        case STMT_CONST_DECLARE: {
+            DataType type = node->as.ConstDeclareStmt.type;
+            char* value = literalValue(gen, node->as.ConstDeclareStmt.value, type);
+            Binding* var = newVariable(gen, tokenName(node->as.ConstDeclareStmt.name), type, TYPE_NONE);
+            line(gen, "%s = %s;", var->access, value);
+            free(value);
+            break;
+        }
+        case STMT_ARRAY_DECLARE: {
+            char* values[4];
+            DataType types[4] = { TYPE_INTEGER, TYPE_INTEGER, TYPE_INTEGER, TYPE_INTEGER };
+            bool effects = false;
+
+            for (int i = 0; i < 4; i++) {
+                ASTNode* dim = node->as.ArrayDeclareStmt.dimensions[i];
+                values[i] = dim != NULL ? genExpr(gen, dim) : format("0");
+                effects |= hasEffects(gen, dim);
+            }
+
+            char* prefix = sequence(gen, values, types, 4, effects);
+            DataType elemType = node->as.ArrayDeclareStmt.type;
+            Binding* array = newVariable(gen, tokenName(node->as.ArrayDeclareStmt.name), TYPE_ARRAY, elemType);
+
+            line(gen, "%s = (%srtArray(%s, %s, %s, %s, %d));", array->access, prefix,
+                 values[0], values[1], values[2], values[3], elementSize(elemType));
+            gen->usedTemps = true;
+            endStatement(gen);
+
+            for (int i = 0; i < 4; i++) {
+                free(values[i]);
+            }
+            free(prefix);
+            break;
+        }
+        case STMT_CASE:
+            genCase(gen, node);
+            break;
+        case STMT_FOR:
+            genFor(gen, node);
+            break;
+        case STMT_CALL: {
+            if (tail && genTailCall(gen, node->as.CallStmt.name, &node->as.CallStmt.arguments)) break;
+
+            char* call = genCall(gen, node->as.CallStmt.name, &node->as.CallStmt.arguments);
+            line(gen, "%s;", call);
+            endStatement(gen);
+            free(call);
+            break;
+        }
+        case STMT_OPENFILE: {
+            Token* filename = node->as.OpenfileStmt.filename;
+            char* path = cString(filename->start + 1, (int)filename->length - 2);
+            Binding* file = newVariable(gen, tokenName(filename), TYPE_FILE, TYPE_NONE);
+            line(gen, "%s = rtOpenFile(%s, %d);", file->access, path, (int)node->as.OpenfileStmt.accessType);
+            free(path);
+            break;
+        }
+        case STMT_CLOSEFILE: {
+            Binding* file = findToken(gen, node->as.ClosefileStmt.filename);
+            if (file == NULL) break;
+
+            line(gen, "rtCloseFile(%s);", file->access);
+            line(gen, "%s = NULL;", file->access);
+            file->closed = true;
+            break;
+        }
+        case STMT_READFILE: {
+            Binding* file = findToken(gen, node->as.ReadfileStmt.filename);
+            if (file == NULL) break;
+
+            char* read = format("rtReadLine(%s)", file->access);
+            char* store = genAssign(gen, node->as.ReadfileStmt.varAccess, read, TYPE_STRING, true);
+            gen->usedTemps = true;
+            line(gen, "%s;", store);
+            endStatement(gen);
+            free(read);
+            free(store);
+            break;
+        }
+        case STMT_WRITEFILE: {
+            Binding* file = findToken(gen, node->as.WritefileStmt.filename);
+            if (file == NULL) break;
+
+            for (int i = 0; i < node->as.WritefileStmt.expressions.count; i++) {
+                ASTNode* expr = node->as.WritefileStmt.expressions.start[i];
+                char* value = genExpr(gen, expr);
+                line(gen, "rtWrite%s(%s, %s);", typeSuffix(expr->as.Expr.resultType), file->access, value);
+                free(value);
+            }
+            line(gen, "rtWriteNewline(%s);", file->access);
+            endStatement(gen);
+            break;
+        }
+        default:
+            internalError(gen, "unexpected statement.");
+            break;
+    }
+}
+
+bool generateC(AST* ast, FILE* out, const CodegenLimits* limits) {
+    Generator gen;
+    initBuffer(&gen.globals);
+    initBuffer(&gen.prototypes);
+    initBuffer(&gen.functions);
+    gen.bindings = NULL;
+    gen.bindingCount = 0;
+    gen.bindingCapacity = 0;
+    gen.globalRoots = 0;
+    gen.nextId = 1;
+    gen.depth = 0;
+    gen.usedTemps = false;
+    gen.inTail = false;
+    gen.hadError = false;
+
+    Function main;
+    initFunction(&main, true, TYPE_NONE);
+    gen.function = &main;
+
+    genStmt(&gen, ast->program);
+
+    if (!gen.hadError) {
+        fprintf(out, "// Generated by PseudoCompiler. Build together with runtime.c, memory.c, object.c and common.c.\n\n");
+        fprintf(out, "#include \"runtime.h\"\n\n");
+        fprintf(out, "static Obj* globals[%d];\n", gen.globalRoots > 0 ? gen.globalRoots : 1);
+        if (gen.globals.count > 0) fprintf(out, "%s", gen.globals.chars);
+        fprintf(out, "\n");
+        if (gen.prototypes.count > 0) fprintf(out, "%s\n", gen.prototypes.chars);
+        if (gen.functions.count > 0) fprintf(out, "%s", gen.functions.chars);
+
+        fprintf(out, "int main(void) {\n");
+        fprintf(out, "    RtFrame frame;\n");
+        if (main.decls.count > 0) fprintf(out, "%s", main.decls.chars);
+        // The program itself runs in a frame, the VM's limit counts only subroutine calls.
+        fprintf(out, "    rtInit(%d, %d, %d);\n", limits->heapCells, limits->gcTrigger, limits->frames + 1);
+        fprintf(out, "    rtEnter(&frame, globals, %d);\n", gen.globalRoots);
+        if (main.body.count > 0) fprintf(out, "%s", main.body.chars);
+        fprintf(out, "    rtLeave(&frame);\n");
+        fprintf(out, "    rtFinish();\n");
+        fprintf(out, "    return 0;\n");
+        fprintf(out, "}\n");
+    }
+
+    truncateBindings(&gen, 0);
+    free(gen.bindings);
+    freeBuffer(&gen.globals);
+    freeBuffer(&gen.prototypes);
+    freeBuffer(&gen.functions);
+    freeFunction(&main);
+
+    return !gen.hadError && !ferror(out);
+}
@@ -0,0 +1,22 @@
+#ifndef PSEUDOCOMPILER_CODEGEN_H
+#define PSEUDOCOMPILER_CODEGEN_H
+
+#include "common.h"
+#include "parser.h"
+
+// Ahead-of-time backend. Translates an analysed program into a single C translation unit
+// that links against runtime.c, memory.c, object.c and common.c. The heap size, collection
+// trigger and call depth limit are fixed into the generated program.
+typedef struct {
+    int heapCells;
+    int gcTrigger;
+    int frames;
+} CodegenLimits;
+
+// Generated code recurses on the native stack, so its calls nest far less deeply than the VM's.
+// Tail calls of a subroutine to itself become jumps and take no frame.
+#define DEFAULT_NATIVE_FRAMES   256
+
+bool generateC(AST* ast, FILE* out, const CodegenLimits* limits);
+
+#endif //PSEUDOCOMPILER_CODEGEN_H
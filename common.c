@@ -1,6 +1,17 @@
 
 #include "common.h"
 
+// Null until the thread redirects its diagnostics.
+static _Thread_local FILE* diagnosticStream = NULL;
+
+FILE* diagnostics() {
+    return diagnosticStream != NULL ? diagnosticStream : stderr;
+}
+
+void setDiagnostics(FILE* stream) {
+    diagnosticStream = stream;
+}
+
 char* extractNullTerminatedString(const char* start, int length) {
     // Allocate memory for the new string (+1 for the null terminator)
     char* result = (char*)malloc(length + 1);
@@ -17,3 +28,24 @@ char* extractNullTerminatedString(const char* start, int length) {
 
     return result;
 }
+
+char* readSource(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    long fileSize = ftell(file);
+    rewind(file);
+
+    char* buffer = fileSize < 0 ? NULL : (char*)malloc((size_t)fileSize + 1);
+    if (buffer == NULL) {
+        fclose(file);
+        return NULL;
+    }
+
+    size_t bytesRead = fread(buffer, sizeof(char), (size_t)fileSize, file);
+    buffer[bytesRead] = '\0';
+
+    fclose(file);
+    return buffer;
+}
@@ -15,5 +15,11 @@ typedef uint32_t byte4;
 typedef uint64_t byte8;
 
 char* extractNullTerminatedString(const char* start, int length);
+// Where compile errors, warnings and runtime errors go: stderr, unless the calling thread
+// has set a stream of its own. NULL goes back to stderr.
+FILE* diagnostics();
+void setDiagnostics(FILE* stream);
+// The whole file as a null-terminated string, or NULL if it cannot be read.
+char* readSource(const char* path);
 
 #endif //PSEUDOCOMPILER_COMMON_H
@@ -18,16 +18,24 @@ static bool initialiseSymbol(Compiler* compiler, const char* key) {
     return true;
 }
 
-static bool addSymbol(Compiler* compiler, const char* key, ASTNode* node, SymbolType type, bool isRelative, bool byref, int size) {
+static void claimSlot(Compiler* compiler) {
+    compiler->symbolTable->nextPos++;
+    if (compiler->symbolTable->nextPos > compiler->highWater) compiler->highWater = compiler->symbolTable->nextPos;
+}
+
+static bool addSymbol(Compiler* compiler, const char* key, ASTNode* node, SymbolType type, bool isRelative, bool byref) {
     int pos = compiler->symbolTable->nextPos;
-    compiler->symbolTable->nextPos += size;
+    claimSlot(compiler);
     return setTable(compiler->symbolTable, key, node, type, pos, isRelative, byref);
 }
 
+static bool addBuiltinSymbol(Compiler* compiler, const char* key, Builtin* builtin) {
+    return setTable(compiler->symbolTable, key, (ASTNode*)builtin, SYMBOL_BUILTIN_FUNC, 0, false, false);
+}
+
 static bool addFile(Compiler* compiler, const char* key, ASTNode* node, SymbolType type, bool isRelative, bool byref, FileAccessType access) {
-    int size = 8;
     int pos = compiler->symbolTable->nextPos;
-    compiler->symbolTable->nextPos += size;
+    claimSlot(compiler);
     return setTableFile(compiler->symbolTable, key, node, type, pos, isRelative, byref, access);
 }
 
@@ -90,9 +98,387 @@ static void addByte(Compiler* compiler, byte b) {
 #define ADD_BOOL(x)  ADD_BYTE(x)
 #define ADD_REF(x)  ADD_8BYTE(x)
 
+static ASTNode* unwrapGroups(ASTNode* node) {
+    while (node != NULL && node->type == EXPR_GROUP) {
+        node = node->as.GroupExpr.subExpr;
+    }
+    return node;
+}
+
+// Register operand for a plain (not byref, not array) variable of the given scalar type.
+static bool slotOperand(Compiler* compiler, ASTNode* node, DataType type, bool writable, int* reg) {
+    node = unwrapGroups(node);
+    if (node == NULL || node->type != EXPR_VARIABLE) return false;
+
+    char* name = extractNullTerminatedString(node->as.VariableExpr.name->start, node->as.VariableExpr.name->length);
+    Symbol var;
+    bool res = findSymbol(compiler, name, &var);
+    free(name);
+
+    if (!res || var.byref) return false;
+
+    DataType varType;
+    switch (var.type) {
+        case SYMBOL_VAR:
+            varType = var.node->as.VarDeclareStmt.type;
+            break;
+        case SYMBOL_PARAM:
+            if (var.node->as.Parameter.isArray) return false;
+            varType = var.node->as.Parameter.type;
+            break;
+        case SYMBOL_FOR_COUNTER:
+            varType = TYPE_INTEGER;
+            break;
+        case SYMBOL_CONST:
+            if (writable) return false;
+            varType = var.node->as.ConstDeclareStmt.type;
+            break;
+        default: return false;
+    }
+
+    if (varType != type) return false;
+
+    *reg = REG_OPERAND(var.pos, var.isRelative);
+    return true;
+}
+
+static bool intImmediate(ASTNode* node, int* value) {
+    node = unwrapGroups(node);
+    if (node == NULL || node->type != EXPR_LITERAL || node->as.LiteralExpr.resultType != TYPE_INTEGER) return false;
+
+    char* num = extractNullTerminatedString(node->as.LiteralExpr.value->start, node->as.LiteralExpr.value->length);
+    *value = atoi(num);
+    free(num);
+    return true;
+}
+
+static void addRegisterOp(Compiler* compiler, Instruction op, int fst, int snd) {
+    addOp(compiler, op);
+    ADD_INT(fst);
+    ADD_INT(snd);
+}
+
+static void addRegisterOp3(Compiler* compiler, Instruction op, int fst, int snd, int trd) {
+    addRegisterOp(compiler, op, fst, snd);
+    ADD_INT(trd);
+}
+
+// Compiles var <- operand and var <- operand op operand on INTEGER or REAL variables straight
+// into register form. Returns false, having emitted nothing, for anything else.
+static bool compileRegisterAssign(Compiler* compiler, ASTNode* node) {
+    if (node->type != EXPR_ASSIGN) return false;
+
+    ASTNode* left = node->as.AssignmentExpr.left;
+    ASTNode* right = unwrapGroups(node->as.AssignmentExpr.right);
+
+    int dst;
+    DataType type = TYPE_INTEGER;
+    if (!slotOperand(compiler, left, TYPE_INTEGER, true, &dst)) {
+        type = TYPE_REAL;
+        if (!slotOperand(compiler, left, TYPE_REAL, true, &dst)) return false;
+    }
+
+    int src, imm;
+    if (slotOperand(compiler, right, type, false, &src)) {
+        addRegisterOp(compiler, MOVE_R, dst, src);
+        return true;
+    }
+    if (type == TYPE_INTEGER && intImmediate(right, &imm)) {
+        addRegisterOp(compiler, LOADK_INT_R, dst, imm);
+        return true;
+    }
+
+    if (right == NULL || right->type != EXPR_BINARY) return false;
+    if (right->as.BinaryExpr.leftType != type || right->as.BinaryExpr.rightType != type) return false;
+
+    Instruction rr, rk = NOP;
+    switch (right->as.BinaryExpr.op) {
+        case BIN_ADD:
+            rr = type == TYPE_INTEGER ? ADD_INT_RR : ADD_REAL_RR;
+            rk = ADD_INT_RK;
+            break;
+        case BIN_MINUS:
+            rr = type == TYPE_INTEGER ? MINUS_INT_RR : MINUS_REAL_RR;
+            rk = MINUS_INT_RK;
+            break;
+        case BIN_MULT:
+            rr = type == TYPE_INTEGER ? MULT_INT_RR : MULT_REAL_RR;
+            rk = MULT_INT_RK;
+            break;
+        case BIN_DIV:
+            if (type != TYPE_REAL) return false;
+            rr = DIV_REAL_RR;
+            break;
+        case BIN_MOD:
+            if (type != TYPE_INTEGER) return false;
+            rr = MOD_INT_RR;
+            rk = MOD_INT_RK;
+            break;
+        case BIN_FDIV:
+            if (type != TYPE_INTEGER) return false;
+            rr = FDIV_INT_RR;
+            rk = FDIV_INT_RK;
+            break;
+        default: return false;
+    }
+
+    ASTNode* fst = right->as.BinaryExpr.left;
+    ASTNode* snd = right->as.BinaryExpr.right;
+    bool commutative = right->as.BinaryExpr.op == BIN_ADD || right->as.BinaryExpr.op == BIN_MULT;
+
+    int a, b;
+    if (!slotOperand(compiler, fst, type, false, &a)) {
+        // 1 + x is emitted as x + 1.
+        if (!commutative || type != TYPE_INTEGER || !intImmediate(fst, &imm) || !slotOperand(compiler, snd, type, false, &a)) return false;
+        addRegisterOp3(compiler, rk, dst, a, imm);
+        return true;
+    }
+
+    if (slotOperand(compiler, snd, type, false, &b)) {
+        addRegisterOp3(compiler, rr, dst, a, b);
+        return true;
+    }
+    if (type == TYPE_INTEGER && intImmediate(snd, &imm)) {
+        addRegisterOp3(compiler, rk, dst, a, imm);
+        return true;
+    }
+
+    return false;
+}
+
+// Compiles "jump to target unless cond" for an INTEGER comparison of registers and literals
+// into one register branch. Returns the position of the target operand for later patching,
+// or -1, having emitted nothing, when cond needs the stack.
+static int compileRegisterBranch(Compiler* compiler, ASTNode* cond, int target) {
+    cond = unwrapGroups(cond);
+    if (cond == NULL || cond->type != EXPR_BINARY) return -1;
+    if (cond->as.BinaryExpr.leftType != TYPE_INTEGER || cond->as.BinaryExpr.rightType != TYPE_INTEGER) return -1;
+
+    Operation op = cond->as.BinaryExpr.op;
+    ASTNode* fst = cond->as.BinaryExpr.left;
+    ASTNode* snd = cond->as.BinaryExpr.right;
+
+    int a, b;
+    if (!slotOperand(compiler, fst, TYPE_INTEGER, false, &a)) {
+        // 5 < x is the same test as x > 5.
+        if (!slotOperand(compiler, snd, TYPE_INTEGER, false, &a)) return -1;
+        snd = fst;
+        switch (op) {
+            case LOGIC_LESS: op = LOGIC_GREATER; break;
+            case LOGIC_LESS_EQUAL: op = LOGIC_GREATER_EQUAL; break;
+            case LOGIC_GREATER: op = LOGIC_LESS; break;
+            case LOGIC_GREATER_EQUAL: op = LOGIC_LESS_EQUAL; break;
+            default: break;
+        }
+    }
+
+    bool isImmediate = false;
+    if (!slotOperand(compiler, snd, TYPE_INTEGER, false, &b)) {
+        if (!intImmediate(snd, &b)) return -1;
+        isImmediate = true;
+    }
+
+    // The branch is taken when the condition fails.
+    Instruction branch;
+    switch (op) {
+        case LOGIC_EQUAL: branch = isImmediate ? BNE_INT_RK : BNE_INT_RR; break;
+        case LOGIC_NOT_EQUAL: branch = isImmediate ? BEQ_INT_RK : BEQ_INT_RR; break;
+        case LOGIC_LESS: branch = isImmediate ? BGE_INT_RK : BGE_INT_RR; break;
+        case LOGIC_LESS_EQUAL: branch = isImmediate ? BGT_INT_RK : BGT_INT_RR; break;
+        case LOGIC_GREATER: branch = isImmediate ? BLE_INT_RK : BLE_INT_RR; break;
+        case LOGIC_GREATER_EQUAL: branch = isImmediate ? BLT_INT_RK : BLT_INT_RR; break;
+        default: return -1;
+    }
+
+    addRegisterOp(compiler, branch, a, b);
+    int targetPos = getNextPos(compiler->bStream);
+    ADD_INT(target);
+    return targetPos;
+}
+
+static void addFetchInt(Compiler* compiler, int reg) {
+    int pos = REG_POS(reg);
+    addOp(compiler, REG_IS_RELATIVE(reg) ? FETCH_LOCAL_INT : FETCH_GLOBAL_INT);
+    ADD_INT(pos);
+}
+
+static void addStoreIntDiscard(Compiler* compiler, int reg) {
+    int pos = REG_POS(reg);
+    addOp(compiler, REG_IS_RELATIVE(reg) ? STORE_LOCAL_INT_DISCARD : STORE_GLOBAL_INT_DISCARD);
+    ADD_INT(pos);
+}
+
+static void compileNode(Compiler* compiler, ASTNode* node);
+
+// Pushes the arguments of a call to a subroutine, with references for BYREF parameters, and
+// calls it. A tail call replaces the current frame instead, so it does not count towards
+// --frames, unless a BYREF argument points into that frame. A BYREF parameter passed on as BYREF hands over the reference it holds.
+// Returns whether a tail call was emitted.
+static bool compileCall(Compiler* compiler, Symbol* callable, ASTNodeArray* arguments, bool tail) {
+    ASTNodeArray* parameters = &callable->node->as.SubroutineStmt.parameters;
+
+    for (int i = 0; i < arguments->count; i++) {
+        if (!parameters->start[i]->as.Parameter.byref) {
+            compileNode(compiler, arguments->start[i]);
+            continue;
+        }
+
+        char* name = extractNullTerminatedString(arguments->start[i]->as.VariableExpr.name->start, arguments->start[i]->as.VariableExpr.name->length);
+        Symbol symbol;
+        bool res = findSymbol(compiler, name, &symbol);
+        free(name);
+        if (!res) {
+            printf("Something went wrong. This shouldn't be able to happen.\n");
+            break;
+        }
+
+        addOp(compiler, LOAD_INT);
+        ADD_INT(symbol.pos);
+
+        if (symbol.byref) {
+            // A BYREF parameter passed on: its slot already holds the reference, which points
+            // outside the current frame.
+            addOp(compiler, symbol.isRelative ? RFETCH_REF : FETCH_REF);
+        } else if (symbol.isRelative) {
+            addOp(compiler, RGET_REF);
+            tail = false;
+        } else {
+            addOp(compiler, GET_REF);
+        }
+    }
+
+    int argc = arguments->count;
+    addOp(compiler, tail ? TAIL_CALL : DO_CALL);
+    ADD_4BYTE(callable->pos);
+    ADD_INT(argc);
+    return tail;
+}
+
+// In the main program, declarations leave their initial value on the stack, where it becomes
+// the variable's slot. Inside IF, CASE and loop bodies that would change the stack depth on
+// some paths only, so there the slot was reserved before the statement (see compileCompound)
+// and the value is stored into it instead. Subroutines reserve every slot with ENTER.
+static bool slotReserved(Compiler* compiler) {
+    return compiler->nested > 0 || compiler->depth > 0;
+}
+
+static void bindSlot(Compiler* compiler, int pos, bool isRef) {
+    if (!slotReserved(compiler)) return;
+
+    bool isRel = compiler->depth > 0;
+    if (isRef) {
+        addOp(compiler, LOAD_INT);
+        ADD_INT(pos);
+        addOp(compiler, isRel ? RSTORE_REF : STORE_REF);
+        addOp(compiler, POP);
+    } else {
+        addStoreIntDiscard(compiler, REG_OPERAND(pos, isRel));
+    }
+}
+
+// Compiles a statement with nested bodies, reserving one zeroed slot for every variable the
+// bodies declare so that each path through the statement leaves the stack as deep as it was.
+static void compileCompound(Compiler* compiler, ASTNode* node) {
+    // Inside a subroutine, ENTER has already reserved them.
+    bool reserve = compiler->depth == 0;
+    int countPos = 0;
+    if (reserve) {
+        addOp(compiler, LOAD_ZEROS);
+        countPos = getNextPos(compiler->bStream);
+        int zero = 0;
+        ADD_INT(zero);
+    }
+
+    int first = compiler->symbolTable->nextPos;
+    if (reserve) compiler->highWater = first;
+
+    compiler->nested++;
+    compileNode(compiler, node);
+    compiler->nested--;
+
+    if (reserve) {
+        int count = compiler->highWater - first;
+        insertAtPos(compiler->bStream, (count >> 24) & 0xff, countPos);
+        insertAtPos(compiler->bStream, (count >> 16) & 0xff, countPos + 1);
+        insertAtPos(compiler->bStream, (count >> 8) & 0xff, countPos + 2);
+        insertAtPos(compiler->bStream, (count) & 0xff, countPos + 3);
+    }
+
+    // FOR gives its slots back to the symbol table, but they stay on the stack.
+    compiler->symbolTable->nextPos = compiler->highWater;
+}
+
+// Compiles "jump to target unless cond" and returns the position of the target operand for
+// later patching. INTEGER comparisons branch directly instead of going through a BOOLEAN.
+static int compileConditionalJump(Compiler* compiler, ASTNode* cond, int target) {
+    if (compiler->registerMode) {
+        int targetPos = compileRegisterBranch(compiler, cond, target);
+        if (targetPos >= 0) return targetPos;
+    }
+
+    ASTNode* test = unwrapGroups(cond);
+    Instruction branch = B_FALSE;
+
+    if (test->type == EXPR_BINARY && test->as.BinaryExpr.leftType == TYPE_INTEGER && test->as.BinaryExpr.rightType == TYPE_INTEGER) {
+        switch (test->as.BinaryExpr.op) {
+            case LOGIC_EQUAL: branch = BNE_INT; break;
+            case LOGIC_NOT_EQUAL: branch = BEQ_INT; break;
+            case LOGIC_LESS: branch = BGE_INT; break;
+            case LOGIC_LESS_EQUAL: branch = BGT_INT; break;
+            case LOGIC_GREATER: branch = BLE_INT; break;
+            case LOGIC_GREATER_EQUAL: branch = BLT_INT; break;
+            default: break;
+        }
+    }
+
+    if (branch == B_FALSE) {
+        compileNode(compiler, cond);
+    } else {
+        compileNode(compiler, test->as.BinaryExpr.left);
+        compileNode(compiler, test->as.BinaryExpr.right);
+    }
+
+    addOp(compiler, branch);
+    int targetPos = getNextPos(compiler->bStream);
+    ADD_INT(target);
+    return targetPos;
+}
+
+// Starts a line table entry for the code a statement is about to emit.
+static void markLine(Compiler* compiler, ASTNode* node) {
+    LineTable* lines = &compiler->bStream->lines;
+
+    if (lines->count > 0) {
+        LineEntry* last = &lines->entries[lines->count - 1];
+        if (last->line == node->line && last->subroutine == compiler->subroutine) return;
+    }
+
+    addLineEntry(compiler->bStream, getNextPos(compiler->bStream), node->line, node->col, compiler->subroutine);
+}
+
 static void compileNode(Compiler* compiler, ASTNode* node) {
     if (node == NULL) return;
 
+    switch (node->type) {
+        case STMT_BLOCK: case STMT_PROGRAM: case STMT_CASE_BLOCK: case STMT_SUBROUTINE: break;
+        default:
+            if (node->type > STMT_BLOCK && node->type <= STMT_WRITEFILE) markLine(compiler, node);
+            break;
+    }
+
+    if (compiler->nested == 0) {
+        switch (node->type) {
+            case STMT_IF: case STMT_WHILE: case STMT_REPEAT: case STMT_FOR: case STMT_CASE:
+                compileCompound(compiler, node);
+                return;
+            default: break;
+        }
+    }
+
+    // Only blocks and IF pass the tail position on to the statements they end with.
+    bool tail = compiler->inTail;
+    compiler->inTail = false;
+
     switch (node->type) {
         case EXPR_LITERAL: {
             switch (node->as.LiteralExpr.resultType) {
@@ -166,33 +552,7 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
                 break;
             }
 
-            addOp(compiler, CALL_SUB);
-            for (int i = 0; i < node->as.CallExpr.arguments.count; i++) {
-                if (callable.node->as.SubroutineStmt.parameters.start[i]->as.Parameter.byref) {
-                    name = extractNullTerminatedString(node->as.CallExpr.arguments.start[i]->as.VariableExpr.name->start, node->as.CallExpr.arguments.start[i]->as.VariableExpr.name->length);
-                    Symbol symbol;
-                    res = findSymbol(compiler, name, &symbol);
-                    if (!res) {
-                        printf("Something went wrong. This shouldn't be able to happen.\n");
-                        break;
-                    }
-                    free(name);
-
-                    addOp(compiler, LOAD_INT);
-                    ADD_INT(symbol.pos);
-
-                    if (symbol.isRelative) {
-                        addOp(compiler, RGET_REF);
-                    } else {
-                        addOp(compiler, GET_REF);
-                    }
-                } else {
-                    compileNode(compiler, node->as.CallExpr.arguments.start[i]);
-                }
-            }
-
-            addOp(compiler, DO_CALL);
-            ADD_4BYTE(callable.pos);
+            compileCall(compiler, &callable, &node->as.CallExpr.arguments, false);
 
             break;
         }
@@ -201,6 +561,12 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
             break;
         }
         case EXPR_VARIABLE:{
+            int reg;
+            if (!node->as.VariableExpr.assigned && slotOperand(compiler, node, TYPE_INTEGER, false, &reg)) {
+                addFetchInt(compiler, reg);
+                break;
+            }
+
             char* name = extractNullTerminatedString(node->as.VariableExpr.name->start, node->as.VariableExpr.name->length);
             Symbol var;
             bool res = findSymbol(compiler, name, &var);
@@ -722,25 +1088,32 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
         }
         case STMT_BLOCK: {
             for (int i = 0; i < node->as.BlockStmt.body.count; i++) {
+                compiler->inTail = tail && i == node->as.BlockStmt.body.count - 1;
                 compileNode(compiler, node->as.BlockStmt.body.start[i]);
             }
             break;
         }
         case STMT_EXPR: {
+            if (compiler->registerMode && compileRegisterAssign(compiler, node->as.ExprStmt.expr)) break;
+
+            ASTNode* expr = node->as.ExprStmt.expr;
+            int reg;
+            if (expr->type == EXPR_ASSIGN && slotOperand(compiler, expr->as.AssignmentExpr.left, TYPE_INTEGER, true, &reg)) {
+                compileNode(compiler, expr->as.AssignmentExpr.right);
+                addStoreIntDiscard(compiler, reg);
+                break;
+            }
+
             compileNode(compiler, node->as.ExprStmt.expr);
 
             switch (node->as.ExprStmt.resultType) {
                 case TYPE_INTEGER:
-                    addOp(compiler, POP_4B);
-                    break;
                 case TYPE_REAL:
                 case TYPE_STRING:
                 case TYPE_ARRAY:
-                    addOp(compiler, POP_8B);
-                    break;
                 case TYPE_BOOLEAN:
                 case TYPE_CHAR:
-                    addOp(compiler, POP_1B);
+                    addOp(compiler, POP);
                     break;
                 default: break;
             }
@@ -756,19 +1129,43 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
             addSubroutineSymbol(compiler, name, node, getNextPos(compiler->bStream));
             initialiseSymbol(compiler, name);
 
+            int outerSubroutine = compiler->subroutine;
+            compiler->subroutine = addSubroutineName(compiler->bStream, node->as.SubroutineStmt.name->start, node->as.SubroutineStmt.name->length);
+            markLine(compiler, node);
+
             createScope(compiler, node->as.SubroutineStmt.subroutineType == TYPE_FUNCTION ? SCOPE_FUNCTION : SCOPE_PROCEDURE);
+            int outerHighWater = compiler->highWater;
+            compiler->highWater = 0;
 
             for (int i = 0; i < node->as.SubroutineStmt.parameters.count; i++) {
                 compileNode(compiler, node->as.SubroutineStmt.parameters.start[i]);
             }
 
+            // The arguments are already in place. ENTER zeroes a slot for every local the body
+            // declares, patched in once the body is compiled.
+            int argc = compiler->symbolTable->nextPos;
+            addOp(compiler, ENTER);
+            int enterPos = getNextPos(compiler->bStream);
+            ADD_INT(zero);
+
+            // A CALL that ends a procedure can hand its frame over to the callee.
+            compiler->inTail = node->as.SubroutineStmt.subroutineType == TYPE_PROCEDURE;
             compileNode(compiler, node->as.SubroutineStmt.body);
 
             if (node->as.SubroutineStmt.subroutineType == TYPE_PROCEDURE) {
                 addOp(compiler, RETURN_NIL);
             }
 
+            int locals = compiler->highWater - argc;
+            insertAtPos(compiler->bStream, (locals >> 24) & 0xff, enterPos);
+            insertAtPos(compiler->bStream, (locals >> 16) & 0xff, enterPos + 1);
+            insertAtPos(compiler->bStream, (locals >> 8) & 0xff, enterPos + 2);
+            insertAtPos(compiler->bStream, (locals) & 0xff, enterPos + 3);
+            compiler->highWater = outerHighWater;
+
+            compiler->subroutine = outerSubroutine;
             int jumpPos = getNextPos(compiler->bStream);
+            addLineEntry(compiler->bStream, jumpPos, node->line, node->col, compiler->subroutine);
             insertAtPos(compiler->bStream, (jumpPos >> 24) & 0xff, branchPos);
             insertAtPos(compiler->bStream, (jumpPos >> 16) & 0xff, branchPos + 1);
             insertAtPos(compiler->bStream, (jumpPos >> 8) & 0xff, branchPos + 2);
@@ -779,12 +1176,10 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
             break;
         }
         case STMT_IF: {
-            compileNode(compiler, node->as.IfStmt.condition);
-            addOp(compiler, B_FALSE);
             int zero = 0;
-            int elseJumpPos = getNextPos(compiler->bStream);
-            ADD_INT(zero);
+            int elseJumpPos = compileConditionalJump(compiler, node->as.IfStmt.condition, zero);
 
+            compiler->inTail = tail;
             compileNode(compiler, node->as.IfStmt.thenBranch);
 
             addOp(compiler, BRANCH);
@@ -797,6 +1192,7 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
             insertAtPos(compiler->bStream, (elseJumpTargetPos) & 0xff, elseJumpPos + 3);
 
             if (node->as.IfStmt.elseBranch != NULL) {
+                compiler->inTail = tail;
                 compileNode(compiler, node->as.IfStmt.elseBranch);
             }
             int endThenTargetPos = getNextPos(compiler->bStream);
@@ -921,54 +1317,41 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
 
             switch (node->as.InputStmt.expectedType) {
                 case TYPE_INTEGER:
-                    addOp(compiler, POP_4B);
-                    break;
                 case TYPE_REAL:
                 case TYPE_STRING:
                 case TYPE_ARRAY:
-                    addOp(compiler, POP_8B);
-                    break;
                 case TYPE_CHAR:
                 case TYPE_BOOLEAN:
-                    addOp(compiler, POP_1B);
+                    addOp(compiler, POP);
                     break;
                 default: break;
             }
             break;
         }
         case STMT_RETURN: {
-            compileNode(compiler, node->as.ReturnStmt.expr);
-
-            addOp(compiler, RETURN);
-
-            int size = 0;
-            switch (node->as.ReturnStmt.returnType) {
-                case TYPE_INTEGER:
-                    size = 4;
+            ASTNode* expr = unwrapGroups(node->as.ReturnStmt.expr);
+            if (expr->type == EXPR_CALL) {
+                char* name = extractNullTerminatedString(expr->as.CallExpr.name->start, expr->as.CallExpr.name->length);
+                Symbol callable;
+                bool res = findSymbol(compiler, name, &callable);
+                free(name);
+
+                if (res && callable.type != SYMBOL_BUILTIN_FUNC) {
+                    if (!compileCall(compiler, &callable, &expr->as.CallExpr.arguments, true)) addOp(compiler, RETURN);
                     break;
-                case TYPE_REAL:
-                case TYPE_STRING:
-                case TYPE_ARRAY:
-                    size = 8;
-                    break;
-                case TYPE_BOOLEAN:
-                case TYPE_CHAR:
-                    size = 1;
-                    break;
-                default: break;
+                }
             }
 
-            ADD_BYTE(size);
+            compileNode(compiler, node->as.ReturnStmt.expr);
+
+            addOp(compiler, RETURN);
 
             break;
         }
         case STMT_WHILE: {
             int condStartPos = getNextPos(compiler->bStream);
-            compileNode(compiler, node->as.WhileStmt.condition);
-            addOp(compiler, B_FALSE);
             int zero = 0;
-            int falseJump = getNextPos(compiler->bStream);
-            ADD_INT(zero);
+            int falseJump = compileConditionalJump(compiler, node->as.WhileStmt.condition, zero);
             compileNode(compiler, node->as.WhileStmt.body);
             addOp(compiler, BRANCH);
             ADD_INT(condStartPos);
@@ -984,11 +1367,17 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
         case STMT_VAR_DECLARE: {
             char* name = extractNullTerminatedString(node->as.VarDeclareStmt.name->start, node->as.VarDeclareStmt.name->length);
 
-            int size = 0;
+            // ENTER zeroed the slot, and at the top level of the body it is never reused.
+            if (compiler->depth > 0 && compiler->nested == 0) {
+                addSymbol(compiler, name, node, SYMBOL_VAR, true, false);
+                free(name);
+                break;
+            }
+
             int zero = 0;
+            double zeroReal = 0;
             switch (node->as.VarDeclareStmt.type) {
                 case TYPE_INTEGER:
-                    size = 4;
                     addOp(compiler, LOAD_INT);
                     ADD_INT(zero);
                     break;
@@ -996,19 +1385,18 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
                 case TYPE_STRING:
                 case TYPE_ARRAY:
                     addOp(compiler, LOAD_REAL);
-                    ADD_REAL(zero);
-                    size = 8;
+                    ADD_REAL(zeroReal);
                     break;
                 case TYPE_BOOLEAN:
                 case TYPE_CHAR:
                     addOp(compiler, LOAD_CHAR);
                     ADD_CHAR(zero);
-                    size = 1;
                     break;
                 default: break;
             }
 
-            addSymbol(compiler, name, node, SYMBOL_VAR, compiler->depth > 0, false, size);
+            bindSlot(compiler, compiler->symbolTable->nextPos, false);
+            addSymbol(compiler, name, node, SYMBOL_VAR, compiler->depth > 0, false);
 
             free(name);
 
@@ -1017,24 +1405,8 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
         case STMT_CONST_DECLARE: {
             char* name = extractNullTerminatedString(node->as.ConstDeclareStmt.name->start, node->as.ConstDeclareStmt.name->length);
 
-            int size = 0;
-            switch (node->as.ConstDeclareStmt.type) {
-                case TYPE_INTEGER:
-                    size = 4;
-                    break;
-                case TYPE_REAL:
-                case TYPE_STRING:
-                case TYPE_ARRAY:
-                    size = 8;
-                    break;
-                case TYPE_BOOLEAN:
-                case TYPE_CHAR:
-                    size = 1;
-                    break;
-                default: break;
-            }
-
-            addSymbol(compiler, name, node, SYMBOL_CONST, compiler->depth > 0, false, size);
+            int constPos = compiler->symbolTable->nextPos;
+            addSymbol(compiler, name, node, SYMBOL_CONST, compiler->depth > 0, false);
 
             free(name);
 
@@ -1138,9 +1510,11 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
                 default: break;
             }
 
+            bindSlot(compiler, constPos, node->as.ConstDeclareStmt.type == TYPE_STRING);
+
             /*switch (node->as.ConstDeclareStmt.type) {
                 case TYPE_INTEGER:
-                    addOp(compiler, POP_4B);
+                    addOp(compiler, POP);
                     break;
                 case TYPE_REAL:
                 case TYPE_STRING:
@@ -1159,9 +1533,9 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
         case STMT_ARRAY_DECLARE: {
             char* name = extractNullTerminatedString(node->as.ArrayDeclareStmt.name->start, node->as.ArrayDeclareStmt.name->length);
 
-            addSymbol(compiler, name, node, SYMBOL_ARRAY, compiler->depth > 0, false, 8);
+            int arrayPos = compiler->symbolTable->nextPos;
+            addSymbol(compiler, name, node, SYMBOL_ARRAY, compiler->depth > 0, false);
 
-            int pos = compiler->symbolTable->nextPos - 8;
             int zero = 0;
 
             for (int i = 0; i < 4; i++) {
@@ -1195,6 +1569,7 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
             ADD_INT(size);
 
             addOp(compiler, CREATE_ARRAY);
+            bindSlot(compiler, arrayPos, true);
 
             /*addOp(compiler, LOAD_INT);
             ADD_INT(pos);
@@ -1208,6 +1583,7 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
             break;
         }
         case STMT_CASE: {
+            int outerCaseJumpPos = compiler->lastCaseJumpPos;
             compiler->lastCaseJumpPos = -1;
 
             compileNode(compiler, node->as.CaseStmt.expr);
@@ -1217,7 +1593,19 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
 
             compileNode(compiler, node->as.CaseStmt.body);
 
-            compiler->lastCaseJumpPos = -1;
+            // Without OTHERWISE, no line matching leaves the value on the stack, and the last
+            // line that matched still has to jump past the POP.
+            if (compiler->lastCaseJumpPos >= 0) {
+                addOp(compiler, POP);
+
+                int pos = getNextPos(compiler->bStream);
+                insertAtPos(compiler->bStream, (pos >> 24) & 0xff, compiler->lastCaseJumpPos);
+                insertAtPos(compiler->bStream, (pos >> 16) & 0xff, compiler->lastCaseJumpPos + 1);
+                insertAtPos(compiler->bStream, (pos >> 8) & 0xff, compiler->lastCaseJumpPos + 2);
+                insertAtPos(compiler->bStream, (pos) & 0xff, compiler->lastCaseJumpPos + 3);
+            }
+
+            compiler->lastCaseJumpPos = outerCaseJumpPos;
             break;
         }
         case STMT_REPEAT: {
@@ -1225,10 +1613,7 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
 
             compileNode(compiler, node->as.RepeatStmt.body);
 
-            compileNode(compiler, node->as.RepeatStmt.condition);
-
-            addOp(compiler, B_FALSE);
-            ADD_INT(first);
+            compileConditionalJump(compiler, node->as.RepeatStmt.condition, first);
 
             break;
         }
@@ -1253,31 +1638,42 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
                 pos = compiler->symbolTable->nextPos;
                 isRel = compiler->depth > 0;
                 byref = false;
-                addSymbol(compiler, name, node, SYMBOL_FOR_COUNTER,isRel, byref, 4);
-                int zero = 0;
-                addOp(compiler, LOAD_INT);
-                ADD_INT(zero);
+                // The slot was reserved by compileCompound.
+                addSymbol(compiler, name, node, SYMBOL_FOR_COUNTER, isRel, byref);
             }
 
-            compileNode(compiler, node->as.ForStmt.init);
-            addOp(compiler, LOAD_INT);
-            ADD_INT(pos);
-            if (byref) {
-                if (isRel) {
-                    addOp(compiler, RFETCH_REF);
-                } else {
-                    addOp(compiler, FETCH_REF);
-                }
-
-                addOp(compiler, STORE_REF_INT);
+            bool useRegisters = compiler->registerMode && !byref;
+            int counterReg = REG_OPERAND(pos, isRel);
+            int operand;
+
+            if (useRegisters && slotOperand(compiler, node->as.ForStmt.init, TYPE_INTEGER, false, &operand)) {
+                addRegisterOp(compiler, MOVE_R, counterReg, operand);
+            } else if (useRegisters && intImmediate(node->as.ForStmt.init, &operand)) {
+                addRegisterOp(compiler, LOADK_INT_R, counterReg, operand);
+            } else if (!byref) {
+                compileNode(compiler, node->as.ForStmt.init);
+                addStoreIntDiscard(compiler, counterReg);
             } else {
-                if (isRel) {
-                    addOp(compiler,  RSTORE_INT);
+                compileNode(compiler, node->as.ForStmt.init);
+                addOp(compiler, LOAD_INT);
+                ADD_INT(pos);
+                if (byref) {
+                    if (isRel) {
+                        addOp(compiler, RFETCH_REF);
+                    } else {
+                        addOp(compiler, FETCH_REF);
+                    }
+
+                    addOp(compiler, STORE_REF_INT);
                 } else {
-                    addOp(compiler, STORE_INT);
+                    if (isRel) {
+                        addOp(compiler,  RSTORE_INT);
+                    } else {
+                        addOp(compiler, STORE_INT);
+                    }
                 }
+                addOp(compiler, POP);
             }
-            addOp(compiler, POP_4B);
 
             int sign = 1;
             int step = 1;
@@ -1302,82 +1698,109 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
             //
 
             int condStartPos = getNextPos(compiler->bStream);
+            int zero = 0;
+            int falseJump = -1;
 
-            addOp(compiler, LOAD_INT);
-            ADD_INT(pos);
-            if (byref) {
-                if (isRel) {
-                    addOp(compiler, RFETCH_REF);
+            if (useRegisters && slotOperand(compiler, node->as.ForStmt.end, TYPE_INTEGER, false, &operand)) {
+                addRegisterOp(compiler, step < 0 ? BLT_INT_RR : BGT_INT_RR, counterReg, operand);
+                falseJump = getNextPos(compiler->bStream);
+                ADD_INT(zero);
+            } else if (useRegisters && intImmediate(node->as.ForStmt.end, &operand)) {
+                addRegisterOp(compiler, step < 0 ? BLT_INT_RK : BGT_INT_RK, counterReg, operand);
+                falseJump = getNextPos(compiler->bStream);
+                ADD_INT(zero);
+            } else if (!byref) {
+                addFetchInt(compiler, counterReg);
+                compileNode(compiler, node->as.ForStmt.end);
+                addOp(compiler, step < 0 ? BLT_INT : BGT_INT);
+                falseJump = getNextPos(compiler->bStream);
+                ADD_INT(zero);
+            } else {
+                addOp(compiler, LOAD_INT);
+                ADD_INT(pos);
+                if (byref) {
+                    if (isRel) {
+                        addOp(compiler, RFETCH_REF);
+                    } else {
+                        addOp(compiler, FETCH_REF);
+                    }
+
+                    addOp(compiler, FETCH_REF_INT);
                 } else {
-                    addOp(compiler, FETCH_REF);
+                    if (isRel) {
+                        addOp(compiler,  RFETCH_INT);
+                    } else {
+                        addOp(compiler, FETCH_INT);
+                    }
                 }
 
-                addOp(compiler, FETCH_REF_INT);
-            } else {
-                if (isRel) {
-                    addOp(compiler,  RFETCH_INT);
+                compileNode(compiler, node->as.ForStmt.end);
+
+                if (step < 0) {
+                    addOp(compiler, GREATER_EQ_INT);
                 } else {
-                    addOp(compiler, FETCH_INT);
+                    addOp(compiler, LESS_EQ_INT);
                 }
-            }
-
-            compileNode(compiler, node->as.ForStmt.end);
 
-            if (step < 0) {
-                addOp(compiler, GREATER_EQ_INT);
-            } else {
-                addOp(compiler, LESS_EQ_INT);
+                addOp(compiler, B_FALSE);
+                falseJump = getNextPos(compiler->bStream);
+                ADD_INT(zero);
             }
 
-            addOp(compiler, B_FALSE);
-            int zero = 0;
-            int falseJump = getNextPos(compiler->bStream);
-            ADD_INT(zero);
-
             compileNode(compiler, node->as.ForStmt.body);
 
-            addOp(compiler, LOAD_INT);
-            ADD_INT(pos);
-            if (byref) {
-                if (isRel) {
-                    addOp(compiler, RFETCH_REF);
-                } else {
-                    addOp(compiler, FETCH_REF);
-                }
-
-                addOp(compiler, FETCH_REF_INT);
+            if (useRegisters) {
+                addRegisterOp3(compiler, ADD_INT_RK, counterReg, counterReg, step);
+            } else if (!byref) {
+                addFetchInt(compiler, counterReg);
+                addOp(compiler, LOAD_INT);
+                ADD_INT(step);
+                addOp(compiler, ADD_INT);
+                addStoreIntDiscard(compiler, counterReg);
             } else {
-                if (isRel) {
-                    addOp(compiler,  RFETCH_INT);
+                addOp(compiler, LOAD_INT);
+                ADD_INT(pos);
+                if (byref) {
+                    if (isRel) {
+                        addOp(compiler, RFETCH_REF);
+                    } else {
+                        addOp(compiler, FETCH_REF);
+                    }
+
+                    addOp(compiler, FETCH_REF_INT);
                 } else {
-                    addOp(compiler, FETCH_INT);
+                    if (isRel) {
+                        addOp(compiler,  RFETCH_INT);
+                    } else {
+                        addOp(compiler, FETCH_INT);
+                    }
                 }
-            }
 
-            addOp(compiler, LOAD_INT);
-            ADD_INT(step);
+                addOp(compiler, LOAD_INT);
+                ADD_INT(step);
 
-            addOp(compiler, ADD_INT);
+                addOp(compiler, ADD_INT);
 
-            addOp(compiler, LOAD_INT);
-            ADD_INT(pos);
-            if (byref) {
-                if (isRel) {
-                    addOp(compiler, RFETCH_REF);
-                } else {
-                    addOp(compiler, FETCH_REF);
-                }
+                addOp(compiler, LOAD_INT);
+                ADD_INT(pos);
+                if (byref) {
+                    if (isRel) {
+                        addOp(compiler, RFETCH_REF);
+                    } else {
+                        addOp(compiler, FETCH_REF);
+                    }
 
-                addOp(compiler, STORE_REF_INT);
-            } else {
-                if (isRel) {
-                    addOp(compiler,  RSTORE_INT);
+                    addOp(compiler, STORE_REF_INT);
                 } else {
-                    addOp(compiler, STORE_INT);
+                    if (isRel) {
+                        addOp(compiler,  RSTORE_INT);
+                    } else {
+                        addOp(compiler, STORE_INT);
+                    }
                 }
-            }
 
-            addOp(compiler, POP_4B);
+                addOp(compiler, POP);
+            }
 
             addOp(compiler, BRANCH);
             ADD_INT(condStartPos);
@@ -1389,9 +1812,6 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
             insertAtPos(compiler->bStream, (endPos) & 0xff, falseJump + 3);
             //
 
-            if (!res) {
-                addOp(compiler, POP_4B);
-            }
             clearTable(compiler->symbolTable);
             copyOverTable(&symbolTable, compiler->symbolTable);
             freeTable(&symbolTable);
@@ -1407,39 +1827,14 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
                 break;
             }
             free(name);
-            addOp(compiler, CALL_SUB);
-            for (int i = 0; i < node->as.CallStmt.arguments.count; i++) {
-                if (callable.node->as.SubroutineStmt.parameters.start[i]->as.Parameter.byref) {
-                    name = extractNullTerminatedString(node->as.CallStmt.arguments.start[i]->as.VariableExpr.name->start, node->as.CallStmt.arguments.start[i]->as.VariableExpr.name->length);
-                    Symbol symbol;
-                    res = findSymbol(compiler, name, &symbol);
-                    if (!res) {
-                        printf("Something went wrong. This shouldn't be able to happen.\n");
-                        break;
-                    }
-                    free(name);
-
-                    addOp(compiler, LOAD_INT);
-                    ADD_INT(symbol.pos);
-
-                    if (symbol.isRelative) {
-                        addOp(compiler, RGET_REF);
-                    } else {
-                        addOp(compiler, GET_REF);
-                    }
-                } else {
-                    compileNode(compiler, node->as.CallStmt.arguments.start[i]);
-                }
-            }
 
-            addOp(compiler, DO_CALL);
-            ADD_4BYTE(callable.pos);
+            compileCall(compiler, &callable, &node->as.CallStmt.arguments, tail);
 
             break;
         }
         case STMT_CASE_LINE: {
             if (node->as.CaseLineStmt.value == NULL) {
-                addOp(compiler, POP_4B);
+                addOp(compiler, POP);
                 compileNode(compiler, node->as.CaseLineStmt.result);
 
                 if (compiler->lastCaseJumpPos >= 0) {
@@ -1448,6 +1843,7 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
                     insertAtPos(compiler->bStream, (pos >> 16) & 0xff, compiler->lastCaseJumpPos + 1);
                     insertAtPos(compiler->bStream, (pos >> 8) & 0xff, compiler->lastCaseJumpPos + 2);
                     insertAtPos(compiler->bStream, (pos) & 0xff, compiler->lastCaseJumpPos + 3);
+                    compiler->lastCaseJumpPos = -1;
                 }
             } else {
                 addOp(compiler, COPY_INT);
@@ -1463,7 +1859,7 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
                 int zero = 0;
                 ADD_INT(zero);
 
-                addOp(compiler, POP_4B);
+                addOp(compiler, POP);
                 compileNode(compiler, node->as.CaseLineStmt.result);
 
                 if (compiler->lastCaseJumpPos >= 0) {
@@ -1494,6 +1890,7 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
         case STMT_OPENFILE: {
             char* filename = extractNullTerminatedString(node->as.OpenfileStmt.filename->start, node->as.OpenfileStmt.filename->length);
 
+            int filePos = compiler->symbolTable->nextPos;
             addFile(compiler, filename, node, SYMBOL_FILE, compiler->depth > 0, false, node->as.OpenfileStmt.accessType);
 
             free(filename);
@@ -1508,6 +1905,7 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
             ADD_INT(node->as.OpenfileStmt.accessType);
 
             addOp(compiler, OPENFILE);
+            bindSlot(compiler, filePos, true);
 
             break;
         }
@@ -1520,7 +1918,6 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
                 printf("Something went wrong. This shouldn't be able to happen.\n");
                 break;
             }
-            free(filename);
 
             addOp(compiler, LOAD_INT);
             ADD_INT(file.pos);
@@ -1532,6 +1929,7 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
             }
 
             deleteTable(compiler->symbolTable, filename);
+            free(filename);
 
             addOp(compiler, CLOSEFILE);
 
@@ -1584,6 +1982,7 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
             } else {
                 addOp(compiler, STORE_REF);
             }
+            addOp(compiler, POP);
 
             free(name);
 
@@ -1658,30 +2057,8 @@ static void compileNode(Compiler* compiler, ASTNode* node) {
         case AST_PARAMETER: {
             bool byref = node->as.Parameter.byref;
 
-            int size = 0;
-
-            if (node->as.Parameter.isArray || node->as.Parameter.byref) {
-                size = 8;
-            } else {
-                switch (node->as.Parameter.type) {
-                    case TYPE_INTEGER:
-                        size = 4;
-                        break;
-                    case TYPE_REAL:
-                    case TYPE_ARRAY:
-                    case TYPE_STRING:
-                        size = 8;
-                        break;
-                    case TYPE_CHAR:
-                    case TYPE_BOOLEAN:
-                        size = 1;
-                        break;
-                    default: break;
-                }
-            }
-
             char* name = extractNullTerminatedString(node->as.Parameter.name->start, node->as.Parameter.name->length);
-            addSymbol(compiler, name, node, SYMBOL_PARAM, true, byref, size);
+            addSymbol(compiler, name, node, SYMBOL_PARAM, true, byref);
 
             free(name);
 
@@ -1699,6 +2076,11 @@ void initCompiler(Compiler* compiler, BytecodeStream* bStream) {
     compiler->bStream = bStream;
     compiler->stackPos = 0;
     compiler->lastCaseJumpPos = -1;
+    compiler->nested = 0;
+    compiler->highWater = 0;
+    compiler->subroutine = -1;
+    compiler->inTail = false;
+    compiler->registerMode = false;
 }
 
 void freeCompiler(Compiler* compiler) {
@@ -1715,48 +2097,48 @@ bool compile(Compiler* compiler, AST* ast) {
     addParamDatatype(&substring, TYPE_STRING, 0);
     addParamDatatype(&substring, TYPE_INTEGER, 1);
     addParamDatatype(&substring, TYPE_INTEGER, 2);
-    addSymbol(compiler, "SUBSTRING", (ASTNode*)&substring, SYMBOL_BUILTIN_FUNC, false, false, 0);
+    addBuiltinSymbol(compiler, "SUBSTRING", &substring);
 
     Builtin length;
     createBuiltin(&length, 1, TYPE_INTEGER, 1);
     addParamDatatype(&length, TYPE_STRING, 0);
-    addSymbol(compiler, "LENGTH", (ASTNode*)&length, SYMBOL_BUILTIN_FUNC, false, false, 0);
+    addBuiltinSymbol(compiler, "LENGTH", &length);
 
     Builtin lcase;
     createBuiltin(&lcase, 1, TYPE_STRING, 2);
     addParamDatatype(&lcase, TYPE_STRING, 0);
-    addSymbol(compiler, "LCASE", (ASTNode*)&lcase, SYMBOL_BUILTIN_FUNC, false, false, 0);
+    addBuiltinSymbol(compiler, "LCASE", &lcase);
 
     Builtin ucase;
     createBuiltin(&ucase, 1, TYPE_STRING, 3);
     addParamDatatype(&ucase, TYPE_STRING, 0);
-    addSymbol(compiler, "UCASE", (ASTNode*)&lcase, SYMBOL_BUILTIN_FUNC, false, false, 0);
+    addBuiltinSymbol(compiler, "UCASE", &ucase);
 
     Builtin randomBetween;
     createBuiltin(&randomBetween, 2, TYPE_INTEGER, 4);
     addParamDatatype(&randomBetween, TYPE_INTEGER, 0);
     addParamDatatype(&randomBetween, TYPE_INTEGER, 1);
-    addSymbol(compiler, "RANDOMBETWEEN", (ASTNode*)&randomBetween, SYMBOL_BUILTIN_FUNC, false, false, 0);
+    addBuiltinSymbol(compiler, "RANDOMBETWEEN", &randomBetween);
 
     Builtin rnd;
     createBuiltin(&rnd, 0, TYPE_REAL, 5);
-    addSymbol(compiler, "RND", (ASTNode*)&rnd, SYMBOL_BUILTIN_FUNC, false, false, 0);
+    addBuiltinSymbol(compiler, "RND", &rnd);
 
     Builtin integer;
     createBuiltin(&integer, 1, TYPE_INTEGER, 6);
     addParamDatatype(&integer, TYPE_REAL, 0);
-    addSymbol(compiler, "INT", (ASTNode*)&integer, SYMBOL_BUILTIN_FUNC, false, false, 0);
+    addBuiltinSymbol(compiler, "INT", &integer);
 
     Builtin eof;
     createBuiltin(&eof, 1, TYPE_BOOLEAN, 7);
     addParamDatatype(&eof, TYPE_STRING, 0);
-    addSymbol(compiler, "EOF", (ASTNode*)&eof, SYMBOL_BUILTIN_FUNC, false, false, 0);
+    addBuiltinSymbol(compiler, "EOF", &eof);
 
     Builtin charAt;
     createBuiltin(&charAt, 2, TYPE_CHAR, 8);
     addParamDatatype(&charAt, TYPE_STRING, 0);
     addParamDatatype(&charAt, TYPE_INTEGER, 1);
-    addSymbol(compiler, "CHARAT", (ASTNode*)&charAt, SYMBOL_BUILTIN_FUNC, false, false, 0);
+    addBuiltinSymbol(compiler, "CHARAT", &charAt);
     //
 
     initBytecodeStream(compiler->bStream);
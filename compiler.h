@@ -14,6 +14,13 @@ typedef struct {
     BytecodeStream* bStream;
     int stackPos;
     int lastCaseJumpPos;
+    int nested;             // Depth of IF, CASE and loop bodies being compiled.
+    int highWater;          // Most slots in use at once inside the outermost of those.
+    int subroutine;         // Line table index of the subroutine being compiled, -1 in the main program.
+    bool inTail;            // The next statement ends the procedure, so a CALL there may be a tail call.
+    // Emit register forms, which work on variable slots directly, for assignments, loop counters
+    // and INTEGER comparisons on plain variables. Everything else still uses the stack.
+    bool registerMode;
 } Compiler;
 
 void initCompiler(Compiler* compiler, BytecodeStream* bStream);
@@ -0,0 +1,510 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+
+#include "daemon.h"
+
+#ifdef DAEMON_AVAILABLE
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define CLIENT_STREAMS  3   // stdin, stdout and stderr.
+#define CLIENT_FDS      4   // The streams, then the client's working directory.
+
+// Modification and status change times with nanoseconds.
+#ifdef __APPLE__
+#define MODIFIED_TIME(st)   ((st)->st_mtimespec)
+#define CHANGED_TIME(st)    ((st)->st_ctimespec)
+#else
+#define MODIFIED_TIME(st)   ((st)->st_mtim)
+#define CHANGED_TIME(st)    ((st)->st_ctim)
+#endif
+
+typedef struct {
+    char* path;
+    struct stat file;       // When it was loaded, to tell whether it changed since.
+    PseudoProgram* program;
+    PseudoVM* idle[DAEMON_IDLE_VMS];
+    int idleCount;
+    int users;              // Jobs running it right now.
+    bool evicted;           // No longer in the cache; its last user frees it.
+    byte8 lastUsed;
+} CachedProgram;
+
+typedef struct {
+    PseudoOptions options;
+    pthread_mutex_t lock;
+    CachedProgram* cache[DAEMON_CACHED_PROGRAMS];
+    int cached;
+    byte8 clock;            // Ticks once per job, for evicting the least recently used program.
+} Daemon;
+
+typedef struct {
+    Daemon* daemon;
+    int fd;
+} Connection;
+
+// For the handler that removes the socket when the daemon is stopped.
+static const char* listeningPath = NULL;
+
+static void stopDaemon(int sig) {
+    (void)sig;
+    if (listeningPath != NULL) unlink(listeningPath);
+    _exit(0);
+}
+
+static bool hasExtension(const char* path, const char* extension) {
+    size_t length = strlen(path);
+    size_t extensionLength = strlen(extension);
+    return length > extensionLength && strcmp(path + length - extensionLength, extension) == 0;
+}
+
+static PseudoProgram* loadProgram(const char* path, const PseudoOptions* options) {
+    if (hasExtension(path, ".pcbc")) return pseudoLoad(path);
+
+    char* source = readSource(path);
+    if (source == NULL) {
+        fprintf(diagnostics(), "Could not open file \"%s\".\n", path);
+        return NULL;
+    }
+
+    PseudoProgram* program = pseudoCompile(source, options);
+    free(source);
+    return program;
+}
+
+static void freeCachedProgram(CachedProgram* entry) {
+    for (int i = 0; i < entry->idleCount; i++) pseudoFreeVM(entry->idle[i]);
+    pseudoFreeProgram(entry->program);
+    free(entry->path);
+    free(entry);
+}
+
+// Takes the entry at index out of the cache. Only called with the lock held.
+static void evict(Daemon* daemon, int index) {
+    CachedProgram* entry = daemon->cache[index];
+    daemon->cache[index] = daemon->cache[--daemon->cached];
+
+    if (entry->users == 0) freeCachedProgram(entry);
+    else entry->evicted = true;
+}
+
+// Makes room for one more program by evicting the least recently used one nobody is running.
+// Only called with the lock held. False if every cached program is in use.
+static bool makeRoom(Daemon* daemon) {
+    if (daemon->cached < DAEMON_CACHED_PROGRAMS) return true;
+
+    int oldest = -1;
+    for (int i = 0; i < daemon->cached; i++) {
+        CachedProgram* entry = daemon->cache[i];
+        if (entry->users == 0 && (oldest < 0 || entry->lastUsed < daemon->cache[oldest]->lastUsed)) oldest = i;
+    }
+
+    if (oldest < 0) return false;
+    evict(daemon, oldest);
+    return true;
+}
+
+static int findCached(Daemon* daemon, const char* path) {
+    for (int i = 0; i < daemon->cached; i++) {
+        if (strcmp(daemon->cache[i]->path, path) == 0) return i;
+    }
+    return -1;
+}
+
+static bool sameTime(struct timespec a, struct timespec b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// Whether the file is still the one that was loaded. Whole-second times would miss an edit in
+// the same second as the last compile, and a file replaced by rename has a new inode.
+static bool unchanged(const struct stat* loaded, const struct stat* now) {
+    return loaded->st_dev == now->st_dev && loaded->st_ino == now->st_ino && loaded->st_size == now->st_size
+        && sameTime(MODIFIED_TIME(loaded), MODIFIED_TIME(now)) && sameTime(CHANGED_TIME(loaded), CHANGED_TIME(now));
+}
+
+// The program at path, compiled or loaded now unless an unchanged copy is cached, along with a
+// VM to run it on. NULL if it could not be loaded, with the reason reported.
+static CachedProgram* acquireProgram(Daemon* daemon, const char* path, const struct stat* file, PseudoVM** vm) {
+    *vm = NULL;
+
+    pthread_mutex_lock(&daemon->lock);
+    int index = findCached(daemon, path);
+    if (index >= 0 && !unchanged(&daemon->cache[index]->file, file)) {
+        evict(daemon, index);
+        index = -1;
+    }
+
+    CachedProgram* entry = NULL;
+    if (index >= 0) {
+        entry = daemon->cache[index];
+        entry->users++;
+        entry->lastUsed = ++daemon->clock;
+        if (entry->idleCount > 0) *vm = entry->idle[--entry->idleCount];
+    }
+    pthread_mutex_unlock(&daemon->lock);
+
+    if (entry == NULL) {
+        // Compiled outside the lock, so one slow compile does not hold up every other job.
+        PseudoProgram* program = loadProgram(path, &daemon->options);
+        if (program == NULL) return NULL;
+
+        entry = (CachedProgram*)calloc(1, sizeof(CachedProgram));
+        char* copy = entry != NULL ? (char*)malloc(strlen(path) + 1) : NULL;
+        if (copy == NULL) {
+            free(entry);
+            pseudoFreeProgram(program);
+            fprintf(diagnostics(), "Not enough memory for the program.\n");
+            return NULL;
+        }
+
+        strcpy(copy, path);
+        entry->path = copy;
+        entry->file = *file;
+        entry->program = program;
+        entry->users = 1;
+
+        // Another job may have cached the same file meanwhile, or the cache may be full of
+        // programs in use; this copy then serves only this job.
+        pthread_mutex_lock(&daemon->lock);
+        entry->lastUsed = ++daemon->clock;
+        if (findCached(daemon, path) < 0 && makeRoom(daemon)) daemon->cache[daemon->cached++] = entry;
+        else entry->evicted = true;
+        pthread_mutex_unlock(&daemon->lock);
+    }
+
+    if (*vm == NULL) *vm = pseudoNewVM(entry->program, &daemon->options);
+    return entry;
+}
+
+static void releaseProgram(Daemon* daemon, CachedProgram* entry, PseudoVM* vm) {
+    // Closes any files the program left open and frees its heap objects before the VM waits.
+    if (vm != NULL) pseudoReset(vm);
+
+    pthread_mutex_lock(&daemon->lock);
+    if (vm != NULL && !entry->evicted && entry->idleCount < DAEMON_IDLE_VMS) {
+        entry->idle[entry->idleCount++] = vm;
+        vm = NULL;
+    }
+    entry->users--;
+    bool unused = entry->evicted && entry->users == 0;
+    pthread_mutex_unlock(&daemon->lock);
+
+    pseudoFreeVM(vm);
+    if (unused) freeCachedProgram(entry);
+}
+
+// Reads the path and the client's descriptors. False if the request is malformed.
+static bool receiveRequest(int fd, char* path, size_t size, int fds[CLIENT_FDS]) {
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(CLIENT_FDS * sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { path, size - 1 };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    for (int i = 0; i < CLIENT_FDS; i++) fds[i] = -1;
+
+    ssize_t got;
+    while ((got = recvmsg(fd, &message, 0)) < 0 && errno == EINTR) {}
+    if (got <= 0) return false;
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (header != NULL && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+        int count = (int)((header->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        int* received = (int*)CMSG_DATA(header);
+        for (int i = 0; i < count; i++) {
+            if (i < CLIENT_FDS) fds[i] = received[i];
+            else close(received[i]);
+        }
+    }
+
+    // The path ends at its terminator, which may arrive in a later read.
+    size_t length = (size_t)got;
+    while (memchr(path, '\0', length) == NULL && length < size - 1) {
+        got = read(fd, path + length, size - 1 - length);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        length += (size_t)got;
+    }
+    path[length] = '\0';
+
+    return fds[CLIENT_FDS - 1] >= 0 && memchr(path, '\0', length) != NULL && path[0] == '/';
+}
+
+static void sendStatus(int fd, const char* status) {
+    char line[64];
+    int length = snprintf(line, sizeof(line), "%s\n", status);
+    ssize_t written;
+    while ((written = write(fd, line, (size_t)length)) < 0 && errno == EINTR) {}
+}
+
+// Opens the client's stream, buffered by line when it is a terminal, as the process's own are.
+static FILE* openStream(int fd, const char* mode) {
+    FILE* stream = fdopen(fd, mode);
+    if (stream == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    if (isatty(fd)) setvbuf(stream, NULL, _IOLBF, BUFSIZ);
+    return stream;
+}
+
+// Runs with files the program opens by a relative name resolved in the client's directory, workDir,
+// as they would be had the client run it itself.
+static const char* runJob(Daemon* daemon, const char* path, int workDir, FILE* in, FILE* out) {
+    struct stat file;
+    if (stat(path, &file) != 0) {
+        fprintf(diagnostics(), "Could not open file \"%s\".\n", path);
+        return "missing-file";
+    }
+
+    PseudoVM* vm;
+    CachedProgram* entry = acquireProgram(daemon, path, &file, &vm);
+    if (entry == NULL) return "compile-error";
+    if (vm == NULL) {
+        fprintf(diagnostics(), "Not enough memory for the VM.\n");
+        releaseProgram(daemon, entry, NULL);
+        return "no-memory";
+    }
+
+    pseudoSetFileDirectory(vm, workDir);
+    PseudoResult result = pseudoRun(vm, in, out);
+    pseudoSetFileDirectory(vm, -1);
+    releaseProgram(daemon, entry, vm);
+
+    if (result == PSEUDO_RUNTIME_ERROR) return "runtime-error";
+    if (result == PSEUDO_INVALID_PROGRAM) return "invalid-program";
+    return "ok";
+}
+
+static void* serveConnection(void* arg) {
+    Connection* connection = (Connection*)arg;
+    Daemon* daemon = connection->daemon;
+    int fd = connection->fd;
+    free(connection);
+
+    char path[PATH_MAX + 1];
+    int fds[CLIENT_FDS];
+    if (!receiveRequest(fd, path, sizeof(path), fds)) {
+        for (int i = 0; i < CLIENT_FDS; i++) {
+            if (fds[i] >= 0) close(fds[i]);
+        }
+        sendStatus(fd, "bad-request");
+        close(fd);
+        return NULL;
+    }
+
+    FILE* in = openStream(fds[0], "rb");
+    FILE* out = openStream(fds[1], "wb");
+    FILE* err = openStream(fds[2], "w");
+    int workDir = fds[CLIENT_STREAMS];
+
+    const char* status = "no-memory";
+    if (in != NULL && out != NULL && err != NULL) {
+        // Compile and runtime errors go to the client too.
+        setDiagnostics(err);
+        status = runJob(daemon, path, workDir, in, out);
+        setDiagnostics(NULL);
+    }
+
+    if (in != NULL) fclose(in);
+    if (out != NULL) fclose(out);
+    if (err != NULL) fclose(err);
+    close(workDir);
+
+    sendStatus(fd, status);
+    close(fd);
+    return NULL;
+}
+
+static bool socketAddress(const char* path, struct sockaddr_un* address) {
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "The socket path \"%s\" is too long.\n", path);
+        return false;
+    }
+
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+bool runDaemon(const char* socketPath, const PseudoOptions* options) {
+    struct sockaddr_un address;
+    if (!socketAddress(socketPath, &address)) return false;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Could not create a socket.\n");
+        return false;
+    }
+
+    // A socket file nobody answers on is left over from a daemon that did not stop cleanly.
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0) {
+        fprintf(stderr, "A daemon is already listening on \"%s\".\n", socketPath);
+        close(fd);
+        return false;
+    }
+    close(fd);
+    unlink(socketPath);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Could not listen on \"%s\".\n", socketPath);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    Daemon daemon;
+    daemon.options = *options;
+    pthread_mutex_init(&daemon.lock, NULL);
+    daemon.cached = 0;
+    daemon.clock = 0;
+
+    // A client that goes away mid-run must not take the daemon with it.
+    signal(SIGPIPE, SIG_IGN);
+    listeningPath = socketPath;
+    signal(SIGINT, stopDaemon);
+    signal(SIGTERM, stopDaemon);
+
+    fprintf(stderr, "Listening on \"%s\".\n", socketPath);
+
+    while (true) {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            fprintf(stderr, "Could not accept a connection.\n");
+            break;
+        }
+
+        Connection* connection = (Connection*)malloc(sizeof(Connection));
+        if (connection == NULL) {
+            close(client);
+            continue;
+        }
+        connection->daemon = &daemon;
+        connection->fd = client;
+
+        pthread_t thread;
+        pthread_attr_t attributes;
+        pthread_attr_init(&attributes);
+        pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attributes, serveConnection, connection) != 0) {
+            // Out of threads: serve this one on the accepting thread.
+            serveConnection(connection);
+        }
+        pthread_attr_destroy(&attributes);
+    }
+
+    close(fd);
+    unlink(socketPath);
+    return false;
+}
+
+int runClient(const char* socketPath, const char* path) {
+    char resolved[PATH_MAX + 1];
+    if (realpath(path, resolved) == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        return 1;
+    }
+
+    struct sockaddr_un address;
+    if (!socketAddress(socketPath, &address)) return 1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "No daemon is listening on \"%s\".\n", socketPath);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+
+    // The daemon opens the program's files relative to our directory rather than its own.
+#ifdef O_PATH
+    int workDir = open(".", O_PATH | O_DIRECTORY);
+#else
+    int workDir = open(".", O_RDONLY | O_DIRECTORY);
+#endif
+    if (workDir < 0) {
+        fprintf(stderr, "Could not open the working directory.\n");
+        close(fd);
+        return 1;
+    }
+
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(CLIENT_FDS * sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { resolved, strlen(resolved) + 1 };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(CLIENT_FDS * sizeof(int));
+    int fds[CLIENT_FDS] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, workDir };
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    bool sent = sendmsg(fd, &message, 0) >= 0;
+    close(workDir);
+    if (!sent) {
+        fprintf(stderr, "Could not send the job to the daemon.\n");
+        close(fd);
+        return 1;
+    }
+
+    // The program writes to our streams itself; all that comes back here is its status.
+    char status[64];
+    size_t length = 0;
+    while (length < sizeof(status) - 1) {
+        ssize_t got = read(fd, status + length, sizeof(status) - 1 - length);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        length += (size_t)got;
+    }
+    status[length] = '\0';
+    close(fd);
+
+    if (length == 0) {
+        fprintf(stderr, "The daemon closed the connection without an answer.\n");
+        return 1;
+    }
+    return strcmp(status, "ok\n") == 0 ? 0 : 1;
+}
+
+#else
+
+bool runDaemon(const char* socketPath, const PseudoOptions* options) {
+    (void)socketPath;
+    (void)options;
+    fprintf(stderr, "-daemon needs Unix domain sockets, which this platform does not have.\n");
+    return false;
+}
+
+int runClient(const char* socketPath, const char* path) {
+    (void)socketPath;
+    (void)path;
+    fprintf(stderr, "-client needs Unix domain sockets, which this platform does not have.\n");
+    return 1;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef PSEUDOCOMPILER_DAEMON_H
+#define PSEUDOCOMPILER_DAEMON_H
+
+#include "common.h"
+#include "pseudo.h"
+
+// Compile-and-run daemon for -daemon, and its client for -client. The daemon listens on a Unix
+// domain socket and runs each connection on a thread of its own. A client sends the absolute
+// path of a source or .pcbc file together with its own stdin, stdout and stderr and its working
+// directory, passed as file descriptors. The program runs inside the daemon but reads and writes
+// the client's streams directly, so output and errors reach the client as they are written, and
+// the files it opens by relative names are found in the client's directory. The daemon then
+// answers with a one-line status: ok, runtime-error, invalid-program, compile-error,
+// missing-file, no-memory or bad-request.
+//
+// Compiled programs stay cached by path until the file changes: its inode, size, or modification
+// or status change time, to the nanosecond. Each keeps the VMs that ran it. A repeated job skips
+// reading, compiling, verifying and setting up a VM, and keeps the native code the JIT made on
+// earlier runs. Unlike -forkserver, jobs share the daemon's process, so a program that never
+// ends keeps its thread busy after the client is gone. SIGINT or SIGTERM stops the daemon and
+// removes the socket.
+#if defined(__unix__) || defined(__APPLE__)
+#define DAEMON_AVAILABLE
+#endif
+
+#define DAEMON_CACHED_PROGRAMS  64
+#define DAEMON_IDLE_VMS         4   // VMs kept for reuse per cached program.
+
+// Serves until the process is stopped. False if the socket could not be set up.
+bool runDaemon(const char* socketPath, const PseudoOptions* options);
+// Runs the file at path on the daemon listening at socketPath, and returns the exit status
+// for the client: 0 if the program ran to its end.
+int runClient(const char* socketPath, const char* path);
+
+#endif //PSEUDOCOMPILER_DAEMON_H
@@ -0,0 +1,164 @@
+#include "decode.h"
+
+#define READ_BYTE(idx)  (bs->stream[idx])
+#define READ_4BYTE(idx) (((byte4)bs->stream[idx] << 24) | ((byte4)bs->stream[idx + 1] << 16) | ((byte4)bs->stream[idx + 2] << 8) | ((byte4)bs->stream[idx + 3]))
+#define READ_8BYTE(idx) (((byte8)bs->stream[idx] << 56) | ((byte8)bs->stream[idx + 1] << 48) | ((byte8)bs->stream[idx + 2] << 40) | ((byte8)bs->stream[idx + 3] << 32) | ((byte8)bs->stream[idx + 4] << 24) | ((byte8)bs->stream[idx + 5] << 16) | ((byte8)bs->stream[idx + 6] << 8) | ((byte8)bs->stream[idx + 7]))
+
+#define READ_INT(var, idx)  {byte4 temp = READ_4BYTE(idx); memcpy(&var, &temp, sizeof(int));}
+#define READ_REAL(var, idx) {byte8 temp = READ_8BYTE(idx); memcpy(&var, &temp, sizeof(double));}
+
+void initDecodedProgram(DecodedProgram* program) {
+    program->ops = NULL;
+    program->count = 0;
+    program->maxDepth = 0;
+    program->maxFrame = 0;
+}
+
+void freeDecodedProgram(DecodedProgram* program) {
+    free(program->ops);
+    initDecodedProgram(program);
+}
+
+static bool resolveTarget(DecodedOp* ops, const int* indexOf, int streamLength, int offset, DecodedOp** target) {
+    if (offset < 0 || offset > streamLength || indexOf[offset] < 0) return false;
+
+    *target = &ops[indexOf[offset]];
+    return true;
+}
+
+bool decodeProgram(DecodedProgram* program, BytecodeStream* bs) {
+    initDecodedProgram(program);
+
+    // Instruction index of every byte offset that starts an instruction, -1 elsewhere. The
+    // extra entry maps the end of the stream to the trailing EXIT added below.
+    int* indexOf = (int*) malloc((bs->count + 1) * sizeof(int));
+    if (indexOf == NULL) {
+        fprintf(diagnostics(), "Not enough memory to decode bytecode.\n");
+        return false;
+    }
+
+    for (int i = 0; i <= bs->count; i++) {
+        indexOf[i] = -1;
+    }
+
+    int count = 0;
+    for (int idx = 0; idx < bs->count;) {
+        int length = getInstructionLength(bs, idx);
+
+        if (length < 0 || idx + length > bs->count) {
+            fprintf(diagnostics(), "Malformed bytecode at offset %d.\n", idx);
+            free(indexOf);
+            return false;
+        }
+
+        indexOf[idx] = count++;
+        idx += length;
+    }
+    indexOf[bs->count] = count;
+
+    DecodedOp* ops = (DecodedOp*) calloc(count + 1, sizeof(DecodedOp));
+    if (ops == NULL) {
+        fprintf(diagnostics(), "Not enough memory to decode bytecode.\n");
+        free(indexOf);
+        return false;
+    }
+
+    for (int idx = 0; idx < bs->count; idx += getInstructionLength(bs, idx)) {
+        DecodedOp* op = &ops[indexOf[idx]];
+        op->op = (Instruction)READ_BYTE(idx);
+        op->offset = idx;
+
+        switch (op->op) {
+            case LOAD_INT:
+            case CALL_BUILTIN:
+            case ENTER:
+            case LOAD_ZEROS: {
+                READ_INT(op->operand.asInt, idx + 1);
+                break;
+            }
+            case LOAD_REAL: {
+                READ_REAL(op->operand.asReal, idx + 1);
+                break;
+            }
+            case LOAD_CHAR: {
+                op->operand.asChar = (char)READ_BYTE(idx + 1);
+                break;
+            }
+            case LOAD_BOOL: {
+                op->operand.asBool = READ_BYTE(idx + 1) != 0;
+                break;
+            }
+            case LOAD_STRING: {
+                READ_INT(op->a, idx + 1);
+                op->operand.chars = (const char*)&bs->stream[idx + 5];
+                break;
+            }
+            case FETCH_LOCAL_INT:
+            case STORE_LOCAL_INT_DISCARD: {
+                int pos;
+                READ_INT(pos, idx + 1);
+                op->a = REG_OPERAND(pos, true);
+                break;
+            }
+            case FETCH_GLOBAL_INT:
+            case STORE_GLOBAL_INT_DISCARD: {
+                int pos;
+                READ_INT(pos, idx + 1);
+                op->a = REG_OPERAND(pos, false);
+                break;
+            }
+            case MOVE_R:
+            case LOADK_INT_R: {
+                READ_INT(op->operand.asInt, idx + 1);
+                READ_INT(op->a, idx + 5);
+                break;
+            }
+            case ADD_INT_RR: case MINUS_INT_RR: case MULT_INT_RR: case MOD_INT_RR: case FDIV_INT_RR:
+            case ADD_INT_RK: case MINUS_INT_RK: case MULT_INT_RK: case MOD_INT_RK: case FDIV_INT_RK:
+            case ADD_REAL_RR: case MINUS_REAL_RR: case MULT_REAL_RR: case DIV_REAL_RR: {
+                READ_INT(op->operand.asInt, idx + 1);
+                READ_INT(op->a, idx + 5);
+                READ_INT(op->b, idx + 9);
+                break;
+            }
+            case DO_CALL:
+            case TAIL_CALL:
+            case B_FALSE:
+            case BRANCH:
+            case BEQ_INT: case BNE_INT: case BLT_INT: case BLE_INT: case BGT_INT: case BGE_INT:
+            case BEQ_INT_RR: case BNE_INT_RR: case BLT_INT_RR: case BLE_INT_RR: case BGT_INT_RR: case BGE_INT_RR:
+            case BEQ_INT_RK: case BNE_INT_RK: case BLT_INT_RK: case BLE_INT_RK: case BGT_INT_RK: case BGE_INT_RK: {
+                int targetIdx = idx + 1;
+                if (op->op == DO_CALL || op->op == TAIL_CALL) {
+                    READ_INT(op->a, idx + 5);
+                } else if (op->op >= BEQ_INT_RR && op->op <= BGE_INT_RK) {
+                    READ_INT(op->a, idx + 1);
+                    READ_INT(op->b, idx + 5);
+                    targetIdx = idx + 9;
+                }
+
+                int dst;
+                READ_INT(dst, targetIdx);
+
+                if (!resolveTarget(ops, indexOf, bs->count, dst, &op->operand.target)) {
+                    fprintf(diagnostics(), "Invalid jump target %d at offset %d.\n", dst, idx);
+                    free(indexOf);
+                    free(ops);
+                    return false;
+                }
+                break;
+            }
+            default: break;
+        }
+    }
+
+    // Running off the end of the stream stops the program like an explicit EXIT.
+    ops[count].op = EXIT;
+    ops[count].offset = bs->count;
+
+    free(indexOf);
+
+    program->ops = ops;
+    program->count = count + 1;
+    return true;
+}
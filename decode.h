@@ -0,0 +1,37 @@
+#ifndef PSEUDOCOMPILER_DECODE_H
+#define PSEUDOCOMPILER_DECODE_H
+
+#include "common.h"
+#include "bytecode.h"
+
+// One instruction of the byte stream, unpacked once at load time so the VM never has to
+// reassemble operands or translate byte offsets while running.
+typedef struct DecodedOp {
+    void* handler;          // Dispatch label, filled in by the run loop that executes the program.
+    Instruction op;
+    int offset;             // Byte offset in the original stream, for error and debug output.
+    int a;                  // LOAD_STRING length, DO_CALL and TAIL_CALL argument count, or the source registers of register forms.
+    int b;                  // DO_CALL and TAIL_CALL callee frame size, set by verifyProgram.
+    union {
+        int asInt;
+        double asReal;
+        char asChar;
+        bool asBool;
+        const char* chars;
+        struct DecodedOp* target;
+    } operand;              // For register forms, the destination register or the branch target.
+} DecodedOp;
+
+typedef struct {
+    DecodedOp* ops;
+    int count;
+    int maxDepth;           // Stack slots the main program needs, set by verifyProgram.
+    int maxFrame;           // Stack slots the largest call frame needs, set by verifyProgram.
+} DecodedProgram;
+
+void initDecodedProgram(DecodedProgram* program);
+void freeDecodedProgram(DecodedProgram* program);
+
+bool decodeProgram(DecodedProgram* program, BytecodeStream* bs);
+
+#endif //PSEUDOCOMPILER_DECODE_H
@@ -0,0 +1,215 @@
+#include <ctype.h>
+#include <errno.h>
+
+#include "forkserver.h"
+
+#ifdef FORK_SERVER_AVAILABLE
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Exit codes of a child, for when its report never arrives.
+#define CHILD_OK            0
+#define CHILD_RUNTIME_ERROR 1
+#define CHILD_INVALID       2
+#define CHILD_MISSING_FILE  3
+
+typedef struct {
+    int code;               // One of the CHILD_ codes.
+    unsigned long long instructions;
+    unsigned long long peakCells;
+} ChildReport;
+
+static const char* childStatus[] = { "ok", "runtime-error", "invalid-program", "missing-file" };
+
+static double now() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static bool writeAll(int fd, const void* data, size_t size) {
+    const char* bytes = (const char*)data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        bytes += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void* data, size_t size) {
+    char* bytes = (char*)data;
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        bytes += got;
+        size -= (size_t)got;
+    }
+    return true;
+}
+
+// Runs in the child: one run of the inherited VM, reported on fd. Never returns.
+static void runChild(PseudoVM* vm, const char* inputPath, const char* outputPath, int fd, int timeoutMs) {
+    ChildReport report = { CHILD_MISSING_FILE, 0, 0 };
+
+    // SIGALRM ends the child once the time is up, wherever the run is, even waiting on a read.
+    if (timeoutMs > 0) {
+        signal(SIGALRM, SIG_DFL);
+        struct itimerval timer;
+        memset(&timer, 0, sizeof(timer));
+        timer.it_value.tv_sec = timeoutMs / 1000;
+        timer.it_value.tv_usec = (timeoutMs % 1000) * 1000;
+        setitimer(ITIMER_REAL, &timer, NULL);
+    }
+
+    // Without an input file INPUT sees an empty one rather than the server's requests, and
+    // without an output file OUTPUT is discarded, as -h says, so it cannot mix with the answers.
+    FILE* in = fopen(inputPath != NULL ? inputPath : "/dev/null", "rb");
+    FILE* out = fopen(outputPath != NULL ? outputPath : "/dev/null", "wb");
+
+    if (in != NULL && out != NULL) {
+        PseudoResult result = pseudoRun(vm, in, out);
+        PseudoStats stats;
+        pseudoGetStats(vm, &stats);
+
+        report.code = result == PSEUDO_OK ? CHILD_OK : result == PSEUDO_RUNTIME_ERROR ? CHILD_RUNTIME_ERROR : CHILD_INVALID;
+        report.instructions = stats.instructions;
+        report.peakCells = stats.peakHeapCells;
+    }
+
+    if (out != NULL) fclose(out);
+    if (in != NULL) fclose(in);
+    fflush(stderr);
+
+    writeAll(fd, &report, sizeof(report));
+    // Skips atexit handlers and the stdio buffers inherited from the server.
+    _exit(report.code);
+}
+
+static void serveRequest(PseudoVM* vm, const char* inputPath, const char* outputPath, int timeoutMs) {
+    const char* name = inputPath != NULL ? inputPath : "-";
+    double start = now();
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        printf("%s\tfork-failed\t0.000\t0\t0\n", name);
+        return;
+    }
+
+    // Anything still buffered would be written again by the child.
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t child = fork();
+    if (child < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        printf("%s\tfork-failed\t0.000\t0\t0\n", name);
+        return;
+    }
+    if (child == 0) {
+        close(fds[0]);
+        runChild(vm, inputPath, outputPath, fds[1], timeoutMs);
+    }
+
+    close(fds[1]);
+    ChildReport report;
+    bool reported = readAll(fds[0], &report, sizeof(report));
+    close(fds[0]);
+
+    int status;
+    while (waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+    double elapsed = now() - start;
+
+    if (timeoutMs > 0 && WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) {
+        printf("%s\ttimeout\t%.3f\t0\t0\n", name, elapsed);
+        return;
+    }
+
+    if (!reported || !WIFEXITED(status) || report.code < CHILD_OK || report.code > CHILD_MISSING_FILE) {
+        if (WIFSIGNALED(status)) fprintf(stderr, "%s: the run was ended by signal %d.\n", name, WTERMSIG(status));
+        printf("%s\tcrashed\t%.3f\t0\t0\n", name, elapsed);
+        return;
+    }
+
+    printf("%s\t%s\t%.3f\t%llu\t%llu\n", name, childStatus[report.code], elapsed, report.instructions, report.peakCells);
+}
+
+static void serve(PseudoVM* vm, int timeoutMs) {
+    char line[4096];
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        char* fields[3];
+        int fieldCount = 0;
+        char* c = line;
+        while (fieldCount < 3) {
+            while (isspace((unsigned char)*c)) c++;
+            if (*c == '\0' || *c == '#') break;
+
+            fields[fieldCount++] = c;
+            while (*c != '\0' && !isspace((unsigned char)*c)) c++;
+            if (*c != '\0') *c++ = '\0';
+        }
+
+        if (fieldCount == 0) continue;
+        if (fieldCount > 2) {
+            fprintf(stderr, "Expected <input file> [<output file>].\n");
+            continue;
+        }
+
+        const char* input = strcmp(fields[0], "-") == 0 ? NULL : fields[0];
+        const char* output = fieldCount < 2 || strcmp(fields[1], "-") == 0 ? NULL : fields[1];
+        serveRequest(vm, input, output, timeoutMs);
+
+        // The driver may be waiting for this answer before it sends the next request.
+        fflush(stdout);
+    }
+}
+
+bool runForkServer(const char* path, const PseudoOptions* options, int timeoutMs) {
+    char* source = readSource(path);
+    if (source == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", path);
+        return false;
+    }
+
+    PseudoProgram* program = pseudoCompile(source, options);
+    free(source);
+    if (program == NULL) return false;
+
+    PseudoVM* vm = pseudoNewVM(program, options);
+    if (vm == NULL) {
+        fprintf(stderr, "Not enough memory for the VM.\n");
+        pseudoFreeProgram(program);
+        return false;
+    }
+
+    if (!pseudoPrepare(vm)) {
+        fprintf(stderr, "The compiled program failed verification.\n");
+        pseudoFreeVM(vm);
+        pseudoFreeProgram(program);
+        return false;
+    }
+
+    serve(vm, timeoutMs);
+
+    pseudoFreeVM(vm);
+    pseudoFreeProgram(program);
+    return true;
+}
+
+#else
+
+bool runForkServer(const char* path, const PseudoOptions* options, int timeoutMs) {
+    (void)path;
+    (void)options;
+    (void)timeoutMs;
+    fprintf(stderr, "-forkserver needs fork(), which this platform does not have.\n");
+    return false;
+}
+
+#endif
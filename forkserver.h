@@ -0,0 +1,34 @@
+#ifndef PSEUDOCOMPILER_FORKSERVER_H
+#define PSEUDOCOMPILER_FORKSERVER_H
+
+#include "common.h"
+#include "pseudo.h"
+
+// Fork server for -forkserver: runs one program against many inputs. The program is compiled,
+// given a VM and decoded and verified once; then every request forks a child that inherits
+// the ready VM copy-on-write, runs it once and exits, so a test costs little more than a fork
+// and a crash or runaway heap in one test cannot touch the next.
+//
+// Requests are read from stdin, one per line:
+//
+//     <input file> [<output file>]
+//
+// The child reads INPUT from the input file ("-" for none) and writes OUTPUT to the output
+// file, or discards it. It reports how the run went back over a pipe, and the server answers
+// each request as soon as the child is done with one tab-separated line on stdout:
+//
+//     <input file> <status> <wall ms> <instructions executed> <peak heap cells>
+//
+// The status is ok, runtime-error, invalid-program, missing-file, timeout, crashed or
+// fork-failed. Instructions are only counted with --stats. A child still running when the
+// timeout is up is ended by SIGALRM and answered with timeout, so a request for a program that
+// never ends does not stall the requests after it.
+#if defined(__unix__) || defined(__APPLE__)
+#define FORK_SERVER_AVAILABLE
+#endif
+
+// timeoutMs limits each run's wall time, 0 for no limit. False if the program did not compile
+// or the server could not start.
+bool runForkServer(const char* path, const PseudoOptions* options, int timeoutMs);
+
+#endif //PSEUDOCOMPILER_FORKSERVER_H
@@ -0,0 +1,1044 @@
+#include "jit.h"
+#include "vm.h"
+
+#ifdef JIT_AVAILABLE
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#endif
+
+void initJit(Jit* jit) {
+#ifdef JIT_AVAILABLE
+    jit->enabled = true;
+#else
+    jit->enabled = false;
+#endif
+    jit->threshold = DEFAULT_JIT_THRESHOLD;
+    jit->depth = 0;
+    jit->count = 0;
+    jit->callCounts = NULL;
+    jit->functions = NULL;
+    jit->code = NULL;
+    jit->codeCount = 0;
+    jit->codeCapacity = 0;
+}
+
+void freeJit(Jit* jit) {
+#ifdef JIT_AVAILABLE
+    for (int i = 0; i < jit->codeCount; i++) {
+        munmap(jit->code[i].memory, jit->code[i].size);
+    }
+#endif
+    free(jit->code);
+    free(jit->callCounts);
+    free(jit->functions);
+
+    bool enabled = jit->enabled;
+    int threshold = jit->threshold;
+    initJit(jit);
+    configureJit(jit, enabled, threshold);
+}
+
+void configureJit(Jit* jit, bool enabled, int threshold) {
+#ifdef JIT_AVAILABLE
+    jit->enabled = enabled;
+#else
+    (void)enabled;
+    jit->enabled = false;
+#endif
+    jit->threshold = threshold > 0 ? threshold : 1;
+}
+
+bool prepareJit(Jit* jit, int count) {
+    if (!jit->enabled) return true;
+
+    free(jit->callCounts);
+    free(jit->functions);
+
+    jit->callCounts = (int*) calloc(count, sizeof(int));
+    jit->functions = (JitFunction*) calloc(count, sizeof(JitFunction));
+    jit->count = count;
+
+    if (jit->callCounts == NULL || jit->functions == NULL) {
+        free(jit->callCounts);
+        free(jit->functions);
+        jit->callCounts = NULL;
+        jit->functions = NULL;
+        jit->count = 0;
+        return false;
+    }
+
+    return true;
+}
+
+#ifdef JIT_AVAILABLE
+
+// Register numbers as encoded in ModRM and REX.
+enum {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+#define XMM0    0
+#define XMM1    1
+
+// Condition codes for Jcc and SETcc.
+enum {
+    CC_O = 0x0, CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7,
+    CC_P = 0xA, CC_NP = 0xB, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF,
+};
+
+// Native code keeps the VM in callee-saved registers:
+//   rbx  VM*
+//   r12  vm->stack.data
+//   r13  address of the top slot, kept in sync with vm->stack.top around every helper call
+//   r14  first slot of the current frame
+//   r15  address of the last slot of the stack
+// It only writes numbers to slots and leaves the reference bitmap alone. A stale bit only
+// makes the collector test that number with isValidReference.
+#define SLOT_SIZE       ((int)sizeof(Value))
+
+typedef struct {
+    int label;
+    JitError error;
+    int index;
+} ErrorStub;
+
+typedef struct {
+    int pos;
+    int label;
+} Fixup;
+
+typedef struct {
+    VM* vm;
+    byte* code;
+    int count;
+    int capacity;
+    bool failed;
+
+    int* labels;                // Code position of each label, -1 while unbound.
+    int labelCount;
+    int labelCapacity;
+    Fixup* fixups;
+    int fixupCount;
+    int fixupCapacity;
+    ErrorStub* stubs;
+    int stubCount;
+    int stubCapacity;
+
+    int epilogue;
+    int entry;                  // Instruction the function starts at.
+} Assembler;
+
+static void emitByte(Assembler* as, int value) {
+    if (as->count == as->capacity) {
+        int capacity = GROW_CAPACITY(as->capacity, 256);
+        byte* code = (byte*) realloc(as->code, capacity);
+        if (code == NULL) {
+            as->failed = true;
+            return;
+        }
+        as->code = code;
+        as->capacity = capacity;
+    }
+
+    as->code[as->count++] = (byte)value;
+}
+
+static void emitInt32(Assembler* as, int32_t value) {
+    for (int i = 0; i < 4; i++) {
+        emitByte(as, (int)(((uint32_t)value >> (8 * i)) & 0xff));
+    }
+}
+
+static void emitInt64(Assembler* as, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        emitByte(as, (int)((value >> (8 * i)) & 0xff));
+    }
+}
+
+static void emitBytes(Assembler* as, const byte* bytes, int count) {
+    for (int i = 0; i < count; i++) {
+        emitByte(as, bytes[i]);
+    }
+}
+
+static int newLabel(Assembler* as) {
+    if (as->labelCount == as->labelCapacity) {
+        int capacity = GROW_CAPACITY(as->labelCapacity, 64);
+        int* labels = (int*) realloc(as->labels, capacity * sizeof(int));
+        if (labels == NULL) {
+            as->failed = true;
+            return 0;
+        }
+        as->labels = labels;
+        as->labelCapacity = capacity;
+    }
+
+    as->labels[as->labelCount] = -1;
+    return as->labelCount++;
+}
+
+static void bindLabel(Assembler* as, int label) {
+    if (!as->failed) as->labels[label] = as->count;
+}
+
+// A rel32 operand pointing at label, patched once every label is bound.
+static void emitLabelRef(Assembler* as, int label) {
+    if (as->fixupCount == as->fixupCapacity) {
+        int capacity = GROW_CAPACITY(as->fixupCapacity, 64);
+        Fixup* fixups = (Fixup*) realloc(as->fixups, capacity * sizeof(Fixup));
+        if (fixups == NULL) {
+            as->failed = true;
+            return;
+        }
+        as->fixups = fixups;
+        as->fixupCapacity = capacity;
+    }
+
+    as->fixups[as->fixupCount].pos = as->count;
+    as->fixups[as->fixupCount].label = label;
+    as->fixupCount++;
+    emitInt32(as, 0);
+}
+
+static void emitRex(Assembler* as, bool wide, int reg, int rm) {
+    int rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+    if (rex != 0x40) emitByte(as, rex);
+}
+
+// op reg, [base + disp32]. op2 is the second opcode byte after 0x0F, or -1.
+static void emitMem(Assembler* as, int prefix, bool wide, int op1, int op2, int reg, int base, int disp) {
+    if (prefix) emitByte(as, prefix);
+    emitRex(as, wide, reg, base);
+    emitByte(as, op1);
+    if (op2 >= 0) emitByte(as, op2);
+    emitByte(as, 0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP) emitByte(as, 0x24);
+    emitInt32(as, disp);
+}
+
+// op reg, rm with both operands in registers.
+static void emitReg(Assembler* as, int prefix, bool wide, int op1, int op2, int reg, int rm) {
+    if (prefix) emitByte(as, prefix);
+    emitRex(as, wide, reg, rm);
+    emitByte(as, op1);
+    if (op2 >= 0) emitByte(as, op2);
+    emitByte(as, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// Group 1 arithmetic with an immediate: ext 0 add, 1 or, 4 and, 5 sub, 6 xor, 7 cmp.
+static void emitAluImm(Assembler* as, bool wide, int ext, int rm, int32_t imm) {
+    emitRex(as, wide, 0, rm);
+    emitByte(as, 0x81);
+    emitByte(as, 0xC0 | (ext << 3) | (rm & 7));
+    emitInt32(as, imm);
+}
+
+static void emitLoad64(Assembler* as, int reg, int base, int disp) {
+    emitMem(as, 0, true, 0x8B, -1, reg, base, disp);
+}
+
+static void emitLoad32(Assembler* as, int reg, int base, int disp) {
+    emitMem(as, 0, false, 0x8B, -1, reg, base, disp);
+}
+
+static void emitLoadByte(Assembler* as, int reg, int base, int disp) {
+    emitMem(as, 0, false, 0x0F, 0xB6, reg, base, disp);
+}
+
+static void emitStore64(Assembler* as, int base, int disp, int reg) {
+    emitMem(as, 0, true, 0x89, -1, reg, base, disp);
+}
+
+static void emitLea(Assembler* as, int reg, int base, int disp) {
+    emitMem(as, 0, true, 0x8D, -1, reg, base, disp);
+}
+
+static void emitMovImm32(Assembler* as, int reg, int32_t imm) {
+    if (reg & 8) emitByte(as, 0x41);
+    emitByte(as, 0xB8 + (reg & 7));
+    emitInt32(as, imm);
+}
+
+static void emitMovImm64(Assembler* as, int reg, uint64_t imm) {
+    emitByte(as, (reg & 8) ? 0x49 : 0x48);
+    emitByte(as, 0xB8 + (reg & 7));
+    emitInt64(as, imm);
+}
+
+static void emitSetcc(Assembler* as, int cc, int reg) {
+    emitByte(as, 0x0F);
+    emitByte(as, 0x90 + cc);
+    emitByte(as, 0xC0 | reg);
+}
+
+static void emitJcc(Assembler* as, int cc, int label) {
+    emitByte(as, 0x0F);
+    emitByte(as, 0x80 + cc);
+    emitLabelRef(as, label);
+}
+
+static void emitJmp(Assembler* as, int label) {
+    emitByte(as, 0xE9);
+    emitLabelRef(as, label);
+}
+
+static void emitCall(Assembler* as, void* function) {
+    emitMovImm64(as, RAX, (uint64_t)(uintptr_t)function);
+    emitByte(as, 0xFF);
+    emitByte(as, 0xD0);
+}
+
+// eax <- zero-extended al.
+static void emitWidenBool(Assembler* as) {
+    emitReg(as, 0, false, 0x0F, 0xB6, RAX, RAX);
+}
+
+static void emitSyncTop(Assembler* as) {
+    emitReg(as, 0, true, 0x89, -1, R13, RAX);
+    emitReg(as, 0, true, 0x29, -1, R12, RAX);
+    emitByte(as, 0x48);
+    emitByte(as, 0xC1);
+    emitByte(as, 0xF8);
+    emitByte(as, 3);
+    emitMem(as, 0, false, 0x89, -1, RAX, RBX, (int)offsetof(VM, stack.top));
+}
+
+static void emitReloadTop(Assembler* as) {
+    static const byte leaTop[] = { 0x4D, 0x8D, 0x2C, 0xCC };    // lea r13, [r12 + rcx * 8]
+
+    // Leaves rax alone, it holds the result of the helper that was just called.
+    emitMem(as, 0, true, 0x63, -1, RCX, RBX, (int)offsetof(VM, stack.top));
+    emitBytes(as, leaTop, sizeof(leaTop));
+}
+
+static int errorStub(Assembler* as, JitError error, int index) {
+    if (as->stubCount == as->stubCapacity) {
+        int capacity = GROW_CAPACITY(as->stubCapacity, 16);
+        ErrorStub* stubs = (ErrorStub*) realloc(as->stubs, capacity * sizeof(ErrorStub));
+        if (stubs == NULL) {
+            as->failed = true;
+            return 0;
+        }
+        as->stubs = stubs;
+        as->stubCapacity = capacity;
+    }
+
+    int label = newLabel(as);
+    as->stubs[as->stubCount].label = label;
+    as->stubs[as->stubCount].error = error;
+    as->stubs[as->stubCount].index = index;
+    as->stubCount++;
+    return label;
+}
+
+// The top count values must exist.
+static void emitNeedValues(Assembler* as, int count, int index) {
+    if (count == 1) {
+        emitReg(as, 0, true, 0x39, -1, R12, R13);
+    } else {
+        emitLea(as, RCX, R13, -(count - 1) * SLOT_SIZE);
+        emitReg(as, 0, true, 0x39, -1, R12, RCX);
+    }
+    emitJcc(as, CC_B, errorStub(as, JIT_STACK_UNDERFLOW, index));
+}
+
+// There must be room for count more values.
+static void emitNeedRoom(Assembler* as, int count, int index) {
+    emitLea(as, RCX, R13, count * SLOT_SIZE);
+    emitReg(as, 0, true, 0x39, -1, R15, RCX);
+    emitJcc(as, CC_A, errorStub(as, JIT_STACK_OVERFLOW, index));
+}
+
+static void emitPushRax(Assembler* as, int index) {
+    emitNeedRoom(as, 1, index);
+    emitAluImm(as, true, 0, R13, SLOT_SIZE);
+    emitStore64(as, R13, 0, RAX);
+}
+
+static void emitDrop(Assembler* as, int count) {
+    emitLea(as, R13, R13, -count * SLOT_SIZE);
+}
+
+static bool slotInRange(VM* vm, int reg) {
+    if (REG_POS(reg) >= (1 << 27)) return false;
+    return REG_IS_RELATIVE(reg) || REG_POS(reg) < vm->stack.capacity;
+}
+
+// Leaves the address of a register operand in target, checked like regSlot.
+static void emitSlotAddress(Assembler* as, int reg, int target, int index) {
+    if (REG_IS_RELATIVE(reg)) {
+        emitLea(as, target, R14, REG_POS(reg) * SLOT_SIZE);
+        emitReg(as, 0, true, 0x39, -1, R15, target);
+        emitJcc(as, CC_A, errorStub(as, JIT_INVALID_SLOT, index));
+    } else {
+        emitLea(as, target, R12, REG_POS(reg) * SLOT_SIZE);
+    }
+}
+
+// Leaves native code and continues in the interpreter at eax unless it is index + 1.
+static void emitContinueUnless(Assembler* as, int index) {
+    emitReloadTop(as);
+    emitAluImm(as, false, 7, RAX, index + 1);
+    emitJcc(as, CC_NE, as->epilogue);
+}
+
+static void emitHelper(Assembler* as, void* helper, int index) {
+    emitSyncTop(as);
+    emitReg(as, 0, true, 0x89, -1, RBX, RDI);
+    emitMovImm32(as, RSI, index);
+    emitCall(as, helper);
+    emitContinueUnless(as, index);
+}
+
+static void emitSideExit(Assembler* as, int index) {
+    emitSyncTop(as);
+    emitMovImm32(as, RAX, index);
+    emitJmp(as, as->epilogue);
+}
+
+static void emitReturn(Assembler* as, bool hasValue) {
+    emitSyncTop(as);
+    emitReg(as, 0, true, 0x89, -1, RBX, RDI);
+    emitMovImm32(as, RSI, hasValue ? 1 : 0);
+    emitCall(as, (void*)jitReturn);
+    emitMovImm32(as, RAX, JIT_RETURNED);
+    emitJmp(as, as->epilogue);
+}
+
+// eax <- eax DIV or MOD -1, without idiv, which traps on INT_MIN DIV -1.
+static void emitDivideByMinusOne(Assembler* as, bool mod, int index) {
+    if (mod) {
+        emitReg(as, 0, false, 0x31, -1, RAX, RAX);
+    } else {
+        emitReg(as, 0, false, 0xF7, -1, 3, RAX);
+        emitJcc(as, CC_O, errorStub(as, JIT_INTEGER_OVERFLOW, index));
+    }
+}
+
+static void emitIdiv(Assembler* as, bool mod) {
+    emitByte(as, 0x99);
+    emitReg(as, 0, false, 0xF7, -1, 7, RCX);
+    if (mod) emitReg(as, 0, false, 0x89, -1, RDX, RAX);
+}
+
+// eax <- eax DIV or MOD the divisor, which is ecx or, if immediate, imm. A zero divisor is a
+// runtime error and -1 is handled apart, so idiv never traps.
+static void emitIntDivide(Assembler* as, bool mod, bool immediate, int32_t imm, int index) {
+    if (immediate) {
+        if (imm == 0) {
+            emitJmp(as, errorStub(as, JIT_DIVISION_BY_ZERO, index));
+        } else if (imm == -1) {
+            emitDivideByMinusOne(as, mod, index);
+        } else {
+            emitMovImm32(as, RCX, imm);
+            emitIdiv(as, mod);
+        }
+        return;
+    }
+
+    int divide = newLabel(as);
+    int done = newLabel(as);
+    emitReg(as, 0, false, 0x85, -1, RCX, RCX);
+    emitJcc(as, CC_E, errorStub(as, JIT_DIVISION_BY_ZERO, index));
+    emitAluImm(as, false, 7, RCX, -1);
+    emitJcc(as, CC_NE, divide);
+    emitDivideByMinusOne(as, mod, index);
+    emitJmp(as, done);
+    bindLabel(as, divide);
+    emitIdiv(as, mod);
+    bindLabel(as, done);
+}
+
+static void emitIntBinary(Assembler* as, Instruction op, int index) {
+    emitNeedValues(as, 2, index);
+    emitLoad32(as, RAX, R13, -SLOT_SIZE);
+
+    switch (op) {
+        case ADD_INT: emitMem(as, 0, false, 0x03, -1, RAX, R13, 0); break;
+        case MINUS_INT: emitMem(as, 0, false, 0x2B, -1, RAX, R13, 0); break;
+        case MULT_INT: emitMem(as, 0, false, 0x0F, 0xAF, RAX, R13, 0); break;
+        case MOD_INT:
+        case FDIV_INT:
+            emitLoad32(as, RCX, R13, 0);
+            emitIntDivide(as, op == MOD_INT, false, 0, index);
+            break;
+        default: break;
+    }
+
+    emitStore64(as, R13, -SLOT_SIZE, RAX);
+    emitDrop(as, 1);
+}
+
+static void emitIntCompare(Assembler* as, int cc, int index) {
+    emitNeedValues(as, 2, index);
+    emitLoad32(as, RAX, R13, -SLOT_SIZE);
+    emitMem(as, 0, false, 0x3B, -1, RAX, R13, 0);
+    emitSetcc(as, cc, RAX);
+    emitWidenBool(as);
+    emitStore64(as, R13, -SLOT_SIZE, RAX);
+    emitDrop(as, 1);
+}
+
+static void emitBoolCompare(Assembler* as, int cc, int index) {
+    emitNeedValues(as, 2, index);
+    emitLoadByte(as, RAX, R13, -SLOT_SIZE);
+    emitLoadByte(as, RCX, R13, 0);
+    emitReg(as, 0, false, 0x39, -1, RCX, RAX);
+    emitSetcc(as, cc, RAX);
+    emitWidenBool(as);
+    emitStore64(as, R13, -SLOT_SIZE, RAX);
+    emitDrop(as, 1);
+}
+
+static void emitRealBinary(Assembler* as, int opcode, int index) {
+    emitNeedValues(as, 2, index);
+    emitMem(as, 0xF2, false, 0x0F, 0x10, XMM0, R13, -SLOT_SIZE);
+    emitMem(as, 0xF2, false, 0x0F, opcode, XMM0, R13, 0);
+    emitMem(as, 0xF2, false, 0x0F, 0x11, XMM0, R13, -SLOT_SIZE);
+    emitDrop(as, 1);
+}
+
+// b is the deeper value and a the top one, as in the interpreter.
+static void emitRealCompare(Assembler* as, Instruction op, int index) {
+    emitNeedValues(as, 2, index);
+    emitMem(as, 0xF2, false, 0x0F, 0x10, XMM0, R13, -SLOT_SIZE);
+    emitMem(as, 0xF2, false, 0x0F, 0x10, XMM1, R13, 0);
+
+    // ucomisd leaves every flag set for NaN, so only above/above-or-equal are safe to test.
+    switch (op) {
+        case LESS_REAL:
+        case LESS_EQ_REAL:
+            emitReg(as, 0x66, false, 0x0F, 0x2E, XMM1, XMM0);
+            emitSetcc(as, op == LESS_REAL ? CC_A : CC_AE, RAX);
+            break;
+        case GREATER_REAL:
+        case GREATER_EQ_REAL:
+            emitReg(as, 0x66, false, 0x0F, 0x2E, XMM0, XMM1);
+            emitSetcc(as, op == GREATER_REAL ? CC_A : CC_AE, RAX);
+            break;
+        case EQ_REAL:
+            emitReg(as, 0x66, false, 0x0F, 0x2E, XMM0, XMM1);
+            emitSetcc(as, CC_E, RAX);
+            emitSetcc(as, CC_NP, RCX);
+            emitByte(as, 0x20);     // and al, cl
+            emitByte(as, 0xC8);
+            break;
+        case NEQ_REAL:
+            emitReg(as, 0x66, false, 0x0F, 0x2E, XMM0, XMM1);
+            emitSetcc(as, CC_NE, RAX);
+            emitSetcc(as, CC_P, RCX);
+            emitByte(as, 0x08);     // or al, cl
+            emitByte(as, 0xC8);
+            break;
+        default: break;
+    }
+
+    emitWidenBool(as);
+    emitStore64(as, R13, -SLOT_SIZE, RAX);
+    emitDrop(as, 1);
+}
+
+static int intCompareCC(Instruction op) {
+    switch (op) {
+        case EQ_INT: case EQ_BOOL: case BEQ_INT: case BEQ_INT_RR: case BEQ_INT_RK: return CC_E;
+        case NEQ_INT: case NEQ_BOOL: case BNE_INT: case BNE_INT_RR: case BNE_INT_RK: return CC_NE;
+        case LESS_INT: case LESS_BOOL: case BLT_INT: case BLT_INT_RR: case BLT_INT_RK: return CC_L;
+        case LESS_EQ_INT: case LESS_EQ_BOOL: case BLE_INT: case BLE_INT_RR: case BLE_INT_RK: return CC_LE;
+        case GREATER_INT: case GREATER_BOOL: case BGT_INT: case BGT_INT_RR: case BGT_INT_RK: return CC_G;
+        case GREATER_EQ_INT: case GREATER_EQ_BOOL: case BGE_INT: case BGE_INT_RR: case BGE_INT_RK: return CC_GE;
+        default: return CC_E;
+    }
+}
+
+// eax <- eax op operand, where operand is [r9] or an immediate.
+static void emitRegisterArith(Assembler* as, Instruction op, bool immediate, int32_t imm, int index) {
+    switch (op) {
+        case ADD_INT_RR: emitMem(as, 0, false, 0x03, -1, RAX, R9, 0); break;
+        case MINUS_INT_RR: emitMem(as, 0, false, 0x2B, -1, RAX, R9, 0); break;
+        case MULT_INT_RR: emitMem(as, 0, false, 0x0F, 0xAF, RAX, R9, 0); break;
+        case ADD_INT_RK: emitAluImm(as, false, 0, RAX, imm); break;
+        case MINUS_INT_RK: emitAluImm(as, false, 5, RAX, imm); break;
+        case MULT_INT_RK:
+            emitReg(as, 0, false, 0x69, -1, RAX, RAX);
+            emitInt32(as, imm);
+            break;
+        case MOD_INT_RR: case FDIV_INT_RR:
+        case MOD_INT_RK: case FDIV_INT_RK:
+            if (!immediate) emitLoad32(as, RCX, R9, 0);
+            emitIntDivide(as, op == MOD_INT_RR || op == MOD_INT_RK, immediate, imm, index);
+            break;
+        default: break;
+    }
+}
+
+// Reachable instructions of the subroutine at entry, without following calls.
+static bool* findRegion(DecodedProgram* program, int entry) {
+    bool* inRegion = (bool*) calloc(program->count, sizeof(bool));
+    int* worklist = (int*) malloc(program->count * sizeof(int));
+    if (inRegion == NULL || worklist == NULL) {
+        free(inRegion);
+        free(worklist);
+        return NULL;
+    }
+
+    int pending = 0;
+    worklist[pending++] = entry;
+    inRegion[entry] = true;
+
+    while (pending > 0) {
+        int index = worklist[--pending];
+        DecodedOp* op = &program->ops[index];
+        int successors[2];
+        int count = 0;
+
+        switch (op->op) {
+            case RETURN: case RETURN_NIL: case EXIT:
+                break;
+            case TAIL_CALL:
+                // Only a call back into this function stays in native code.
+                if (op->operand.target - program->ops == entry) successors[count++] = entry;
+                break;
+            case BRANCH:
+                successors[count++] = (int)(op->operand.target - program->ops);
+                break;
+            case B_FALSE:
+            case BEQ_INT: case BNE_INT: case BLT_INT: case BLE_INT: case BGT_INT: case BGE_INT:
+            case BEQ_INT_RR: case BNE_INT_RR: case BLT_INT_RR: case BLE_INT_RR: case BGT_INT_RR: case BGE_INT_RR:
+            case BEQ_INT_RK: case BNE_INT_RK: case BLT_INT_RK: case BLE_INT_RK: case BGT_INT_RK: case BGE_INT_RK:
+                successors[count++] = (int)(op->operand.target - program->ops);
+                successors[count++] = index + 1;
+                break;
+            default:
+                // The decoder's trailing EXIT keeps index + 1 inside the program.
+                successors[count++] = index + 1;
+                break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (!inRegion[successors[i]]) {
+                inRegion[successors[i]] = true;
+                worklist[pending++] = successors[i];
+            }
+        }
+    }
+
+    free(worklist);
+    return inRegion;
+}
+
+static void compileOp(Assembler* as, DecodedOp* ops, int index) {
+    VM* vm = as->vm;
+    DecodedOp* op = &ops[index];
+
+    switch (op->op) {
+        case NOP:
+            break;
+        case LOAD_INT:
+            emitMovImm32(as, RAX, op->operand.asInt);
+            emitPushRax(as, index);
+            break;
+        case LOAD_CHAR:
+            emitMovImm32(as, RAX, (unsigned char)op->operand.asChar);
+            emitPushRax(as, index);
+            break;
+        case LOAD_BOOL:
+            emitMovImm32(as, RAX, op->operand.asBool ? 1 : 0);
+            emitPushRax(as, index);
+            break;
+        case LOAD_REAL: {
+            uint64_t bits;
+            memcpy(&bits, &op->operand.asReal, sizeof(bits));
+            emitMovImm64(as, RAX, bits);
+            emitPushRax(as, index);
+            break;
+        }
+        case ENTER:
+        case LOAD_ZEROS: {
+            int count = op->operand.asInt;
+            if (count > 16) {
+                emitHelper(as, (void*)jitStep, index);
+                break;
+            }
+            if (count <= 0) break;
+
+            emitNeedRoom(as, count, index);
+            emitReg(as, 0, false, 0x31, -1, RAX, RAX);
+            for (int i = 1; i <= count; i++) {
+                emitStore64(as, R13, i * SLOT_SIZE, RAX);
+            }
+            emitLea(as, R13, R13, count * SLOT_SIZE);
+            break;
+        }
+        case POP:
+            emitNeedValues(as, 1, index);
+            emitDrop(as, 1);
+            break;
+        case COPY_INT:
+            emitNeedValues(as, 1, index);
+            emitNeedRoom(as, 1, index);
+            emitLoad32(as, RAX, R13, 0);
+            emitStore64(as, R13, 0, RAX);
+            emitStore64(as, R13, SLOT_SIZE, RAX);
+            emitLea(as, R13, R13, SLOT_SIZE);
+            break;
+        case ADD_INT: case MINUS_INT: case MULT_INT: case MOD_INT: case FDIV_INT:
+            emitIntBinary(as, op->op, index);
+            break;
+        case NEG_INT:
+            emitNeedValues(as, 1, index);
+            emitLoad32(as, RAX, R13, 0);
+            emitReg(as, 0, false, 0xF7, -1, 3, RAX);
+            emitStore64(as, R13, 0, RAX);
+            break;
+        case CAST_CHAR_INT:
+            emitNeedValues(as, 1, index);
+            emitMem(as, 0, false, 0x0F, 0xBE, RAX, R13, 0);
+            emitStore64(as, R13, 0, RAX);
+            break;
+        case CAST_INT_REAL:
+            emitNeedValues(as, 1, index);
+            emitMem(as, 0xF2, false, 0x0F, 0x2A, XMM0, R13, 0);
+            emitMem(as, 0xF2, false, 0x0F, 0x11, XMM0, R13, 0);
+            break;
+        case ADD_REAL: emitRealBinary(as, 0x58, index); break;
+        case MINUS_REAL: emitRealBinary(as, 0x5C, index); break;
+        case MULT_REAL: emitRealBinary(as, 0x59, index); break;
+        case DIV_REAL: emitRealBinary(as, 0x5E, index); break;
+        case DIV_INT:
+            emitNeedValues(as, 2, index);
+            emitMem(as, 0xF2, false, 0x0F, 0x2A, XMM0, R13, -SLOT_SIZE);
+            emitMem(as, 0xF2, false, 0x0F, 0x2A, XMM1, R13, 0);
+            emitReg(as, 0xF2, false, 0x0F, 0x5E, XMM0, XMM1);
+            emitMem(as, 0xF2, false, 0x0F, 0x11, XMM0, R13, -SLOT_SIZE);
+            emitDrop(as, 1);
+            break;
+        case EQ_INT: case NEQ_INT: case LESS_INT: case LESS_EQ_INT: case GREATER_INT: case GREATER_EQ_INT:
+            emitIntCompare(as, intCompareCC(op->op), index);
+            break;
+        case EQ_BOOL: case NEQ_BOOL: case LESS_BOOL: case LESS_EQ_BOOL: case GREATER_BOOL: case GREATER_EQ_BOOL:
+            emitBoolCompare(as, intCompareCC(op->op), index);
+            break;
+        case EQ_REAL: case NEQ_REAL: case LESS_REAL: case LESS_EQ_REAL: case GREATER_REAL: case GREATER_EQ_REAL:
+            emitRealCompare(as, op->op, index);
+            break;
+        case AND:
+        case OR:
+            emitNeedValues(as, 2, index);
+            emitLoadByte(as, RAX, R13, -SLOT_SIZE);
+            emitLoadByte(as, RCX, R13, 0);
+            emitReg(as, 0, false, op->op == AND ? 0x21 : 0x09, -1, RCX, RAX);
+            emitStore64(as, R13, -SLOT_SIZE, RAX);
+            emitDrop(as, 1);
+            break;
+        case NOT:
+            emitNeedValues(as, 1, index);
+            emitLoadByte(as, RAX, R13, 0);
+            emitAluImm(as, false, 6, RAX, 1);
+            emitStore64(as, R13, 0, RAX);
+            break;
+        case FETCH_LOCAL_INT:
+        case FETCH_GLOBAL_INT:
+            if (!slotInRange(vm, op->a)) {
+                emitHelper(as, (void*)jitStep, index);
+                break;
+            }
+            emitSlotAddress(as, op->a, R8, index);
+            emitLoad64(as, RAX, R8, 0);
+            emitPushRax(as, index);
+            break;
+        case STORE_LOCAL_INT_DISCARD:
+        case STORE_GLOBAL_INT_DISCARD:
+            if (!slotInRange(vm, op->a)) {
+                emitHelper(as, (void*)jitStep, index);
+                break;
+            }
+            emitNeedValues(as, 1, index);
+            emitSlotAddress(as, op->a, R8, index);
+            emitLoad64(as, RAX, R13, 0);
+            emitStore64(as, R8, 0, RAX);
+            emitDrop(as, 1);
+            break;
+        case MOVE_R:
+            if (!slotInRange(vm, op->a) || !slotInRange(vm, op->operand.asInt)) {
+                emitHelper(as, (void*)jitStep, index);
+                break;
+            }
+            emitSlotAddress(as, op->a, R8, index);
+            emitSlotAddress(as, op->operand.asInt, R10, index);
+            emitLoad64(as, RAX, R8, 0);
+            emitStore64(as, R10, 0, RAX);
+            break;
+        case LOADK_INT_R:
+            if (!slotInRange(vm, op->operand.asInt)) {
+                emitHelper(as, (void*)jitStep, index);
+                break;
+            }
+            emitSlotAddress(as, op->operand.asInt, R10, index);
+            emitMovImm32(as, RAX, op->a);
+            emitStore64(as, R10, 0, RAX);
+            break;
+        case ADD_INT_RR: case MINUS_INT_RR: case MULT_INT_RR: case MOD_INT_RR: case FDIV_INT_RR:
+        case ADD_INT_RK: case MINUS_INT_RK: case MULT_INT_RK: case MOD_INT_RK: case FDIV_INT_RK: {
+            bool immediate = op->op >= ADD_INT_RK && op->op <= FDIV_INT_RK;
+            if (!slotInRange(vm, op->a) || !slotInRange(vm, op->operand.asInt) ||
+                (!immediate && !slotInRange(vm, op->b))) {
+                emitHelper(as, (void*)jitStep, index);
+                break;
+            }
+            emitSlotAddress(as, op->a, R8, index);
+            if (!immediate) emitSlotAddress(as, op->b, R9, index);
+            emitSlotAddress(as, op->operand.asInt, R10, index);
+            emitLoad32(as, RAX, R8, 0);
+            emitRegisterArith(as, op->op, immediate, op->b, index);
+            emitStore64(as, R10, 0, RAX);
+            break;
+        }
+        case ADD_REAL_RR: case MINUS_REAL_RR: case MULT_REAL_RR: case DIV_REAL_RR: {
+            if (!slotInRange(vm, op->a) || !slotInRange(vm, op->b) || !slotInRange(vm, op->operand.asInt)) {
+                emitHelper(as, (void*)jitStep, index);
+                break;
+            }
+            int opcode = op->op == ADD_REAL_RR ? 0x58 : op->op == MINUS_REAL_RR ? 0x5C :
+                         op->op == MULT_REAL_RR ? 0x59 : 0x5E;
+            emitSlotAddress(as, op->a, R8, index);
+            emitSlotAddress(as, op->b, R9, index);
+            emitSlotAddress(as, op->operand.asInt, R10, index);
+            emitMem(as, 0xF2, false, 0x0F, 0x10, XMM0, R8, 0);
+            emitMem(as, 0xF2, false, 0x0F, opcode, XMM0, R9, 0);
+            emitMem(as, 0xF2, false, 0x0F, 0x11, XMM0, R10, 0);
+            break;
+        }
+        case B_FALSE:
+            emitNeedValues(as, 1, index);
+            emitLoadByte(as, RAX, R13, 0);
+            emitDrop(as, 1);
+            emitReg(as, 0, false, 0x85, -1, RAX, RAX);
+            emitJcc(as, CC_E, (int)(op->operand.target - ops));
+            break;
+        case BRANCH:
+            emitJmp(as, (int)(op->operand.target - ops));
+            break;
+        case BEQ_INT: case BNE_INT: case BLT_INT: case BLE_INT: case BGT_INT: case BGE_INT:
+            emitNeedValues(as, 2, index);
+            emitLoad32(as, RAX, R13, -SLOT_SIZE);
+            emitMem(as, 0, false, 0x3B, -1, RAX, R13, 0);
+            emitDrop(as, 2);
+            emitJcc(as, intCompareCC(op->op), (int)(op->operand.target - ops));
+            break;
+        case BEQ_INT_RR: case BNE_INT_RR: case BLT_INT_RR: case BLE_INT_RR: case BGT_INT_RR: case BGE_INT_RR:
+        case BEQ_INT_RK: case BNE_INT_RK: case BLT_INT_RK: case BLE_INT_RK: case BGT_INT_RK: case BGE_INT_RK: {
+            bool immediate = op->op >= BEQ_INT_RK;
+            if (!slotInRange(vm, op->a) || (!immediate && !slotInRange(vm, op->b))) {
+                // A branch cannot go through jitStep, so let the interpreter raise the error.
+                emitSideExit(as, index);
+                break;
+            }
+            emitSlotAddress(as, op->a, R8, index);
+            emitLoad32(as, RAX, R8, 0);
+            if (immediate) {
+                emitAluImm(as, false, 7, RAX, op->b);
+            } else {
+                emitSlotAddress(as, op->b, R9, index);
+                emitMem(as, 0, false, 0x3B, -1, RAX, R9, 0);
+            }
+            emitJcc(as, intCompareCC(op->op), (int)(op->operand.target - ops));
+            break;
+        }
+        case DO_CALL:
+            emitHelper(as, (void*)jitCall, index);
+            break;
+        case TAIL_CALL: {
+            // The interpreter moves the arguments over the frame, which keeps its base, and
+            // answers with the callee's entry. Any other callee is left to the interpreter.
+            int target = (int)(op->operand.target - ops);
+            emitSyncTop(as);
+            emitReg(as, 0, true, 0x89, -1, RBX, RDI);
+            emitMovImm32(as, RSI, index);
+            emitCall(as, (void*)jitStep);
+            emitReloadTop(as);
+            if (target == as->entry) {
+                emitAluImm(as, false, 7, RAX, target);
+                emitJcc(as, CC_NE, as->epilogue);
+                emitJmp(as, target);
+            } else {
+                emitJmp(as, as->epilogue);
+            }
+            break;
+        }
+        case RETURN:
+            emitReturn(as, true);
+            break;
+        case RETURN_NIL:
+            emitReturn(as, false);
+            break;
+        case EXIT:
+            emitSideExit(as, index);
+            break;
+        default:
+            emitHelper(as, (void*)jitStep, index);
+            break;
+    }
+}
+
+static void emitPrologue(Assembler* as) {
+    static const byte saveRegisters[] = {
+        0x53,               // push rbx
+        0x41, 0x54,         // push r12
+        0x41, 0x55,         // push r13
+        0x41, 0x56,         // push r14
+        0x41, 0x57,         // push r15
+    };
+    static const byte leaLast[] = { 0x4D, 0x8D, 0x7C, 0xC4, 0xF8 };    // lea r15, [r12 + rax * 8 - 8]
+
+    emitBytes(as, saveRegisters, sizeof(saveRegisters));
+    emitReg(as, 0, true, 0x89, -1, RDI, RBX);
+    emitReg(as, 0, true, 0x89, -1, RSI, R14);
+    emitLoad64(as, R12, RBX, (int)offsetof(VM, stack.data));
+    emitReloadTop(as);
+    emitMem(as, 0, true, 0x63, -1, RAX, RBX, (int)offsetof(VM, stack.capacity));
+    emitBytes(as, leaLast, sizeof(leaLast));
+}
+
+static void emitEpilogue(Assembler* as) {
+    static const byte restoreRegisters[] = {
+        0x41, 0x5F,         // pop r15
+        0x41, 0x5E,         // pop r14
+        0x41, 0x5D,         // pop r13
+        0x41, 0x5C,         // pop r12
+        0x5B,               // pop rbx
+        0xC3,               // ret
+    };
+
+    bindLabel(as, as->epilogue);
+    emitBytes(as, restoreRegisters, sizeof(restoreRegisters));
+}
+
+static void emitErrorStubs(Assembler* as) {
+    // Stubs may not add stubs of their own, so walk a fixed count.
+    int count = as->stubCount;
+
+    for (int i = 0; i < count; i++) {
+        ErrorStub stub = as->stubs[i];
+
+        bindLabel(as, stub.label);
+        emitSyncTop(as);
+        emitReg(as, 0, true, 0x89, -1, RBX, RDI);
+        emitMovImm32(as, RSI, stub.error);
+        emitCall(as, (void*)jitError);
+        emitMovImm32(as, RAX, stub.index);
+        emitJmp(as, as->epilogue);
+    }
+}
+
+static void freeAssembler(Assembler* as) {
+    free(as->code);
+    free(as->labels);
+    free(as->fixups);
+    free(as->stubs);
+}
+
+static JitFunction install(Jit* jit, Assembler* as) {
+    if (jit->codeCount == jit->codeCapacity) {
+        int capacity = GROW_CAPACITY(jit->codeCapacity, 8);
+        JitCode* code = (JitCode*) realloc(jit->code, capacity * sizeof(JitCode));
+        if (code == NULL) return NULL;
+        jit->code = code;
+        jit->codeCapacity = capacity;
+    }
+
+    void* memory = mmap(NULL, as->count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return NULL;
+
+    memcpy(memory, as->code, as->count);
+    if (mprotect(memory, as->count, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, as->count);
+        return NULL;
+    }
+
+    jit->code[jit->codeCount].memory = memory;
+    jit->code[jit->codeCount].size = as->count;
+    jit->codeCount++;
+
+    return (JitFunction)memory;
+}
+
+static JitFunction compileFunction(VM* vm, int entry) {
+    DecodedProgram* program = &vm->code;
+
+    bool* inRegion = findRegion(program, entry);
+    if (inRegion == NULL) return NULL;
+
+    Assembler as;
+    memset(&as, 0, sizeof(as));
+    as.vm = vm;
+    as.entry = entry;
+
+    // Labels 0 .. count - 1 are the instructions themselves.
+    for (int i = 0; i < program->count; i++) {
+        newLabel(&as);
+    }
+    as.epilogue = newLabel(&as);
+
+    emitPrologue(&as);
+    emitJmp(&as, entry);
+
+    for (int i = 0; i < program->count && !as.failed; i++) {
+        if (!inRegion[i]) continue;
+
+        bindLabel(&as, i);
+        compileOp(&as, program->ops, i);
+
+        // An instruction that falls through into code outside the region hands over to the
+        // interpreter there.
+        if (i + 1 < program->count && !inRegion[i + 1]) emitSideExit(&as, i + 1);
+    }
+
+    emitErrorStubs(&as);
+    emitEpilogue(&as);
+    free(inRegion);
+
+    JitFunction function = NULL;
+
+    if (!as.failed) {
+        for (int i = 0; i < as.fixupCount; i++) {
+            Fixup* fixup = &as.fixups[i];
+            int target = as.labels[fixup->label];
+            if (target < 0) {
+                as.failed = true;
+                break;
+            }
+
+            int32_t rel = target - (fixup->pos + 4);
+            memcpy(&as.code[fixup->pos], &rel, sizeof(rel));
+        }
+    }
+
+    if (!as.failed) function = install(&vm->jit, &as);
+
+    freeAssembler(&as);
+    return function;
+}
+
+JitFunction jitLookup(VM* vm, int entry) {
+    Jit* jit = &vm->jit;
+
+    if (jit->functions[entry] != NULL) return jit->functions[entry];
+    if (jit->callCounts[entry] < 0 || ++jit->callCounts[entry] < jit->threshold) return NULL;
+
+    jit->functions[entry] = compileFunction(vm, entry);
+    if (jit->functions[entry] == NULL) jit->callCounts[entry] = -1;
+
+    return jit->functions[entry];
+}
+
+#else
+
+JitFunction jitLookup(VM* vm, int entry) {
+    (void)vm;
+    (void)entry;
+    return NULL;
+}
+
+#endif
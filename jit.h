@@ -0,0 +1,74 @@
+#ifndef PSEUDOCOMPILER_JIT_H
+#define PSEUDOCOMPILER_JIT_H
+
+#include "common.h"
+#include "stack.h"
+
+// Template JIT for subroutines. Once a subroutine has been called threshold times, the
+// instructions reachable from its entry (without following calls) are translated to x86-64
+// code. Instructions without a native template run through jitStep, one at a time, and
+// anything that leaves the subroutine's control flow hands the rest of the call back to the
+// interpreter. Only built on x86-64 Linux and macOS, and only with PSEUDO_JIT defined.
+#if defined(PSEUDO_JIT) && defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define JIT_AVAILABLE
+#endif
+
+#define DEFAULT_JIT_THRESHOLD   50
+
+// Deepest nesting of native calls. Deeper calls run in the interpreter, which keeps the C
+// stack bounded whatever --frames allows.
+#define JIT_MAX_DEPTH           10000
+
+// Native functions return JIT_RETURNED once the subroutine has returned, or the index of the
+// instruction the interpreter must continue from.
+#define JIT_RETURNED            -1
+#define JIT_NOT_RUN             -2
+
+typedef struct VM VM;
+
+typedef int (*JitFunction)(VM* vm, Value* fp);
+
+typedef enum {
+    JIT_STACK_OVERFLOW,
+    JIT_STACK_UNDERFLOW,
+    JIT_INVALID_SLOT,
+    JIT_DIVISION_BY_ZERO,
+    JIT_INTEGER_OVERFLOW,
+} JitError;
+
+typedef struct {
+    void* memory;
+    size_t size;
+} JitCode;
+
+typedef struct {
+    bool enabled;
+    int threshold;
+    int depth;
+    int count;
+    int* callCounts;            // Per instruction index. -1 once compiling has failed.
+    JitFunction* functions;     // Per instruction index, NULL until compiled.
+    JitCode* code;
+    int codeCount;
+    int codeCapacity;
+} Jit;
+
+void initJit(Jit* jit);
+void freeJit(Jit* jit);
+void configureJit(Jit* jit, bool enabled, int threshold);
+
+// Sizes the per-instruction tables for a freshly decoded program.
+bool prepareJit(Jit* jit, int count);
+
+// Counts a call to the subroutine starting at entry, compiling it once it is hot. Returns
+// its native code, or NULL if it should be interpreted.
+JitFunction jitLookup(VM* vm, int entry);
+
+// Runtime entry points used by native code, implemented in vm.c. jitStep and jitCall return
+// the index of the next instruction to run.
+int jitStep(VM* vm, int index);
+int jitCall(VM* vm, int index);
+void jitReturn(VM* vm, bool hasValue);
+void jitError(VM* vm, JitError error);
+
+#endif //PSEUDOCOMPILER_JIT_H
@@ -1,3 +1,4 @@
+#include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -547,8 +548,25 @@ void freeNode(Node* node) {
     free(node);
 }
 
+// The keyword trie never changes once built, so it is built once per process and shared by
+// every lexer on every thread. Threads that lose the race to build it wait until it is ready.
+static Node* sharedTrie() {
+    static atomic_int state = 0;    // 0: not built, 1: being built, 2: built.
+    static Node* trie = NULL;
+
+    int expected = 0;
+    if (atomic_compare_exchange_strong(&state, &expected, 1)) {
+        trie = createTrie();
+        atomic_store(&state, 2);
+    }
+
+    while (atomic_load(&state) != 2) {}
+    return trie;
+}
+
 void freeTrie(Lexer* lexer) {
-    freeNode(lexer->keywordTrie);
+    // Shared, so it stays for the next lexer.
+    lexer->keywordTrie = NULL;
 }
 
 void initLexer(Lexer* lexer, const char* source) {
@@ -556,7 +574,7 @@ void initLexer(Lexer* lexer, const char* source) {
     lexer->current = source;
     lexer->line = 1;
     lexer->col = 1;
-    lexer->keywordTrie = createTrie();
+    lexer->keywordTrie = sharedTrie();
     lexer->array = initTokenArray();
 }
 
@@ -1,13 +1,35 @@
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #include "lexer.h"
 #include "parser.h"
 #include "semantic.h"
 #include "bytecode.h"
 #include "compiler.h"
+#include "optimizer.h"
 #include "vm.h"
+#include "codegen.h"
+#include "batch.h"
+#include "forkserver.h"
+#include "daemon.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SPAWN_AVAILABLE
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char** environ;
+#endif
+
+// Where -cc finds runtime.c, memory.c, object.c and common.c to build them into the executable,
+// fixed when this compiler is built. The PSEUDO_RUNTIME_DIR environment variable overrides it.
+#ifndef PSEUDO_RUNTIME_DIR
+#define PSEUDO_RUNTIME_DIR "."
+#endif
 
 static char* readFile(const char* path) {
     FILE* file = fopen(path, "rb");
@@ -38,30 +60,144 @@ static char* readFile(const char* path) {
     return buffer;
 }
 
-const char* getExecutableName(const char* fullPath) {
-    // Find last slash in the path (Windows uses \, Unix uses /)
-    const char* lastSlash = strrchr(fullPath, '\\');
-    const char* lastForwardSlash = strrchr(fullPath, '/');
-
-    // Choose the one that appears later
+// Copies the file name of fullPath, without its directory or a ".exe" extension, into buffer.
+void getExecutableName(const char* fullPath, char* buffer, size_t size) {
+    // Windows separates directories with \, Unix with /.
     const char* base = fullPath;
-    if (lastSlash && lastForwardSlash)
-        base = (lastSlash > lastForwardSlash) ? lastSlash + 1 : lastForwardSlash + 1;
-    else if (lastSlash)
-        base = lastSlash + 1;
-    else if (lastForwardSlash)
-        base = lastForwardSlash + 1;
-
-    // Check if it ends in ".exe" (case-insensitive)
+    for (const char* c = fullPath; *c != '\0'; c++) {
+        if (*c == '\\' || *c == '/') base = c + 1;
+    }
+
     size_t len = strlen(base);
-    if (len > 4 && _stricmp(base + len - 4, ".exe") == 0) {
-        static char buffer[256];  // buffer to store result
-        strncpy(buffer, base, len - 4); // copy without ".exe"
-        buffer[len - 4] = '\0';         // null-terminate
-        return buffer;
+    if (len > 4 && base[len - 4] == '.' && tolower((unsigned char)base[len - 3]) == 'e' &&
+        tolower((unsigned char)base[len - 2]) == 'x' && tolower((unsigned char)base[len - 1]) == 'e') {
+        len -= 4;
+    }
+
+    snprintf(buffer, size, "%.*s", (int)len, base);
+}
+
+typedef struct {
+    bool registerMode;
+    bool optimize;
+    int gcTrigger;
+    int heapCells;
+    int stackSlots;
+    int frames;             // 0 unless --frames is given; the VM and native code differ.
+    bool jit;
+    int jitThreshold;
+    bool profileOps;
+    const char* profilePath;    // Where --profile writes its collapsed stacks, NULL without it.
+    int traceEntries;           // Instructions --trace keeps, 0 without it.
+    bool stats;
+    unsigned long long maxInstructions; // 0 for no limit.
+    int timeoutMs;          // Wall time of each -forkserver run, 0 for no limit.
+    int threads;            // Workers for -batch, 0 for one per processor.
+} Options;
+
+static void initOptions(Options* options) {
+    options->registerMode = false;
+    options->optimize = true;
+    options->gcTrigger = DEFAULT_GC_TRIGGER;
+    options->heapCells = DEFAULT_HEAP_CELLS;
+    options->stackSlots = DEFAULT_STACK_SLOTS;
+    options->frames = 0;
+    options->jit = true;
+    options->jitThreshold = DEFAULT_JIT_THRESHOLD;
+    options->profileOps = false;
+    options->profilePath = NULL;
+    options->traceEntries = 0;
+    options->stats = false;
+    options->maxInstructions = 0;
+    options->timeoutMs = 0;
+    options->threads = 0;
+}
+
+// Value of a "--name=value" flag, or NULL if arg is a different flag.
+static const char* optionValue(const char* arg, const char* name) {
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0 || arg[length] != '=') return NULL;
+    return arg + length + 1;
+}
+
+static bool readCount(const char* name, const char* value, int min, int max, int* count) {
+    char* end;
+    long parsed = strtol(value, &end, 10);
+
+    if (end == value || *end != '\0' || parsed < min || parsed > max) {
+        fprintf(stderr, "%s must be a number between %d and %d.\n", name, min, max);
+        return false;
+    }
+
+    *count = (int)parsed;
+    return true;
+}
+
+static bool readLimit(const char* name, const char* value, unsigned long long* limit) {
+    char* end;
+    unsigned long long parsed = strtoull(value, &end, 10);
+
+    if (end == value || *end != '\0' || value[0] == '-' || parsed == 0) {
+        fprintf(stderr, "%s must be a positive number.\n", name);
+        return false;
     }
 
-    return base;  // return base name as-is
+    *limit = parsed;
+    return true;
+}
+
+// Flags starting with "--" may appear anywhere after the command. Recognised ones are removed
+// from argv so the positional arguments keep their usual places.
+static bool parseOptions(int* argc, char* argv[], Options* options) {
+    int kept = 1;
+
+    for (int i = 1; i < *argc; i++) {
+        const char* value;
+
+        if (strncmp(argv[i], "--", 2) != 0) {
+            argv[kept++] = argv[i];
+        } else if (strcmp(argv[i], "--register") == 0) {
+            options->registerMode = true;
+        } else if (strcmp(argv[i], "--no-optimize") == 0) {
+            options->optimize = false;
+        } else if ((value = optionValue(argv[i], "--gc-trigger")) != NULL) {
+            if (!readCount("--gc-trigger", value, 1, 100, &options->gcTrigger)) return false;
+        } else if ((value = optionValue(argv[i], "--heap")) != NULL) {
+            if (!readCount("--heap", value, 1, INT_MAX, &options->heapCells)) return false;
+        } else if ((value = optionValue(argv[i], "--stack")) != NULL) {
+            if (!readCount("--stack", value, 16, INT_MAX / 2, &options->stackSlots)) return false;
+        } else if ((value = optionValue(argv[i], "--frames")) != NULL) {
+            if (!readCount("--frames", value, 1, INT_MAX / 2, &options->frames)) return false;
+        } else if (strcmp(argv[i], "--no-jit") == 0) {
+            options->jit = false;
+        } else if ((value = optionValue(argv[i], "--jit-threshold")) != NULL) {
+            if (!readCount("--jit-threshold", value, 1, INT_MAX, &options->jitThreshold)) return false;
+        } else if (strcmp(argv[i], "--profile-ops") == 0) {
+            options->profileOps = true;
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            options->traceEntries = DEFAULT_TRACE_ENTRIES;
+        } else if ((value = optionValue(argv[i], "--trace")) != NULL) {
+            if (!readCount("--trace", value, 1, 1 << 24, &options->traceEntries)) return false;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options->stats = true;
+        } else if ((value = optionValue(argv[i], "--max-instructions")) != NULL) {
+            if (!readLimit("--max-instructions", value, &options->maxInstructions)) return false;
+        } else if ((value = optionValue(argv[i], "--timeout")) != NULL) {
+            if (!readCount("--timeout", value, 1, INT_MAX, &options->timeoutMs)) return false;
+        } else if ((value = optionValue(argv[i], "--threads")) != NULL) {
+            if (!readCount("--threads", value, 1, MAX_BATCH_THREADS, &options->threads)) return false;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            options->profilePath = "profile.folded";
+        } else if ((value = optionValue(argv[i], "--profile")) != NULL) {
+            options->profilePath = value;
+        } else {
+            fprintf(stderr, "Unknown option \"%s\".\n", argv[i]);
+            return false;
+        }
+    }
+
+    *argc = kept;
+    return true;
 }
 
 static bool hasExtension(const char* filename, const char* extension) {
@@ -70,7 +206,72 @@ static bool hasExtension(const char* filename, const char* extension) {
     return strcmp(dot, extension) == 0;
 }
 
-static void runFile(const char* path, bool debug) {
+// Runs a VM that is ready to go, with the profiles that were asked for.
+static void runWithOptions(VM* vm, const Options* options, bool debug) {
+    OpProfile profile;
+    SampleProfile samples;
+    TraceBuffer trace;
+
+    // Debug runs always keep a trace, in place of printing every instruction as it runs.
+    int traceEntries = options->traceEntries > 0 ? options->traceEntries : debug ? DEFAULT_TRACE_ENTRIES : 0;
+    if (traceEntries > 0) {
+        if (!initTraceBuffer(&trace, traceEntries)) {
+            fprintf(stderr, "Not enough memory for the instruction trace.\n");
+            return;
+        }
+        vm->trace = &trace;
+    }
+
+    if (options->profileOps) {
+        if (!initOpProfile(&profile)) {
+            fprintf(stderr, "Not enough memory for the instruction profile.\n");
+            if (vm->trace != NULL) freeTraceBuffer(&trace);
+            return;
+        }
+        vm->opProfile = &profile;
+    }
+
+    if (options->profilePath != NULL) {
+#ifdef PROFILER_AVAILABLE
+        if (!initSampleProfile(&samples)) {
+            fprintf(stderr, "Not enough memory for the profile.\n");
+            if (vm->opProfile != NULL) freeOpProfile(&profile);
+            if (vm->trace != NULL) freeTraceBuffer(&trace);
+            return;
+        }
+        vm->sampleProfile = &samples;
+#else
+        fprintf(stderr, "--profile is not supported on this platform.\n");
+#endif
+    }
+
+    vm->countInstructions = options->stats || options->maxInstructions > 0;
+    if (options->maxInstructions > 0) vm->instructionLimit = options->maxInstructions;
+    if (run(vm, debug)) printf("Program executed correctly.\n");
+
+    if (options->stats) {
+        fprintf(stderr, "Instructions executed: %llu\n", (unsigned long long)vm->executed);
+        fprintf(stderr, "Peak heap cells: %zu\n", vm->mem.peakInUse);
+    }
+
+    if (vm->trace != NULL) {
+        vm->trace = NULL;
+        freeTraceBuffer(&trace);
+    }
+
+    if (vm->opProfile != NULL) {
+        vm->opProfile = NULL;
+        freeOpProfile(&profile);
+    }
+
+    if (vm->sampleProfile != NULL) {
+        writeSampleProfile(&samples, &vm->code, vm->program, options->profilePath, stderr);
+        vm->sampleProfile = NULL;
+        freeSampleProfile(&samples);
+    }
+}
+
+static void runFile(const char* path, const Options* options, bool debug) {
     char* source = readFile(path);
 
     Lexer lexer;
@@ -112,22 +313,35 @@ static void runFile(const char* path, bool debug) {
 
     Compiler compiler;
     initCompiler(&compiler, &stream);
+    compiler.registerMode = options->registerMode;
 
     compile(&compiler, &parser.ast);
 
+    if (options->optimize) optimizeBytecode(compiler.bStream);
+
     if (debug) printf("COMPILED\n");
 
     if (debug) printCompileResult(&compiler);
 
 
     VM vm;
-    initVM(&vm, 1024, 1024, 256, compiler.bStream);
+    bool vmReady = initVM(&vm, options->heapCells, options->stackSlots, options->frames > 0 ? options->frames : DEFAULT_CALL_FRAMES, compiler.bStream);
+    if (!vmReady) {
+        freeParser(&parser);
+        freeLexer(&lexer);
+        freeAnalyser(&analyser);
+        freeCompiler(&compiler);
+        freeBytecodeStream(&stream);
+        return;
+    }
+    setCollectionTrigger(&vm.mem, options->gcTrigger);
+    configureJit(&vm.jit, options->jit, options->jitThreshold);
 
     if (debug) printf("_______________________________________________\n");
     if (debug) printf("RUN RESULT\n");
     if (debug) printf("_______________________________________________\n\n");
 
-    run(&vm, debug);
+    runWithOptions(&vm, options, debug);
 
     /*for (int i = 0; i < compiler.bStream->count; i++) {
         printf("%x\n", compiler.bStream->stream[i]);
@@ -148,7 +362,7 @@ static void runFile(const char* path, bool debug) {
     freeVM(&vm);
 }
 
-static void compileFile(const char* path, const char* target, bool debug) {
+static void compileFile(const char* path, const char* target, const Options* options, bool debug) {
     char* source = readFile(path);
 
     Lexer lexer;
@@ -190,9 +404,12 @@ static void compileFile(const char* path, const char* target, bool debug) {
 
     Compiler compiler;
     initCompiler(&compiler, &stream);
+    compiler.registerMode = options->registerMode;
 
     compile(&compiler, &parser.ast);
 
+    if (options->optimize) optimizeBytecode(compiler.bStream);
+
     bool genRes = genBinFile(compiler.bStream, target);
 
     if (!genRes) {
@@ -210,28 +427,214 @@ static void compileFile(const char* path, const char* target, bool debug) {
     freeBytecodeStream(&stream);
 }
 
-static void runBytecode(const char* path, bool debug) {
+#ifdef SPAWN_AVAILABLE
+// Runs the C compiler on an argument list rather than a shell command, so names containing
+// quotes, $ or backticks reach it unchanged. CC may hold extra words, such as "gcc -m32".
+static bool buildNative(const char* cc, const char* dir, const char* target, const char* cPath, bool debug) {
+    const char* sources[] = { "runtime.c", "memory.c", "object.c", "common.c" };
+    const int sourceCount = sizeof(sources) / sizeof(sources[0]);
+
+    char* words = strdup(cc);
+    int maxArgs = (int)strlen(cc) / 2 + 1 + 6 + sourceCount + 2;
+    char** argv = (char**)malloc(sizeof(char*) * maxArgs);
+    char* paths[sizeof(sources) / sizeof(sources[0])] = { NULL };
+    bool ok = words != NULL && argv != NULL;
+
+    int argc = 0;
+    if (ok) {
+        for (char* word = strtok(words, " \t"); word != NULL; word = strtok(NULL, " \t")) argv[argc++] = word;
+        ok = argc > 0;
+    }
+
+    for (int i = 0; ok && i < sourceCount; i++) {
+        size_t size = strlen(dir) + strlen(sources[i]) + 2;
+        paths[i] = (char*)malloc(size);
+        if (paths[i] == NULL) ok = false;
+        else snprintf(paths[i], size, "%s/%s", dir, sources[i]);
+    }
+
+    if (ok) {
+        argv[argc++] = "-O2";
+        argv[argc++] = "-std=gnu11";
+        argv[argc++] = "-I";
+        argv[argc++] = (char*)dir;
+        argv[argc++] = "-o";
+        argv[argc++] = (char*)target;
+        argv[argc++] = (char*)cPath;
+        for (int i = 0; i < sourceCount; i++) argv[argc++] = paths[i];
+        argv[argc++] = "-lm";
+        argv[argc] = NULL;
+
+        if (debug) {
+            for (int i = 0; i < argc; i++) printf(i == 0 ? "%s" : " %s", argv[i]);
+            printf("\n");
+        }
+
+        // The compiler's output must not be interleaved with anything still buffered here.
+        fflush(stdout);
+        fflush(stderr);
+
+        pid_t child;
+        int status;
+        ok = posix_spawnp(&child, argv[0], NULL, NULL, argv, environ) == 0;
+        if (ok) {
+            while (waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+            ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+    }
+
+    for (int i = 0; i < sourceCount; i++) free(paths[i]);
+    free(argv);
+    free(words);
+    return ok;
+}
+#else
+// Without posix_spawn the command goes through system(), so names that the shell would
+// interpret inside double quotes are refused.
+static bool shellSafe(const char* name) {
+    return strpbrk(name, "\"$`%\\") == NULL;
+}
+
+static bool buildNative(const char* cc, const char* dir, const char* target, const char* cPath, bool debug) {
+    if (!shellSafe(dir) || !shellSafe(target)) {
+        fprintf(stderr, "Names passed to the C compiler may not contain quotes, $, %%, backticks or backslashes.\n");
+        return false;
+    }
+
+    const char* fmt = "%s -O2 -std=gnu11 -I\"%s\" -o \"%s\" \"%s\" \"%s/runtime.c\" \"%s/memory.c\" \"%s/object.c\" \"%s/common.c\" -lm";
+    int size = snprintf(NULL, 0, fmt, cc, dir, target, cPath, dir, dir, dir, dir) + 1;
+    char* command = (char*)malloc(size);
+    if (command == NULL) return false;
+    snprintf(command, size, fmt, cc, dir, target, cPath, dir, dir, dir, dir);
+
+    if (debug) printf("%s\n", command);
+
+    bool ok = system(command) == 0;
+    free(command);
+    return ok;
+}
+#endif
+
+static void compileToNative(const char* path, const char* target, const Options* options, bool debug) {
+    char* source = readFile(path);
+
+    Lexer lexer;
+    initLexer(&lexer, source);
+
+    scanSource(&lexer);
+
+    if (debug) printTokens(&lexer);
+
+    Parser parser;
+    initParser(&parser, lexer.array);
+
+    bool res = genAST(&parser);
+
+    if (res) {
+        freeLexer(&lexer);
+        freeParser(&parser);
+        return;
+    }
+
+    Analyser analyser;
+    initAnalyser(&analyser);
+
+    bool semRes = semanticAnalysis(&analyser, &parser.ast);
+
+    if (semRes) {
+        freeLexer(&lexer);
+        freeParser(&parser);
+        freeAnalyser(&analyser);
+        return;
+    }
+
+    if (debug) printAST(&parser);
+
+    size_t length = strlen(target);
+    char* cPath = (char*)malloc(length + 3);
+    memcpy(cPath, target, length);
+    memcpy(cPath + length, ".c", 3);
+
+    // The only options that reach the executable. The rest only affect the VM.
+    CodegenLimits limits = { options->heapCells, options->gcTrigger, options->frames > 0 ? options->frames : DEFAULT_NATIVE_FRAMES };
+    bool genRes = false;
+
+    FILE* out = fopen(cPath, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Could not open file \"%s\".\n", cPath);
+    } else {
+        genRes = generateC(&parser.ast, out, &limits);
+        if (fclose(out) != 0) genRes = false;
+    }
+
+    freeParser(&parser);
+    freeLexer(&lexer);
+    freeAnalyser(&analyser);
+
+    if (!genRes) {
+        fprintf(stderr, "Something went wrong generating the C file.\n");
+        free(cPath);
+        return;
+    }
+
+    // The runtime is compiled from source next to the generated file, so the executable does
+    // not depend on how this compiler was built.
+    const char* cc = getenv("CC");
+    const char* dir = getenv("PSEUDO_RUNTIME_DIR");
+    if (cc == NULL || cc[0] == '\0') cc = "cc";
+    if (dir == NULL || dir[0] == '\0') dir = PSEUDO_RUNTIME_DIR;
+
+    if (!buildNative(cc, dir, target, cPath, debug)) {
+        fprintf(stderr, "The C compiler failed building \"%s\".\n", target);
+    }
+
+    free(cPath);
+}
+
+static void runBytecode(const char* path, const Options* options, bool debug) {
     bool addExtension = !hasExtension(path, ".pcbc");
 
     BytecodeStream stream;
     initBytecodeStream(&stream);
 
-    bool res = readBinFile(&stream, path, addExtension);
-
+    if (!readBinFile(&stream, path, addExtension)) {
+        freeBytecodeStream(&stream);
+        return;
+    }
 
     VM vm;
-    initVM(&vm, 1024, 1024, 256, &stream);
+    if (!initVM(&vm, options->heapCells, options->stackSlots, options->frames > 0 ? options->frames : DEFAULT_CALL_FRAMES, &stream)) {
+        freeBytecodeStream(&stream);
+        return;
+    }
+    setCollectionTrigger(&vm.mem, options->gcTrigger);
+    configureJit(&vm.jit, options->jit, options->jitThreshold);
 
     if (debug) printf("_______________________________________________\n");
     if (debug) printf("RUN RESULT\n");
     if (debug) printf("_______________________________________________\n\n");
 
-    run(&vm, debug);
+    runWithOptions(&vm, options, debug);
 
     freeBytecodeStream(&stream);
     freeVM(&vm);
 }
 
+// The options that -batch, -forkserver and -daemon pass on to libpseudo.
+static void toPseudoOptions(const Options* options, PseudoOptions* pseudoOptions) {
+    pseudoInitOptions(pseudoOptions);
+    pseudoOptions->registerMode = options->registerMode;
+    pseudoOptions->optimize = options->optimize;
+    pseudoOptions->heapCells = options->heapCells;
+    pseudoOptions->gcTrigger = options->gcTrigger;
+    pseudoOptions->stackSlots = options->stackSlots;
+    pseudoOptions->frames = options->frames > 0 ? options->frames : DEFAULT_CALL_FRAMES;
+    pseudoOptions->jit = options->jit;
+    pseudoOptions->jitThreshold = options->jitThreshold;
+    pseudoOptions->countInstructions = options->stats;
+    pseudoOptions->maxInstructions = options->maxInstructions;
+}
+
 static void printHelp() {
     printf("\nCambridge Psuedocode Compiler and Virtual Machine\n"
            "By Pablo Mestre Alonso              2025\n"
@@ -240,7 +643,43 @@ static void printHelp() {
            "-h -> Show help menu\n"
            "-cr <file path> -> Compiles and runs pseudocode source.\n"
            "-c <file path> <target name> -> Compiles pseudocode source and saves bytecode result as .pcbc.\n"
-           "-r <file path> -> Runs pseudocode bytecode (.pcbc file).\n\n");
+           "-r <file path> -> Runs pseudocode bytecode (.pcbc file).\n"
+           "-cc <file path> <target name> -> Translates pseudocode source to C (<target name>.c) and builds it\n"
+           "    into a native executable with the system C compiler ($CC, default cc).\n"
+           "-batch <manifest> -> Compiles and runs every job in the manifest across worker threads, one line\n"
+           "    per job: <source> [<input> [<expected output>]], with - for none. Prints one record per job:\n"
+           "    job, source, status, wall ms, instructions executed and peak heap cells, tab-separated.\n"
+           "-forkserver <file path> -> Compiles pseudocode source once, then reads requests from stdin, one per\n"
+           "    line: <input file> [<output file>], with - for none. Without an output file the program's OUTPUT\n"
+           "    is discarded. Each is run in a forked copy of the ready VM and answered on stdout with the input,\n"
+           "    status, wall ms, instructions executed (with --stats) and peak heap cells.\n"
+           "-daemon <socket path> -> Serves compile-and-run jobs on a Unix domain socket, keeping compiled\n"
+           "    programs and their VMs between jobs. Options given here apply to every job.\n"
+           "-client <socket path> <file path> -> Runs a source or .pcbc file on the daemon, with this process's\n"
+           "    stdin, stdout, stderr and working directory. Exits with 0 if the program ran to its end.\n"
+           "\n"
+           "Options:\n"
+           "--register -> Compile to register-form instructions where possible.\n"
+           "--no-optimize -> Skip the peephole pass over the compiled bytecode.\n"
+           "--gc-trigger=<percent> -> Heap occupancy that makes the next allocation collect garbage first (default 75).\n"
+           "--heap=<cells> -> Most heap objects (strings, arrays, files) the program may hold (default 1048576).\n"
+           "--stack=<slots> -> Size of the value stack (default %d).\n"
+           "--frames=<count> -> Deepest call nesting allowed (default %d, or %d in -cc executables).\n"
+           "--no-jit -> Interpret every subroutine instead of compiling hot ones to native code.\n"
+           "--jit-threshold=<calls> -> Calls after which a subroutine is compiled to native code (default 50).\n"
+           "--trace[=<entries>] -> Keep the last instructions executed (default %d) and print them if the program\n"
+           "    fails, or on SIGUSR1. Debug runs always keep them. Turns the JIT off.\n"
+           "--stats -> Print the number of instructions executed and the most heap cells in use at once\n"
+           "    to stderr when the program ends. Turns the JIT off.\n"
+           "--profile-ops -> Count and time every instruction and the most frequent instruction sequences,\n"
+           "    and print a report to stderr when the program ends. Turns the JIT off.\n"
+           "--profile[=<file>] -> Sample where the program spends its time, print a summary by subroutine and\n"
+           "    line, and write collapsed stacks for flame graphs to <file> (default profile.folded). Turns the JIT off.\n"
+           "--max-instructions=<n> -> Stop the program with a runtime error once it has executed n instructions,\n"
+           "    so one that never ends cannot hold up -batch. Turns the JIT off.\n"
+           "--timeout=<ms> -> Answer a -forkserver request with timeout if its run takes longer than this.\n"
+           "--threads=<n> -> Worker threads for -batch (default one per processor).\n\n",
+           DEFAULT_STACK_SLOTS, DEFAULT_CALL_FRAMES, DEFAULT_NATIVE_FRAMES, DEFAULT_TRACE_ENTRIES);
 }
 
 int main(int argc, char* argv[]) {
@@ -249,6 +688,13 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
+    Options options;
+    initOptions(&options);
+
+    if (!parseOptions(&argc, argv, &options)) {
+        return 1;
+    }
+
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-h") == 0) {
             printHelp();
@@ -261,19 +707,19 @@ int main(int argc, char* argv[]) {
             const char* path = argv[2];
 
             if (argc == 4 && strcmp(argv[3], "true") == 0) {
-                runFile(path, true);
+                runFile(path, &options, true);
                 return 0;
             }
             if (argc != 3) {
                 fprintf(stderr, "Usage: pseudo -r <file path>\n");
                 return 1;
             }
-            runFile(path, false);
+            runFile(path, &options, false);
         } else if (strcmp(argv[1], "-c") == 0) {
             const char* path = argv[2];
 
             if (argc == 5 && strcmp(argv[4], "true") == 0) {
-                compileFile(path, argv[3], true);
+                compileFile(path, argv[3], &options, true);
                 return 0;
             }
             if (argc != 4) {
@@ -281,19 +727,66 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
 
-            compileFile(path, argv[3], false);
+            compileFile(path, argv[3], &options, false);
         } else if (strcmp(argv[1], "-r") == 0) {
             const char* path = argv[2];
 
             if (argc == 4 && strcmp(argv[3], "true") == 0) {
-                runBytecode(path, true);
+                runBytecode(path, &options, true);
                 return 0;
             }
             if (argc != 3) {
                 fprintf(stderr, "Usage: pseudo -r <file path>\n");
                 return 1;
             }
-            runBytecode(path, false);
+            runBytecode(path, &options, false);
+        } else if (strcmp(argv[1], "-batch") == 0) {
+            if (argc != 3) {
+                fprintf(stderr, "Usage: pseudo -batch <manifest>\n");
+                return 1;
+            }
+
+            PseudoOptions pseudoOptions;
+            toPseudoOptions(&options, &pseudoOptions);
+            return runBatch(argv[2], &pseudoOptions, options.threads) ? 0 : 1;
+        } else if (strcmp(argv[1], "-forkserver") == 0) {
+            if (argc != 3) {
+                fprintf(stderr, "Usage: pseudo -forkserver <file path>\n");
+                return 1;
+            }
+
+            PseudoOptions pseudoOptions;
+            toPseudoOptions(&options, &pseudoOptions);
+            return runForkServer(argv[2], &pseudoOptions, options.timeoutMs) ? 0 : 1;
+        } else if (strcmp(argv[1], "-daemon") == 0) {
+            if (argc != 3) {
+                fprintf(stderr, "Usage: pseudo -daemon <socket path>\n");
+                return 1;
+            }
+
+            PseudoOptions pseudoOptions;
+            toPseudoOptions(&options, &pseudoOptions);
+            return runDaemon(argv[2], &pseudoOptions) ? 0 : 1;
+        } else if (strcmp(argv[1], "-client") == 0) {
+            if (argc != 4) {
+                fprintf(stderr, "Usage: pseudo -client <socket path> <file path>\n");
+                return 1;
+            }
+
+            return runClient(argv[2], argv[3]);
+        } else if (strcmp(argv[1], "-cc") == 0) {
+            const char* path = argv[2];
+
+            if (argc == 5 && strcmp(argv[4], "true") == 0) {
+                compileToNative(path, argv[3], &options, true);
+                return 0;
+            }
+            if (argc != 4) {
+                fprintf(stderr, "Usage: pseudo -cc <file path> <target name>\n");
+                return 1;
+            }
+
+            compileToNative(path, argv[3], &options, false);
         } else {
             fprintf(stderr, "Unknown command.\n");
             printHelp();
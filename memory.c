@@ -1,28 +1,71 @@
 
 #include "memory.h"
 
-void createProgramMemory(ProgramMemory* mem, int numCells) {
-    mem->memSize = numCells * sizeof(MemoryCell);
-    mem->inUse = 0;
+static void resetCells(MemoryCell* cells, size_t count, MemoryCell* next) {
+    for (size_t i = 0; i < count; i++) {
+        cells[i].obj.type = OBJ_NONE;
+        cells[i].nextFree = i + 1 < count ? &cells[i + 1] : next;
+        cells[i].free = true;
+        cells[i].forceFree = false;
+        cells[i].marked = false;
+    }
+}
+
+// Adds a chunk of free cells, doubling the heap each time until it reaches maxCells.
+static bool growProgramMemory(ProgramMemory* mem) {
+    size_t count = mem->numCells > 0 ? mem->numCells : HEAP_INITIAL_CELLS;
+    if (count > mem->maxCells - mem->numCells) count = mem->maxCells - mem->numCells;
+    if (count == 0) return false;
+
+    if (mem->chunkCount == mem->chunkCapacity) {
+        int capacity = GROW_CAPACITY(mem->chunkCapacity, 8);
+        HeapChunk* chunks = (HeapChunk*) realloc(mem->chunks, capacity * sizeof(HeapChunk));
+        if (chunks == NULL) return false;
 
-    mem->memBlock = (MemoryCell*) malloc(mem->memSize);
-    if (mem->memBlock == NULL) {
-        fprintf(stderr, "Problem allocating program memory block. Machine will abort now.\n");
-        exit(-1);
+        mem->chunks = chunks;
+        mem->chunkCapacity = capacity;
     }
 
-    mem->free = mem->memBlock;
+    MemoryCell* cells = (MemoryCell*) malloc(count * sizeof(MemoryCell));
+    if (cells == NULL) return false;
 
-    for (int i = 0; i < numCells - 1; i++) {
-        mem->memBlock[i].nextFree = &(mem->memBlock[i + 1]);
-        mem->memBlock[i].free = true;
-        mem->memBlock[i].forceFree = false;
-        mem->memBlock[i].marked = false;
+    resetCells(cells, count, mem->free);
+    mem->free = cells;
+
+    int pos = mem->chunkCount;
+    while (pos > 0 && mem->chunks[pos - 1].cells > cells) {
+        mem->chunks[pos] = mem->chunks[pos - 1];
+        pos--;
     }
-    mem->memBlock[numCells - 1].nextFree = NULL;
-    mem->memBlock[numCells - 1].free = true;
-    mem->memBlock[numCells - 1].forceFree = false;
-    mem->memBlock[numCells - 1].marked = false;
+    mem->chunks[pos].cells = cells;
+    mem->chunks[pos].count = count;
+    mem->chunkCount++;
+    mem->numCells += count;
+
+    return true;
+}
+
+bool createProgramMemory(ProgramMemory* mem, int maxCells) {
+    mem->chunks = NULL;
+    mem->chunkCount = 0;
+    mem->chunkCapacity = 0;
+    mem->numCells = 0;
+    mem->maxCells = maxCells > 0 ? maxCells : 1;
+    mem->inUse = 0;
+    mem->peakInUse = 0;
+    mem->free = NULL;
+    mem->markRoots = NULL;
+    mem->rootsContext = NULL;
+    mem->logCollections = false;
+
+    if (!growProgramMemory(mem)) {
+        fprintf(diagnostics(), "Problem allocating program memory block.\n");
+        freeProgramMemory(mem);
+        return false;
+    }
+
+    setCollectionTrigger(mem, DEFAULT_GC_TRIGGER);
+    return true;
 }
 
 static void freeCell(MemoryCell* cell, ProgramMemory* mem) {
@@ -37,37 +80,70 @@ static void freeCell(MemoryCell* cell, ProgramMemory* mem) {
 }
 
 void freeProgramMemory(ProgramMemory* mem) {
-    size_t numCells = mem->memSize / sizeof(MemoryCell);
+    for (int c = 0; c < mem->chunkCount; c++) {
+        for (size_t i = 0; i < mem->chunks[c].count; i++) {
+            MemoryCell* cell = &mem->chunks[c].cells[i];
+            if (!cell->free) freeCell(cell, mem);
+        }
 
-    for (size_t i = 0; i < numCells; i++) {
-        MemoryCell* cell = &mem->memBlock[i];
-        freeCell(cell, mem);
+        free(mem->chunks[c].cells);
     }
 
+    free(mem->chunks);
+    mem->chunks = NULL;
+    mem->chunkCount = 0;
+    mem->chunkCapacity = 0;
+    mem->numCells = 0;
     mem->inUse = 0;
+    mem->free = NULL;
+}
 
-    free(mem->memBlock);
+// Collect again once occupancy reaches the trigger, or, if most cells are still live,
+// once half the remaining space is used, so a large live set does not collect on every
+// allocation.
+static void scheduleCollection(ProgramMemory* mem) {
+    size_t trigger = mem->numCells * mem->gcTrigger / 100;
+    size_t halfway = mem->inUse + (mem->numCells - mem->inUse) / 2;
+    mem->nextCollection = trigger > halfway ? trigger : halfway;
 }
 
-Obj* allocString(ProgramMemory* mem, const char* chars, int length) {
-    if (mem->free == NULL) return NULL;
+void setRootMarker(ProgramMemory* mem, MarkRootsFn markRoots, void* context) {
+    mem->markRoots = markRoots;
+    mem->rootsContext = context;
+}
 
-    MemoryCell* cell = mem->free;
-    mem->free = mem->free->nextFree;
+void setCollectionTrigger(ProgramMemory* mem, int percent) {
+    if (percent < 1) percent = 1;
+    if (percent > 100) percent = 100;
 
-    cell->nextFree = NULL;
-    cell->free = false;
+    mem->gcTrigger = percent;
+    scheduleCollection(mem);
+}
 
-    createString(&cell->obj, chars, length);
+void resetProgramMemory(ProgramMemory* mem) {
+    for (int c = 0; c < mem->chunkCount; c++) {
+        for (size_t i = 0; i < mem->chunks[c].count; i++) {
+            MemoryCell* cell = &mem->chunks[c].cells[i];
+            if (!cell->free) freeCell(cell, mem);
+        }
+    }
 
-    if (cell->obj.as.StringObj.start == NULL) return NULL;
+    mem->peakInUse = 0;
+    scheduleCollection(mem);
+}
 
-    mem->inUse++;
+// Takes a cell off the free list, collecting first once occupancy reaches the trigger. If
+// the heap is still above the trigger afterwards, it grows by another chunk.
+// Collects first once occupancy reaches the trigger, and always before giving up on a full heap.
+static MemoryCell* takeCell(ProgramMemory* mem) {
+    if (mem->inUse >= mem->nextCollection || mem->free == NULL) {
+        collectGarbage(mem);
 
-    return &cell->obj;
-}
+        if (mem->inUse * 100 >= mem->numCells * mem->gcTrigger || mem->free == NULL) {
+            if (growProgramMemory(mem)) scheduleCollection(mem);
+        }
+    }
 
-Obj* allocArray(ProgramMemory* mem, int length, int width, int x0, int y0, size_t elemSize) {
     if (mem->free == NULL) return NULL;
 
     MemoryCell* cell = mem->free;
@@ -75,43 +151,99 @@ Obj* allocArray(ProgramMemory* mem, int length, int width, int x0, int y0, size_
 
     cell->nextFree = NULL;
     cell->free = false;
+    mem->inUse++;
+    if (mem->inUse > mem->peakInUse) mem->peakInUse = mem->inUse;
+
+    return cell;
+}
+
+// Hands back a cell whose object could not be created.
+static void releaseCell(ProgramMemory* mem, MemoryCell* cell) {
+    cell->obj.type = OBJ_NONE;
+    cell->free = true;
+    cell->nextFree = mem->free;
+    mem->free = cell;
+    mem->inUse--;
+}
 
-    createArray(&cell->obj, length, width, x0, y0, elemSize);
+Obj* allocString(ProgramMemory* mem, const char* chars, int length) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        MemoryCell* cell = takeCell(mem);
+        if (cell == NULL) return NULL;
 
-    if (cell->obj.as.ArrayObj.start == NULL) return NULL;
+        createString(&cell->obj, chars, length);
 
-    mem->inUse++;
+        if (cell->obj.as.StringObj.start != NULL) return &cell->obj;
 
-    return &cell->obj;
+        // Collecting frees the buffers of dead strings, which may be enough for a retry.
+        releaseCell(mem, cell);
+        if (attempt == 0) collectGarbage(mem);
+    }
+
+    return NULL;
 }
 
-Obj* allocFile(ProgramMemory* mem, const char* filename, FileAccessType accessType) {
-    if (mem->free == NULL) return NULL;
+Obj* allocArray(ProgramMemory* mem, int length, int width, int x0, int y0, size_t elemSize) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        MemoryCell* cell = takeCell(mem);
+        if (cell == NULL) return NULL;
 
-    MemoryCell* cell = mem->free;
-    mem->free = mem->free->nextFree;
+        createArray(&cell->obj, length, width, x0, y0, elemSize);
 
-    cell->nextFree = NULL;
-    cell->free = false;
+        if (cell->obj.as.ArrayObj.start != NULL) return &cell->obj;
 
-    createFile(&cell->obj, filename, accessType);
+        releaseCell(mem, cell);
+        if (attempt == 0) collectGarbage(mem);
+    }
 
-    if (cell->obj.as.FileObj.filePtr == NULL) return NULL;
+    return NULL;
+}
 
-    mem->inUse++;
+Obj* allocFile(ProgramMemory* mem, int dirFd, const char* filename, FileAccessType accessType) {
+    MemoryCell* cell = takeCell(mem);
+    if (cell == NULL) return NULL;
+
+    createFile(&cell->obj, dirFd, filename, accessType);
+
+    if (cell->obj.as.FileObj.filePtr == NULL) {
+        releaseCell(mem, cell);
+        return NULL;
+    }
 
     return &cell->obj;
 }
 
-bool inProgramMemory(ProgramMemory* mem, void* ptr) {
-    if (ptr >= (void*)mem->memBlock && ptr < (void*)mem->memBlock + mem->memSize) {
-        return true;
+// Chunk holding ptr, or NULL.
+static HeapChunk* findChunk(ProgramMemory* mem, void* ptr) {
+    int lo = 0;
+    int hi = mem->chunkCount - 1;
+
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        HeapChunk* chunk = &mem->chunks[mid];
+
+        if ((MemoryCell*)ptr < chunk->cells) {
+            hi = mid - 1;
+        } else if ((MemoryCell*)ptr >= chunk->cells + chunk->count) {
+            lo = mid + 1;
+        } else {
+            return chunk;
+        }
     }
-    return false;
+
+    return NULL;
+}
+
+bool inProgramMemory(ProgramMemory* mem, void* ptr) {
+    return findChunk(mem, ptr) != NULL;
 }
 
 bool isValidReference(ProgramMemory* mem, void* ptr) {
-    if (!inProgramMemory(mem, ptr)) return false;
+    HeapChunk* chunk = findChunk(mem, ptr);
+    if (chunk == NULL) return false;
+
+    // Must be the start of a cell, not just somewhere inside the chunk.
+    if (((byte*)ptr - (byte*)chunk->cells) % sizeof(MemoryCell) != 0) return false;
 
     if (((MemoryCell*)ptr)->free) return false;
 
@@ -119,40 +251,52 @@ bool isValidReference(ProgramMemory* mem, void* ptr) {
 }
 
 void markCell(ProgramMemory* mem, void* ptr) {
-    if (!inProgramMemory(mem, ptr)) return;
+    if (!isValidReference(mem, ptr)) return;
+
+    MemoryCell* cell = (MemoryCell*)ptr;
+    if (cell->marked) return;
+    cell->marked = true;
+
+    // 8-byte elements may be strings. REAL elements are checked the same way, but a double
+    // only passes isValidReference if its bits happen to be a live cell address.
+    if (cell->obj.type == OBJ_ARRAY && cell->obj.as.ArrayObj.elemSize == 8) {
+        byte8* elems = (byte8*)cell->obj.as.ArrayObj.start;
+        int count = cell->obj.as.ArrayObj.length * cell->obj.as.ArrayObj.width;
 
-    if (((MemoryCell*)ptr)->obj.type == OBJ_ARRAY && ((MemoryCell*)ptr)->obj.as.ArrayObj.elemSize == 8) {
-        for (int i = 0; i < ((MemoryCell*)ptr)->obj.as.ArrayObj.length * ((MemoryCell*)ptr)->obj.as.ArrayObj.width; i+=8) {
-            byte8 strPtr = (((byte8)((MemoryCell*)ptr)->obj.as.ArrayObj.start[i]) << 56) | (((byte8)((MemoryCell*)ptr)->obj.as.ArrayObj.start[i + 1]) << 48) | (((byte8)((MemoryCell*)ptr)->obj.as.ArrayObj.start[i + 2]) << 40) | (((byte8)((MemoryCell*)ptr)->obj.as.ArrayObj.start[i + 3]) << 32) | (((byte8)((MemoryCell*)ptr)->obj.as.ArrayObj.start[i + 4]) << 24) | (((byte8)((MemoryCell*)ptr)->obj.as.ArrayObj.start[i + 5]) << 16) | (((byte8)((MemoryCell*)ptr)->obj.as.ArrayObj.start[i + 6]) << 8) | (((byte8)((MemoryCell*)ptr)->obj.as.ArrayObj.start[i + 7]));
-            markCell(mem, (void*)strPtr);
+        for (int i = 0; i < count; i++) {
+            markCell(mem, (void*)elems[i]);
         }
     }
-
-    ((MemoryCell*)ptr)->marked = true;
 }
 
 void markForceFree(ProgramMemory* mem, void* ptr) {
-    if (!inProgramMemory(mem, ptr)) return;
+    if (!isValidReference(mem, ptr)) return;
 
     ((MemoryCell*)ptr)->forceFree = true;
 }
 
 size_t collectGarbage(ProgramMemory* mem) {
+    if (mem->markRoots != NULL) mem->markRoots(mem->rootsContext);
+
     size_t collected = 0;
 
-    size_t numCells = mem->memSize / sizeof(MemoryCell);
+    for (int c = 0; c < mem->chunkCount; c++) {
+        for (size_t i = 0; i < mem->chunks[c].count; i++) {
+            MemoryCell* cell = &mem->chunks[c].cells[i];
 
-    for (size_t i = 0; i < numCells; i++) {
-        MemoryCell* cell = &mem->memBlock[i];
+            if (!cell->free && (!cell->marked || cell->forceFree)) {
+                freeCell(cell, mem);
+                collected += sizeof(Obj);
+            }
 
-        if (!cell->marked || cell->forceFree) {
-            freeCell(cell, mem);
-            collected += sizeof(Obj);
+            cell->marked = false;
+            cell->forceFree = false;
         }
-
-        cell->marked = false;
-        cell->forceFree = false;
     }
 
+    scheduleCollection(mem);
+
+    if (mem->logCollections) printf("GARBAGE COLLECTOR COLLECTED %zu bytes.\n", collected);
+
     return collected;
-}
\ No newline at end of file
+}
@@ -14,19 +14,47 @@ typedef struct MemoryCell {
     struct MemoryCell* nextFree;
 } MemoryCell;
 
+#define DEFAULT_GC_TRIGGER  75
+#define HEAP_INITIAL_CELLS  1024        // The heap doubles from here on demand, up to its limit.
+#define DEFAULT_HEAP_CELLS  (1024 * 1024)
+
+// Called at the start of every collection to mark everything the program can still reach.
+typedef void (*MarkRootsFn)(void* context);
+
 typedef struct {
-    MemoryCell* memBlock;
-    size_t  memSize;
+    MemoryCell* cells;
+    size_t count;
+} HeapChunk;
+
+typedef struct {
+    HeapChunk* chunks;          // Sorted by address, so resolving a reference is a binary search.
+    int chunkCount;
+    int chunkCapacity;
+    size_t numCells;            // Cells across all chunks.
+    size_t maxCells;            // The heap never grows past this many cells.
     size_t inUse;
+    size_t peakInUse;           // Most cells in use at once so far.
     MemoryCell* free;
+    size_t nextCollection;      // Cells in use at which the next allocation collects first.
+    int gcTrigger;              // Occupancy, as a percentage of all cells, that triggers a collection.
+    MarkRootsFn markRoots;
+    void* rootsContext;
+    bool logCollections;
 } ProgramMemory;
 
-void createProgramMemory(ProgramMemory* mem, int numCells);
+// False, with nothing left allocated, if the first block of cells could not be allocated.
+bool createProgramMemory(ProgramMemory* mem, int maxCells);
 void freeProgramMemory(ProgramMemory* mem);
+// Frees every object but keeps the cells, so the heap starts the next run at the size it grew to.
+void resetProgramMemory(ProgramMemory* mem);
+
+void setRootMarker(ProgramMemory* mem, MarkRootsFn markRoots, void* context);
+void setCollectionTrigger(ProgramMemory* mem, int percent);
 
 Obj* allocString(ProgramMemory* mem, const char* chars, int length);
 Obj* allocArray(ProgramMemory* mem, int length, int width, int x0, int y0, size_t elemSize);
-Obj* allocFile(ProgramMemory* mem, const char* filename, FileAccessType accessType);
+// Relative file names are resolved in the directory open as dirFd, or the working directory for -1.
+Obj* allocFile(ProgramMemory* mem, int dirFd, const char* filename, FileAccessType accessType);
 
 bool inProgramMemory(ProgramMemory* mem, void* ptr);
 bool isValidReference(ProgramMemory* mem, void* ptr);
@@ -1,4 +1,10 @@
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define OPEN_AT_AVAILABLE
+#endif
+
 #include "object.h"
 
 void freeObj(Obj* obj) {
@@ -18,7 +24,9 @@ void freeObj(Obj* obj) {
             break;
         }
         case OBJ_FILE: {
-            fclose(obj->as.FileObj.filePtr);
+            // CLOSEFILE may already have closed it.
+            if (obj->as.FileObj.filePtr != NULL) fclose(obj->as.FileObj.filePtr);
+            obj->as.FileObj.filePtr = NULL;
             obj->as.FileObj.accessType = ACCESS_NONE;
             break;
         }
@@ -34,7 +42,7 @@ void createString(Obj* obj, const char* chars, int length) {
     char* buff = (char*) malloc(length * sizeof(char));
 
     if (buff == NULL) {
-        printf("Not enough memory available to allocate string");
+        fprintf(diagnostics(), "Not enough memory available to allocate string.\n");
         obj->as.StringObj.start = NULL;
         return;
     }
@@ -53,10 +61,27 @@ void createArray(Obj* obj, int length, int width, int x0, int y0, size_t elemSiz
     obj->as.ArrayObj.y0 = y0;
     obj->as.ArrayObj.elemSize = elemSize;
 
-    obj->as.ArrayObj.start = (byte*) malloc(elemSize * length * width);
+    // Zeroed, so the collector never mistakes leftover heap contents for references.
+    obj->as.ArrayObj.start = (byte*) calloc((size_t)length * width, elemSize);
+}
+
+#ifdef OPEN_AT_AVAILABLE
+// fopen relative to a directory other than the working directory, with the same modes.
+static FILE* openFileAt(int dirFd, const char* filename, const char* access) {
+    int flags = O_RDONLY;
+    if (access[0] == 'w') flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (access[0] == 'a') flags = O_WRONLY | O_CREAT | O_APPEND;
+
+    int fd = openat(dirFd, filename, flags, 0666);
+    if (fd < 0) return NULL;
+
+    FILE* file = fdopen(fd, access);
+    if (file == NULL) close(fd);
+    return file;
 }
+#endif
 
-void createFile(Obj* obj, const char* filename, FileAccessType accessType) {
+void createFile(Obj* obj, int dirFd, const char* filename, FileAccessType accessType) {
     obj->type = OBJ_FILE;
 
     char access[] = "0\0";
@@ -75,10 +100,15 @@ void createFile(Obj* obj, const char* filename, FileAccessType accessType) {
             break;
     }
 
+#ifdef OPEN_AT_AVAILABLE
+    FILE* temp = dirFd >= 0 ? openFileAt(dirFd, filename, access) : fopen(filename, access);
+#else
+    (void)dirFd;
     FILE* temp = fopen(filename, access);
+#endif
 
     if (temp == NULL) {
-        printf("Failed opening file.");
+        fprintf(diagnostics(), "Failed opening file \"%s\".\n", filename);
     }
 
     obj->as.FileObj.filePtr = temp;
@@ -36,7 +36,7 @@ typedef struct {
 void freeObj(Obj* obj);
 void createString(Obj* obj, const char* chars, int length);
 void createArray(Obj* obj, int length, int width, int x0, int y0, size_t elemSize);
-void createFile(Obj* obj, const char* filename, FileAccessType accessType);
+void createFile(Obj* obj, int dirFd, const char* filename, FileAccessType accessType);
 
 
 #endif //PSEUDOCOMPILER_OBJECT_H
@@ -0,0 +1,149 @@
+#include "opprofile.h"
+
+// Sequences shown in each part of the report.
+#define REPORT_SEQUENCES    20
+
+typedef struct {
+    byte4 key;
+    byte8 count;
+} Ranked;
+
+bool initOpProfile(OpProfile* profile) {
+    memset(profile->counts, 0, sizeof(profile->counts));
+    memset(profile->ticks, 0, sizeof(profile->ticks));
+    profile->pairs = (byte8*) calloc(OP_KINDS * OP_KINDS, sizeof(byte8));
+    profile->triples = (OpTriple*) calloc(TRIPLE_SLOTS, sizeof(OpTriple));
+    profile->tripleCount = 0;
+    profile->droppedTriples = 0;
+    profile->previous = -1;
+    profile->beforePrevious = -1;
+    profile->lastTick = 0;
+
+    if (profile->pairs == NULL || profile->triples == NULL) {
+        freeOpProfile(profile);
+        return false;
+    }
+    return true;
+}
+
+void freeOpProfile(OpProfile* profile) {
+    free(profile->pairs);
+    free(profile->triples);
+    profile->pairs = NULL;
+    profile->triples = NULL;
+}
+
+void countOpTriple(OpProfile* profile, byte4 key) {
+    byte4 slot = (key * 2654435761u) & (TRIPLE_SLOTS - 1);
+
+    for (int probes = 0; probes < TRIPLE_SLOTS; probes++) {
+        OpTriple* triple = &profile->triples[slot];
+
+        if (triple->count > 0 && triple->key == key) {
+            triple->count++;
+            return;
+        }
+        if (triple->count == 0) {
+            // Keep some room free so probing stays short.
+            if (profile->tripleCount >= TRIPLE_SLOTS / 2) break;
+
+            triple->key = key;
+            triple->count = 1;
+            profile->tripleCount++;
+            return;
+        }
+
+        slot = (slot + 1) & (TRIPLE_SLOTS - 1);
+    }
+
+    profile->droppedTriples++;
+}
+
+static int compareRanked(const void* a, const void* b) {
+    const Ranked* x = (const Ranked*)a;
+    const Ranked* y = (const Ranked*)b;
+    if (x->count != y->count) return x->count < y->count ? 1 : -1;
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+static double percent(byte8 part, byte8 total) {
+    return total == 0 ? 0.0 : 100.0 * (double)part / (double)total;
+}
+
+static void printSequences(Ranked* ranked, int count, int length, byte8 total, FILE* out) {
+    qsort(ranked, count, sizeof(Ranked), compareRanked);
+
+    for (int i = 0; i < count && i < REPORT_SEQUENCES; i++) {
+        fprintf(out, "%14llu %6.2f%%  ", (unsigned long long)ranked[i].count, percent(ranked[i].count, total));
+        for (int j = length - 1; j >= 0; j--) {
+            fprintf(out, "%s%s", getInstructionName((Instruction)((ranked[i].key >> (8 * j)) & 0xff)), j > 0 ? " -> " : "\n");
+        }
+    }
+}
+
+void printOpProfile(OpProfile* profile, FILE* out) {
+    byte8 totalCount = 0;
+    byte8 totalTicks = 0;
+    Ranked ops[OP_KINDS];
+    int opCount = 0;
+
+    for (int i = 0; i < OP_KINDS; i++) {
+        totalCount += profile->counts[i];
+        totalTicks += profile->ticks[i];
+        if (profile->counts[i] > 0) {
+            ops[opCount].key = (byte4)i;
+            ops[opCount].count = profile->ticks[i];
+            opCount++;
+        }
+    }
+    qsort(ops, opCount, sizeof(Ranked), compareRanked);
+
+    fprintf(out, "\nInstruction profile: %llu instructions, %llu ticks\n",
+            (unsigned long long)totalCount, (unsigned long long)totalTicks);
+    fprintf(out, "%-26s %14s %8s %16s %8s %10s\n", "instruction", "count", "count%", "ticks", "ticks%", "ticks/op");
+    for (int i = 0; i < opCount; i++) {
+        int op = (int)ops[i].key;
+        byte8 count = profile->counts[op];
+        byte8 ticks = profile->ticks[op];
+        fprintf(out, "%-26s %14llu %7.2f%% %16llu %7.2f%% %10.1f\n", getInstructionName((Instruction)op),
+                (unsigned long long)count, percent(count, totalCount),
+                (unsigned long long)ticks, percent(ticks, totalTicks), (double)ticks / (double)count);
+    }
+
+    int pairCount = 0;
+    for (int i = 0; i < OP_KINDS * OP_KINDS; i++) {
+        if (profile->pairs[i] > 0) pairCount++;
+    }
+
+    Ranked* ranked = (Ranked*) malloc((pairCount > profile->tripleCount ? pairCount : profile->tripleCount + 1) * sizeof(Ranked));
+    if (ranked == NULL) return;
+
+    byte8 totalPairs = 0;
+    int n = 0;
+    for (int i = 0; i < OP_KINDS * OP_KINDS; i++) {
+        if (profile->pairs[i] == 0) continue;
+        ranked[n].key = (byte4)i;
+        ranked[n].count = profile->pairs[i];
+        totalPairs += profile->pairs[i];
+        n++;
+    }
+    fprintf(out, "\nMost frequent pairs:\n");
+    printSequences(ranked, n, 2, totalPairs, out);
+
+    byte8 totalTriples = profile->droppedTriples;
+    n = 0;
+    for (int i = 0; i < TRIPLE_SLOTS; i++) {
+        if (profile->triples[i].count == 0) continue;
+        ranked[n].key = profile->triples[i].key;
+        ranked[n].count = profile->triples[i].count;
+        totalTriples += profile->triples[i].count;
+        n++;
+    }
+    fprintf(out, "\nMost frequent triples:\n");
+    printSequences(ranked, n, 3, totalTriples, out);
+    if (profile->droppedTriples > 0) {
+        fprintf(out, "(%llu executions of rarer triples were not recorded)\n", (unsigned long long)profile->droppedTriples);
+    }
+
+    free(ranked);
+}
@@ -0,0 +1,76 @@
+#ifndef PSEUDOCOMPILER_OPPROFILE_H
+#define PSEUDOCOMPILER_OPPROFILE_H
+
+#include "common.h"
+#include "bytecode.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+// Instruction-level profile for --profile-ops: how often each opcode runs, the time spent
+// in it, and the most frequent sequences of two and three opcodes, to tell which fused and
+// specialised instructions would pay off. The VM fills it from a run loop of its own (see
+// vm.c), so runs without the flag execute exactly as before.
+
+#define OP_KINDS            256
+#define TRIPLE_SLOTS        (1 << 16)
+
+typedef struct {
+    byte4 key;              // First opcode << 16 | second << 8 | third, valid when count > 0.
+    byte8 count;
+} OpTriple;
+
+typedef struct {
+    byte8 counts[OP_KINDS];
+    byte8 ticks[OP_KINDS];
+    byte8* pairs;           // OP_KINDS * OP_KINDS counts, indexed first * OP_KINDS + second.
+    OpTriple* triples;      // Open-addressed table of TRIPLE_SLOTS entries.
+    int tripleCount;
+    byte8 droppedTriples;   // Executions of triples that found the table full.
+    int previous;           // The last two opcodes run, -1 before there were any.
+    int beforePrevious;
+    byte8 lastTick;
+} OpProfile;
+
+bool initOpProfile(OpProfile* profile);
+void freeOpProfile(OpProfile* profile);
+void countOpTriple(OpProfile* profile, byte4 key);
+void printOpProfile(OpProfile* profile, FILE* out);
+
+// Time stamp counter where there is one, nanoseconds elsewhere.
+static inline byte8 readTicks() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __rdtsc();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    byte8 ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (byte8)now.tv_sec * 1000000000u + (byte8)now.tv_nsec;
+#endif
+}
+
+// Called before every instruction. The time since the previous call goes to the previous
+// instruction; the stamp is taken again at the end so the bookkeeping is not counted.
+static inline void profileOp(OpProfile* profile, Instruction op) {
+    byte8 now = readTicks();
+    int previous = profile->previous;
+
+    if (previous >= 0) {
+        profile->ticks[previous] += now - profile->lastTick;
+        profile->pairs[previous * OP_KINDS + op]++;
+        if (profile->beforePrevious >= 0) {
+            countOpTriple(profile, ((byte4)profile->beforePrevious << 16) | ((byte4)previous << 8) | (byte4)op);
+        }
+    }
+
+    profile->counts[op]++;
+    profile->beforePrevious = previous;
+    profile->previous = op;
+    profile->lastTick = readTicks();
+}
+
+#endif //PSEUDOCOMPILER_OPPROFILE_H
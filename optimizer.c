@@ -0,0 +1,359 @@
+#include "optimizer.h"
+
+// One instruction of the stream being optimized. Rewritten instructions keep their encoding
+// in buffer, everything else points back into the original stream.
+typedef struct {
+    Instruction op;
+    int length;
+    const byte* bytes;
+    byte buffer[13];
+    int target;             // Index of the jump or call target (count for the end), -1 for none.
+    bool removed;
+    bool isTarget;
+} PeepholeOp;
+
+static int readInt(const byte* bytes) {
+    byte4 temp = ((byte4)bytes[0] << 24) | ((byte4)bytes[1] << 16) | ((byte4)bytes[2] << 8) | (byte4)bytes[3];
+    int value;
+    memcpy(&value, &temp, sizeof(int));
+    return value;
+}
+
+static void writeInt(byte* bytes, int value) {
+    byte4 temp;
+    memcpy(&temp, &value, sizeof(int));
+    bytes[0] = (byte)(temp >> 24);
+    bytes[1] = (byte)(temp >> 16);
+    bytes[2] = (byte)(temp >> 8);
+    bytes[3] = (byte)temp;
+}
+
+// Byte position of the target operand inside the instruction, -1 if it has none.
+static int targetOperandPos(Instruction op) {
+    switch (op) {
+        case DO_CALL:
+        case TAIL_CALL:
+        case B_FALSE:
+        case BRANCH:
+        case BEQ_INT: case BNE_INT: case BLT_INT: case BLE_INT: case BGT_INT: case BGE_INT:
+            return 1;
+        case BEQ_INT_RR: case BNE_INT_RR: case BLT_INT_RR: case BLE_INT_RR: case BGT_INT_RR: case BGE_INT_RR:
+        case BEQ_INT_RK: case BNE_INT_RK: case BLT_INT_RK: case BLE_INT_RK: case BGT_INT_RK: case BGE_INT_RK:
+            return 9;
+        default:
+            return -1;
+    }
+}
+
+static void rewrite(PeepholeOp* op, Instruction newOp, int operand) {
+    op->op = newOp;
+    op->length = 5;
+    op->buffer[0] = (byte)newOp;
+    writeInt(&op->buffer[1], operand);
+    op->bytes = op->buffer;
+}
+
+static int nextKept(PeepholeOp* ops, int count, int i) {
+    do {
+        i++;
+    } while (i < count && ops[i].removed);
+    return i;
+}
+
+// True if the instruction at i exists and may be folded into the one before it.
+static bool foldable(PeepholeOp* ops, int count, int i) {
+    return i < count && !ops[i].isTarget;
+}
+
+static bool isZeroPush(PeepholeOp* op) {
+    switch (op->op) {
+        case LOAD_INT:
+            return readInt(&op->bytes[1]) == 0;
+        case LOAD_REAL:
+            // Only +0.0 has all bits clear.
+            for (int i = 1; i < 9; i++) {
+                if (op->bytes[i] != 0) return false;
+            }
+            return true;
+        case LOAD_CHAR:
+        case LOAD_BOOL:
+            return op->bytes[1] == 0;
+        case LOAD_ZEROS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isPurePush(Instruction op) {
+    switch (op) {
+        case LOAD_INT: case LOAD_REAL: case LOAD_CHAR: case LOAD_BOOL: case LOAD_STRING:
+        case FETCH_LOCAL_INT: case FETCH_GLOBAL_INT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static Instruction fusedIntBranch(Instruction compare) {
+    // B_FALSE jumps when the comparison fails, so the fused branch tests the opposite.
+    switch (compare) {
+        case EQ_INT: return BNE_INT;
+        case NEQ_INT: return BEQ_INT;
+        case LESS_INT: return BGE_INT;
+        case LESS_EQ_INT: return BGT_INT;
+        case GREATER_INT: return BLE_INT;
+        case GREATER_EQ_INT: return BLT_INT;
+        default: return EXIT;
+    }
+}
+
+static void markTargets(PeepholeOp* ops, int count) {
+    for (int i = 0; i < count; i++) {
+        ops[i].isTarget = false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (ops[i].removed || ops[i].target < 0) continue;
+
+        // Removed instructions hand their incoming jumps over to the next one that survives.
+        int target = ops[i].target;
+        while (target < count && ops[target].removed) target++;
+        ops[i].target = target;
+
+        if (target < count) ops[target].isTarget = true;
+    }
+}
+
+// Jumps that land on an unconditional BRANCH go straight to its destination instead.
+static bool threadJumps(PeepholeOp* ops, int count) {
+    bool changed = false;
+
+    for (int i = 0; i < count; i++) {
+        if (ops[i].removed || ops[i].target < 0 || ops[i].op == DO_CALL || ops[i].op == TAIL_CALL) continue;
+
+        int target = ops[i].target;
+        for (int hops = 0; hops < count && target < count && ops[target].op == BRANCH; hops++) {
+            if (ops[target].target == target) break;
+            target = ops[target].target;
+        }
+
+        if (target != ops[i].target) {
+            ops[i].target = target;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+static bool peephole(PeepholeOp* ops, int count) {
+    bool changed = false;
+
+    for (int i = 0; i < count; i++) {
+        if (ops[i].removed) continue;
+
+        PeepholeOp* op = &ops[i];
+        int next = nextKept(ops, count, i);
+
+        // A branch to the instruction that follows it does nothing.
+        if (op->op == BRANCH && op->target == next) {
+            op->removed = true;
+            changed = true;
+            continue;
+        }
+
+        // Statements and subroutines that declare nothing still reserve zero slots.
+        if ((op->op == LOAD_ZEROS || op->op == ENTER) && readInt(&op->bytes[1]) == 0) {
+            op->removed = true;
+            changed = true;
+            continue;
+        }
+
+        if (!foldable(ops, count, next)) continue;
+        PeepholeOp* nextOp = &ops[next];
+
+        // A value pushed only to be popped again.
+        if (isPurePush(op->op) && nextOp->op == POP) {
+            op->removed = true;
+            nextOp->removed = true;
+            changed = true;
+            continue;
+        }
+
+        // LOAD_INT pos; FETCH_x -> FETCH_*_INT pos
+        if (op->op == LOAD_INT) {
+            bool local;
+            switch (nextOp->op) {
+                case FETCH_INT: case FETCH_REAL: case FETCH_CHAR: case FETCH_BOOL: local = false; break;
+                case RFETCH_INT: case RFETCH_REAL: case RFETCH_CHAR: case RFETCH_BOOL: local = true; break;
+                default: goto notFetch;
+            }
+
+            rewrite(op, local ? FETCH_LOCAL_INT : FETCH_GLOBAL_INT, readInt(&op->bytes[1]));
+            nextOp->removed = true;
+            changed = true;
+            continue;
+        }
+        notFetch:
+
+        // LOAD_INT pos; STORE_x; POP -> STORE_*_INT_DISCARD pos
+        if (op->op == LOAD_INT) {
+            int last = nextKept(ops, count, next);
+            if (!foldable(ops, count, last) || ops[last].op != POP) goto notStore;
+
+            bool local;
+            switch (nextOp->op) {
+                case STORE_INT: case STORE_REAL: case STORE_CHAR: case STORE_BOOL: local = false; break;
+                case RSTORE_INT: case RSTORE_REAL: case RSTORE_CHAR: case RSTORE_BOOL: local = true; break;
+                default: goto notStore;
+            }
+
+            rewrite(op, local ? STORE_LOCAL_INT_DISCARD : STORE_GLOBAL_INT_DISCARD, readInt(&op->bytes[1]));
+            nextOp->removed = true;
+            ops[last].removed = true;
+            changed = true;
+            continue;
+        }
+        notStore:
+
+        // Integer comparison followed by B_FALSE.
+        if (nextOp->op == B_FALSE && fusedIntBranch(op->op) != EXIT) {
+            rewrite(op, fusedIntBranch(op->op), 0);
+            op->target = nextOp->target;
+            nextOp->removed = true;
+            nextOp->target = -1;
+            changed = true;
+            continue;
+        }
+
+        // Runs of zero constants, as emitted for declarations.
+        if (isZeroPush(op) && isZeroPush(nextOp)) {
+            int zeros = op->op == LOAD_ZEROS ? readInt(&op->bytes[1]) : 1;
+            int j = next;
+            while (foldable(ops, count, j) && isZeroPush(&ops[j])) {
+                zeros += ops[j].op == LOAD_ZEROS ? readInt(&ops[j].bytes[1]) : 1;
+                ops[j].removed = true;
+                j = nextKept(ops, count, j);
+            }
+
+            rewrite(op, LOAD_ZEROS, zeros);
+            changed = true;
+            continue;
+        }
+    }
+
+    return changed;
+}
+
+// Moves the line table over to the new offsets. Entries whose code was removed entirely end up
+// on the same offset as the next one, which takes precedence.
+static void remapLines(LineTable* lines, const int* indexOf, const int* newOffset) {
+    int kept = 0;
+
+    for (int i = 0; i < lines->count; i++) {
+        LineEntry entry = lines->entries[i];
+        if (indexOf[entry.offset] < 0) continue;
+        entry.offset = newOffset[indexOf[entry.offset]];
+
+        if (kept > 0 && lines->entries[kept - 1].offset == entry.offset) kept--;
+        lines->entries[kept++] = entry;
+    }
+
+    lines->count = kept;
+}
+
+int optimizeBytecode(BytecodeStream* bs) {
+    int count = 0;
+    for (int idx = 0; idx < bs->count; count++) {
+        int length = getInstructionLength(bs, idx);
+        if (length < 0 || idx + length > bs->count) return 0;
+        idx += length;
+    }
+
+    PeepholeOp* ops = (PeepholeOp*) calloc(count + 1, sizeof(PeepholeOp));
+    int* indexOf = (int*) malloc((bs->count + 1) * sizeof(int));
+    int* newOffset = (int*) malloc((count + 1) * sizeof(int));
+    if (ops == NULL || indexOf == NULL || newOffset == NULL) {
+        free(ops);
+        free(indexOf);
+        free(newOffset);
+        return 0;
+    }
+
+    for (int i = 0; i <= bs->count; i++) {
+        indexOf[i] = -1;
+    }
+
+    for (int idx = 0, i = 0; idx < bs->count; i++) {
+        ops[i].op = (Instruction)bs->stream[idx];
+        ops[i].length = getInstructionLength(bs, idx);
+        ops[i].bytes = &bs->stream[idx];
+        ops[i].target = -1;
+        indexOf[idx] = i;
+        idx += ops[i].length;
+    }
+    indexOf[bs->count] = count;
+
+    for (int i = 0; i < count; i++) {
+        int pos = targetOperandPos(ops[i].op);
+        if (pos < 0) continue;
+
+        int dst = readInt(&ops[i].bytes[pos]);
+        if (dst < 0 || dst > bs->count || indexOf[dst] < 0) {
+            // Leave malformed programs for the decoder to report.
+            free(ops);
+            free(indexOf);
+            free(newOffset);
+            return 0;
+        }
+        ops[i].target = indexOf[dst];
+    }
+
+    bool changed = true;
+    while (changed) {
+        markTargets(ops, count);
+        changed = threadJumps(ops, count);
+        markTargets(ops, count);
+        changed |= peephole(ops, count);
+    }
+    markTargets(ops, count);
+
+    int size = 0;
+    for (int i = 0; i < count; i++) {
+        newOffset[i] = size;
+        if (!ops[i].removed) size += ops[i].length;
+    }
+    newOffset[count] = size;
+
+    byte* stream = (byte*) malloc(size > 0 ? size : 1);
+    if (stream == NULL) {
+        free(ops);
+        free(indexOf);
+        free(newOffset);
+        return 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (ops[i].removed) continue;
+
+        byte* out = &stream[newOffset[i]];
+        memcpy(out, ops[i].bytes, ops[i].length);
+
+        int pos = targetOperandPos(ops[i].op);
+        if (pos >= 0) writeInt(&out[pos], newOffset[ops[i].target]);
+    }
+
+    remapLines(&bs->lines, indexOf, newOffset);
+    int saved = bs->count - size;
+
+    free(bs->stream);
+    bs->stream = stream;
+    bs->count = size;
+    bs->capacity = size > 0 ? size : 1;
+
+    free(ops);
+    free(indexOf);
+    free(newOffset);
+    return saved;
+}
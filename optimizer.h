@@ -0,0 +1,11 @@
+#ifndef PSEUDOCOMPILER_OPTIMIZER_H
+#define PSEUDOCOMPILER_OPTIMIZER_H
+
+#include "common.h"
+#include "bytecode.h"
+
+// Peephole pass over compiled bytecode, run before it is run or written to a .pcbc file unless
+// --no-optimize is given. Rewrites the stream in place and fixes every jump and call target. A stream it cannot parse is left untouched. Returns the number of bytes saved.
+int optimizeBytecode(BytecodeStream* bs);
+
+#endif //PSEUDOCOMPILER_OPTIMIZER_H
@@ -3,8 +3,10 @@
 
 //#define ALLOC_AST(parser, type)     (type*)allocArena(&parser->memArena, sizeof(type));
 
+// Zeroed, so that a node freed on an error path before all its children were parsed only
+// holds NULL children and empty arrays.
 static void* allocMem(size_t allocSize) {
-    return malloc(allocSize);
+    return calloc(1, allocSize);
 }
 
 static void* reallocMem(void* ptr, size_t oldSize, size_t newSize) {
@@ -608,17 +610,17 @@ void freeParser(Parser* parser) {
 static void errorAt(Parser* parser, Token* token, const char* message) {
     if (parser->panicMode) return;
     parser->panicMode = true;
-    fprintf(stderr, "[line: %d, col: %d] Error", token->line, token->col);
+    fprintf(diagnostics(), "[line: %d, col: %d] Error", token->line, token->col);
 
     if (token->type == TOK_EOF) {
-        fprintf(stderr, " at end");
+        fprintf(diagnostics(), " at end");
     } else if (token->type == TOK_ERROR) {
         // SKIP
     } else {
-        fprintf(stderr, " at '%.*s'", token->length, token->start);
+        fprintf(diagnostics(), " at '%.*s'", token->length, token->start);
     }
 
-    fprintf(stderr, ": %s\n", message);
+    fprintf(diagnostics(), ": %s\n", message);
     parser->hadError = true;
 }
 
@@ -1349,6 +1351,7 @@ static ASTNode* parameter(Parser* parser) {
 #define PARAM param->as.Parameter
     PARAM.byref = false;
     PARAM.isArray = false;
+    PARAM.is2D = false;
 
     if (match(parser, TOK_BYREF)) {
         PARAM.byref = true;
@@ -1959,7 +1962,7 @@ static ASTNode* caseLine(Parser* parser) {
     LINE.result = block;
     BLCK.body.start = NULL;
     BLCK.body.count = 0;
-    BLCK.body.count = 0;
+    BLCK.body.size = 0;
 
     if (!match(parser, TOK_OTHERWISE)) {
         ASTNode* expr = expression(parser);
@@ -1978,7 +1981,6 @@ static ASTNode* caseLine(Parser* parser) {
     ASTNode* res = declaration(parser);
     if (res == NULL) {
         freeASTNode(line);
-        freeASTNode(block);
         return NULL;
     }
 
@@ -2002,7 +2004,6 @@ static ASTNode* caseLine(Parser* parser) {
         ASTNode* subRes = declaration(parser);
         if (subRes == NULL) {
             freeASTNode(line);
-            freeASTNode(block);
             return NULL;
         }
 
@@ -2014,7 +2015,6 @@ static ASTNode* caseLine(Parser* parser) {
 
     if (!valid) {
         freeASTNode(line);
-        freeASTNode(block);
         return NULL;
     }
 
@@ -2177,7 +2177,7 @@ static ASTNode* forStatement(Parser* parser) {
 
     if (prev->length != FOR.counterName->length || memcmp(prev->start, FOR.counterName->start, FOR.counterName->length) != 0) {
         errorAtCurrent(parser, "");
-        fprintf(stderr, "Expected counter name '%.*s' after NEXT, but got '%.*s'.", FOR.counterName->length, FOR.counterName->start, prev->length, prev->start);
+        fprintf(diagnostics(), "Expected counter name '%.*s' after NEXT, but got '%.*s'.", FOR.counterName->length, FOR.counterName->start, prev->length, prev->start);
         valid = false;
     }
 
@@ -0,0 +1,239 @@
+#include "profiler.h"
+
+// Lines listed in the summary.
+#define SUMMARY_LINES   15
+
+typedef struct {
+    char* stack;
+    int subroutine;         // Of the running instruction, -1 for the main program.
+    int line;               // 0 without a line table.
+} Sample;
+
+bool initSampleProfile(SampleProfile* profile) {
+    profile->buffer = (int*) malloc(SAMPLE_BUFFER_INTS * sizeof(int));
+    profile->used = 0;
+    profile->samples = 0;
+    profile->dropped = 0;
+    profile->truncated = 0;
+    return profile->buffer != NULL;
+}
+
+void freeSampleProfile(SampleProfile* profile) {
+    free(profile->buffer);
+    profile->buffer = NULL;
+    profile->used = 0;
+}
+
+void recordSample(SampleProfile* profile, int current, CallStack* calls, int top) {
+    int frames = top + 2;
+    bool truncated = frames > SAMPLE_MAX_DEPTH;
+    if (truncated) frames = SAMPLE_MAX_DEPTH;
+
+    if (profile->used + frames + 1 > SAMPLE_BUFFER_INTS) {
+        profile->dropped++;
+        return;
+    }
+
+    // A negative count marks a sample whose outermost frames were cut off.
+    int* out = &profile->buffer[profile->used];
+    out[0] = truncated ? -frames : frames;
+    out[1] = current;
+    for (int i = 2, k = top; i <= frames; i++, k--) {
+        out[i] = (int)calls->frames[k].returnPC - 1;
+    }
+
+    profile->used += frames + 1;
+    profile->samples++;
+    if (truncated) profile->truncated++;
+}
+
+static const LineEntry* entryOf(DecodedProgram* code, BytecodeStream* bs, int index) {
+    if (index < 0 || index >= code->count) return NULL;
+    return findLineEntry(bs, code->ops[index].offset);
+}
+
+static void append(char** buffer, size_t* length, size_t* capacity, const char* text) {
+    size_t add = strlen(text);
+    if (*buffer == NULL) return;
+
+    if (*length + add + 1 > *capacity) {
+        size_t grown = (*length + add + 1) * 2;
+        char* resized = (char*) realloc(*buffer, grown);
+        if (resized == NULL) {
+            free(*buffer);
+            *buffer = NULL;
+            return;
+        }
+        *buffer = resized;
+        *capacity = grown;
+    }
+
+    memcpy(*buffer + *length, text, add + 1);
+    *length += add;
+}
+
+// Frames from the outermost to the running one, then the running line.
+static char* collapseSample(int* positions, int frames, bool truncated, DecodedProgram* code, BytecodeStream* bs) {
+    size_t capacity = 64;
+    size_t length = 0;
+    char* stack = (char*) malloc(capacity);
+    if (stack == NULL) return NULL;
+    stack[0] = '\0';
+
+    if (truncated) append(&stack, &length, &capacity, "[truncated];");
+
+    for (int i = frames - 1; i >= 0; i--) {
+        const LineEntry* entry = entryOf(code, bs, positions[i]);
+        append(&stack, &length, &capacity, getSubroutineName(bs, entry == NULL ? -1 : entry->subroutine));
+        append(&stack, &length, &capacity, ";");
+    }
+
+    char leaf[32];
+    const LineEntry* entry = entryOf(code, bs, positions[0]);
+    if (entry != NULL) {
+        snprintf(leaf, sizeof(leaf), "line %d", entry->line);
+    } else {
+        snprintf(leaf, sizeof(leaf), "pc %d", positions[0] < code->count ? code->ops[positions[0]].offset : -1);
+    }
+    append(&stack, &length, &capacity, leaf);
+
+    return stack;
+}
+
+static int compareStacks(const void* a, const void* b) {
+    return strcmp(((const Sample*)a)->stack, ((const Sample*)b)->stack);
+}
+
+static int compareLines(const void* a, const void* b) {
+    const Sample* x = (const Sample*)a;
+    const Sample* y = (const Sample*)b;
+    if (x->subroutine != y->subroutine) return x->subroutine < y->subroutine ? -1 : 1;
+    return x->line < y->line ? -1 : x->line > y->line;
+}
+
+typedef struct {
+    int subroutine;
+    int line;
+    byte8 count;
+} LineCount;
+
+static int compareLineCounts(const void* a, const void* b) {
+    const LineCount* x = (const LineCount*)a;
+    const LineCount* y = (const LineCount*)b;
+    if (x->count != y->count) return x->count < y->count ? 1 : -1;
+    return x->line < y->line ? -1 : x->line > y->line;
+}
+
+static void printSummary(Sample* samples, int count, BytecodeStream* bs, byte8* self, byte8* total, FILE* out) {
+    int names = bs->lines.nameCount;
+
+    fprintf(out, "\nSampled profile: %d samples of %d us CPU time\n", count, SAMPLE_INTERVAL_US);
+
+    fprintf(out, "%-24s %10s %8s %10s %8s\n", "subroutine", "self", "self%", "total", "total%");
+    for (int s = -1; s < names; s++) {
+        if (total[s + 1] == 0) continue;
+        fprintf(out, "%-24s %10llu %7.2f%% %10llu %7.2f%%\n", getSubroutineName(bs, s),
+                (unsigned long long)self[s + 1], 100.0 * (double)self[s + 1] / count,
+                (unsigned long long)total[s + 1], 100.0 * (double)total[s + 1] / count);
+    }
+
+    qsort(samples, count, sizeof(Sample), compareLines);
+    LineCount* lines = (LineCount*) malloc(count * sizeof(LineCount));
+    if (lines == NULL) return;
+
+    int lineCount = 0;
+    for (int i = 0; i < count; i++) {
+        if (lineCount > 0 && lines[lineCount - 1].subroutine == samples[i].subroutine && lines[lineCount - 1].line == samples[i].line) {
+            lines[lineCount - 1].count++;
+            continue;
+        }
+        lines[lineCount].subroutine = samples[i].subroutine;
+        lines[lineCount].line = samples[i].line;
+        lines[lineCount].count = 1;
+        lineCount++;
+    }
+    qsort(lines, lineCount, sizeof(LineCount), compareLineCounts);
+
+    fprintf(out, "\n%-8s %-24s %10s %8s\n", "line", "subroutine", "samples", "%");
+    for (int i = 0; i < lineCount && i < SUMMARY_LINES; i++) {
+        fprintf(out, "%-8d %-24s %10llu %7.2f%%\n", lines[i].line, getSubroutineName(bs, lines[i].subroutine),
+                (unsigned long long)lines[i].count, 100.0 * (double)lines[i].count / count);
+    }
+
+    free(lines);
+}
+
+bool writeSampleProfile(SampleProfile* profile, DecodedProgram* code, BytecodeStream* bs, const char* path, FILE* summary) {
+    int count = (int)profile->samples;
+    int names = bs->lines.nameCount;
+    Sample* samples = (Sample*) calloc(count > 0 ? count : 1, sizeof(Sample));
+    byte8* self = (byte8*) calloc(names + 1, sizeof(byte8));
+    byte8* total = (byte8*) calloc(names + 1, sizeof(byte8));
+    int* seen = (int*) malloc((names + 1) * sizeof(int));
+    bool ok = samples != NULL && self != NULL && total != NULL && seen != NULL;
+
+    for (int s = 0; ok && s <= names; s++) {
+        seen[s] = -1;
+    }
+
+    size_t pos = 0;
+    for (int i = 0; ok && i < count; i++) {
+        int frames = profile->buffer[pos];
+        bool truncated = frames < 0;
+        if (truncated) frames = -frames;
+        int* positions = &profile->buffer[pos + 1];
+        pos += frames + 1;
+
+        samples[i].stack = collapseSample(positions, frames, truncated, code, bs);
+        if (samples[i].stack == NULL) {
+            ok = false;
+            break;
+        }
+
+        const LineEntry* entry = entryOf(code, bs, positions[0]);
+        samples[i].subroutine = entry == NULL ? -1 : entry->subroutine;
+        samples[i].line = entry == NULL ? 0 : entry->line;
+        self[samples[i].subroutine + 1]++;
+
+        // Recursive subroutines count once per sample towards their total.
+        for (int f = 0; f < frames; f++) {
+            const LineEntry* frame = entryOf(code, bs, positions[f]);
+            int s = (frame == NULL ? -1 : frame->subroutine) + 1;
+            if (seen[s] != i) {
+                seen[s] = i;
+                total[s]++;
+            }
+        }
+    }
+
+    FILE* out = ok ? fopen(path, "w") : NULL;
+    if (ok && out == NULL) fprintf(stderr, "Could not open \"%s\" for the profile.\n", path);
+
+    if (out != NULL) {
+        qsort(samples, count, sizeof(Sample), compareStacks);
+        for (int i = 0; i < count;) {
+            int j = i;
+            while (j < count && strcmp(samples[j].stack, samples[i].stack) == 0) j++;
+            fprintf(out, "%s %d\n", samples[i].stack, j - i);
+            i = j;
+        }
+        fclose(out);
+
+        if (count > 0) printSummary(samples, count, bs, self, total, summary);
+        if (bs->lines.count == 0) fprintf(summary, "The bytecode has no line table, so samples are attributed to instruction offsets.\n");
+        if (profile->truncated > 0) fprintf(summary, "%llu samples were deeper than %d frames and lost their outermost ones.\n", (unsigned long long)profile->truncated, SAMPLE_MAX_DEPTH);
+        if (profile->dropped > 0) fprintf(summary, "%llu samples did not fit the sample buffer.\n", (unsigned long long)profile->dropped);
+        fprintf(summary, "Collapsed stacks written to %s.\n", path);
+    } else if (!ok) {
+        fprintf(stderr, "Not enough memory to write the profile.\n");
+    }
+
+    for (int i = 0; samples != NULL && i < count; i++) {
+        free(samples[i].stack);
+    }
+    free(samples);
+    free(self);
+    free(total);
+    free(seen);
+    return out != NULL;
+}
@@ -0,0 +1,40 @@
+#ifndef PSEUDOCOMPILER_PROFILER_H
+#define PSEUDOCOMPILER_PROFILER_H
+
+#include "common.h"
+#include "bytecode.h"
+#include "decode.h"
+#include "stack.h"
+
+// Sampling profiler for --profile. While the program runs, SIGPROF interrupts it every
+// SAMPLE_INTERVAL_US of CPU time and the handler copies the current instruction and the call
+// site of every active frame into a preallocated buffer. Afterwards the line table turns each
+// sample into a stack of PROCEDURE and FUNCTION names ending in the source line, written out
+// in the collapsed format flamegraph tools read ("main;Outer;Inner;line 12 34").
+#if defined(__unix__) || defined(__APPLE__)
+#define PROFILER_AVAILABLE
+#endif
+
+#define SAMPLE_INTERVAL_US  1000
+#define SAMPLE_BUFFER_INTS  (1 << 22)
+#define SAMPLE_MAX_DEPTH    128     // Frames kept per sample, innermost first.
+
+typedef struct {
+    int* buffer;            // Per sample: frame count, then instruction indices innermost first.
+    size_t used;
+    byte8 samples;
+    byte8 dropped;          // Samples that found the buffer full.
+    byte8 truncated;        // Samples whose outermost frames did not fit SAMPLE_MAX_DEPTH.
+} SampleProfile;
+
+bool initSampleProfile(SampleProfile* profile);
+void freeSampleProfile(SampleProfile* profile);
+
+// Records the running instruction and the frames under it, calls->frames[0] to [top]. Only
+// touches the buffer, so it may be called from the signal handler.
+void recordSample(SampleProfile* profile, int current, CallStack* calls, int top);
+
+// Writes the collapsed stacks to path and a summary by line and by subroutine to summary.
+bool writeSampleProfile(SampleProfile* profile, DecodedProgram* code, BytecodeStream* bs, const char* path, FILE* summary);
+
+#endif //PSEUDOCOMPILER_PROFILER_H
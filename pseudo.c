@@ -0,0 +1,156 @@
+#include "pseudo.h"
+
+#include "lexer.h"
+#include "parser.h"
+#include "semantic.h"
+#include "bytecode.h"
+#include "compiler.h"
+#include "optimizer.h"
+#include "vm.h"
+
+struct PseudoProgram {
+    BytecodeStream stream;
+};
+
+struct PseudoVM {
+    VM vm;
+    bool hasRun;            // Set by a run, cleared by a reset.
+};
+
+void pseudoSetDiagnostics(FILE* stream) {
+    setDiagnostics(stream);
+}
+
+void pseudoInitOptions(PseudoOptions* options) {
+    options->registerMode = false;
+    options->optimize = true;
+    options->heapCells = DEFAULT_HEAP_CELLS;
+    options->gcTrigger = DEFAULT_GC_TRIGGER;
+    options->stackSlots = DEFAULT_STACK_SLOTS;
+    options->frames = DEFAULT_CALL_FRAMES;
+    options->jit = true;
+    options->jitThreshold = DEFAULT_JIT_THRESHOLD;
+    options->countInstructions = false;
+    options->maxInstructions = 0;
+}
+
+PseudoProgram* pseudoCompile(const char* source, const PseudoOptions* options) {
+    PseudoProgram* program = (PseudoProgram*) malloc(sizeof(PseudoProgram));
+    if (program == NULL) return NULL;
+    initBytecodeStream(&program->stream);
+
+    Lexer lexer;
+    initLexer(&lexer, source);
+    scanSource(&lexer);
+
+    Parser parser;
+    initParser(&parser, lexer.array);
+
+    bool failed = genAST(&parser);
+
+    Analyser analyser;
+    initAnalyser(&analyser);
+
+    if (!failed) failed = semanticAnalysis(&analyser, &parser.ast);
+
+    if (!failed) {
+        Compiler compiler;
+        initCompiler(&compiler, &program->stream);
+        compiler.registerMode = options->registerMode;
+
+        compile(&compiler, &parser.ast);
+        if (options->optimize) optimizeBytecode(&program->stream);
+
+        freeCompiler(&compiler);
+    }
+
+    freeAnalyser(&analyser);
+    freeParser(&parser);
+    freeLexer(&lexer);
+
+    if (failed) {
+        pseudoFreeProgram(program);
+        return NULL;
+    }
+    return program;
+}
+
+PseudoProgram* pseudoLoad(const char* path) {
+    PseudoProgram* program = (PseudoProgram*) malloc(sizeof(PseudoProgram));
+    if (program == NULL) return NULL;
+    initBytecodeStream(&program->stream);
+
+    if (!readBinFile(&program->stream, path, false)) {
+        pseudoFreeProgram(program);
+        return NULL;
+    }
+    return program;
+}
+
+bool pseudoSave(PseudoProgram* program, const char* path) {
+    return genBinFile(&program->stream, path);
+}
+
+void pseudoFreeProgram(PseudoProgram* program) {
+    if (program == NULL) return;
+    freeBytecodeStream(&program->stream);
+    free(program);
+}
+
+PseudoVM* pseudoNewVM(PseudoProgram* program, const PseudoOptions* options) {
+    PseudoVM* vm = (PseudoVM*) malloc(sizeof(PseudoVM));
+    if (vm == NULL) return NULL;
+
+    if (!initVM(&vm->vm, options->heapCells, options->stackSlots, options->frames, &program->stream)) {
+        free(vm);
+        return NULL;
+    }
+    setCollectionTrigger(&vm->vm.mem, options->gcTrigger);
+    configureJit(&vm->vm.jit, options->jit, options->jitThreshold);
+    vm->vm.countInstructions = options->countInstructions || options->maxInstructions > 0;
+    if (options->maxInstructions > 0) vm->vm.instructionLimit = options->maxInstructions;
+    vm->hasRun = false;
+    return vm;
+}
+
+void pseudoFreeVM(PseudoVM* vm) {
+    if (vm == NULL) return;
+    freeVM(&vm->vm);
+    free(vm);
+}
+
+bool pseudoPrepare(PseudoVM* vm) {
+    return prepareProgram(&vm->vm);
+}
+
+PseudoResult pseudoRun(PseudoVM* vm, FILE* in, FILE* out) {
+    if (vm->hasRun) pseudoReset(vm);
+
+    vm->vm.in = in;
+    vm->vm.out = out;
+    vm->hasRun = true;
+
+    bool started = run(&vm->vm, false);
+    fflush(out);
+
+    if (!started) return PSEUDO_INVALID_PROGRAM;
+    return vm->vm.hadRuntimeError ? PSEUDO_RUNTIME_ERROR : PSEUDO_OK;
+}
+
+void pseudoReset(PseudoVM* vm) {
+    vmReset(&vm->vm);
+    vm->hasRun = false;
+}
+
+void pseudoSetFileDirectory(PseudoVM* vm, int dirFd) {
+    vm->vm.fileDir = dirFd;
+}
+
+const char* pseudoErrorMessage(PseudoVM* vm) {
+    return vm->vm.errorMessage;
+}
+
+void pseudoGetStats(PseudoVM* vm, PseudoStats* stats) {
+    stats->instructions = vm->vm.executed;
+    stats->peakHeapCells = vm->vm.mem.peakInUse;
+}
@@ -0,0 +1,95 @@
+#ifndef PSEUDOCOMPILER_PSEUDO_H
+#define PSEUDOCOMPILER_PSEUDO_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Public interface of libpseudo, for programs that embed the compiler and virtual machine.
+// A program is compiled or loaded once and can be run by any number of VMs. A VM runs one
+// program; after a run it is reset in place, keeping its heap, stacks, decoded program and
+// native code, so running the same program on many inputs costs no setup after the first.
+//
+//     PseudoOptions options;
+//     pseudoInitOptions(&options);
+//     PseudoProgram* program = pseudoCompile(source, &options);
+//     PseudoVM* vm = pseudoNewVM(program, &options);
+//     for (each input) {
+//         pseudoRun(vm, input, output);
+//         pseudoReset(vm);
+//     }
+//     pseudoFreeVM(vm);
+//     pseudoFreeProgram(program);
+//
+// Compile errors and runtime errors are reported on stderr, as the command-line tool does,
+// unless the calling thread has given pseudoSetDiagnostics a stream of its own.
+//
+// Nothing is shared between VMs, so separate VMs may run on separate threads, even for the same
+// program. A single VM must only be used by one thread at a time.
+
+typedef struct PseudoProgram PseudoProgram;
+typedef struct PseudoVM PseudoVM;
+
+typedef struct {
+    bool registerMode;      // Compile to register-form instructions where possible.
+    bool optimize;          // Run the peephole pass over the compiled bytecode.
+    int heapCells;          // Most heap objects a run may hold at once.
+    int gcTrigger;          // Heap occupancy, in percent, that makes an allocation collect first.
+    int stackSlots;
+    int frames;             // Deepest call nesting.
+    bool jit;
+    int jitThreshold;       // Calls after which a subroutine is compiled to native code.
+    bool countInstructions; // Count the instructions each run executes, which turns the JIT off.
+    unsigned long long maxInstructions; // Stops a run with a runtime error past this many, 0 for
+                                        // no limit. Counts instructions like countInstructions.
+} PseudoOptions;
+
+typedef struct {
+    unsigned long long instructions;    // Zero unless the VM counts instructions.
+    unsigned long long peakHeapCells;   // Most heap objects held at once.
+} PseudoStats;
+
+typedef enum {
+    PSEUDO_OK,
+    PSEUDO_RUNTIME_ERROR,   // The program stopped on a runtime error, see pseudoErrorMessage.
+    PSEUDO_INVALID_PROGRAM, // The bytecode failed verification, or the stacks could not be set up.
+} PseudoResult;
+
+// Sends the compile and runtime errors of everything this thread does from now on to stream,
+// or back to stderr for NULL. Other threads are not affected.
+void pseudoSetDiagnostics(FILE* stream);
+
+// The defaults the command-line tool uses.
+void pseudoInitOptions(PseudoOptions* options);
+
+// Compiles pseudocode source, or returns NULL if it has errors. The source is not kept.
+PseudoProgram* pseudoCompile(const char* source, const PseudoOptions* options);
+// Loads a .pcbc file written by pseudoSave or pseudo -c, or returns NULL.
+PseudoProgram* pseudoLoad(const char* path);
+bool pseudoSave(PseudoProgram* program, const char* path);
+// Only once every VM running the program has been freed.
+void pseudoFreeProgram(PseudoProgram* program);
+
+// Returns NULL if there is not enough memory for the VM.
+PseudoVM* pseudoNewVM(PseudoProgram* program, const PseudoOptions* options);
+void pseudoFreeVM(PseudoVM* vm);
+
+// Decodes and verifies the program ahead of the first run. A VM prepared this way and then
+// copied, as by fork(), starts running in each copy without repeating that work. False if the
+// program is invalid.
+bool pseudoPrepare(PseudoVM* vm);
+
+// Runs the program from the start with INPUT reading from in and OUTPUT writing to out. A VM
+// that has already run is reset first, if pseudoReset was not called since.
+PseudoResult pseudoRun(PseudoVM* vm, FILE* in, FILE* out);
+// Frees every object the last run left on the heap, closing its files, and empties the stacks.
+void pseudoReset(PseudoVM* vm);
+// Has OPENFILE resolve relative file names in the directory open as dirFd, for hosts that run
+// programs for clients in other directories, instead of the process's working directory. -1
+// restores the default. The VM does not close it. Only on Linux and macOS.
+void pseudoSetFileDirectory(PseudoVM* vm, int dirFd);
+// The last run's runtime error, or NULL.
+const char* pseudoErrorMessage(PseudoVM* vm);
+// What the last run used.
+void pseudoGetStats(PseudoVM* vm, PseudoStats* stats);
+
+#endif //PSEUDOCOMPILER_PSEUDO_H
@@ -0,0 +1,345 @@
+#include "runtime.h"
+
+Runtime rt;
+
+// Root marker for the heap: the reference variables of every active frame, then the
+// temporaries of the statements still running.
+static void markRoots(void* context) {
+    (void)context;
+
+    for (RtFrame* frame = rt.frames; frame != NULL; frame = frame->parent) {
+        for (int i = 0; i < frame->rootCount; i++) {
+            if (frame->roots[i] != NULL) markCell(&rt.mem, frame->roots[i]);
+        }
+    }
+
+    for (int i = 0; i < rt.tempCount; i++) {
+        if (rt.temps[i] != NULL) markCell(&rt.mem, rt.temps[i]);
+    }
+}
+
+void rtInit(int heapCells, int gcTrigger, int maxDepth) {
+    if (!createProgramMemory(&rt.mem, heapCells)) exit(70);
+    setCollectionTrigger(&rt.mem, gcTrigger);
+    setRootMarker(&rt.mem, markRoots, NULL);
+
+    rt.frames = NULL;
+    rt.temps = NULL;
+    rt.tempCount = 0;
+    rt.tempCapacity = 0;
+    rt.depth = 0;
+    rt.maxDepth = maxDepth;
+}
+
+void rtFinish(void) {
+    printf("Program executed correctly.\n");
+
+    freeProgramMemory(&rt.mem);
+    free(rt.temps);
+    rt.temps = NULL;
+    rt.tempCount = 0;
+    rt.tempCapacity = 0;
+}
+
+void rtError(const char* message) {
+    fflush(stdout);
+    fprintf(stderr, "Runtime error: %s\n", message);
+    exit(70);
+}
+
+void rtGrowTemps(void) {
+    int capacity = GROW_CAPACITY(rt.tempCapacity, 64);
+    Obj** temps = (Obj**) realloc(rt.temps, capacity * sizeof(Obj*));
+    if (temps == NULL) rtError("Not enough memory available for string allocation.");
+
+    rt.temps = temps;
+    rt.tempCapacity = capacity;
+}
+
+static Obj* newString(const char* chars, int length, const char* message) {
+    Obj* str = allocString(&rt.mem, chars, length);
+    if (str == NULL) rtError(message);
+    return rtKeep(str);
+}
+
+Obj* rtLiteral(Obj** slot, const char* chars, int length) {
+    Obj* str = allocString(&rt.mem, chars, length);
+    if (str == NULL) rtError("String allocation failed in heap.");
+
+    *slot = str;
+    return str;
+}
+
+Obj* rtArray(int x0, int x1, int y0, int y1, int elemSize) {
+    Obj* arr = allocArray(&rt.mem, x1 - x0 + 1, y1 - y0 + 1, x0, y0, elemSize);
+    if (arr == NULL) rtError("Array allocation failed.");
+    return rtKeep(arr);
+}
+
+Obj* rtConcat(Obj* fst, Obj* snd) {
+    rtCheck(fst);
+    rtCheck(snd);
+
+    int length = fst->as.StringObj.length + snd->as.StringObj.length;
+    char* buff = malloc(length > 0 ? length : 1);
+    if (buff == NULL) rtError("Not enough memory available for string allocation.");
+
+    memcpy(buff, fst->as.StringObj.start, fst->as.StringObj.length);
+    memcpy(buff + fst->as.StringObj.length, snd->as.StringObj.start, snd->as.StringObj.length);
+
+    Obj* res = newString(buff, length, "Not enough memory available for string allocation.");
+    free(buff);
+    return res;
+}
+
+int rtCompare(Obj* str1, Obj* str2) {
+    rtCheck(str1);
+    rtCheck(str2);
+
+    // 0 if equal, <0 if str1 before str2 and viceversa
+    int length = str1->as.StringObj.length;
+    int shorter = -1;
+    if (str2->as.StringObj.length < length) {
+        length = str2->as.StringObj.length;
+        shorter = 1;
+    } else if (str2->as.StringObj.length == length) {
+        shorter = 0;
+    }
+
+    for (int i = 0; i < length; i++) {
+        if (str1->as.StringObj.start[i] != str2->as.StringObj.start[i]) {
+            return (int)str1->as.StringObj.start[i] - (int)str2->as.StringObj.start[i];
+        }
+    }
+
+    return shorter;
+}
+
+Obj* rtSubstring(Obj* str, int initPos, int length) {
+    rtCheck(str);
+
+    if (initPos + length - 1 > str->as.StringObj.length) {
+        rtError("Substring overextends string.");
+    }
+    if (initPos <= 0 || initPos > str->as.StringObj.length) {
+        rtError("Initial pos must be between 1 and length of string.");
+    }
+
+    return newString(str->as.StringObj.start + initPos - 1, length, "String allocation failed in heap.");
+}
+
+int rtLength(Obj* str) {
+    return rtCheck(str)->as.StringObj.length;
+}
+
+static Obj* changeCase(Obj* str, char from, char to) {
+    rtCheck(str);
+
+    int length = str->as.StringObj.length;
+    char* chars = (char*) malloc(length > 0 ? length : 1);
+    if (chars == NULL) rtError("Memory allocation fail.");
+
+    for (int i = 0; i < length; i++) {
+        char c = str->as.StringObj.start[i];
+        if (c >= from && c <= from + 25) c += to - from;
+        chars[i] = c;
+    }
+
+    Obj* res = newString(chars, length, "Memory allocation fail.");
+    free(chars);
+    return res;
+}
+
+Obj* rtLcase(Obj* str) {
+    return changeCase(str, 'A', 'a');
+}
+
+Obj* rtUcase(Obj* str) {
+    return changeCase(str, 'a', 'A');
+}
+
+int rtRandomBetween(int min, int max) {
+    srand((unsigned int)clock());
+    return rand() % (max - min + 1) + min;
+}
+
+double rtRnd(void) {
+    srand((unsigned int)clock());
+    return rand() / ((double) RAND_MAX);
+}
+
+bool rtEof(Obj* file) {
+    rtCheck(file);
+    return feof(file->as.FileObj.filePtr) != 0;
+}
+
+char rtCharAt(Obj* str, int pos) {
+    rtCheck(str);
+
+    if (pos <= 0 || pos > str->as.StringObj.length) {
+        rtError("Position must be between 1 and length of string.");
+    }
+
+    return str->as.StringObj.start[pos - 1];
+}
+
+void rtOutputInt(int a) {
+    printf("%d", a);
+}
+
+void rtOutputReal(double a) {
+    printf("%f", a);
+}
+
+void rtOutputChar(char c) {
+    putchar(c);
+}
+
+void rtOutputBool(bool a) {
+    fputs(a ? "TRUE" : "FALSE", stdout);
+}
+
+void rtOutputRef(Obj* ref) {
+    printf("[%p]", (void*)ref);
+}
+
+void rtOutputString(Obj* str) {
+    rtCheck(str);
+    fwrite(str->as.StringObj.start, 1, str->as.StringObj.length, stdout);
+}
+
+void rtOutputNewline(void) {
+    putchar('\n');
+}
+
+static void clearInputBuffer() {
+    clearerr(stdin);
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF) { }
+}
+
+int rtInputInt(void) {
+    int num;
+    int res = scanf("%d", &num);
+    clearInputBuffer();
+
+    if (res <= 0) rtError("I/O error.");
+    return num;
+}
+
+double rtInputReal(void) {
+    double num;
+    int res = scanf("%lf", &num);
+    clearInputBuffer();
+
+    if (res <= 0) rtError("I/O error.");
+    return num;
+}
+
+char rtInputChar(void) {
+    char c;
+    int res = scanf("%c", &c);
+    clearInputBuffer();
+
+    if (res <= 0) rtError("I/O error.");
+    return c;
+}
+
+bool rtInputBool(void) {
+    char boolean[10];
+    int res = scanf("%9s", boolean);
+    clearInputBuffer();
+
+    if (res <= 0) rtError("I/O error.");
+
+    return memcmp(boolean, "TRUE", 4) == 0 || memcmp(boolean, "true", 4) == 0 || memcmp(boolean, "True", 4) == 0;
+}
+
+// Characters up to the end of the line, which is dropped. Fails at the end of input.
+static Obj* readLine(FILE* stream, bool endOk, const char* message) {
+    int capacity = 128;
+    int length = 0;
+    char* buff = malloc(capacity);
+    if (buff == NULL) rtError("I/O error.");
+
+    while (true) {
+        int c = fgetc(stream);
+        if (c == EOF) {
+            if (ferror(stream) || !endOk) {
+                free(buff);
+                rtError(message);
+            }
+            break;
+        }
+
+        if (c == '\n') break;
+
+        if (length >= capacity) {
+            capacity *= 2;
+            char* grown = realloc(buff, capacity);
+            if (grown == NULL) {
+                free(buff);
+                rtError("I/O error.");
+            }
+            buff = grown;
+        }
+
+        buff[length++] = (char)c;
+    }
+
+    Obj* str = newString(buff, length, "I/O error.");
+    free(buff);
+    return str;
+}
+
+Obj* rtInputString(void) {
+    return readLine(stdin, false, "I/O error.");
+}
+
+Obj* rtOpenFile(const char* name, FileAccessType accessType) {
+    Obj* file = allocFile(&rt.mem, -1, name, accessType);
+    if (file == NULL) rtError("Error opening file.");
+    return file;
+}
+
+void rtCloseFile(Obj* file) {
+    rtCheck(file);
+    markForceFree(&rt.mem, file);
+
+    fclose(file->as.FileObj.filePtr);
+    file->as.FileObj.filePtr = NULL;
+}
+
+Obj* rtReadLine(Obj* file) {
+    return readLine(rtCheck(file)->as.FileObj.filePtr, true, "Error reading file.");
+}
+
+void rtWriteInt(Obj* file, int a) {
+    fprintf(rtCheck(file)->as.FileObj.filePtr, "%d", a);
+}
+
+void rtWriteReal(Obj* file, double a) {
+    fprintf(rtCheck(file)->as.FileObj.filePtr, "%f", a);
+}
+
+void rtWriteChar(Obj* file, char c) {
+    fputc(c, rtCheck(file)->as.FileObj.filePtr);
+}
+
+void rtWriteBool(Obj* file, bool a) {
+    fputs(a ? "TRUE" : "FALSE", rtCheck(file)->as.FileObj.filePtr);
+}
+
+void rtWriteRef(Obj* file, Obj* ref) {
+    fprintf(rtCheck(file)->as.FileObj.filePtr, "[%p]", (void*)ref);
+}
+
+void rtWriteString(Obj* file, Obj* str) {
+    rtCheck(file);
+    rtCheck(str);
+    fwrite(str->as.StringObj.start, 1, str->as.StringObj.length, file->as.FileObj.filePtr);
+}
+
+void rtWriteNewline(Obj* file) {
+    fputc('\n', rtCheck(file)->as.FileObj.filePtr);
+}
@@ -0,0 +1,155 @@
+#ifndef PSEUDOCOMPILER_RUNTIME_H
+#define PSEUDOCOMPILER_RUNTIME_H
+
+#include <limits.h>
+#include <math.h>
+
+#include "common.h"
+#include "memory.h"
+
+// Support library linked into programs translated to C by the -cc backend. It behaves like
+// the VM: the same heap and collector, the same builtins and the same output formats, with
+// runtime errors ending the program.
+
+// Reference variables of one active subroutine (or the globals), visible to the collector.
+// Intermediate objects are kept alive as temporaries until the statement that made them ends.
+typedef struct RtFrame {
+    Obj** roots;
+    int rootCount;
+    int tempBase;
+    struct RtFrame* parent;
+} RtFrame;
+
+typedef struct {
+    ProgramMemory mem;
+    RtFrame* frames;
+    Obj** temps;
+    int tempCount;
+    int tempCapacity;
+    int depth;
+    int maxDepth;
+} Runtime;
+
+extern Runtime rt;
+
+void rtInit(int heapCells, int gcTrigger, int maxDepth);
+void rtFinish(void);
+_Noreturn void rtError(const char* message);
+void rtGrowTemps(void);
+
+static inline void rtEnter(RtFrame* frame, Obj** roots, int rootCount) {
+    if (++rt.depth > rt.maxDepth) rtError("Call stack overflow.");
+
+    frame->roots = roots;
+    frame->rootCount = rootCount;
+    frame->tempBase = rt.tempCount;
+    frame->parent = rt.frames;
+    rt.frames = frame;
+}
+
+static inline void rtLeave(RtFrame* frame) {
+    rt.frames = frame->parent;
+    rt.tempCount = frame->tempBase;
+    rt.depth--;
+}
+
+static inline Obj* rtKeep(Obj* obj) {
+    if (rt.tempCount == rt.tempCapacity) rtGrowTemps();
+    rt.temps[rt.tempCount++] = obj;
+    return obj;
+}
+
+// Drops the temporaries of the statement that just ran.
+static inline void rtRelease(RtFrame* frame) {
+    rt.tempCount = frame->tempBase;
+}
+
+// Loop and branch conditions release their temporaries once evaluated.
+static inline bool rtTest(RtFrame* frame, bool value) {
+    rt.tempCount = frame->tempBase;
+    return value;
+}
+
+static inline Obj* rtCheck(Obj* obj) {
+    if (obj == NULL) rtError("Segmentation fault.");
+    return obj;
+}
+
+// Integer DIV and MOD, with the VM's runtime errors where the machine would trap.
+static inline int rtIntDiv(int a, int b) {
+    if (b == 0) rtError("Division by zero.");
+    if (b == -1 && a == INT_MIN) rtError("Integer overflow in DIV.");
+    return a / b;
+}
+
+static inline int rtIntMod(int a, int b) {
+    if (b == 0) rtError("Division by zero.");
+    return b == -1 ? 0 : a % b;
+}
+
+static inline double rtMod(double a, double b) {
+    return a - (int)(a / b) * b;
+}
+
+static inline char rtIntToChar(int num) {
+    if (num >= 256) num = 256;
+    else if (num < 0) num = 0;
+    return (char)num;
+}
+
+// Address of an array element, after the same bounds check as the VM.
+static inline void* rtElement(Obj* arr, int x, int y) {
+    rtCheck(arr);
+
+#define ARR arr->as.ArrayObj
+    if (x < ARR.x0 || x >= ARR.x0 + ARR.length || y < ARR.y0 || y >= ARR.y0 + ARR.width) {
+        rtError("Array out of bounds access.");
+    }
+
+    return ARR.start + ((size_t)(y - ARR.y0) * ARR.length + (x - ARR.x0)) * ARR.elemSize;
+#undef ARR
+}
+
+// String literals are allocated on first use and then kept in a root slot of their own.
+#define RT_LITERAL(slot, chars, length)     ((slot) != NULL ? (slot) : rtLiteral(&(slot), chars, length))
+
+Obj* rtLiteral(Obj** slot, const char* chars, int length);
+Obj* rtArray(int x0, int x1, int y0, int y1, int elemSize);
+Obj* rtConcat(Obj* fst, Obj* snd);
+int rtCompare(Obj* str1, Obj* str2);
+
+Obj* rtSubstring(Obj* str, int initPos, int length);
+int rtLength(Obj* str);
+Obj* rtLcase(Obj* str);
+Obj* rtUcase(Obj* str);
+int rtRandomBetween(int min, int max);
+double rtRnd(void);
+bool rtEof(Obj* file);
+char rtCharAt(Obj* str, int pos);
+
+void rtOutputInt(int a);
+void rtOutputReal(double a);
+void rtOutputChar(char c);
+void rtOutputBool(bool a);
+void rtOutputRef(Obj* ref);
+void rtOutputString(Obj* str);
+void rtOutputNewline(void);
+
+int rtInputInt(void);
+double rtInputReal(void);
+char rtInputChar(void);
+bool rtInputBool(void);
+Obj* rtInputString(void);
+
+Obj* rtOpenFile(const char* name, FileAccessType accessType);
+void rtCloseFile(Obj* file);
+Obj* rtReadLine(Obj* file);
+void rtWriteInt(Obj* file, int a);
+void rtWriteReal(Obj* file, double a);
+void rtWriteChar(Obj* file, char c);
+void rtWriteBool(Obj* file, bool a);
+void rtWriteRef(Obj* file, Obj* ref);
+void rtWriteString(Obj* file, Obj* str);
+void rtWriteNewline(Obj* file);
+
+#endif //PSEUDOCOMPILER_RUNTIME_H
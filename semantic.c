@@ -7,123 +7,123 @@ static void semanticErrorMessage(ASTNode* node, const char* message) {
     switch (node->type) {
         // EXPRESSIONS
         case EXPR_BINARY:
-            fprintf(stderr, "binary expression:\n");
+            fprintf(diagnostics(), "binary expression:\n");
             break;
         case EXPR_ASSIGN:
-            fprintf(stderr, "assignment expression:\n");
+            fprintf(diagnostics(), "assignment expression:\n");
             break;
         case EXPR_CALL:
-            fprintf(stderr, "call expression:\n");
+            fprintf(diagnostics(), "call expression:\n");
             break;
         case EXPR_GET:
-            fprintf(stderr, "get expression:\n");
+            fprintf(diagnostics(), "get expression:\n");
             break;
         case EXPR_GROUP:
-            fprintf(stderr, "group expression:\n");
+            fprintf(diagnostics(), "group expression:\n");
             break;
         case EXPR_LITERAL:
-            fprintf(stderr, "literal expression:\n");
+            fprintf(diagnostics(), "literal expression:\n");
             break;
         case EXPR_LOGICAL:
-            fprintf(stderr, "logical expression:\n");
+            fprintf(diagnostics(), "logical expression:\n");
             break;
         case EXPR_SET:
-            fprintf(stderr, "set expression:\n");
+            fprintf(diagnostics(), "set expression:\n");
             break;
         case EXPR_SUPER:
-            fprintf(stderr, "super expression:\n");
+            fprintf(diagnostics(), "super expression:\n");
             break;
         case EXPR_THIS:
-            fprintf(stderr, "this expression:\n");
+            fprintf(diagnostics(), "this expression:\n");
             break;
         case EXPR_UNARY:
-            fprintf(stderr, "unary expression:\n");
+            fprintf(diagnostics(), "unary expression:\n");
             break;
         case EXPR_VARIABLE:
-            fprintf(stderr, "variable expression:\n");
+            fprintf(diagnostics(), "variable expression:\n");
             break;
         case EXPR_ARRAY_ACCESS:
-            fprintf(stderr, "array access expression:\n");
+            fprintf(diagnostics(), "array access expression:\n");
             break;
 
             // STATEMENTS
         case STMT_BLOCK:
-            fprintf(stderr, "block statement:\n");
+            fprintf(diagnostics(), "block statement:\n");
             break;
         case STMT_EXPR:
-            fprintf(stderr, "expression statement:\n");
+            fprintf(diagnostics(), "expression statement:\n");
             break;
         case STMT_SUBROUTINE:
             if (node->as.SubroutineStmt.subroutineType == TYPE_FUNCTION) {
-                fprintf(stderr, "FUNCTION statement:\n");
+                fprintf(diagnostics(), "FUNCTION statement:\n");
             } else {
-                fprintf(stderr, "PROCEDURE statement:\n");
+                fprintf(diagnostics(), "PROCEDURE statement:\n");
             }
             break;
         case STMT_IF:
-            fprintf(stderr, "IF statement:\n");
+            fprintf(diagnostics(), "IF statement:\n");
             break;
         case STMT_OUTPUT:
-            fprintf(stderr, "OUTPUT statement:\n");
+            fprintf(diagnostics(), "OUTPUT statement:\n");
             break;
         case STMT_INPUT:
-            fprintf(stderr, "INPUT statement:\n");
+            fprintf(diagnostics(), "INPUT statement:\n");
             break;
         case STMT_RETURN:
-            fprintf(stderr, "RETURN statement:\n");
+            fprintf(diagnostics(), "RETURN statement:\n");
             break;
         case STMT_WHILE:
-            fprintf(stderr, "WHILE statement:\n");
+            fprintf(diagnostics(), "WHILE statement:\n");
             break;
         case STMT_VAR_DECLARE:
-            fprintf(stderr, "variable declaration statement:\n");
+            fprintf(diagnostics(), "variable declaration statement:\n");
             break;
         case STMT_CONST_DECLARE:
-            fprintf(stderr, "constant declaration statement:\n");
+            fprintf(diagnostics(), "constant declaration statement:\n");
             break;
         case STMT_ARRAY_DECLARE:
-            fprintf(stderr, "array declaration statement:\n");
+            fprintf(diagnostics(), "array declaration statement:\n");
             break;
         case STMT_CASE:
-            fprintf(stderr, "CASE statement:\n");
+            fprintf(diagnostics(), "CASE statement:\n");
             break;
         case STMT_REPEAT:
-            fprintf(stderr, "REPEAT-UNTIL statement:\n");
+            fprintf(diagnostics(), "REPEAT-UNTIL statement:\n");
             break;
         case STMT_CALL:
-            fprintf(stderr, "CALL statement:\n");
+            fprintf(diagnostics(), "CALL statement:\n");
             break;
         case STMT_CASE_BLOCK:
-            fprintf(stderr, "CASE block statement:\n");
+            fprintf(diagnostics(), "CASE block statement:\n");
             break;
         case STMT_PROGRAM:
-            fprintf(stderr, "program statement:\n");
+            fprintf(diagnostics(), "program statement:\n");
             break;
         case STMT_FOR:
-            fprintf(stderr, "FOR statement:\n");
+            fprintf(diagnostics(), "FOR statement:\n");
             break;
         case STMT_CASE_LINE:
-            fprintf(stderr, "CASE line statement:\n");
+            fprintf(diagnostics(), "CASE line statement:\n");
             break;
 
             // MISCELLANEOUS
         case AST_PARAMETER:
-            fprintf(stderr, "AST parameter:\n");
+            fprintf(diagnostics(), "AST parameter:\n");
             break;
 
         default:
-            fprintf(stderr, "syntax node referring to source:\n");
+            fprintf(diagnostics(), "syntax node referring to source:\n");
             break;
     }
 
-    fprintf(stderr, "%.*s\n%s", (int)node->length, node->start, message);
+    fprintf(diagnostics(), "%.*s\n%s", (int)node->length, node->start, message);
 }
 
 static void semanticError(Analyser* analyser, ASTNode* node, const char* message) {
     if (node == NULL) return;
     analyser->hadError = true;
 
-    fprintf(stderr, "\n[line: %d, col: %d] Error in ", node->line, node->col);
+    fprintf(diagnostics(), "\n[line: %d, col: %d] Error in ", node->line, node->col);
 
     semanticErrorMessage(node, message);
 }
@@ -131,7 +131,7 @@ static void semanticError(Analyser* analyser, ASTNode* node, const char* message
 static void semanticWarning(ASTNode* node, const char* message) {
     if (node == NULL) return;
 
-    fprintf(stderr, "\n[line: %d, col: %d] Warning in ", node->line, node->col);
+    fprintf(diagnostics(), "\n[line: %d, col: %d] Warning in ", node->line, node->col);
 
     semanticErrorMessage(node, message);
 }
@@ -270,7 +270,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             bool res = findSymbol(analyser, name, &callable);
             if (!res) {
                 semanticError(analyser, node, "Callable symbol ");
-                fprintf(stderr, "'%s' not in scope.", name);
+                fprintf(diagnostics(), "'%s' not in scope.", name);
                 return TYPE_ERROR;
             }
             if (callable.type != SYMBOL_FUNC && callable.type != SYMBOL_BUILTIN_FUNC) {
@@ -281,7 +281,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             if (callable.type == SYMBOL_BUILTIN_FUNC) {
                 if (node->as.CallExpr.arguments.count != ((Builtin*)callable.node)->numParams) {
                     semanticError(analyser, node, "Expected ");
-                    fprintf(stderr, "%d arguments as per definition but got %d.", callable.node->as.SubroutineStmt.parameters.count,
+                    fprintf(diagnostics(), "%d arguments as per definition but got %d.", callable.node->as.SubroutineStmt.parameters.count,
                             node->as.CallExpr.arguments.count);
                     return TYPE_ERROR;
                 }
@@ -312,7 +312,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
                     if (type == TYPE_ERROR) continue;
                     if (type != ((Builtin*)callable.node)->parameterTypes[i]) {
                         semanticError(analyser, node, "Argument number ");
-                        fprintf(stderr, "%d is not correct type.", i + 1);
+                        fprintf(diagnostics(), "%d is not correct type.", i + 1);
                         return TYPE_ERROR;
                     }
                 }
@@ -324,12 +324,12 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
 
             if (!callable.initialised) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "'%s' is not initialised previously, and therefore, cannot be used.", name);
+                fprintf(diagnostics(), "'%s' is not initialised previously, and therefore, cannot be used.", name);
                 return TYPE_ERROR;
             }
             if (callable.node->as.SubroutineStmt.parameters.count != node->as.CallExpr.arguments.count) {
                 semanticError(analyser, node, "Expected ");
-                fprintf(stderr, "%d arguments as per definition but got %d.", callable.node->as.SubroutineStmt.parameters.count,
+                fprintf(diagnostics(), "%d arguments as per definition but got %d.", callable.node->as.SubroutineStmt.parameters.count,
                         node->as.CallExpr.arguments.count);
                 return TYPE_ERROR;
             }
@@ -341,7 +341,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
                 if (type == TYPE_ERROR) continue;
                 if (type != callable.node->as.SubroutineStmt.parameters.start[i]->as.Parameter.type && !(type == TYPE_ARRAY && callable.node->as.SubroutineStmt.parameters.start[i]->as.Parameter.isArray)) {
                     semanticError(analyser, node, "Argument number ");
-                    fprintf(stderr, "%d is not correct type.", i + 1);
+                    fprintf(diagnostics(), "%d is not correct type.", i + 1);
                     return TYPE_ERROR;
                 }
 
@@ -354,7 +354,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
                     DataType baseType = getArrayBaseType(analyser, node->as.CallExpr.arguments.start[i], node->as.CallExpr.arguments.start[i]->type);
                     if (baseType != callable.node->as.SubroutineStmt.parameters.start[i]->as.Parameter.type) {
                         semanticError(analyser, node, "Argument number ");
-                        fprintf(stderr, "%d is an array but not of the correct type.", i + 1);
+                        fprintf(diagnostics(), "%d is an array but not of the correct type.", i + 1);
                         return TYPE_ERROR;
                     }
                 }
@@ -373,7 +373,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             bool res = findSymbol(analyser, name, &var);
             if (!res) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "%s not in scope.", name);
+                fprintf(diagnostics(), "%s not in scope.", name);
                 return TYPE_ERROR;
             }
             if (var.type != SYMBOL_VAR && var.type != SYMBOL_PARAM && var.type != SYMBOL_CONST && var.type != SYMBOL_FOR_COUNTER && var.type != SYMBOL_ARRAY && var.type != SYMBOL_FILE) {
@@ -383,13 +383,13 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
 
             if (var.type == SYMBOL_CONST && analyser->assigning) {
                 semanticError(analyser, node, "Can't assign to constant ");
-                fprintf(stderr, "'%s'.", name);
+                fprintf(diagnostics(), "'%s'.", name);
                 return TYPE_ERROR;
             }
 
             if (var.type == SYMBOL_FOR_COUNTER && analyser->assigning) {
                 semanticError(analyser, node, "Can't assign to FOR loop counter ");
-                fprintf(stderr, "'%s'.", name);
+                fprintf(diagnostics(), "'%s'.", name);
                 return TYPE_ERROR;
             }
 
@@ -400,7 +400,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
 
             if (!var.initialised) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "'%s' is not initialised previously and therefore cannot be used.", name);
+                fprintf(diagnostics(), "'%s' is not initialised previously and therefore cannot be used.", name);
                 return TYPE_ERROR;
             }
 
@@ -433,7 +433,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             bool res = findSymbol(analyser, name, &array);
             if (!res) {
                 semanticError(analyser, node, "Array ");
-                fprintf(stderr, "%s is not in scope.", name);
+                fprintf(diagnostics(), "%s is not in scope.", name);
                 return TYPE_ERROR;
             }
             if (array.type != SYMBOL_ARRAY && !(array.type == SYMBOL_PARAM && array.node->as.Parameter.isArray)) {
@@ -463,9 +463,9 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             if ((index2 != TYPE_NONE && index2 != TYPE_ERROR) ^ is2D) {
                 semanticError(analyser, node, "Wrong array dimensions. Expected ");
                 if (array.node->as.ArrayDeclareStmt.is2D) {
-                    fprintf(stderr, "two indices but got one.");
+                    fprintf(diagnostics(), "two indices but got one.");
                 } else {
-                    fprintf(stderr, "one index but got two.");
+                    fprintf(diagnostics(), "one index but got two.");
                 }
                 return TYPE_ERROR;
             }
@@ -598,7 +598,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             bool res = findSymbol(analyser, name, &func);
             if (res) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "'%s' already exists.", name);
+                fprintf(diagnostics(), "'%s' already exists.", name);
                 return TYPE_ERROR;
             }
 
@@ -695,7 +695,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
 
             if (node->as.InputStmt.varAccess->type == EXPR_CALL) {
                 semanticError(analyser, node, "Call expression ");
-                fprintf(stderr, "%.*s is not assignable.", (int)node->as.InputStmt.varAccess->length, node->as.InputStmt.varAccess->start);
+                fprintf(diagnostics(), "%.*s is not assignable.", (int)node->as.InputStmt.varAccess->length, node->as.InputStmt.varAccess->start);
                 return TYPE_ERROR;
             }
 
@@ -714,25 +714,25 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
 
             if (!res) {
                 semanticError(analyser, node, "Target variable ");
-                fprintf(stderr, "'%s' not in scope.", name);
+                fprintf(diagnostics(), "'%s' not in scope.", name);
                 return TYPE_ERROR;
             }
 
             if (var.type == SYMBOL_FOR_COUNTER) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "'%s' is a counter in a FOR loop. It can't be inputted to.", name);
+                fprintf(diagnostics(), "'%s' is a counter in a FOR loop. It can't be inputted to.", name);
                 return TYPE_ERROR;
             }
 
             if (var.type != SYMBOL_VAR && var.type != SYMBOL_PARAM && !(var.type == SYMBOL_ARRAY && node->as.InputStmt.varAccess->type == EXPR_ARRAY_ACCESS)) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "'%s' is not a variable. Array references, constants and subroutines can't be inputted to.", name);
+                fprintf(diagnostics(), "'%s' is not a variable. Array references, constants and subroutines can't be inputted to.", name);
                 return TYPE_ERROR;
             }
 
             if (var.type == SYMBOL_PARAM && var.node->as.Parameter.isArray && node->as.InputStmt.varAccess->type != EXPR_ARRAY_ACCESS) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "'%s' is not a variable, but an ARRAY reference. It can't be inputted to.", name);
+                fprintf(diagnostics(), "'%s' is not a variable, but an ARRAY reference. It can't be inputted to.", name);
                 return TYPE_ERROR;
             }
 
@@ -802,14 +802,14 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             bool res = findSymbolInCurrScope(analyser, name, &var);
             if (res) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "'%s' already exists.", name);
+                fprintf(diagnostics(), "'%s' already exists.", name);
                 return TYPE_ERROR;
             }
 
             res = findSymbol(analyser, name, &var);
             if (res) {
                 semanticWarning(node, "Symbol ");
-                fprintf(stderr, "'%s' redeclaration in inner scope shadows outer definition.", name);
+                fprintf(diagnostics(), "'%s' redeclaration in inner scope shadows outer definition.", name);
             }
 
             addSymbol(analyser, name, node, SYMBOL_VAR);
@@ -824,14 +824,14 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             bool res = findSymbolInCurrScope(analyser, name, &var);
             if (res) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "'%s' already exists.", name);
+                fprintf(diagnostics(), "'%s' already exists.", name);
                 return TYPE_ERROR;
             }
 
             res = findSymbol(analyser, name, &var);
             if (res) {
                 semanticWarning(node, "Symbol ");
-                fprintf(stderr, "'%s' redeclaration in inner scope shadows outer definition.", name);
+                fprintf(diagnostics(), "'%s' redeclaration in inner scope shadows outer definition.", name);
             }
 
             addSymbol(analyser, name, node, SYMBOL_CONST);
@@ -846,14 +846,14 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             bool res = findSymbolInCurrScope(analyser, name, &var);
             if (res) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "'%s' already exists.", name);
+                fprintf(diagnostics(), "'%s' already exists.", name);
                 return TYPE_ERROR;
             }
 
             res = findSymbol(analyser, name, &var);
             if (res) {
                 semanticWarning(node, "Symbol ");
-                fprintf(stderr, "'%s' redeclaration in inner scope shadows outer definition.", name);
+                fprintf(diagnostics(), "'%s' redeclaration in inner scope shadows outer definition.", name);
             }
 
             for (int i = 0; i < 4; i++) {
@@ -969,13 +969,13 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             if (res) {
                 if (counter.type != SYMBOL_VAR && counter.type != SYMBOL_PARAM && counter.type != SYMBOL_FOR_COUNTER) {
                     semanticError(analyser, node, "Symbol ");
-                    fprintf(stderr, "'%s' already exists and is not a valid counter symbol.", name);
+                    fprintf(diagnostics(), "'%s' already exists and is not a valid counter symbol.", name);
                     return TYPE_ERROR;
                 }
 
                 if (counter.type == SYMBOL_FOR_COUNTER) {
                     semanticError(analyser, node, "");
-                    fprintf(stderr, "'%s' is already a counter variable for another FOR loop. It can't be used.", name);
+                    fprintf(diagnostics(), "'%s' is already a counter variable for another FOR loop. It can't be used.", name);
                     return TYPE_ERROR;
                 }
 
@@ -984,7 +984,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
                 if (counter.type == SYMBOL_PARAM) {
                     if (counter.node->as.Parameter.isArray) {
                         semanticError(analyser, node, "Symbol ");
-                        fprintf(stderr, "'%s' already exists and is not a valid counter type.", name);
+                        fprintf(diagnostics(), "'%s' already exists and is not a valid counter type.", name);
                         return TYPE_ERROR;
                     }
                 }
@@ -997,12 +997,12 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
 
                 if (type != TYPE_INTEGER) {
                     semanticError(analyser, node, "Symbol ");
-                    fprintf(stderr, "'%s' already exists and is not type INTEGER.", name);
+                    fprintf(diagnostics(), "'%s' already exists and is not type INTEGER.", name);
                     return TYPE_ERROR;
                 }
 
                 semanticWarning(node, "Symbol ");
-                fprintf(stderr, "'%s' already exists. It is not recommended as it may lead to infinite loops, as only FOR loop variable counters are protected from assignment.", name);
+                fprintf(diagnostics(), "'%s' already exists. It is not recommended as it may lead to infinite loops, as only FOR loop variable counters are protected from assignment.", name);
                 createScope(analyser, SCOPE_LOOP);
             } else {
                 createScope(analyser, SCOPE_LOOP);
@@ -1029,7 +1029,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             bool res = findSymbol(analyser, name, &callable);
             if (!res) {
                 semanticError(analyser, node, "Callable symbol ");
-                fprintf(stderr, "'%s' not in scope.", name);
+                fprintf(diagnostics(), "'%s' not in scope.", name);
                 return TYPE_ERROR;
             }
             if (callable.type != SYMBOL_PROC) {
@@ -1038,12 +1038,12 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             }
             if (!callable.initialised) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "'%s' is not initialised previously and therefore cannot be used.", name);
+                fprintf(diagnostics(), "'%s' is not initialised previously and therefore cannot be used.", name);
                 return TYPE_ERROR;
             }
             if (callable.node->as.SubroutineStmt.parameters.count != node->as.CallStmt.arguments.count) {
                 semanticError(analyser, node, "Expected ");
-                fprintf(stderr, "%d arguments as per definition but got %d.", callable.node->as.SubroutineStmt.parameters.count,
+                fprintf(diagnostics(), "%d arguments as per definition but got %d.", callable.node->as.SubroutineStmt.parameters.count,
                         node->as.CallStmt.arguments.count);
                 return TYPE_ERROR;
             }
@@ -1055,7 +1055,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
                 if (type == TYPE_ERROR) continue;
                 if (type != callable.node->as.SubroutineStmt.parameters.start[i]->as.Parameter.type && !(type == TYPE_ARRAY && callable.node->as.SubroutineStmt.parameters.start[i]->as.Parameter.isArray)) {
                     semanticError(analyser, node, "Argument number ");
-                    fprintf(stderr, "%d is not correct type.", i + 1);
+                    fprintf(diagnostics(), "%d is not correct type.", i + 1);
                     return TYPE_ERROR;
                 }
 
@@ -1068,7 +1068,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
                     DataType baseType = getArrayBaseType(analyser, node->as.CallStmt.arguments.start[i], node->as.CallStmt.arguments.start[i]->type);
                     if (baseType != callable.node->as.SubroutineStmt.parameters.start[i]->as.Parameter.type) {
                         semanticError(analyser, node, "Argument number ");
-                        fprintf(stderr, "%d is an array but not of the correct type.", i + 1);
+                        fprintf(diagnostics(), "%d is an array but not of the correct type.", i + 1);
                         return TYPE_ERROR;
                     }
                 }
@@ -1116,7 +1116,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             bool res = findSymbol(analyser, filename, &file);
             if (res) {
                 semanticError(analyser, node, "File ");
-                fprintf(stderr, "%s is already open.", filename);
+                fprintf(diagnostics(), "%s is already open.", filename);
                 return TYPE_ERROR;
             }
 
@@ -1133,7 +1133,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             bool res = findSymbolInCurrScope(analyser, filename, &file);
             if (!res) {
                 semanticError(analyser, node, "File ");
-                fprintf(stderr, "%s not found in current scope. Files may only be closed in the same scope in which they were opened.", filename);
+                fprintf(diagnostics(), "%s not found in current scope. Files may only be closed in the same scope in which they were opened.", filename);
                 return TYPE_ERROR;
             }
 
@@ -1148,19 +1148,19 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             bool res = findSymbol(analyser, filename, &file);
             if (!res) {
                 semanticError(analyser, node, "File ");
-                fprintf(stderr, "%s is not open and therefore can't be read.", filename);
+                fprintf(diagnostics(), "%s is not open and therefore can't be read.", filename);
                 return TYPE_ERROR;
             }
 
             if (file.type != SYMBOL_FILE) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "%s is not a file.", filename);
+                fprintf(diagnostics(), "%s is not a file.", filename);
                 return TYPE_ERROR;
             }
 
             if (file.access != ACCESS_READ) {
                 semanticError(analyser, node, "File ");
-                fprintf(stderr, "%s is not open for READ, therefore it can't be read.", filename);
+                fprintf(diagnostics(), "%s is not open for READ, therefore it can't be read.", filename);
                 return TYPE_ERROR;
             }
 
@@ -1170,7 +1170,7 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
 
             if (node->as.ReadfileStmt.varAccess->type == EXPR_CALL) {
                 semanticError(analyser, node, "Call expression ");
-                fprintf(stderr, "%.*s is not assignable.", (int)node->as.ReadfileStmt.varAccess->length, node->as.ReadfileStmt.varAccess->start);
+                fprintf(diagnostics(), "%.*s is not assignable.", (int)node->as.ReadfileStmt.varAccess->length, node->as.ReadfileStmt.varAccess->start);
                 return TYPE_ERROR;
             }
 
@@ -1189,25 +1189,25 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
 
             if (!res) {
                 semanticError(analyser, node, "Target variable ");
-                fprintf(stderr, "'%s' not in scope.", name);
+                fprintf(diagnostics(), "'%s' not in scope.", name);
                 return TYPE_ERROR;
             }
 
             if (var.type == SYMBOL_FOR_COUNTER) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "'%s' is a counter in a FOR loop. It can't be inputted to.", name);
+                fprintf(diagnostics(), "'%s' is a counter in a FOR loop. It can't be inputted to.", name);
                 return TYPE_ERROR;
             }
 
             if (var.type != SYMBOL_VAR && var.type != SYMBOL_PARAM && !(var.type == SYMBOL_ARRAY && node->as.InputStmt.varAccess->type == EXPR_ARRAY_ACCESS)) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "'%s' is not a variable. Array references, constants and subroutines can't be inputted to.", name);
+                fprintf(diagnostics(), "'%s' is not a variable. Array references, constants and subroutines can't be inputted to.", name);
                 return TYPE_ERROR;
             }
 
             if (var.type == SYMBOL_PARAM && var.node->as.Parameter.isArray && node->as.InputStmt.varAccess->type != EXPR_ARRAY_ACCESS) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "'%s' is not a variable, but an ARRAY reference. It can't be inputted to.", name);
+                fprintf(diagnostics(), "'%s' is not a variable, but an ARRAY reference. It can't be inputted to.", name);
                 return TYPE_ERROR;
             }
 
@@ -1239,19 +1239,19 @@ static DataType semanticCheck(Analyser* analyser, ASTNode* node) {
             bool res = findSymbol(analyser, filename, &file);
             if (!res) {
                 semanticError(analyser, node, "File ");
-                fprintf(stderr, "%s is not open and therefore can't be written to.", filename);
+                fprintf(diagnostics(), "%s is not open and therefore can't be written to.", filename);
                 return TYPE_ERROR;
             }
 
             if (file.type != SYMBOL_FILE) {
                 semanticError(analyser, node, "Symbol ");
-                fprintf(stderr, "%s is not a file.", filename);
+                fprintf(diagnostics(), "%s is not a file.", filename);
                 return TYPE_ERROR;
             }
 
             if (file.access != ACCESS_WRITE && file.access != ACCESS_APPEND) {
                 semanticError(analyser, node, "File ");
-                fprintf(stderr, "%s is not open for WRITE nor APPEND, therefore it can't be written to.", filename);
+                fprintf(diagnostics(), "%s is not open for WRITE nor APPEND, therefore it can't be written to.", filename);
                 return TYPE_ERROR;
             }
 
@@ -1363,7 +1363,7 @@ bool semanticAnalysis(Analyser* analyser, AST* ast) {
     //bool staticRes = staticSymbolCheck(analyser, program); // CHECKS FOR SUBROUTINES IN THE TOP LEVEL SO THAT THEY ARE STATIC SYMBOLS
 
     /*if (!staticRes) {
-        fprintf(stderr, "\n\nSomething failed in static analysis.\n\n");
+        fprintf(diagnostics(), "\n\nSomething failed in static analysis.\n\n");
     }*/
 
     semanticCheck(analyser, program);
@@ -1,23 +1,158 @@
 
 #include "stack.h"
 
-void initStack(Stack* stack, int capacity) {
-    stack->data = (StackElem*)malloc(capacity * sizeof(StackElem));
-    if (stack->data == NULL) {
-        fprintf(stderr, "Failed to allocate memory for stack.\n");
-        exit(-1);
+#ifdef STACK_GUARD_PAGES
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Bytes committed when a stack is mapped, enough for programs that never call deeply.
+#define INITIAL_COMMIT  (16 * 1024)
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE   0
+#endif
+
+static size_t pageSize() {
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static size_t roundToPages(size_t size) {
+    size_t page = pageSize();
+    return (size + page - 1) / page * page;
+}
+
+// Reserves size usable bytes followed by at least guard inaccessible ones, and commits the
+// first of them. The usable part is placed so that it ends exactly where the guard starts.
+static void* mapGuarded(size_t size, size_t guard, void** mapping, size_t* mappingSize, size_t* committed) {
+    size_t usable = roundToPages(size);
+    size_t guarded = guard > pageSize() ? roundToPages(guard) : pageSize();
+
+    byte* mem = mmap(NULL, usable + guarded, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) return NULL;
+
+    size_t initial = usable < INITIAL_COMMIT ? usable : roundToPages(INITIAL_COMMIT);
+    if (mprotect(mem, initial, PROT_READ | PROT_WRITE) != 0) {
+        munmap(mem, usable + guarded);
+        return NULL;
     }
+
+    *mapping = mem;
+    *mappingSize = usable + guarded;
+    *committed = initial;
+    return mem + usable - size;
+}
+
+// Commits up to and including the page of addr, at least doubling what is committed so that
+// a growing stack faults only a logarithmic number of times. Only calls mprotect, so it is
+// safe inside the fault handler.
+static bool commitTo(void* end, void* mapping, size_t* committed, void* addr) {
+    byte* start = (byte*)mapping;
+    if (mapping == NULL || (byte*)addr < start + *committed || (byte*)addr >= (byte*)end) return false;
+
+    size_t usable = (size_t)((byte*)end - start);
+    size_t wanted = roundToPages((size_t)((byte*)addr - start) + 1);
+    if (wanted < *committed * 2) wanted = *committed * 2;
+    if (wanted > usable) wanted = usable;
+
+    if (mprotect(start + *committed, wanted - *committed, PROT_READ | PROT_WRITE) != 0) return false;
+    *committed = wanted;
+    return true;
+}
+
+static void unmapGuarded(void* mapping, size_t mappingSize) {
+    if (mapping != NULL) munmap(mapping, mappingSize);
+}
+
+static bool inGuard(void* end, void* mapping, size_t mappingSize, void* addr) {
+    return mapping != NULL && (byte*)addr >= (byte*)end && (byte*)addr < (byte*)mapping + mappingSize;
+}
+#endif
+
+bool initStack(Stack* stack, int capacity) {
+    stack->mapping = NULL;
+    stack->mappingSize = 0;
+    stack->committed = 0;
+#ifdef STACK_GUARD_PAGES
+    stack->data = (Value*)mapGuarded((size_t)capacity * sizeof(Value), 0, &stack->mapping, &stack->mappingSize, &stack->committed);
+#else
+    stack->data = (Value*)malloc(capacity * sizeof(Value));
+#endif
+    stack->refMap = (byte8*)calloc(REFMAP_WORD(capacity - 1) + 1, sizeof(byte8));
     stack->top = -1;
     stack->capacity = capacity;
+    if (stack->data == NULL || stack->refMap == NULL) {
+        fprintf(diagnostics(), "Failed to allocate memory for stack.\n");
+        freeStack(stack);
+        return false;
+    }
+    return true;
 }
 
 void freeStack(Stack* stack) {
+#ifdef STACK_GUARD_PAGES
+    unmapGuarded(stack->mapping, stack->mappingSize);
+#else
     free(stack->data);
+#endif
+    free(stack->refMap);
+    stack->mapping = NULL;
+    stack->mappingSize = 0;
+    stack->committed = 0;
     stack->data = NULL;
+    stack->refMap = NULL;
     stack->top = -1;
     stack->capacity = 0;
 }
 
+void resetStack(Stack* stack) {
+    if (stack->top >= 0) clearRefBits(stack, 0, stack->top + 1);
+    stack->top = -1;
+}
+
+bool reserveStackGuard(Stack* stack, int slots) {
+#ifdef STACK_GUARD_PAGES
+    size_t size = (size_t)stack->capacity * sizeof(Value);
+    size_t guard = (size_t)slots * sizeof(Value);
+    if ((byte*)stack->mapping + stack->mappingSize - (byte*)(stack->data + stack->capacity) >= guard) return true;
+
+    void* mapping;
+    size_t mappingSize;
+    size_t committed;
+    Value* data = (Value*)mapGuarded(size, guard, &mapping, &mappingSize, &committed);
+    if (data == NULL) return false;
+
+    unmapGuarded(stack->mapping, stack->mappingSize);
+    stack->data = data;
+    stack->mapping = mapping;
+    stack->mappingSize = mappingSize;
+    stack->committed = committed;
+#else
+    (void)stack;
+    (void)slots;
+#endif
+    return true;
+}
+
+bool isStackGuard(Stack* stack, void* addr) {
+#ifdef STACK_GUARD_PAGES
+    return inGuard(stack->data + stack->capacity, stack->mapping, stack->mappingSize, addr);
+#else
+    (void)stack;
+    (void)addr;
+    return false;
+#endif
+}
+
+bool commitStack(Stack* stack, void* addr) {
+#ifdef STACK_GUARD_PAGES
+    return commitTo(stack->data + stack->capacity, stack->mapping, &stack->committed, addr);
+#else
+    (void)stack;
+    (void)addr;
+    return false;
+#endif
+}
+
 bool isStackEmpty(Stack* stack) {
     return stack->top == -1;
 }
@@ -26,49 +161,72 @@ bool isStackFull(Stack* stack) {
     return stack->top == stack->capacity - 1;
 }
 
-bool push(Stack* stack, byte value, bool isRef) {
+static void setRefBit(Stack* stack, int pos, bool isRef) {
+    if (isRef) {
+        stack->refMap[REFMAP_WORD(pos)] |= REFMAP_BIT(pos);
+    } else {
+        stack->refMap[REFMAP_WORD(pos)] &= ~REFMAP_BIT(pos);
+    }
+}
+
+bool push(Stack* stack, Value value, bool isRef) {
     if (isStackFull(stack)) {
-        fprintf(stderr, "Stack overflow.\n");
+        fprintf(diagnostics(), "Stack overflow.\n");
         return false;
     }
-    stack->data[++stack->top].value = value;
-    stack->data[stack->top].isRef = isRef;
+    stack->data[++stack->top] = value;
+    setRefBit(stack, stack->top, isRef);
     return true;
 }
 
-byte pop(Stack* stack) {
-    if (isStackEmpty(stack)) {
-        fprintf(stderr, "Stack underflow.\n");
-        exit(-1);
-    }
-    return stack->data[stack->top--].value;
+bool pop(Stack* stack, Value* value) {
+    if (isStackEmpty(stack)) return false;
+    *value = stack->data[stack->top--];
+    return true;
 }
 
-byte peek(Stack* stack) {
-    if (isStackEmpty(stack)) {
-        fprintf(stderr, "Stack is empty.\n");
-        exit(-1);
-    }
-    return stack->data[stack->top].value;
+bool peek(Stack* stack, Value* value) {
+    if (isStackEmpty(stack)) return false;
+    *value = stack->data[stack->top];
+    return true;
 }
 
-byte getAt(Stack* stack, int pos) {
-    if (pos < 0 || pos >= stack->capacity) return 0;
+Value getAt(Stack* stack, int pos) {
+    if (pos < 0 || pos >= stack->capacity) {
+        Value zero = { .raw = 0 };
+        return zero;
+    }
 
-    return stack->data[pos].value;
+    return stack->data[pos];
 }
 
 bool isRefAt(Stack* stack, int pos) {
     if (pos < 0 || pos >= stack->capacity) return false;
 
-    return stack->data[pos].isRef;
+    return (stack->refMap[REFMAP_WORD(pos)] & REFMAP_BIT(pos)) != 0;
 }
 
-void setAt(Stack* stack, byte value, bool isRef, int pos) {
+void clearRefBits(Stack* stack, int pos, int count) {
+    int end = pos + count;
+
+    // Whole words at once, bit by bit at the edges.
+    while (pos < end && (pos & 63) != 0) {
+        setRefBit(stack, pos++, false);
+    }
+    while (end - pos >= 64) {
+        stack->refMap[REFMAP_WORD(pos)] = 0;
+        pos += 64;
+    }
+    while (pos < end) {
+        setRefBit(stack, pos++, false);
+    }
+}
+
+void setAt(Stack* stack, Value value, bool isRef, int pos) {
     if (pos < 0 || pos >= stack->capacity) return;
 
-    stack->data[pos].value = value;
-    stack->data[pos].isRef = isRef;
+    stack->data[pos] = value;
+    setRefBit(stack, pos, isRef);
 }
 
 int getNextFree(Stack* stack) {
@@ -82,62 +240,105 @@ void* getMemRefAt(Stack* stack, int pos) {
 }
 
 bool isStackRef(Stack* stack, void* ptr) {
-    if (ptr < (void*)stack->data || ptr >= (void*)(stack->data) + stack->capacity * sizeof(StackElem)) {
+    if (ptr < (void*)stack->data || ptr >= (void*)(stack->data + stack->capacity)) {
         return false;
     }
-    return true;
+    return ((byte*)ptr - (byte*)stack->data) % sizeof(Value) == 0;
+}
+
+int getSlotOf(Stack* stack, void* ptr) {
+    return (int)((Value*)ptr - stack->data);
 }
 
 void showStack(Stack* stack) {
     for (int i = stack->top; i >= 0; i--) {
-        printf("[ %x ]", stack->data[i].value);
-        printf(stack->data[i].isRef ? " <- ref start\n" : "\n");
+        printf("[ %016llx ]", (unsigned long long)stack->data[i].raw);
+        printf(isRefAt(stack, i) ? " <- ref\n" : "\n");
     }
 }
 
-void initCallStack(CallStack* stack, int capacity) {
+bool initCallStack(CallStack* stack, int capacity) {
+    stack->mapping = NULL;
+    stack->mappingSize = 0;
+    stack->committed = 0;
+#ifdef STACK_GUARD_PAGES
+    stack->frames = (CallFrame*)mapGuarded((size_t)capacity * sizeof(CallFrame), 0, &stack->mapping, &stack->mappingSize, &stack->committed);
+#else
     stack->frames = (CallFrame*)malloc(capacity * sizeof(CallFrame));
-    if (stack->frames == NULL) {
-        fprintf(stderr, "Failed to allocate memory for call stack.\n");
-        exit(-1);
-    }
+#endif
     stack->top = -1;
     stack->capacity = capacity;
+    if (stack->frames == NULL) {
+        fprintf(diagnostics(), "Failed to allocate memory for call stack.\n");
+        return false;
+    }
+    return true;
 }
 
 void freeCallStack(CallStack* stack) {
+#ifdef STACK_GUARD_PAGES
+    unmapGuarded(stack->mapping, stack->mappingSize);
+#else
     free(stack->frames);
+#endif
+    stack->mapping = NULL;
+    stack->mappingSize = 0;
+    stack->committed = 0;
     stack->frames = NULL;
     stack->top = -1;
     stack->capacity = 0;
 }
 
+void resetCallStack(CallStack* stack) {
+    stack->top = -1;
+}
+
+bool isCallStackGuard(CallStack* stack, void* addr) {
+#ifdef STACK_GUARD_PAGES
+    return inGuard(stack->frames + stack->capacity, stack->mapping, stack->mappingSize, addr);
+#else
+    (void)stack;
+    (void)addr;
+    return false;
+#endif
+}
+
+bool commitCallStack(CallStack* stack, void* addr) {
+#ifdef STACK_GUARD_PAGES
+    return commitTo(stack->frames + stack->capacity, stack->mapping, &stack->committed, addr);
+#else
+    (void)stack;
+    (void)addr;
+    return false;
+#endif
+}
+
 bool isCallStackEmpty(CallStack* stack) {
     return stack->top == -1;
 }
 
 bool pushCallFrame(CallStack* stack, long returnPC, int baseStackPos) {
+#ifndef STACK_GUARD_PAGES
     if (stack->top == stack->capacity - 1) {
-        fprintf(stderr, "Call stack overflow.\n");
+        fprintf(diagnostics(), "Call stack overflow.\n");
         return false;
     }
-    stack->frames[++stack->top].returnPC = returnPC;
-    stack->frames[stack->top].baseStackPos = baseStackPos;
+#endif
+    // The frame is written before top moves, so a write into the guard leaves the stack as it was.
+    stack->frames[stack->top + 1].returnPC = returnPC;
+    stack->frames[stack->top + 1].baseStackPos = baseStackPos;
+    stack->top++;
     return true;
 }
 
-long popCallFrame(CallStack* stack) {
-    if (isCallStackEmpty(stack)) {
-        fprintf(stderr, "Call stack underflow.\n");
-        exit(-1);
-    }
-    return stack->frames[stack->top--].returnPC;
+bool popCallFrame(CallStack* stack, long* returnPC) {
+    if (isCallStackEmpty(stack)) return false;
+    *returnPC = stack->frames[stack->top--].returnPC;
+    return true;
 }
 
-int getBaseStackPos(CallStack* stack) {
-    if (isCallStackEmpty(stack)) {
-        fprintf(stderr, "Call stack is empty.\n");
-        exit(-1);
-    }
-    return stack->frames[stack->top].baseStackPos;
+bool getBaseStackPos(CallStack* stack, int* baseStackPos) {
+    if (isCallStackEmpty(stack)) return false;
+    *baseStackPos = stack->frames[stack->top].baseStackPos;
+    return true;
 }
\ No newline at end of file
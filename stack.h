@@ -3,30 +3,77 @@
 
 #include "common.h"
 
-typedef struct {
-    byte value;
-    bool isRef;
-} StackElem;
+// On POSIX systems both stacks are mapped with inaccessible guard pages right after their
+// last slot, so an overflowing write faults instead of every push being checked; the VM turns
+// the fault into a runtime error (see run in vm.c). Elsewhere pushCallFrame and the VM's calls
+// check the capacity explicitly.
+//
+// The mapping reserves the whole capacity but commits only its first pages. A fault further
+// in commits more (commitStack and commitCallStack, from the same handler), so slots never
+// move, references into the stack stay valid, and a shallow program touches a few pages of
+// a stack that may grow far deeper.
+#if defined(__unix__) || defined(__APPLE__)
+#define STACK_GUARD_PAGES
+#endif
+
+#ifdef STACK_GUARD_PAGES
+#define DEFAULT_STACK_SLOTS (1 << 22)
+#define DEFAULT_CALL_FRAMES (1 << 18)
+#else
+#define DEFAULT_STACK_SLOTS 1024
+#define DEFAULT_CALL_FRAMES 256
+#endif
+
+// Every value lives in one native 8-byte slot, whatever its pseudocode type.
+typedef union {
+    byte8 raw;
+    int asInt;
+    double asReal;
+    char asChar;
+    bool asBool;
+    void* asRef;
+} Value;
 
 typedef struct {
-    StackElem* data;
+    Value* data;
+    byte8* refMap; // One bit per slot, set when the slot holds a heap reference.
     int top;
     int capacity;
+    void* mapping;      // The whole mapping, guard included, with STACK_GUARD_PAGES.
+    size_t mappingSize;
+    size_t committed;   // Bytes from the start of the mapping that are accessible.
 } Stack;
 
-void initStack(Stack* stack, int capacity);
+#define REFMAP_WORD(pos)    ((pos) >> 6)
+#define REFMAP_BIT(pos)     ((byte8)1 << ((pos) & 63))
+
+// False, with the stack freed, if its memory could not be allocated.
+bool initStack(Stack* stack, int capacity);
 void freeStack(Stack* stack);
+// Empties the stack, keeping its memory.
+void resetStack(Stack* stack);
+
+// Makes the guard at least slots long, so writes up to that far past the end still fault.
+// Only valid while the stack is empty.
+bool reserveStackGuard(Stack* stack, int slots);
+bool isStackGuard(Stack* stack, void* addr);
+// Commits the part of the stack addr falls in, plus room to grow. False if addr is not in
+// the uncommitted part of the stack, or the memory is not available.
+bool commitStack(Stack* stack, void* addr);
 bool isStackEmpty(Stack* stack);
 bool isStackFull(Stack* stack);
-bool push(Stack* stack, byte value, bool isRef);
-byte pop(Stack* stack);
-byte peek(Stack* stack);
-byte getAt(Stack* stack, int pos);
+bool push(Stack* stack, Value value, bool isRef);
+// False if the stack is empty.
+bool pop(Stack* stack, Value* value);
+bool peek(Stack* stack, Value* value);
+Value getAt(Stack* stack, int pos);
 bool isRefAt(Stack* stack, int pos);
-void setAt(Stack* stack, byte value, bool isRef, int pos);
+void clearRefBits(Stack* stack, int pos, int count);
+void setAt(Stack* stack, Value value, bool isRef, int pos);
 int getNextFree(Stack* stack);
 void* getMemRefAt(Stack* stack, int pos);
 bool isStackRef(Stack* stack, void* ptr);
+int getSlotOf(Stack* stack, void* ptr);
 
 void showStack(Stack* stack);
 
@@ -39,14 +86,21 @@ typedef struct {
     CallFrame* frames;
     int top;
     int capacity;
+    void* mapping;
+    size_t mappingSize;
+    size_t committed;
 } CallStack;
 
-void initCallStack(CallStack* stack, int capacity);
+bool initCallStack(CallStack* stack, int capacity);
 void freeCallStack(CallStack* stack);
+void resetCallStack(CallStack* stack);
+bool isCallStackGuard(CallStack* stack, void* addr);
+bool commitCallStack(CallStack* stack, void* addr);
 bool isCallStackEmpty(CallStack* stack);
 bool pushCallFrame(CallStack* stack, long returnPC, int baseStackPos);
-long popCallFrame(CallStack* stack);
-int getBaseStackPos(CallStack* stack);
+// False if there is no frame.
+bool popCallFrame(CallStack* stack, long* returnPC);
+bool getBaseStackPos(CallStack* stack, int* baseStackPos);
 
 
 #endif //PSEUDOCOMPILER_STACK_H
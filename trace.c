@@ -0,0 +1,40 @@
+#include "trace.h"
+
+bool initTraceBuffer(TraceBuffer* trace, int entries) {
+    byte8 capacity = 1;
+    while (capacity < (byte8)entries) capacity <<= 1;
+
+    trace->entries = (TraceEntry*) malloc(capacity * sizeof(TraceEntry));
+    trace->mask = capacity - 1;
+    trace->count = 0;
+    return trace->entries != NULL;
+}
+
+void freeTraceBuffer(TraceBuffer* trace) {
+    free(trace->entries);
+    trace->entries = NULL;
+    trace->mask = 0;
+    trace->count = 0;
+}
+
+void dumpTrace(TraceBuffer* trace, BytecodeStream* bs, FILE* out) {
+    byte8 capacity = trace->mask + 1;
+    byte8 first = trace->count > capacity ? trace->count - capacity : 0;
+
+    fprintf(out, "\nLast %llu of %llu instructions executed:\n",
+            (unsigned long long)(trace->count - first), (unsigned long long)trace->count);
+    fprintf(out, "%8s %6s  %-26s %8s %10s\n", "PC", "line", "instruction", "top", "heap");
+
+    for (byte8 i = first; i < trace->count; i++) {
+        TraceEntry* entry = &trace->entries[i & trace->mask];
+        const LineEntry* line = findLineEntry(bs, entry->offset);
+
+        fprintf(out, "%8d ", entry->offset);
+        if (line != NULL) {
+            fprintf(out, "%6d  ", line->line);
+        } else {
+            fprintf(out, "%6s  ", "?");
+        }
+        fprintf(out, "%-26s %8d %10zu\n", getInstructionName(entry->op), entry->top, entry->heapInUse);
+    }
+}
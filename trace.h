@@ -0,0 +1,44 @@
+#ifndef PSEUDOCOMPILER_TRACE_H
+#define PSEUDOCOMPILER_TRACE_H
+
+#include "common.h"
+#include "bytecode.h"
+
+// Instruction trace for debug runs and --trace. A run loop of its own (see vm.c) records every
+// instruction into a fixed ring, which keeps the last entries and costs a few stores per
+// instruction. The ring is printed when the program fails, at the end of a debug run, or on
+// SIGUSR1 where there are signals, so a program that hangs can be looked into.
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TRACE_ON_SIGNAL
+#endif
+
+#define DEFAULT_TRACE_ENTRIES   64
+
+typedef struct {
+    int offset;
+    Instruction op;
+    int top;                // Stack top before the instruction ran.
+    size_t heapInUse;
+} TraceEntry;
+
+typedef struct {
+    TraceEntry* entries;
+    byte8 mask;             // Capacity - 1, the capacity being a power of two.
+    byte8 count;            // Instructions recorded so far, including those overwritten.
+} TraceBuffer;
+
+bool initTraceBuffer(TraceBuffer* trace, int entries);
+void freeTraceBuffer(TraceBuffer* trace);
+void dumpTrace(TraceBuffer* trace, BytecodeStream* bs, FILE* out);
+
+static inline void traceInstruction(TraceBuffer* trace, int offset, Instruction op, int top, size_t heapInUse) {
+    TraceEntry* entry = &trace->entries[trace->count & trace->mask];
+    entry->offset = offset;
+    entry->op = op;
+    entry->top = top;
+    entry->heapInUse = heapInUse;
+    trace->count++;
+}
+
+#endif //PSEUDOCOMPILER_TRACE_H
@@ -0,0 +1,441 @@
+#include <limits.h>
+
+#include "verify.h"
+
+// Deepest stack a program may ask for, well clear of int overflow while adding up effects.
+#define MAX_VERIFIED_DEPTH  (INT_MAX / 2)
+
+typedef enum {
+    CALLEE_UNKNOWN,
+    CALLEE_PROCEDURE,   // Returns with RETURN_NIL, or never returns.
+    CALLEE_FUNCTION,    // Returns a value with RETURN.
+} CalleeKind;
+
+typedef struct {
+    int pops;
+    int pushes;
+} StackEffect;
+
+// Indexed like the builtin table the compiler registers: SUBSTRING, LENGTH, LCASE, UCASE,
+// RANDOMBETWEEN, RND, INT, EOF, CHARAT. Each pushes its result.
+static const int builtinArgs[] = { 3, 1, 1, 1, 2, 0, 1, 1, 2 };
+#define BUILTIN_COUNT   ((int)(sizeof(builtinArgs) / sizeof(builtinArgs[0])))
+
+typedef struct {
+    DecodedProgram* program;
+    int* depth;         // Stack depth before each instruction in the current region, or -1.
+    int* worklist;
+    int* search;        // Worklist of findCalleeKind, which runs while a region is walked.
+    bool* seen;
+    CalleeKind* kind;   // Per call target.
+    int* argc;          // Per call target, -1 until a call to it is found.
+    int* frameMax;      // Per call target, once its region is verified.
+    int* regions;       // Call targets waiting to be verified.
+    int regionCount;
+    int globalMax;      // Highest absolute register used anywhere, plus one.
+} Verifier;
+
+static bool verifyError(DecodedOp* op, const char* message) {
+    fprintf(diagnostics(), "Invalid bytecode at offset %d: %s.\n", op->offset, message);
+    return false;
+}
+
+static bool isConditionalBranch(Instruction op) {
+    switch (op) {
+        case B_FALSE:
+        case BEQ_INT: case BNE_INT: case BLT_INT: case BLE_INT: case BGT_INT: case BGE_INT:
+        case BEQ_INT_RR: case BNE_INT_RR: case BLT_INT_RR: case BLE_INT_RR: case BGT_INT_RR: case BGE_INT_RR:
+        case BEQ_INT_RK: case BNE_INT_RK: case BLT_INT_RK: case BLE_INT_RK: case BGT_INT_RK: case BGE_INT_RK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Values an instruction pops and then pushes. False for instructions that are not plain
+// stack operations: calls, returns, EXIT and anything the VM cannot run.
+static bool stackEffect(DecodedOp* op, StackEffect* effect) {
+    effect->pops = 0;
+    effect->pushes = 0;
+
+    switch (op->op) {
+        case NOP:
+        case OUTPUT_NL:
+        case BRANCH:
+        case MOVE_R: case LOADK_INT_R:
+        case ADD_INT_RR: case MINUS_INT_RR: case MULT_INT_RR: case MOD_INT_RR: case FDIV_INT_RR:
+        case ADD_INT_RK: case MINUS_INT_RK: case MULT_INT_RK: case MOD_INT_RK: case FDIV_INT_RK:
+        case ADD_REAL_RR: case MINUS_REAL_RR: case MULT_REAL_RR: case DIV_REAL_RR:
+        case BEQ_INT_RR: case BNE_INT_RR: case BLT_INT_RR: case BLE_INT_RR: case BGT_INT_RR: case BGE_INT_RR:
+        case BEQ_INT_RK: case BNE_INT_RK: case BLT_INT_RK: case BLE_INT_RK: case BGT_INT_RK: case BGE_INT_RK:
+            break;
+
+        case LOAD_INT: case LOAD_REAL: case LOAD_CHAR: case LOAD_BOOL: case LOAD_STRING:
+        case INPUT_INT: case INPUT_REAL: case INPUT_CHAR: case INPUT_BOOL: case INPUT_STRING:
+        case FETCH_LOCAL_INT: case FETCH_GLOBAL_INT:
+            effect->pushes = 1;
+            break;
+
+        case FETCH_INT: case FETCH_REAL: case FETCH_CHAR: case FETCH_BOOL: case FETCH_REF:
+        case RFETCH_INT: case RFETCH_REAL: case RFETCH_CHAR: case RFETCH_BOOL: case RFETCH_REF:
+        case FETCH_REF_INT: case FETCH_REF_REAL: case FETCH_REF_CHAR: case FETCH_REF_BOOL:
+        case CAST_INT_REAL: case CAST_INT_CHAR: case CAST_CHAR_INT:
+        case NEG_INT: case NEG_REAL: case NOT:
+        case READ_LINE:
+        case GET_REF: case RGET_REF:
+            effect->pops = 1;
+            effect->pushes = 1;
+            break;
+
+        case STORE_INT: case STORE_REAL: case STORE_CHAR: case STORE_BOOL: case STORE_REF:
+        case RSTORE_INT: case RSTORE_REAL: case RSTORE_CHAR: case RSTORE_BOOL: case RSTORE_REF:
+        case STORE_REF_INT: case STORE_REF_REAL: case STORE_REF_CHAR: case STORE_REF_BOOL:
+        case ADD_INT: case ADD_REAL: case MINUS_INT: case MINUS_REAL: case MULT_INT: case MULT_REAL:
+        case DIV_INT: case DIV_REAL: case MOD_INT: case MOD_REAL: case FDIV_INT: case FDIV_REAL:
+        case POW_INT: case POW_REAL:
+        case CONCAT:
+        case EQ_INT: case EQ_REAL: case EQ_BOOL: case EQ_REF: case EQ_STRING:
+        case LESS_INT: case LESS_REAL: case LESS_BOOL: case LESS_REF: case LESS_STRING:
+        case LESS_EQ_INT: case LESS_EQ_REAL: case LESS_EQ_BOOL: case LESS_EQ_REF: case LESS_EQ_STRING:
+        case NEQ_INT: case NEQ_REAL: case NEQ_BOOL: case NEQ_REF: case NEQ_STRING:
+        case GREATER_INT: case GREATER_REAL: case GREATER_BOOL: case GREATER_REF: case GREATER_STRING:
+        case GREATER_EQ_INT: case GREATER_EQ_REAL: case GREATER_EQ_BOOL: case GREATER_EQ_REF: case GREATER_EQ_STRING:
+        case AND: case OR:
+        case OPENFILE:
+            effect->pops = 2;
+            effect->pushes = 1;
+            break;
+
+        case FETCH_ARRAY_ELEM:
+            effect->pops = 3;
+            effect->pushes = 1;
+            break;
+        case STORE_ARRAY_ELEM:
+            effect->pops = 4;
+            effect->pushes = 1;
+            break;
+        case CREATE_ARRAY:
+            effect->pops = 5;
+            effect->pushes = 1;
+            break;
+
+        case POP:
+        case OUTPUT_INT: case OUTPUT_REAL: case OUTPUT_CHAR: case OUTPUT_BOOL: case OUTPUT_REF: case OUTPUT_STRING:
+        case WRITE_NL:
+        case CLOSEFILE:
+        case B_FALSE:
+        case STORE_LOCAL_INT_DISCARD: case STORE_GLOBAL_INT_DISCARD:
+            effect->pops = 1;
+            break;
+
+        case WRITE_INT: case WRITE_REAL: case WRITE_CHAR: case WRITE_BOOL: case WRITE_REF: case WRITE_STRING:
+        case BEQ_INT: case BNE_INT: case BLT_INT: case BLE_INT: case BGT_INT: case BGE_INT:
+            effect->pops = 2;
+            break;
+
+        case COPY_INT:
+            effect->pops = 1;
+            effect->pushes = 2;
+            break;
+
+        case ENTER:
+        case LOAD_ZEROS:
+            effect->pushes = op->operand.asInt;
+            break;
+        case CALL_BUILTIN:
+            effect->pops = builtinArgs[op->operand.asInt];
+            effect->pushes = 1;
+            break;
+
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+// Register operands of an instruction, as REG_OPERAND values. Returns how many there are.
+static int registerOperands(DecodedOp* op, int* regs) {
+    switch (op->op) {
+        case FETCH_LOCAL_INT: case FETCH_GLOBAL_INT:
+        case STORE_LOCAL_INT_DISCARD: case STORE_GLOBAL_INT_DISCARD:
+        case BEQ_INT_RK: case BNE_INT_RK: case BLT_INT_RK: case BLE_INT_RK: case BGT_INT_RK: case BGE_INT_RK:
+            regs[0] = op->a;
+            return 1;
+        case LOADK_INT_R:
+            regs[0] = op->operand.asInt;
+            return 1;
+        case MOVE_R:
+        case ADD_INT_RK: case MINUS_INT_RK: case MULT_INT_RK: case MOD_INT_RK: case FDIV_INT_RK:
+            regs[0] = op->operand.asInt;
+            regs[1] = op->a;
+            return 2;
+        case ADD_INT_RR: case MINUS_INT_RR: case MULT_INT_RR: case MOD_INT_RR: case FDIV_INT_RR:
+        case ADD_REAL_RR: case MINUS_REAL_RR: case MULT_REAL_RR: case DIV_REAL_RR:
+            regs[0] = op->operand.asInt;
+            regs[1] = op->a;
+            regs[2] = op->b;
+            return 3;
+        case BEQ_INT_RR: case BNE_INT_RR: case BLT_INT_RR: case BLE_INT_RR: case BGT_INT_RR: case BGE_INT_RR:
+            regs[0] = op->a;
+            regs[1] = op->b;
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+// Whether the subroutine at entry returns a value, from the returns reachable from it and
+// from the subroutines it tail calls, which return for it.
+static bool findCalleeKind(Verifier* v, int entry, DecodedOp* call) {
+    DecodedOp* ops = v->program->ops;
+    int count = v->program->count;
+
+    memset(v->seen, 0, count * sizeof(bool));
+    bool returnsValue = false;
+    bool returnsNil = false;
+
+    int pending = 0;
+    v->search[pending++] = entry;
+    v->seen[entry] = true;
+
+    while (pending > 0) {
+        int i = v->search[--pending];
+        DecodedOp* op = &ops[i];
+
+        int next[2];
+        int nextCount = 0;
+        switch (op->op) {
+            case RETURN: returnsValue = true; break;
+            case RETURN_NIL: returnsNil = true; break;
+            case EXIT: break;
+            case BRANCH:
+            case TAIL_CALL:
+                next[nextCount++] = (int)(op->operand.target - ops);
+                break;
+            default:
+                if (isConditionalBranch(op->op)) next[nextCount++] = (int)(op->operand.target - ops);
+                next[nextCount++] = i + 1;
+                break;
+        }
+
+        for (int j = 0; j < nextCount; j++) {
+            if (next[j] < count && !v->seen[next[j]]) {
+                v->seen[next[j]] = true;
+                v->search[pending++] = next[j];
+            }
+        }
+    }
+
+    if (returnsValue && returnsNil) return verifyError(call, "subroutine returns both with and without a value");
+
+    v->kind[entry] = returnsValue ? CALLEE_FUNCTION : CALLEE_PROCEDURE;
+    return true;
+}
+
+// Records the depth an instruction is reached with. Returns 1 if it is new and has to be
+// walked, 0 if it was already reached with that depth, and -1 after reporting a mismatch.
+static int reach(Verifier* v, int i, int depth, DecodedOp* from) {
+    if (v->depth[i] < 0) {
+        v->depth[i] = depth;
+        return 1;
+    }
+
+    if (v->depth[i] != depth) {
+        verifyError(from, "stack depth differs between paths");
+        return -1;
+    }
+    return 0;
+}
+
+static bool checkRegisters(Verifier* v, DecodedOp* op, int* max) {
+    int regs[3];
+    int count = registerOperands(op, regs);
+
+    for (int j = 0; j < count; j++) {
+        int pos = REG_POS(regs[j]);
+        if (pos < 0 || pos >= MAX_VERIFIED_DEPTH) return verifyError(op, "invalid register operand");
+
+        if (REG_IS_RELATIVE(regs[j])) {
+            if (pos + 1 > *max) *max = pos + 1;
+        } else if (pos + 1 > v->globalMax) {
+            v->globalMax = pos + 1;
+        }
+    }
+
+    return true;
+}
+
+// Walks every path from entry, which starts with startDepth values in its frame: the
+// arguments of a subroutine, or nothing for the main program.
+static bool verifyRegion(Verifier* v, int entry, int startDepth, bool isMain, int* maxDepth) {
+    DecodedOp* ops = v->program->ops;
+    int count = v->program->count;
+
+    for (int i = 0; i < count; i++) {
+        v->depth[i] = -1;
+    }
+
+    int max = startDepth;
+    int pending = 0;
+    v->depth[entry] = startDepth;
+    v->worklist[pending++] = entry;
+
+    while (pending > 0) {
+        int i = v->worklist[--pending];
+
+        // Straight-line walk until the path ends or reaches code already verified.
+        for (;;) {
+            DecodedOp* op = &ops[i];
+            int depth = v->depth[i];
+            bool fallsThrough = true;
+
+            if (!checkRegisters(v, op, &max)) return false;
+
+            switch (op->op) {
+                case DO_CALL: {
+                    int target = (int)(op->operand.target - ops);
+                    int args = op->a;
+                    if (args < 0) return verifyError(op, "negative argument count");
+                    if (depth < args) return verifyError(op, "stack underflow");
+
+                    if (v->kind[target] == CALLEE_UNKNOWN && !findCalleeKind(v, target, op)) return false;
+
+                    if (v->argc[target] < 0) {
+                        v->argc[target] = args;
+                        v->regions[v->regionCount++] = target;
+                    } else if (v->argc[target] != args) {
+                        return verifyError(op, "argument count differs between calls");
+                    }
+
+                    depth = depth - args + (v->kind[target] == CALLEE_FUNCTION ? 1 : 0);
+                    break;
+                }
+                case TAIL_CALL: {
+                    int target = (int)(op->operand.target - ops);
+                    int args = op->a;
+                    if (isMain) return verifyError(op, "tail call outside a subroutine");
+                    if (args < 0) return verifyError(op, "negative argument count");
+                    if (depth < args) return verifyError(op, "stack underflow");
+
+                    if (v->kind[target] == CALLEE_UNKNOWN && !findCalleeKind(v, target, op)) return false;
+                    if (v->kind[target] != v->kind[entry]) return verifyError(op, "tail call to a different kind of subroutine");
+
+                    if (v->argc[target] < 0) {
+                        v->argc[target] = args;
+                        v->regions[v->regionCount++] = target;
+                    } else if (v->argc[target] != args) {
+                        return verifyError(op, "argument count differs between calls");
+                    }
+
+                    fallsThrough = false;
+                    break;
+                }
+                case RETURN:
+                case RETURN_NIL:
+                    if (isMain) return verifyError(op, "return outside a subroutine");
+                    if (op->op == RETURN && depth < 1) return verifyError(op, "stack underflow");
+                    fallsThrough = false;
+                    break;
+                case EXIT:
+                    fallsThrough = false;
+                    break;
+                case CALL_BUILTIN:
+                    if (op->operand.asInt < 0 || op->operand.asInt >= BUILTIN_COUNT) {
+                        return verifyError(op, "unknown builtin function");
+                    }
+                    // Fall through.
+                default: {
+                    StackEffect effect;
+                    if (!stackEffect(op, &effect)) return verifyError(op, "unknown instruction");
+                    if (effect.pushes < 0) return verifyError(op, "negative slot count");
+                    if (depth < effect.pops) return verifyError(op, "stack underflow");
+
+                    depth -= effect.pops;
+                    if (effect.pushes > MAX_VERIFIED_DEPTH - depth) return verifyError(op, "stack too deep");
+                    depth += effect.pushes;
+                    break;
+                }
+            }
+
+            if (depth > max) max = depth;
+
+            if (op->op == BRANCH || isConditionalBranch(op->op)) {
+                int state = reach(v, (int)(op->operand.target - ops), depth, op);
+                if (state < 0) return false;
+                if (state > 0) v->worklist[pending++] = (int)(op->operand.target - ops);
+
+                if (op->op == BRANCH) fallsThrough = false;
+            }
+
+            if (!fallsThrough) break;
+
+            // The trailing EXIT never falls through, so i + 1 is in range.
+            int state = reach(v, i + 1, depth, op);
+            if (state < 0) return false;
+            if (state == 0) break;
+            i++;
+        }
+    }
+
+    *maxDepth = max;
+    return true;
+}
+
+bool verifyProgram(DecodedProgram* program) {
+    int count = program->count;
+    DecodedOp* ops = program->ops;
+
+    Verifier v;
+    v.program = program;
+    v.depth = (int*) malloc(count * sizeof(int));
+    v.worklist = (int*) malloc(count * sizeof(int));
+    v.search = (int*) malloc(count * sizeof(int));
+    v.seen = (bool*) malloc(count * sizeof(bool));
+    v.kind = (CalleeKind*) calloc(count, sizeof(CalleeKind));
+    v.argc = (int*) malloc(count * sizeof(int));
+    v.frameMax = (int*) calloc(count, sizeof(int));
+    v.regions = (int*) malloc(count * sizeof(int));
+    v.regionCount = 0;
+    v.globalMax = 0;
+
+    bool ok = v.depth != NULL && v.worklist != NULL && v.search != NULL &&
+              v.seen != NULL && v.kind != NULL && v.argc != NULL && v.frameMax != NULL && v.regions != NULL;
+    if (!ok) fprintf(diagnostics(), "Not enough memory to verify bytecode.\n");
+
+    if (ok) {
+        for (int i = 0; i < count; i++) {
+            v.argc[i] = -1;
+        }
+
+        int mainMax = 0;
+        ok = verifyRegion(&v, 0, 0, true, &mainMax);
+
+        // Regions are queued as calls to them are found, each with the argument count of the
+        // first call.
+        for (int r = 0; ok && r < v.regionCount; r++) {
+            int entry = v.regions[r];
+            ok = verifyRegion(&v, entry, v.argc[entry], false, &v.frameMax[entry]);
+        }
+
+        if (ok) {
+            for (int i = 0; i < count; i++) {
+                if (ops[i].op != DO_CALL && ops[i].op != TAIL_CALL) continue;
+
+                ops[i].b = v.frameMax[ops[i].operand.target - ops];
+                if (ops[i].b > program->maxFrame) program->maxFrame = ops[i].b;
+            }
+            program->maxDepth = mainMax > v.globalMax ? mainMax : v.globalMax;
+        }
+    }
+
+    free(v.depth);
+    free(v.worklist);
+    free(v.search);
+    free(v.seen);
+    free(v.kind);
+    free(v.argc);
+    free(v.frameMax);
+    free(v.regions);
+    return ok;
+}
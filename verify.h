@@ -0,0 +1,19 @@
+#ifndef PSEUDOCOMPILER_VERIFY_H
+#define PSEUDOCOMPILER_VERIFY_H
+
+#include "common.h"
+#include "decode.h"
+
+// Load-time check of a decoded program, so the run loop can trust it and skip per-instruction
+// stack checks. Along every control-flow path it proves that the stack never underflows the
+// current frame, that paths meet at the same depth, that calls agree on their argument count
+// and callee kind, and that builtin indices and register operands are in range.
+//
+// It does not track what kind of object a reference points to. Damaged bytecode can still hand
+// a string to a file instruction, so the handlers check the object type before using it.
+//
+// On success each DO_CALL and TAIL_CALL records the slots its callee's frame needs in b, and
+// the program records the depth the main program reaches and the largest frame any call needs.
+bool verifyProgram(DecodedProgram* program);
+
+#endif //PSEUDOCOMPILER_VERIFY_H
@@ -1,22 +1,99 @@
 
-#include "vm.h"
+#include <limits.h>
+#include <signal.h>
+#include <stdatomic.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/time.h>
+#endif
 
+#include "vm.h"
 
 
+// Only the first error is kept. The run loop reports it once it stops, when the offset of
+// the failing instruction is known.
 static void runtimeError(VM* vm, const char* message) {
+    if (vm->hadRuntimeError) return;
+
     vm->hadRuntimeError = true;
+    vm->errorMessage = message;
+}
+
+// The object a handler expects behind a reference. The verifier only tracks which slots hold
+// references, not what they point to, so damaged bytecode can hand a string to a file
+// instruction. Raises the runtime error and returns NULL when the reference is not one.
+static Obj* objectOf(VM* vm, void* ref, ObjType type) {
+    if (!isValidReference(&vm->mem, ref)) {
+        runtimeError(vm, "Segmentation fault.");
+        return NULL;
+    }
 
-    fprintf(stderr, "Runtime error at PC %d: %s\n",vm->PC, message);
+    Obj* obj = (Obj*)ref;
+    if (obj->type != type) {
+        runtimeError(vm, "Reference to the wrong type of object.");
+        return NULL;
+    }
+
+    if (type == OBJ_FILE && obj->as.FileObj.filePtr == NULL) {
+        runtimeError(vm, "File is not open.");
+        return NULL;
+    }
+
+    return obj;
+}
+
+static void reportRuntimeError(VM* vm) {
+    const LineEntry* entry = findLineEntry(vm->program, vm->PC);
+
+    if (entry == NULL) {
+        fprintf(diagnostics(), "Runtime error at PC %d: %s\n", vm->PC, vm->errorMessage);
+    } else if (entry->subroutine < 0) {
+        fprintf(diagnostics(), "Runtime error at PC %d (line %d): %s\n", vm->PC, entry->line, vm->errorMessage);
+    } else {
+        fprintf(diagnostics(), "Runtime error at PC %d (line %d, in %s): %s\n", vm->PC, entry->line,
+                getSubroutineName(vm->program, entry->subroutine), vm->errorMessage);
+    }
 }
 
-void initVM(VM* vm, int heapCapacity, int stackCapacity, int callStackCapacity, BytecodeStream* bStream) {
+// Each VM draws from its own generator, so VMs on different threads neither share nor race on
+// its state. Seeds taken at the same moment still differ by the VM's address.
+static byte8 nextRandom(VM* vm) {
+    // splitmix64
+    byte8 z = (vm->random += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+bool initVM(VM* vm, int heapCapacity, int stackCapacity, int callStackCapacity, BytecodeStream* bStream) {
     vm->PC = 0;
     vm->hadRuntimeError = false;
-    initStack(&vm->stack, stackCapacity);
-    initCallStack(&vm->callStack, callStackCapacity);
-    createProgramMemory(&vm->mem, heapCapacity);
+    if (!initStack(&vm->stack, stackCapacity)) return false;
+    if (!initCallStack(&vm->callStack, callStackCapacity)) {
+        freeStack(&vm->stack);
+        return false;
+    }
+    if (!createProgramMemory(&vm->mem, heapCapacity)) {
+        freeCallStack(&vm->callStack);
+        freeStack(&vm->stack);
+        return false;
+    }
     vm->program = bStream;
-    vm->nextCallBase = 0;
+    initDecodedProgram(&vm->code);
+    initJit(&vm->jit);
+    vm->opProfile = NULL;
+    vm->sampleProfile = NULL;
+    atomic_init(&vm->sampledAt, 0);
+    vm->trace = NULL;
+    vm->countInstructions = false;
+    vm->executed = 0;
+    vm->instructionLimit = ~(byte8)0;
+    vm->errorMessage = NULL;
+    vm->callPC = 0;
+    vm->in = stdin;
+    vm->out = stdout;
+    vm->fileDir = -1;
+    vm->random = (byte8)time(NULL) ^ (byte8)clock() ^ (byte8)(uintptr_t)vm;
+    return true;
 }
 
 void freeVM(VM* vm) {
@@ -25,11 +102,21 @@ void freeVM(VM* vm) {
     freeStack(&vm->stack);
     freeCallStack(&vm->callStack);
     freeProgramMemory(&vm->mem);
+    freeDecodedProgram(&vm->code);
+    freeJit(&vm->jit);
     vm->program = NULL;
 }
 
-static void advance(VM* vm) {
-    vm->PC++;
+void vmReset(VM* vm) {
+    resetProgramMemory(&vm->mem);
+    resetStack(&vm->stack);
+    resetCallStack(&vm->callStack);
+    vm->PC = 0;
+    vm->hadRuntimeError = false;
+    vm->errorMessage = NULL;
+    vm->callPC = 0;
+    vm->executed = 0;
+    vm->jit.depth = 0;
 }
 
 static void outputStack(VM* vm) {
@@ -55,9 +142,7 @@ static Obj* concatStrings(VM* vm, Obj* fst, Obj* snd) {
     }
 
     Obj* res = allocString(&vm->mem, buff, length);
-    if (res == NULL) {
-        free(buff);
-    }
+    free(buff);
     return res;
 }
 
@@ -81,57 +166,168 @@ static int cmpStrings(Obj* str1, Obj* str2) {
     return shorter;
 }
 
-static void clearInputBuffer() {
-    clearerr(stdin);
+static void clearInputBuffer(VM* vm) {
+    clearerr(vm->in);
     int c;
-    while ((c = getchar()) != '\n' && c != EOF) { }
+    while ((c = fgetc(vm->in)) != '\n' && c != EOF) { }
+}
+
+// The verifier has proved that the program fits in the stack (see verify.h), so pushes, pops
+// and register operands go unchecked. A call frame that does not fit runs into the guard
+// pages, or is caught by DO_CALL where there are none.
+static inline void pushValue(VM* vm, Value value, bool isRef) {
+    Stack* stack = &vm->stack;
+
+    stack->data[++stack->top] = value;
+    if (isRef) {
+        stack->refMap[REFMAP_WORD(stack->top)] |= REFMAP_BIT(stack->top);
+    } else {
+        stack->refMap[REFMAP_WORD(stack->top)] &= ~REFMAP_BIT(stack->top);
+    }
+}
+
+static inline void pushZeros(VM* vm, int count) {
+    Stack* stack = &vm->stack;
+
+    // Zeroing first runs into the guard before the reference bits are touched.
+    memset(stack->data + stack->top + 1, 0, count * sizeof(Value));
+    clearRefBits(stack, stack->top + 1, count);
+    stack->top += count;
+}
+
+static inline Value popValue(VM* vm) {
+    return vm->stack.data[vm->stack.top--];
 }
 
-static void jmpTo(VM* vm, int dst) {
-    vm->PC = dst - 1;
+static inline Value loadSlot(VM* vm, int pos) {
+    if (pos < 0 || pos >= vm->stack.capacity) {
+        runtimeError(vm, "Invalid stack slot access.");
+        Value zero = { .raw = 0 };
+        return zero;
+    }
+
+    return vm->stack.data[pos];
+}
+
+static inline void storeSlot(VM* vm, Value value, bool isRef, int pos) {
+    Stack* stack = &vm->stack;
+
+    if (pos < 0 || pos >= stack->capacity) {
+        runtimeError(vm, "Invalid stack slot access.");
+        return;
+    }
+
+    stack->data[pos] = value;
+    if (isRef) {
+        stack->refMap[REFMAP_WORD(pos)] |= REFMAP_BIT(pos);
+    } else {
+        stack->refMap[REFMAP_WORD(pos)] &= ~REFMAP_BIT(pos);
+    }
+}
+
+static inline int frameBase(VM* vm) {
+    if (vm->callStack.top < 0) {
+        runtimeError(vm, "Call stack is empty.");
+        return 0;
+    }
+
+    return vm->callStack.frames[vm->callStack.top].baseStackPos;
+}
+
+// First slot of the current call frame, or of the globals outside any call.
+static inline Value* frameSlots(VM* vm) {
+    if (vm->callStack.top < 0) return vm->stack.data;
+
+    return vm->stack.data + vm->callStack.frames[vm->callStack.top].baseStackPos;
 }
 
-static void pushByte(VM* vm, byte b, bool isRef) {
-    bool res = push(&vm->stack, b, isRef);
-    if (!res) {
+static inline Value* regSlot(VM* vm, Value* fp, int reg) {
+    return (REG_IS_RELATIVE(reg) ? fp : vm->stack.data) + REG_POS(reg);
+}
+
+// Starts a call to the DO_CALL at index, whose arguments are on top of the stack.
+static inline bool enterCall(VM* vm, DecodedOp* call, int index) {
+    int base = vm->stack.top + 1 - call->a;
+    vm->callPC = index;
+
+#ifndef STACK_GUARD_PAGES
+    if (base + call->b > vm->stack.capacity) {
         runtimeError(vm, "Stack overflow.");
+        return false;
+    }
+#endif
+
+    if (!pushCallFrame(&vm->callStack, index + 1, base)) {
+        runtimeError(vm, "Call stack overflow.");
+        return false;
     }
+
+    return true;
+}
+
+// Moves the arguments of the TAIL_CALL on top of the stack down over the current frame, which
+// the callee takes over along with its return address.
+static inline bool tailCall(VM* vm, DecodedOp* call) {
+    Stack* stack = &vm->stack;
+    int base = frameBase(vm);
+    int from = stack->top + 1 - call->a;
+
+#ifndef STACK_GUARD_PAGES
+    if (base + call->b > stack->capacity) {
+        runtimeError(vm, "Stack overflow.");
+        return false;
+    }
+#endif
+
+    for (int i = 0; i < call->a; i++) {
+        bool isRef = isRefAt(stack, from + i);
+        stack->data[base + i] = stack->data[from + i];
+        if (isRef) {
+            stack->refMap[REFMAP_WORD(base + i)] |= REFMAP_BIT(base + i);
+        } else {
+            stack->refMap[REFMAP_WORD(base + i)] &= ~REFMAP_BIT(base + i);
+        }
+    }
+    stack->top = base + call->a - 1;
+
+    return true;
 }
 
-static byte popByte(VM* vm) {
-    return pop(&vm->stack);
+static inline bool topIsRef(VM* vm) {
+    return isRefAt(&vm->stack, vm->stack.top);
 }
 
-#define READ_BYTE(idx)  (vm->program->stream[idx])
-#define READ_4BYTE(idx) (((byte4)vm->program->stream[idx] << 24) | ((byte4)vm->program->stream[idx + 1] << 16) | ((byte4)vm->program->stream[idx + 2] << 8) | ((byte4)vm->program->stream[idx + 3]))
-#define READ_8BYTE(idx) (((byte8)vm->program->stream[idx] << 56) | ((byte8)vm->program->stream[idx + 1] << 48) | ((byte8)vm->program->stream[idx + 2] << 40) | ((byte8)vm->program->stream[idx + 3] << 32) | ((byte8)vm->program->stream[idx + 4] << 24) | ((byte8)vm->program->stream[idx + 5] << 16) | ((byte8)vm->program->stream[idx + 6] << 8) | ((byte8)vm->program->stream[idx + 7]))
-
-#define READ_INT(var, idx)  {byte4 temp = READ_4BYTE(idx); var = *(int*)(&temp);}
-#define READ_REAL(var, idx) {byte8 temp = READ_8BYTE(idx); var = *(double*)(&temp);}
-#define READ_CHAR(var, idx) {var = *(char*)(&READ_BYTE(idx));}
-#define READ_BOOL(var, idx) {var = *(bool*)(&READ_BYTE(idx));}
-#define READ_REF(var, idx)  {void* temp = READ_8BYTE(idx); var = *(void**)(&temp);}
-
-#define PUSH_BYTE(b)    { pushByte(vm, b, false); }
-#define PUSH_4BYTE(b)   { pushByte(vm, (byte)(b & 0xff), false); pushByte(vm, (byte)((b>>8) & 0xff), false); pushByte(vm, (byte)((b>>16) & 0xff), false); pushByte(vm, (byte)((b>>24) & 0xff), false); }
-#define PUSH_8BYTE(b)   { pushByte(vm, (byte)(b & 0xff), false); pushByte(vm, (byte)((b>>8) & 0xff), false); pushByte(vm, (byte)((b>>16) & 0xff), false); pushByte(vm, (byte)((b>>24) & 0xff), false); pushByte(vm, (byte)((b>>32) & 0xff), false); pushByte(vm, (byte)((b>>40) & 0xff), false); pushByte(vm, (byte)((b>>48) & 0xff), false); pushByte(vm, (byte)((b>>56) & 0xff), false); }
-#define PUSH_8BREF(b)   { pushByte(vm, (byte)(b & 0xff), true); pushByte(vm, (byte)((b>>8) & 0xff), false); pushByte(vm, (byte)((b>>16) & 0xff), false); pushByte(vm, (byte)((b>>24) & 0xff), false); pushByte(vm, (byte)((b>>32) & 0xff), false); pushByte(vm, (byte)((b>>40) & 0xff), false); pushByte(vm, (byte)((b>>48) & 0xff), false); pushByte(vm, (byte)((b>>56) & 0xff), false); }
-
-#define PUSH_CHAR(c)    { byte temp = *(byte*)(&c); PUSH_BYTE(temp); }
-#define PUSH_BOOL(b)    { byte temp = *(byte*)(&b); PUSH_BYTE(temp); }
-#define PUSH_INT(x)     { byte4 temp = *(byte4*)(&x); PUSH_4BYTE(temp); }
-#define PUSH_REAL(r)    { byte8 temp = *(byte8*)(&r); PUSH_8BYTE(temp); }
-#define PUSH_REF(r)     { byte8 temp = *(byte8*)(&r); PUSH_8BREF(temp); }
-
-#define POP_BYTE(var)   { var = popByte(vm); }
-#define POP_4BYTE(var)  { var = (((byte4)(popByte(vm)) << 24) | ((byte4)(popByte(vm)) << 16) | ((byte4)(popByte(vm)) << 8) | ((byte4)(popByte(vm)))); }
-#define POP_8BYTE(var)  { var = (((byte8)(popByte(vm)) << 56) | ((byte8)(popByte(vm)) << 48) | ((byte8)(popByte(vm)) << 40) | ((byte8)(popByte(vm)) << 32) | ((byte8)(popByte(vm)) << 24) | ((byte8)(popByte(vm)) << 16) | ((byte8)(popByte(vm)) << 8) | ((byte8)(popByte(vm)))); }
-
-#define POP_CHAR(c)     { byte temp; POP_BYTE(temp); c = *(char*)(&temp); }
-#define POP_BOOL(b)     { byte temp; POP_BYTE(temp); b = *(bool*)(&temp); }
-#define POP_INT(n)      { byte4 temp; POP_4BYTE(temp); n = *(int*)(&temp); }
-#define POP_REAL(r)     { byte8 temp; POP_8BYTE(temp); r = *(double*)(&temp); }
-#define POP_REF(r)      { byte8 temp; POP_8BYTE(temp); r = *(void**)(&temp); }
+#define PUSH_VALUE(v, isRef)    { pushValue(vm, v, isRef); }
+#define PUSH_INT(x)     { Value temp = { .raw = 0 }; temp.asInt = (x); pushValue(vm, temp, false); }
+#define PUSH_REAL(r)    { Value temp; temp.asReal = (r); pushValue(vm, temp, false); }
+#define PUSH_CHAR(c)    { Value temp = { .raw = 0 }; temp.asChar = (c); pushValue(vm, temp, false); }
+#define PUSH_BOOL(b)    { Value temp = { .raw = 0 }; temp.asBool = (b); pushValue(vm, temp, false); }
+#define PUSH_REF(r)     { Value temp; temp.asRef = (void*)(r); pushValue(vm, temp, true); }
+
+#define POP_VALUE(var)  { var = popValue(vm); }
+#define POP_INT(n)      { n = popValue(vm).asInt; }
+#define POP_REAL(r)     { r = popValue(vm).asReal; }
+#define POP_CHAR(c)     { c = popValue(vm).asChar; }
+#define POP_BOOL(b)     { b = popValue(vm).asBool; }
+#define POP_REF(r)      { r = popValue(vm).asRef; }
+
+#define REG(reg)        regSlot(vm, fp, reg)
+
+// Register forms: dst <- a op b, with b a register (RR) or an immediate (RK).
+#define INT_RR(expr)    { int a = REG(ip->a)->asInt; int b = REG(ip->b)->asInt; \
+                          Value res = { .raw = 0 }; res.asInt = (expr); *REG(ip->operand.asInt) = res; }
+#define INT_RK(expr)    { int a = REG(ip->a)->asInt; int b = ip->b; \
+                          Value res = { .raw = 0 }; res.asInt = (expr); *REG(ip->operand.asInt) = res; }
+// Integer DIV and MOD. The machine traps on a zero divisor and on INT_MIN DIV -1, the one
+// quotient an INTEGER cannot hold, so the handlers check for those first. INT_MIN MOD -1 is 0.
+#define DIVISION_BY_ZERO    "Division by zero."
+#define DIVISION_OVERFLOW   "Integer overflow in DIV."
+#define CHECK_DIVISION(dividend, divisor, isDiv) \
+    { if ((divisor) == 0) { runtimeError(vm, DIVISION_BY_ZERO); break; } \
+      if ((isDiv) && (divisor) == -1 && (dividend) == INT_MIN) { runtimeError(vm, DIVISION_OVERFLOW); break; } }
+#define INT_MOD(a, b)   ((b) == -1 ? 0 : (a) % (b))
+#define REAL_RR(expr)   { double a = REG(ip->a)->asReal; double b = REG(ip->b)->asReal; \
+                          Value res; res.asReal = (expr); *REG(ip->operand.asInt) = res; }
 
 static void substring(VM* vm) {
     int length;
@@ -141,12 +337,8 @@ static void substring(VM* vm) {
     void* ref;
     POP_REF(ref);
 
-    if (!isValidReference(&vm->mem, ref)) {
-        runtimeError(vm, "Segmentation fault.");
-        return;
-    }
-
-    Obj* str = (Obj*)ref;
+    Obj* str = objectOf(vm, ref, OBJ_STRING);
+    if (str == NULL) return;
 
     if (initPos + length - 1 > str->as.StringObj.length) {
         runtimeError(vm, "Substring overextends string.");
@@ -159,11 +351,10 @@ static void substring(VM* vm) {
     char* sub = extractNullTerminatedString(str->as.StringObj.start + initPos - 1, length);
 
     Obj* strPtr = allocString(&vm->mem, sub, length);
+    free(sub);
 
     if (strPtr == NULL) {
         runtimeError(vm, "String allocation failed in heap.");
-        printf("IN USE %zu of %zu and next free is %p\n",  vm->mem.inUse, vm->mem.memSize, vm->mem.free);
-        free(sub);
         return;
     }
 
@@ -174,12 +365,8 @@ static void length(VM* vm) {
     void* ref;
     POP_REF(ref);
 
-    if (!isValidReference(&vm->mem, ref)) {
-        runtimeError(vm, "Segmentation fault.");
-        return;
-    }
-
-    Obj* str = (Obj*)ref;
+    Obj* str = objectOf(vm, ref, OBJ_STRING);
+    if (str == NULL) return;
 
     int len = str->as.StringObj.length;
 
@@ -190,12 +377,8 @@ static void lcase(VM* vm) {
     void* ref;
     POP_REF(ref);
 
-    if (!isValidReference(&vm->mem, ref)) {
-        runtimeError(vm, "Segmentation fault.");
-        return;
-    }
-
-    Obj* str = (Obj*)ref;
+    Obj* str = objectOf(vm, ref, OBJ_STRING);
+    if (str == NULL) return;
 
     char* lchars = (char*) malloc(sizeof(char) * str->as.StringObj.length);
 
@@ -215,6 +398,7 @@ static void lcase(VM* vm) {
     }
 
     Obj* newStr = allocString(&vm->mem, lchars, str->as.StringObj.length);
+    free(lchars);
 
     if (newStr == NULL) {
         runtimeError(vm, "Memory allocation fail.");
@@ -228,12 +412,8 @@ static void ucase(VM* vm) {
     void* ref;
     POP_REF(ref);
 
-    if (!isValidReference(&vm->mem, ref)) {
-        runtimeError(vm, "Segmentation fault.");
-        return;
-    }
-
-    Obj* str = (Obj*)ref;
+    Obj* str = objectOf(vm, ref, OBJ_STRING);
+    if (str == NULL) return;
 
     char* uchars = (char*) malloc(sizeof(char) * str->as.StringObj.length);
 
@@ -253,6 +433,7 @@ static void ucase(VM* vm) {
     }
 
     Obj* newStr = allocString(&vm->mem, uchars, str->as.StringObj.length);
+    free(uchars);
 
     if (newStr == NULL) {
         runtimeError(vm, "Memory allocation fail.");
@@ -267,17 +448,20 @@ static void randomBetween(VM* vm) {
     POP_INT(max);
     POP_INT(min);
 
-    srand((unsigned int)clock());
+    if (max < min) {
+        runtimeError(vm, "RANDOMBETWEEN needs a lower bound no greater than its upper bound.");
+        return;
+    }
 
-    int randomNum = rand() % (max - min + 1) + min;
+    byte8 range = (byte8)((long long)max - min) + 1;
+    int randomNum = (int)((long long)min + (long long)(nextRandom(vm) % range));
 
     PUSH_INT(randomNum);
 }
 
 static void rnd(VM* vm) {
-    srand((unsigned int)clock());
-
-    double randomReal = rand() / ((double) RAND_MAX);
+    // The top 53 bits, scaled to [0, 1).
+    double randomReal = (double)(nextRandom(vm) >> 11) * (1.0 / 9007199254740992.0);
 
     PUSH_REAL(randomReal);
 }
@@ -295,12 +479,8 @@ static void eof(VM* vm) {
     void* ref;
     POP_REF(ref);
 
-    if (!isValidReference(&vm->mem, ref)) {
-        runtimeError(vm, "Segmentation fault.");
-        return;
-    }
-
-    Obj* file = (Obj*) ref;
+    Obj* file = objectOf(vm, ref, OBJ_FILE);
+    if (file == NULL) return;
 
     FILE* filePtr = file->as.FileObj.filePtr;
 
@@ -316,12 +496,8 @@ static void charAt(VM* vm) {
     void* ref;
     POP_REF(ref);
 
-    if (!isValidReference(&vm->mem, ref)) {
-        runtimeError(vm, "Segmentation fault.");
-        return;
-    }
-
-    Obj* str = (Obj*) ref;
+    Obj* str = objectOf(vm, ref, OBJ_STRING);
+    if (str == NULL) return;
 
     if (pos <= 0 || pos > str->as.StringObj.length) {
         runtimeError(vm, "Position must be between 1 and length of string.");
@@ -375,1540 +551,350 @@ static void runBuiltinFunc(VM* vm, int idx) {
     }
 }
 
-static void runInstruction(VM* vm) {
-    Instruction op = vm->program->stream[vm->PC];
-
-    switch (op) {
-        case LOAD_INT: {
-            int n;
-            READ_INT(n, vm->PC + 1);
-            vm->PC += 4;
-            PUSH_INT(n);
-            break;
-        }
-        case LOAD_REAL: {
-            double d;
-            READ_REAL(d, vm->PC + 1);
-            vm->PC += 8;
-            PUSH_REAL(d);
-            break;
-        }
-        case LOAD_CHAR: {
-            char c;
-            READ_CHAR(c, vm->PC + 1);
-            vm->PC++;
-            PUSH_CHAR(c);
-            break;
-        }
-        case LOAD_BOOL: {
-            bool b;
-            READ_BOOL(b, vm->PC + 1);
-            vm->PC++;
-            PUSH_BOOL(b);
-            break;
-        }
-        case LOAD_STRING: {
-            int length;
-            READ_INT(length, vm->PC + 1);
-            vm->PC += 4;
-            char* buff = malloc(length * sizeof(char));
-            if (buff == NULL) {
-                runtimeError(vm, "String allocation failed.");
-                break;
-            }
-            for (int i = 0; i < length; i++) {
-                char c;
-                READ_CHAR(c, vm->PC + 1);
-                vm->PC++;
-                buff[i] = c;
-            }
-
-            Obj* strPtr = allocString(&vm->mem, buff, length);
-            if (strPtr == NULL) {
-                runtimeError(vm, "String allocation failed in heap.");
-                printf("IN USE %zu of %zu and next free is %p\n",  vm->mem.inUse, vm->mem.memSize, vm->mem.free);
-                free(buff);
-                break;
-            }
-
-            PUSH_REF(strPtr);
-            break;
-        }
-        case CREATE_ARRAY: {
-            int x0, x1, y0, y1, elemSize;
-            POP_INT(elemSize);
-            POP_INT(y1);
-            POP_INT(y0);
-            POP_INT(x1);
-            POP_INT(x0);
-
-            Obj* arrPtr = allocArray(&vm->mem, x1 - x0 + 1, y1 - y0 + 1, x0, y0, elemSize);
-            if (arrPtr == NULL) {
-                runtimeError(vm, "Array allocation failed.");
-                break;
-            }
-
-            PUSH_REF(arrPtr);
-            break;
-        }
-        case STORE_INT: {
-            int pos; POP_INT(pos);
-            int num; POP_INT(num);
-            setAt(&vm->stack, (byte)(num) & 0xff, false, pos);
-            setAt(&vm->stack, (byte)(num >> 8) & 0xff, false, pos + 1);
-            setAt(&vm->stack, (byte)(num >> 16) & 0xff, false, pos + 2);
-            setAt(&vm->stack, (byte)(num >> 24) & 0xff, false, pos + 3);
-            PUSH_INT(num);
-            break;
-        }
-        case STORE_REAL: {
-            int pos; POP_INT(pos);
-            byte8 num; POP_8BYTE(num);
-            setAt(&vm->stack, (byte)(num) & 0xff, false, pos);
-            setAt(&vm->stack, (byte)(num >> 8) & 0xff, false, pos + 1);
-            setAt(&vm->stack, (byte)(num >> 16) & 0xff, false, pos + 2);
-            setAt(&vm->stack, (byte)(num >> 24) & 0xff, false, pos + 3);
-            setAt(&vm->stack, (byte)(num >> 32) & 0xff, false, pos + 4);
-            setAt(&vm->stack, (byte)(num >> 40) & 0xff, false, pos + 5);
-            setAt(&vm->stack, (byte)(num >> 48) & 0xff, false, pos + 6);
-            setAt(&vm->stack, (byte)(num >> 56) & 0xff, false, pos + 7);
-
-            PUSH_8BYTE(num);
-            break;
-        }
-        case STORE_CHAR: {
-            int pos;
-            POP_INT(pos);
-            byte c; POP_BYTE(c);
-            setAt(&vm->stack, c, false, pos);
-
-            PUSH_BYTE(c);
-            break;
-        }
-        case STORE_BOOL: {
-            int pos;
-            POP_INT(pos);
-            byte b; POP_BYTE(b);
-            setAt(&vm->stack, b, false, pos);
-
-            PUSH_BYTE(b);
-            break;
-        }
-        case STORE_REF: {
-            int pos; POP_INT(pos);
-            byte8 num; POP_8BYTE(num);
-            setAt(&vm->stack, (byte)(num) & 0xff, true, pos);
-            setAt(&vm->stack, (byte)(num >> 8) & 0xff, true, pos + 1);
-            setAt(&vm->stack, (byte)(num >> 16) & 0xff, true, pos + 2);
-            setAt(&vm->stack, (byte)(num >> 24) & 0xff, true, pos + 3);
-            setAt(&vm->stack, (byte)(num >> 32) & 0xff, true, pos + 4);
-            setAt(&vm->stack, (byte)(num >> 40) & 0xff, true, pos + 5);
-            setAt(&vm->stack, (byte)(num >> 48) & 0xff, true, pos + 6);
-            setAt(&vm->stack, (byte)(num >> 56) & 0xff, true, pos + 7);
-
-            PUSH_8BYTE(num);
-            break;
-        }
-        case FETCH_INT: {
-            int pos; POP_INT(pos);
-
-            byte4 res = (((byte4)(getAt(&vm->stack, pos + 3)) << 24) | ((byte4)(getAt(&vm->stack, pos + 2)) << 16) | ((byte4)(getAt(&vm->stack, pos + 1)) << 8) | ((byte4)(getAt(&vm->stack, pos))));
-            PUSH_4BYTE(res);
-            break;
-        }
-        case FETCH_REAL: {
-            int pos; POP_INT(pos);
-
-            byte8 res = (((byte8)(getAt(&vm->stack, pos + 7)) << 56) | ((byte8)(getAt(&vm->stack, pos + 6)) << 48) | ((byte8)(getAt(&vm->stack, pos + 5)) << 40) | ((byte8)(getAt(&vm->stack, pos + 4)) << 32) | ((byte8)(getAt(&vm->stack, pos + 3)) << 24) | ((byte8)(getAt(&vm->stack, pos + 2)) << 16) | ((byte8)(getAt(&vm->stack, pos + 1)) << 8) | ((byte8)(getAt(&vm->stack, pos))));
-            PUSH_8BYTE(res);
-            break;
-        }
-        case FETCH_CHAR: {
-            int pos; POP_INT(pos);
-            byte res = getAt(&vm->stack, pos);
-            PUSH_BYTE(res);
-            break;
-        }
-        case FETCH_BOOL: {
-            int pos; POP_INT(pos);
-            byte res = getAt(&vm->stack, pos);
-            PUSH_BYTE(res);
-            break;
-        }
-        case FETCH_REF: {
-            int pos; POP_INT(pos);
-
-            byte8 res = (((byte8)(getAt(&vm->stack, pos + 7)) << 56) | ((byte8)(getAt(&vm->stack, pos + 6)) << 48) | ((byte8)(getAt(&vm->stack, pos + 5)) << 40) | ((byte8)(getAt(&vm->stack, pos + 4)) << 32) | ((byte8)(getAt(&vm->stack, pos + 3)) << 24) | ((byte8)(getAt(&vm->stack, pos + 2)) << 16) | ((byte8)(getAt(&vm->stack, pos + 1)) << 8) | ((byte8)(getAt(&vm->stack, pos))));
-            PUSH_8BREF(res);
-            break;
-        }
-        case CALL_SUB: {
-            vm->nextCallBase = getNextFree(&vm->stack);
-            break;
-        }
-        case DO_CALL: {
-            int newPC;
-            READ_INT(newPC, vm->PC + 1);
-            vm->PC += 4;
-            int returnPC = vm->PC + 1;
-            pushCallFrame(&vm->callStack, returnPC, vm->nextCallBase);
-            jmpTo(vm, newPC);
-            break;
-        }
-        case RETURN: {
-            byte size = READ_BYTE(vm->PC + 1);
-            vm->PC++;
-            switch (size) {
-                case 1: {
-                    byte res; POP_BYTE(res);
-                    int base = getBaseStackPos(&vm->callStack);
-                    int returnPC = popCallFrame(&vm->callStack);
-                    jmpTo(vm, returnPC);
-                    vm->stack.top = base - 1;
-                    PUSH_BYTE(res);
-                    break;
-                }
-                case 4: {
-                    byte4 res; POP_4BYTE(res);
-                    int base = getBaseStackPos(&vm->callStack);
-                    int returnPC = popCallFrame(&vm->callStack);
-                    jmpTo(vm, returnPC);
-                    vm->stack.top = base - 1;
-                    PUSH_4BYTE(res);
-                    break;
-                }
-                case 8: {
-                    byte8 res; POP_8BYTE(res);
-                    int base = getBaseStackPos(&vm->callStack);
-                    int returnPC = popCallFrame(&vm->callStack);
-                    jmpTo(vm, returnPC);
-                    vm->stack.top = base - 1;
-                    PUSH_8BYTE(res);
-                    break;
-                }
-                default: break;
-            }
-            break;
-        }
-        case RETURN_NIL: {
-            int base = getBaseStackPos(&vm->callStack);
-            int returnPC = popCallFrame(&vm->callStack);
-            jmpTo(vm, returnPC);
-            vm->stack.top = base - 1;
-            break;
-        }
-        case CALL_BUILTIN: {
-            int builtinIdx;
-            READ_INT(builtinIdx, vm->PC + 1);
-            vm->PC += 4;
-            runBuiltinFunc(vm, builtinIdx);
-            break;
-        }
-        case RSTORE_INT: {
-            int base = getBaseStackPos(&vm->callStack);
-            int pos; POP_INT(pos); pos += base;
-            int num; POP_INT(num);
-            setAt(&vm->stack, (byte)(num) & 0xff, false, pos);
-            setAt(&vm->stack, (byte)(num >> 8) & 0xff, false, pos + 1);
-            setAt(&vm->stack, (byte)(num >> 16) & 0xff, false, pos + 2);
-            setAt(&vm->stack, (byte)(num >> 24) & 0xff, false, pos + 3);
-            PUSH_INT(num);
-            break;
-        }
-        case RSTORE_REAL: {
-            int base = getBaseStackPos(&vm->callStack);
-            int pos; POP_INT(pos); pos += base;
-            byte8 num; POP_8BYTE(num);
-            setAt(&vm->stack, (byte)(num) & 0xff, false, pos);
-            setAt(&vm->stack, (byte)(num >> 8) & 0xff, false, pos + 1);
-            setAt(&vm->stack, (byte)(num >> 16) & 0xff, false, pos + 2);
-            setAt(&vm->stack, (byte)(num >> 24) & 0xff, false, pos + 3);
-            setAt(&vm->stack, (byte)(num >> 32) & 0xff, false, pos + 4);
-            setAt(&vm->stack, (byte)(num >> 40) & 0xff, false, pos + 5);
-            setAt(&vm->stack, (byte)(num >> 48) & 0xff, false, pos + 6);
-            setAt(&vm->stack, (byte)(num >> 56) & 0xff, false, pos + 7);
-
-            PUSH_8BYTE(num);
-            break;
-        }
-        case RSTORE_CHAR: {
-            int base = getBaseStackPos(&vm->callStack);
-            int pos;
-            POP_INT(pos); pos += base;
-            byte c; POP_BYTE(c);
-            setAt(&vm->stack, c, false, pos);
-
-            PUSH_BYTE(c);
-            break;
-        }
-        case RSTORE_BOOL: {
-            int base = getBaseStackPos(&vm->callStack);
-            int pos;
-            POP_INT(pos); pos += base;
-            byte c; POP_BYTE(c);
-            setAt(&vm->stack, c, false, pos);
-
-            PUSH_BYTE(c);
-            break;
-        }
-        case RSTORE_REF: {
-            int base = getBaseStackPos(&vm->callStack);
-            int pos; POP_INT(pos); pos += base;
-            byte8 num; POP_8BYTE(num);
-            setAt(&vm->stack, (byte)(num) & 0xff, true, pos);
-            setAt(&vm->stack, (byte)(num >> 8) & 0xff, true, pos + 1);
-            setAt(&vm->stack, (byte)(num >> 16) & 0xff, true, pos + 2);
-            setAt(&vm->stack, (byte)(num >> 24) & 0xff, true, pos + 3);
-            setAt(&vm->stack, (byte)(num >> 32) & 0xff, true, pos + 4);
-            setAt(&vm->stack, (byte)(num >> 40) & 0xff, true, pos + 5);
-            setAt(&vm->stack, (byte)(num >> 48) & 0xff, true, pos + 6);
-            setAt(&vm->stack, (byte)(num >> 56) & 0xff, true, pos + 7);
-
-            PUSH_8BYTE(num);
-            break;
-        }
-        case RFETCH_INT: {
-            int base = getBaseStackPos(&vm->callStack);
-            int pos; POP_INT(pos); pos += base;
-
-            byte4 res = (((byte4)(getAt(&vm->stack, pos + 3)) << 24) | ((byte4)(getAt(&vm->stack, pos + 2)) << 16) | ((byte4)(getAt(&vm->stack, pos + 1)) << 8) | ((byte4)(getAt(&vm->stack, pos))));
-            PUSH_4BYTE(res);
-            break;
-        }
-        case RFETCH_REAL: {
-            int base = getBaseStackPos(&vm->callStack);
-            int pos; POP_INT(pos); pos += base;
-
-            byte8 res = (((byte8)(getAt(&vm->stack, pos + 7)) << 56) | ((byte8)(getAt(&vm->stack, pos + 6)) << 48) | ((byte8)(getAt(&vm->stack, pos + 5)) << 40) | ((byte8)(getAt(&vm->stack, pos + 4)) << 32) | ((byte8)(getAt(&vm->stack, pos + 3)) << 24) | ((byte8)(getAt(&vm->stack, pos + 2)) << 16) | ((byte8)(getAt(&vm->stack, pos + 1)) << 8) | ((byte8)(getAt(&vm->stack, pos))));
-            PUSH_8BYTE(res);
-            break;
-        }
-        case RFETCH_CHAR: {
-            int base = getBaseStackPos(&vm->callStack);
-            int pos; POP_INT(pos); pos += base;
-            byte res = getAt(&vm->stack, pos);
-            PUSH_BYTE(res);
-            break;
-        }
-        case RFETCH_BOOL: {
-            int base = getBaseStackPos(&vm->callStack);
-            int pos; POP_INT(pos); pos += base;
-            byte res = getAt(&vm->stack, pos);
-            PUSH_BYTE(res);
-            break;
-        }
-        case RFETCH_REF: {
-            int base = getBaseStackPos(&vm->callStack);
-            int pos; POP_INT(pos); pos += base;
-
-            byte8 res = (((byte8)(getAt(&vm->stack, pos + 7)) << 56) | ((byte8)(getAt(&vm->stack, pos + 6)) << 48) | ((byte8)(getAt(&vm->stack, pos + 5)) << 40) | ((byte8)(getAt(&vm->stack, pos + 4)) << 32) | ((byte8)(getAt(&vm->stack, pos + 3)) << 24) | ((byte8)(getAt(&vm->stack, pos + 2)) << 16) | ((byte8)(getAt(&vm->stack, pos + 1)) << 8) | ((byte8)(getAt(&vm->stack, pos))));
-            PUSH_8BREF(res);
-            break;
-        }
-        case FETCH_ARRAY_ELEM: {
-            int y; POP_INT(y);
-            int x; POP_INT(x);
-            void* ref; POP_REF(ref);
-
-            if (!isValidReference(&vm->mem, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* arr = (Obj*)ref;
-#define ARR arr->as.ArrayObj
-            if (x < ARR.x0 || x >= ARR.x0 + ARR.length || y < ARR.y0 || y >= ARR.y0 + ARR.width) {
-                runtimeError(vm, "Array out of bounds access.");
-                break;
-            }
-
-            for (int i = ARR.elemSize - 1; i >= 0; i--) {
-                byte temp = ARR.start[(y - ARR.y0) * ARR.length * ARR.elemSize + (x - ARR.x0) * ARR.elemSize + i];
-                PUSH_BYTE(temp);
-            }
-
-#undef ARR
-            break;
-        }
-        case STORE_ARRAY_ELEM: {
-            int y; POP_INT(y);
-            int x; POP_INT(x);
-            void* ref; POP_REF(ref);
-
-            if (!isValidReference(&vm->mem, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* arr = (Obj*)ref;
-#define ARR arr->as.ArrayObj
-            if (x < ARR.x0 || x >= ARR.x0 + ARR.length || y < ARR.y0 || y >= ARR.y0 + ARR.width) {
-                runtimeError(vm, "Array out of bounds access.");
-                break;
-            }
-
-            for (int i = 0; i < ARR.elemSize; i++) {
-                byte temp; POP_BYTE(temp);
-                ARR.start[(y - ARR.y0) * ARR.length * ARR.elemSize + (x - ARR.x0) * ARR.elemSize + i] = temp;
-            }
-
-            for (int i = ARR.elemSize - 1; i >= 0; i--) {
-                byte temp = ARR.start[(y - ARR.y0) * ARR.length * ARR.elemSize + (x - ARR.x0) * ARR.elemSize + i];
-                PUSH_BYTE(temp);
-            }
-
-#undef ARR
-            break;
-        }
-        case STORE_REF_INT: {
-            void* ref;
-            POP_REF(ref);
-            byte4 num; POP_4BYTE(num);
-
-            if (!isStackRef(&vm->stack, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            StackElem* ptr = (StackElem*)ref;
-
-            for (int i = 0; i < 4; i++) {
-                (ptr[i]).value = (byte)((num >> (8 * i)) & 0xff);
-                (ptr[i]).isRef = false;
-            }
-
-            PUSH_4BYTE(num);
-            break;
-        }
-        case STORE_REF_REAL: {
-            void* ref;
-            POP_REF(ref);
-            byte8 num; POP_8BYTE(num);
-
-            if (!isStackRef(&vm->stack, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            StackElem* ptr = (StackElem*)ref;
-
-            for (int i = 0; i < 8; i++) {
-                (ptr[i]).value = (byte)((num >> (8 * i)) & 0xff);
-                (ptr[i]).isRef = false;
-            }
-
-            PUSH_8BYTE(num);
-            break;
-        }
-        case STORE_REF_CHAR: {
-            void* ref;
-            POP_REF(ref);
-            byte c; POP_BYTE(c);
-
-            if (!isStackRef(&vm->stack, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            StackElem* ptr = (StackElem*)ref;
-
-            ptr->value = c;
-            ptr->isRef = false;
-
-            PUSH_BYTE(c);
-            break;
-        }
-        case STORE_REF_BOOL: {
-            void* ref;
-            POP_REF(ref);
-            byte c; POP_BYTE(c);
-
-            if (!isStackRef(&vm->stack, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            StackElem* ptr = (StackElem*)ref;
-
-            ptr->value = c;
-            ptr->isRef = false;
-
-            PUSH_BYTE(c);
-            break;
-        }
-        case FETCH_REF_INT: {
-            void* ref;
-            POP_REF(ref);
-
-            if (!isStackRef(&vm->stack, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            StackElem* ptr = (StackElem*)ref;
-            byte4 num = 0;
-
-            for (int i = 0; i < 4; i++) {
-                num |= (byte4)((ptr[i].value)) << (8 * i);
-            }
-
-            PUSH_4BYTE(num);
-            break;
-        }
-        case FETCH_REF_REAL: {
-            void* ref;
-            POP_REF(ref);
-
-            if (!isStackRef(&vm->stack, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            StackElem* ptr = (StackElem*)ref;
-            byte8 num = 0;
-
-            for (int i = 0; i < 4; i++) {
-                num |= (byte8)((ptr[i].value)) << (8*i);
-            }
-
-            PUSH_8BYTE(num);
-            break;
-        }
-        case FETCH_REF_CHAR: {
-            void* ref;
-            POP_REF(ref);
-
-            if (!isStackRef(&vm->stack, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            StackElem* ptr = (StackElem*)ref;
-            byte c;
-
-            c = ptr->value;
-
-            PUSH_BYTE(c);
-            break;
-        }
-        case FETCH_REF_BOOL: {
-            void* ref;
-            POP_REF(ref);
-
-            if (!isStackRef(&vm->stack, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            StackElem* ptr = (StackElem*)ref;
-            byte c;
-
-            c = ptr->value;
-
-            PUSH_BYTE(c);
-            break;
-        }
-        case CAST_INT_REAL: {
-            int num; POP_INT(num);
-
-            double real = (double)num;
-
-            PUSH_REAL(real);
-            break;
-        }
-        case CAST_INT_CHAR: {
-            int num; POP_INT(num);
-            if (num >= 256) num = 256;
-            else if (num < 0) num = 0;
-
-            char c = (char)num;
-            PUSH_CHAR(c);
-            break;
-        }
-        case CAST_CHAR_INT: {
-            char c;
-            POP_CHAR(c);
-            int num = (int)c;
-            PUSH_INT(num);
-            break;
-        }
-        case ADD_INT: {
-            int a, b;
-            POP_INT(a); POP_INT(b);
-            int res = a + b;
-            PUSH_INT(res);
-            break;
-        }
-        case ADD_REAL: {
-            double a, b;
-            POP_REAL(a); POP_REAL(b);
-            double res = a + b;
-            PUSH_REAL(res);
-            break;
-        }
-        case MINUS_INT: {
-            int a, b;
-            POP_INT(a); POP_INT(b);
-            int res = b - a;
-            PUSH_INT(res);
-            break;
-        }
-        case MINUS_REAL: {
-            double a, b;
-            POP_REAL(a); POP_REAL(b);
-            double res = b - a;
-            PUSH_REAL(res);
-            break;
-        }
-        case MULT_INT: {
-            int a, b;
-            POP_INT(a); POP_INT(b);
-            int res = a * b;
-            PUSH_INT(res);
-            break;
-        }
-        case MULT_REAL: {
-            double a, b;
-            POP_REAL(a); POP_REAL(b);
-            double res = a * b;
-            PUSH_REAL(res);
-            break;
-        }
-        case DIV_INT: {
-            int a, b;
-            POP_INT(a); POP_INT(b);
-            double res = (double)((double)b / (double)a);
-            PUSH_REAL(res);
-            break;
-        }
-        case DIV_REAL: {
-            double a, b;
-            POP_REAL(a); POP_REAL(b);
-            double res = b / a;
-            PUSH_REAL(res);
-            break;
-        }
-        case MOD_INT: {
-            int a, b;
-            POP_INT(a); POP_INT(b);
-            int res = b % a;
-            PUSH_INT(res);
-            break;
-        }
-        case MOD_REAL: {
-            double a, b;
-            POP_REAL(a); POP_REAL(b);
-            double res = dmod(b, a);
-            PUSH_REAL(res);
-            break;
-        }
-        case FDIV_INT: {
-            int a, b;
-            POP_INT(a); POP_INT(b);
-            int res = (int)(b / a);
-            PUSH_INT(res);
-            break;
-        }
-        case FDIV_REAL: {
-            double a, b;
-            POP_REAL(a); POP_REAL(b);
-            int res = (int)(b / a);
-            PUSH_INT(res);
-            break;
-        }
-        case POW_INT: {
-            int a, b;
-            POP_INT(a); POP_INT(b);
-            double res = pow(b, a);
-            PUSH_REAL(res);
-            break;
-        }
-        case POW_REAL: {
-            double a, b;
-            POP_REAL(a); POP_REAL(b);
-            double res = pow(b, a);
-            PUSH_REAL(res);
-            break;
-        }
-        case CONCAT: {
-            void* ref1, *ref2;
-            POP_REF(ref1); POP_REF(ref2);
-
-            if (!isValidReference(&vm->mem, ref1) || !isValidReference(&vm->mem, ref2)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* str2 = (Obj*)ref1;
-            Obj* str1 = (Obj*)ref2;
-
-            Obj* res = concatStrings(vm, str1, str2);
-            if (res == NULL) {
-                runtimeError(vm, "Not enough memory available for string allocation.");
-                break;
-            }
-
-            //void* resRef = (void*)res;
-
-            PUSH_REF(res);
-            break;
-        }
-        case EQ_INT: {
-            int a, b;
-            POP_INT(a); POP_INT(b);
-            bool res = a==b;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case EQ_REAL: {
-            double a, b;
-            POP_REAL(a); POP_REAL(b);
-            bool res = a==b;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case EQ_BOOL: {
-            bool a, b;
-            POP_BOOL(a); POP_BOOL(b);
-            bool res = a==b;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case EQ_REF: {
-            void* a, *b;
-            POP_REF(a); POP_REF(b);
-            bool res = a==b;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case EQ_STRING: {
-            void* a, *b;
-            POP_REF(a); POP_REF(b);
-
-            if (!isValidReference(&vm->mem, a) || !isValidReference(&vm->mem, b)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* str1 = (Obj*)a;
-            Obj* str2 = (Obj*)b;
-
-            bool res = cmpStrings(str1, str2) == 0;
-            PUSH_BOOL(res);
-            break;
-        }
-        case LESS_INT: {
-            int a, b;
-            POP_INT(a); POP_INT(b);
-            bool res = b < a;
-            PUSH_BOOL(res);
-            break;
-        }
-        case LESS_REAL: {
-            double a, b;
-            POP_REAL(a); POP_REAL(b);
-            bool res = b < a;
-            PUSH_BOOL(res);
-            break;
-        }
-        case LESS_BOOL: {
-            bool a, b;
-            POP_BOOL(a); POP_BOOL(b);
-            bool res = b < a;
-            PUSH_BOOL(res);
-            break;
-        }
-        case LESS_REF: {
-            void* a, *b;
-            POP_REF(a); POP_REF(b);
-            bool res = b < a;
-            PUSH_BOOL(res);
-            break;
-        }
-        case LESS_STRING: {
-            void* a, *b;
-            POP_REF(a); POP_REF(b);
-
-            if (!isValidReference(&vm->mem, a) || !isValidReference(&vm->mem, b)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* str1 = (Obj*)b;
-            Obj* str2 = (Obj*)a;
-
-            bool res = cmpStrings(str1, str2) < 0;
-            PUSH_BOOL(res);
-            break;
-        }
-        case LESS_EQ_INT: {
-            int a, b;
-            POP_INT(a); POP_INT(b);
-            bool res = b <= a;
-            PUSH_BOOL(res);
-            break;
-        }
-        case LESS_EQ_REAL: {
-            double a, b;
-            POP_REAL(a); POP_REAL(b);
-            bool res = b <= a;
-            PUSH_BOOL(res);
-            break;
-        }
-        case LESS_EQ_BOOL: {
-            bool a, b;
-            POP_BOOL(a); POP_BOOL(b);
-            bool res = b <= a;
-            PUSH_BOOL(res);
-            break;
-        }
-        case LESS_EQ_REF: {
-            void* a, *b;
-            POP_REF(a); POP_REF(b);
-            bool res = b <= a;
-            PUSH_BOOL(res);
-            break;
-        }
-        case LESS_EQ_STRING: {
-            void* a, *b;
-            POP_REF(a); POP_REF(b);
-
-            if (!isValidReference(&vm->mem, a) || !isValidReference(&vm->mem, b)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* str1 = (Obj*)b;
-            Obj* str2 = (Obj*)a;
-
-            bool res = cmpStrings(str1, str2) <= 0;
-            PUSH_BOOL(res);
-            break;
-        }
-        case NEQ_INT: {
-            int a, b;
-            POP_INT(a); POP_INT(b);
-            bool res = a!=b;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case NEQ_REAL: {
-            double a, b;
-            POP_REAL(a); POP_REAL(b);
-            bool res = a!=b;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case NEQ_BOOL: {
-            bool a, b;
-            POP_BOOL(a); POP_BOOL(b);
-            bool res = a!=b;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case NEQ_REF: {
-            void* a, *b;
-            POP_REF(a); POP_REF(b);
-            bool res = a!=b;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case NEQ_STRING: {
-            void* a, *b;
-            POP_REF(a); POP_REF(b);
-
-            if (!isValidReference(&vm->mem, a) || !isValidReference(&vm->mem, b)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* str1 = (Obj*)a;
-            Obj* str2 = (Obj*)b;
-
-            bool res = cmpStrings(str1, str2) != 0;
-            PUSH_BOOL(res);
-            break;
-        }
-        case GREATER_INT: {
-            int a, b;
-            POP_INT(a); POP_INT(b);
-            bool res = b > a;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case GREATER_REAL: {
-            double a, b;
-            POP_REAL(a); POP_REAL(b);
-            bool res = b > a;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case GREATER_BOOL: {
-            bool a, b;
-            POP_BOOL(a); POP_BOOL(b);
-            bool res = b > a;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case GREATER_REF: {
-            void* a, *b;
-            POP_REF(a); POP_REF(b);
-            bool res = b > a;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case GREATER_STRING: {
-            void* a, *b;
-            POP_REF(a); POP_REF(b);
-
-            if (!isValidReference(&vm->mem, a) || !isValidReference(&vm->mem, b)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* str1 = (Obj*)b;
-            Obj* str2 = (Obj*)a;
-
-            bool res = cmpStrings(str1, str2) > 0;
-            PUSH_BOOL(res);
-            break;
-        }
-        case GREATER_EQ_INT: {
-            int a, b;
-            POP_INT(a); POP_INT(b);
-            bool res = b >= a;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case GREATER_EQ_REAL: {
-            double a, b;
-            POP_REAL(a); POP_REAL(b);
-            bool res = b >= a;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case GREATER_EQ_BOOL: {
-            bool a, b;
-            POP_BOOL(a); POP_BOOL(b);
-            bool res = b >= a;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case GREATER_EQ_REF: {
-            void* a, *b;
-            POP_REF(a); POP_REF(b);
-            bool res = b >= a;
-
-            PUSH_BOOL(res);
-            break;
-        }
-        case GREATER_EQ_STRING: {
-            void* a, *b;
-            POP_REF(a); POP_REF(b);
-
-            if (!isValidReference(&vm->mem, a) || !isValidReference(&vm->mem, b)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* str1 = (Obj*)b;
-            Obj* str2 = (Obj*)a;
-
-            bool res = cmpStrings(str1, str2) >= 0;
-            PUSH_BOOL(res);
-            break;
-        }
-        case AND: {
-            bool a, b;
-            POP_BOOL(a); POP_BOOL(b);
-
-            bool res = a && b;
-            PUSH_BOOL(res);
-            break;
-        }
-        case OR: {
-            bool a, b;
-            POP_BOOL(a); POP_BOOL(b);
-
-            bool res = a || b;
-            PUSH_BOOL(res);
-            break;
-        }
-        case NEG_INT: {
-            int a;
-            POP_INT(a);
-            a *= -1;
-            PUSH_INT(a);
-            break;
-        }
-        case NEG_REAL: {
-            double a;
-            POP_REAL(a);
-            a *= -1;
-            PUSH_REAL(a);
-            break;
-        }
-        case NOT: {
-            bool a;
-            POP_BOOL(a);
-            a = !a;
-            PUSH_BOOL(a);
-            break;
-        }
-        case POP_1B: {
-            byte temp; POP_BYTE(temp);
-            break;
-        }
-        case POP_4B: {
-            byte4 temp;
-            POP_4BYTE(temp);
-            break;
-        }
-        case POP_8B: {
-            byte8 temp;
-            POP_8BYTE(temp);
-            break;
-        }
-        case COPY_INT: {
-            int a;
-            POP_INT(a);
-            PUSH_INT(a);
-            PUSH_INT(a);
-            break;
-        }
-        case INPUT_INT: {
-            //clearInputBuffer();
-            int num;
-            int res = scanf("%d", &num);
-            clearInputBuffer();
-
-            if (res <= 0) {
-                runtimeError(vm, "I/O error.");
-                break;
-            }
-
-            PUSH_INT(num);
-            break;
-        }
-        case INPUT_REAL: {
-            //clearInputBuffer();
-            double num;
-            int res = scanf("%lf", &num);
-            clearInputBuffer();
-
-            if (res <= 0) {
-                runtimeError(vm, "I/O error.");
-                break;
-            }
-
-            PUSH_REAL(num);
-            break;
-        }
-        case INPUT_CHAR: {
-            //clearInputBuffer();
-            char c;
-            int res = scanf("%c", &c);
-            clearInputBuffer();
-
-            if (res <= 0) {
-                runtimeError(vm, "I/O error.");
-                break;
-            }
-
-            PUSH_CHAR(c);
-            break;
-        }
-        case INPUT_BOOL: {
-            //clearInputBuffer();
-            char boolean[10];
-
-            int res = scanf("%s", boolean);
-            clearInputBuffer();
-
-            if (res <= 0) {
-                runtimeError(vm, "I/O error.");
-                break;
-            }
-
-            bool b = memcmp(boolean, "TRUE", 4) == 0 || memcmp(boolean, "true", 4) == 0 || memcmp(boolean, "True", 4) == 0;
-
-            PUSH_BOOL(b);
-            break;
-        }
-        case INPUT_STRING: {
-            //clearInputBuffer();
-            int currSize = 128;
-            char* buff = malloc(sizeof(char) * currSize);
-            if (buff == NULL) {
-                runtimeError(vm, "I/O error.");
-                break;
-            }
-
-            int length = 0;
-
-            while (true) {
-                char c;
-                int res = scanf("%c", &c);
-                if (res <= 0) {
-                    runtimeError(vm, "I/O error.");
-                    free(buff);
-                    length = -1;
-                    break;
-                }
-
-                if (c == '\n') break;
-
-                if (length >= currSize) {
-                    currSize *= 2;
-                    char* orig = buff;
-                    buff = realloc(buff, sizeof(char) * currSize);
-
-                    if (buff == NULL) {
-                        runtimeError(vm , "I/O error.");
-                        length = -1;
-                        free(orig);
-                        break;
-                    }
-                }
-
-                buff[length] = c;
-                length++;
-            }
-
-            if (length < 0) {
-                break;
-            }
-
-            char* strBuff = malloc(sizeof(char) * length);
-
-            if (strBuff == NULL) {
-                runtimeError(vm, "I/O error.");
-                free(buff);
-                break;
-            }
-
-            for (int i = 0; i < length; i++) {
-                strBuff[i] = buff[i];
-            }
-
-            free(buff);
-
-            Obj* strPtr = allocString(&vm->mem, strBuff, length);
-
-            if (strPtr == NULL) {
-                free(strBuff);
-                runtimeError(vm, "I/O error.");
-                break;
-            }
-
-            PUSH_REF(strPtr);
-            break;
-        }
-        case OUTPUT_INT: {
-            int a;
-            POP_INT(a);
-            printf("%d", a);
-            break;
-        }
-        case OUTPUT_REAL: {
-            double a;
-            POP_REAL(a);
-            printf("%f", a);
-            break;
-        }
-        case OUTPUT_CHAR: {
-            char c;
-            POP_CHAR(c);
-            printf("%c", c);
-            break;
-        }
-        case OUTPUT_BOOL: {
-            bool a;
-            POP_BOOL(a);
-            printf(a ? "TRUE" : "FALSE");
-            break;
-        }
-        case OUTPUT_REF: {
-            void* ref;
-            POP_REF(ref);
-            printf("[%p]", ref);
-            break;
-        }
-        case OUTPUT_STRING: {
-            void* a;
-            POP_REF(a);
-
-            if (!isValidReference(&vm->mem, a)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* str = (Obj*)a;
-
-            for (int i = 0; i < str->as.StringObj.length; i++) {
-                printf("%c", str->as.StringObj.start[i]);
-            }
-
-            break;
-        }
-        case OUTPUT_NL: {
-            printf("\n");
-            break;
-        }
-        case READ_LINE: {
-            void* ref;
-            POP_REF(ref);
-
-            if (!isValidReference(&vm->mem, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* file = (Obj*)ref;
-
-            int currSize = 128;
-            char* buff = malloc(sizeof(char) * currSize);
-            if (buff == NULL) {
-                runtimeError(vm, "I/O error.");
-                break;
-            }
-
-            int length = 0;
-
-            while (true) {
-                int c = fgetc(file->as.FileObj.filePtr);
-                if (c == EOF) {
-                    if (ferror(file->as.FileObj.filePtr)) {
-                        runtimeError(vm, "Error reading file.");
-                        free(buff);
-                        length = -1;
-                        break;
-                    }
-                }
-
-                if (c == '\n' || c == EOF) break;
-
-                if (length >= currSize) {
-                    currSize *= 2;
-                    char* orig = buff;
-                    buff = realloc(buff, sizeof(char) * currSize);
-
-                    if (buff == NULL) {
-                        runtimeError(vm , "I/O error.");
-                        length = -1;
-                        free(orig);
-                        break;
-                    }
-                }
-
-                buff[length] = (char)c;
-                length++;
-            }
-
-            if (length < 0) {
-                break;
-            }
-
-            char* strBuff = malloc(sizeof(char) * length);
-
-            if (strBuff == NULL) {
-                runtimeError(vm, "I/O error.");
-                free(buff);
-                break;
-            }
-
-            for (int i = 0; i < length; i++) {
-                strBuff[i] = buff[i];
-            }
-
-            free(buff);
-
-            Obj* strPtr = allocString(&vm->mem, strBuff, length);
-
-            if (strPtr == NULL) {
-                free(strBuff);
-                runtimeError(vm, "I/O error.");
-                break;
-            }
-
-            PUSH_REF(strPtr);
-            break;
-        }
-        case WRITE_INT: {
-            void* ref;
-            POP_REF(ref);
-
-            if (!isValidReference(&vm->mem, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* file = (Obj*)ref;
-
-            int a;
-            POP_INT(a);
-
-            fprintf(file->as.FileObj.filePtr, "%d", a);
-
-            break;
-        }
-        case WRITE_REAL: {
-            void* ref;
-            POP_REF(ref);
-
-            if (!isValidReference(&vm->mem, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* file = (Obj*)ref;
-
-            double a;
-            POP_REAL(a);
-
-            fprintf(file->as.FileObj.filePtr, "%f", a);
-
-            break;
-        }
-        case WRITE_CHAR: {
-            void* ref;
-            POP_REF(ref);
-
-            if (!isValidReference(&vm->mem, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* file = (Obj*)ref;
-
-            char a;
-            POP_CHAR(a);
-
-            fprintf(file->as.FileObj.filePtr, "%c", a);
-
-            break;
-        }
-        case WRITE_BOOL: {
-            void* ref;
-            POP_REF(ref);
+// Root marker for the heap: every stack slot flagged as a reference.
+static void markReferences(void* context) {
+    VM* vm = (VM*)context;
 
-            if (!isValidReference(&vm->mem, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
-
-            Obj* file = (Obj*)ref;
-
-            bool a;
-            POP_BOOL(a);
-
-            fprintf(file->as.FileObj.filePtr, a ? "TRUE" : "FALSE");
-
-            break;
+    for (int i = 0; i <= vm->stack.top; i++) {
+        if (isRefAt(&vm->stack, i)) {
+            markCell(&vm->mem, vm->stack.data[i].asRef);
         }
-        case WRITE_REF: {
-            void* ref;
-            POP_REF(ref);
+    }
+}
 
-            if (!isValidReference(&vm->mem, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
+// Runs the subroutine called from callIndex as native code once it is hot. Its frame has
+// already been pushed. Returns the instruction to continue from, or JIT_NOT_RUN.
+static int runCompiled(VM* vm, int callIndex) {
+    if (!vm->jit.enabled || vm->jit.depth >= JIT_MAX_DEPTH) return JIT_NOT_RUN;
 
-            Obj* file = (Obj*)ref;
+    DecodedOp* call = &vm->code.ops[callIndex];
+    JitFunction function = jitLookup(vm, (int)(call->operand.target - vm->code.ops));
+    if (function == NULL) return JIT_NOT_RUN;
 
-            void* a;
-            POP_REF(a);
+    vm->jit.depth++;
+    int next = function(vm, frameSlots(vm));
+    vm->jit.depth--;
 
-            fprintf(file->as.FileObj.filePtr, "[%p]", a);
+    return next == JIT_RETURNED ? callIndex + 1 : next;
+}
 
-            break;
-        }
-        case WRITE_STRING: {
-            void* ref;
-            POP_REF(ref);
+#if defined(PSEUDO_THREADED_DISPATCH) && defined(__GNUC__)
+#define VM_THREADED_DISPATCH
+#endif
+
+#ifdef VM_THREADED_DISPATCH
+#define CASE(op)    case op: op_##op:
+#define DISPATCH()  { LOOP_HOOK(); goto *ip->handler; }
+#else
+#define CASE(op)    case op:
+#define DISPATCH()  break
+#endif
+
+// A handler that raised an error leaves ip on the failing instruction.
+#define NEXT        { if (vm->hadRuntimeError) break; ip++; DISPATCH(); }
+#define JUMP(dst)   { if (vm->hadRuntimeError) break; ip = (dst); DISPATCH(); }
+
+#define LOOP_NAME       runLoop
+#define LOOP_HOOK()
+#define CALL_HOOK()     { int next = runCompiled(vm, (int)(ip - code)); \
+                          if (next != JIT_NOT_RUN) { fp = frameSlots(vm); ip = code + next; \
+                                                     if (!vm->hadRuntimeError) { DISPATCH(); } break; } }
+#include "vmloop.h"
+#undef LOOP_NAME
+#undef LOOP_HOOK
+#undef CALL_HOOK
+
+// Set by SIGUSR1 to have the traced loop print its trace before the next instruction.
+static volatile sig_atomic_t traceRequested = 0;
+
+#define LOOP_NAME       runTracedLoop
+#define LOOP_HOOK()     { traceInstruction(vm->trace, ip->offset, ip->op, vm->stack.top, vm->mem.inUse); \
+                          if (traceRequested) { traceRequested = 0; dumpTrace(vm->trace, vm->program, stderr); } }
+#define CALL_HOOK()
+#include "vmloop.h"
+#undef LOOP_NAME
+#undef LOOP_HOOK
+#undef CALL_HOOK
+
+#define LOOP_NAME       runProfileLoop
+#define LOOP_HOOK()     { profileOp(vm->opProfile, ip->op); }
+#define CALL_HOOK()
+#include "vmloop.h"
+#undef LOOP_NAME
+#undef LOOP_HOOK
+#undef CALL_HOOK
+
+#define LOOP_NAME       runSampledLoop
+#define SAMPLE_POINT(index, top)    (((byte8)(unsigned)((top) + 1) << 32) | (byte8)(unsigned)((index) + 1))
+#define LOOP_HOOK()     { atomic_store_explicit(&vm->sampledAt, SAMPLE_POINT(ip - code, vm->callStack.top), memory_order_relaxed); }
+#define CALL_HOOK()
+#include "vmloop.h"
+#undef LOOP_NAME
+#undef LOOP_HOOK
+#undef CALL_HOOK
+
+#define LOOP_NAME       runCountedLoop
+// A break here leaves ip on the instruction that was not run, as a handler's error does.
+#define LOOP_HOOK()     { if (vm->executed == vm->instructionLimit) { \
+                              runtimeError(vm, "Instruction limit reached."); break; } \
+                          vm->executed++; }
+#define CALL_HOOK()
+#include "vmloop.h"
+#undef LOOP_NAME
+#undef LOOP_HOOK
+#undef CALL_HOOK
+
+#ifdef JIT_AVAILABLE
+// Runs one instruction for native code and stops at the next. It must not patch the threaded
+// handlers the run loop installed, so it always uses switch dispatch.
+#undef VM_THREADED_DISPATCH
+#undef CASE
+#undef DISPATCH
+#define CASE(op)    case op:
+#define DISPATCH()  break
+
+#define LOOP_NAME       stepLoop
+#define LOOP_HOOK()     { if (ip != entry) return ip; }
+#define CALL_HOOK()
+#include "vmloop.h"
+#undef LOOP_NAME
+#undef LOOP_HOOK
+#undef CALL_HOOK
+
+int jitStep(VM* vm, int index) {
+    return (int)(stepLoop(vm, vm->code.ops + index) - vm->code.ops);
+}
 
-            if (!isValidReference(&vm->mem, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
+int jitCall(VM* vm, int index) {
+    DecodedOp* call = &vm->code.ops[index];
 
-            Obj* file = (Obj*)ref;
+    if (!enterCall(vm, call, index)) return index;
 
-            void* a;
-            POP_REF(a);
+    int next = runCompiled(vm, index);
+    return next == JIT_NOT_RUN ? (int)(call->operand.target - vm->code.ops) : next;
+}
 
-            if (!isValidReference(&vm->mem, a)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
+void jitReturn(VM* vm, bool hasValue) {
+    bool isRef = hasValue && topIsRef(vm);
+    Value res = { .raw = 0 };
+    if (hasValue) res = popValue(vm);
 
-            Obj* str = (Obj*)a;
+    int base = frameBase(vm);
+    long returnPC;
+    popCallFrame(&vm->callStack, &returnPC);
+    vm->stack.top = base - 1;
 
-            for (int i = 0; i < str->as.StringObj.length; i++) {
-                fprintf(file->as.FileObj.filePtr, "%c", str->as.StringObj.start[i]);
-            }
+    if (hasValue) pushValue(vm, res, isRef);
+}
 
-            break;
-        }
-        case WRITE_NL: {
-            void* ref;
-            POP_REF(ref);
+void jitError(VM* vm, JitError error) {
+    switch (error) {
+        case JIT_STACK_OVERFLOW: runtimeError(vm, "Stack overflow."); break;
+        case JIT_STACK_UNDERFLOW: runtimeError(vm, "Stack underflow."); break;
+        case JIT_INVALID_SLOT: runtimeError(vm, "Invalid stack slot access."); break;
+        case JIT_DIVISION_BY_ZERO: runtimeError(vm, DIVISION_BY_ZERO); break;
+        case JIT_INTEGER_OVERFLOW: runtimeError(vm, DIVISION_OVERFLOW); break;
+    }
+}
+#endif
 
-            if (!isValidReference(&vm->mem, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
+#ifdef STACK_GUARD_PAGES
+// The VM running on this thread, for the fault handler.
+static _Thread_local VM* guardedVM = NULL;
 
-            Obj* file = (Obj*)ref;
+// Handlers in place before the overflow handler, which faults that are not ours go back to.
+static struct sigaction previousSegv;
+static struct sigaction previousBus;
 
-            fprintf(file->as.FileObj.filePtr, "\n");
-            break;
-        }
-        case OPENFILE: {
-            int accessType;
-            POP_INT(accessType);
+static void overflowHandler(int sig, siginfo_t* info, void* context) {
+    (void)context;
+    VM* vm = guardedVM;
 
-            void* a;
-            POP_REF(a);
+    // Reaching into the reserved but uncommitted part of a stack: commit it and retry.
+    if (vm != NULL && (commitStack(&vm->stack, info->si_addr) || commitCallStack(&vm->callStack, info->si_addr))) return;
 
-            if (!isValidReference(&vm->mem, a)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
+    if (vm != NULL && isStackGuard(&vm->stack, info->si_addr)) siglongjmp(vm->overflowJump, 1);
+    if (vm != NULL && isCallStackGuard(&vm->callStack, info->si_addr)) siglongjmp(vm->overflowJump, 2);
 
-            Obj* str = (Obj*)a;
+    // A genuine crash: returning with the previous action in place faults again and handles it
+    // as if this handler had never been installed.
+    sigaction(sig, sig == SIGBUS ? &previousBus : &previousSegv, NULL);
+}
 
-            char* name = extractNullTerminatedString(str->as.StringObj.start, str->as.StringObj.length);
+// Installed once for the whole process rather than around each run: saving and restoring it
+// per run would let a VM finishing on one thread take the handler away from one still running
+// on another. Threads that lose the race to install wait until it is in place.
+static void installOverflowHandler() {
+    static atomic_int state = 0;    // 0: not installed, 1: being installed, 2: installed.
+
+    int expected = 0;
+    if (atomic_compare_exchange_strong(&state, &expected, 1)) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = overflowHandler;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+
+        // macOS reports some protection faults as SIGBUS.
+        sigaction(SIGSEGV, &action, &previousSegv);
+        sigaction(SIGBUS, &action, &previousBus);
+        atomic_store(&state, 2);
+    }
 
-            Obj* file = allocFile(&vm->mem, name, accessType);
+    while (atomic_load(&state) != 2) {}
+}
+#endif
 
-            free(name);
+#ifdef PROFILER_AVAILABLE
+// SIGPROF goes to whichever thread is running, so the sampled VM is process-wide.
+static VM* volatile sampledVM = NULL;
 
-            if (file == NULL) {
-                runtimeError(vm, "Error opening file.");
-                break;
-            }
+static void sampleHandler(int sig) {
+    (void)sig;
+    VM* vm = sampledVM;
 
-            PUSH_REF(file);
-            break;
-        }
-        case CLOSEFILE: {
-            void* ref;
-            POP_REF(ref);
+    if (vm == NULL) return;
 
-            if (!isValidReference(&vm->mem, ref)) {
-                runtimeError(vm, "Segmentation fault.");
-                break;
-            }
+    // A call or return changes the call stack before the next instruction is published, so
+    // only the frames that were live when this instruction started are recorded.
+    byte8 at = atomic_load_explicit(&vm->sampledAt, memory_order_relaxed);
+    if (at != 0) {
+        recordSample(vm->sampleProfile, (int)(at & 0xffffffffu) - 1, &vm->callStack, (int)(at >> 32) - 1);
+    }
+}
 
-            markForceFree(&vm->mem, ref);
+static void setSampling(VM* vm, bool enable) {
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+
+    if (enable) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = sampleHandler;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, NULL);
+
+        atomic_store(&vm->sampledAt, 0);
+        sampledVM = vm;
+        timer.it_interval.tv_usec = SAMPLE_INTERVAL_US;
+        timer.it_value.tv_usec = SAMPLE_INTERVAL_US;
+        setitimer(ITIMER_PROF, &timer, NULL);
+    } else {
+        setitimer(ITIMER_PROF, &timer, NULL);
+        signal(SIGPROF, SIG_IGN);
+        sampledVM = NULL;
+    }
+}
+#endif
 
-            Obj* file = (Obj*)ref;
+#ifdef TRACE_ON_SIGNAL
+static void requestTrace(int sig) {
+    (void)sig;
+    traceRequested = 1;
+}
+#endif
+
+static DecodedOp* runFromStart(VM* vm) {
+    if (vm->trace != NULL) {
+#ifdef TRACE_ON_SIGNAL
+        struct sigaction action;
+        struct sigaction previous;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = requestTrace;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR1, &action, &previous);
+
+        DecodedOp* last = runTracedLoop(vm, vm->code.ops);
+        sigaction(SIGUSR1, &previous, NULL);
+        return last;
+#else
+        return runTracedLoop(vm, vm->code.ops);
+#endif
+    }
+    if (vm->opProfile != NULL) return runProfileLoop(vm, vm->code.ops);
+    if (vm->countInstructions) return runCountedLoop(vm, vm->code.ops);
+#ifdef PROFILER_AVAILABLE
+    if (vm->sampleProfile != NULL) {
+        setSampling(vm, true);
+        DecodedOp* last = runSampledLoop(vm, vm->code.ops);
+        setSampling(vm, false);
+        return last;
+    }
+#endif
+    return runLoop(vm, vm->code.ops);
+}
 
-            fclose(file->as.FileObj.filePtr);
-            break;
-        }
-        /*case RINPUT_INT: {
-        }
-        case RINPUT_REAL: {
-        }
-        case RINPUT_CHAR: {
-        }
-        case RINPUT_BOOL: {
-        }
-        case RINPUT_STRING: {
-        }*/
-        case B_FALSE: {
-            int newPC; READ_INT(newPC, vm->PC + 1);
-            vm->PC += 4;
-
-            bool cond;
-            POP_BOOL(cond);
-            if (!cond) {
-                jmpTo(vm, newPC);
-            }
-            break;
-        }
-        case BRANCH: {
-            int newPC; READ_INT(newPC, vm->PC + 1);
-            vm->PC += 4;
-            jmpTo(vm, newPC);
+// Runs the program from its first instruction. With guard pages, a fault in either stack's
+// guard unwinds back here and becomes the runtime error the explicit checks would have raised,
+// while faults in the rest of the reservation just commit more of it.
+static DecodedOp* runGuarded(VM* vm) {
+#ifdef STACK_GUARD_PAGES
+    installOverflowHandler();
+    guardedVM = vm;
+
+    DecodedOp* last;
+    int overflow = sigsetjmp(vm->overflowJump, 1);
+    if (overflow == 0) {
+        last = runFromStart(vm);
+    } else if (overflow == 1) {
+        // The frame that overflowed was entered by the DO_CALL before its return address.
+        runtimeError(vm, "Stack overflow.");
+        CallStack* calls = &vm->callStack;
+        last = calls->top < 0 ? vm->code.ops : vm->code.ops + calls->frames[calls->top].returnPC - 1;
+    } else {
+        runtimeError(vm, "Call stack overflow.");
+        last = vm->code.ops + vm->callPC;
+    }
 
-            break;
-        }
-        case GET_REF: {
-            int pos;
-            POP_INT(pos);
+    guardedVM = NULL;
+    return last;
+#else
+    return runFromStart(vm);
+#endif
+}
 
-            void* ref = (void*)(&vm->stack.data[pos]);
-            PUSH_REF(ref);
-            break;
-        }
-        case RGET_REF: {
-            int base = getBaseStackPos(&vm->callStack);
-            int pos; POP_INT(pos);
+bool prepareProgram(VM* vm) {
+    // A VM that was reset keeps the program it decoded and verified on its first run.
+    if (vm->code.ops != NULL) return true;
 
-            void* ref = (void*)(&vm->stack.data[pos]);
-            PUSH_REF(ref);
-            break;
-        }
-        case EXIT: {
-            vm->PC = -10;
-            return;
-        }
-        default: break;
+    if (!decodeProgram(&vm->code, vm->program) || !verifyProgram(&vm->code)) {
+        freeDecodedProgram(&vm->code);
+        return false;
     }
-}
-
-static void markReferences(VM* vm) {
 
-#define READSTACK_8BYTE(idx) (((byte8)vm->stack->data[idx + 7] << 56) | ((byte8)vm->stack->data[idx + 6] << 48) | ((byte8)vm->stack->data[idx + 5] << 40) | ((byte8)vm->stack->data[idx + 4] << 32) | ((byte8)vm->stack->data[idx + 3] << 24) | ((byte8)vm->stack->data[idx + 2] << 16) | ((byte8)vm->stack->data[idx + 1] << 8) | ((byte8)vm->stack->data[idx]))
+    if (!prepareJit(&vm->jit, vm->code.count)) vm->jit.enabled = false;
+    return true;
+}
 
+bool run(VM* vm, bool debug) {
+    // Native code would skip the trace, the profiles and the instruction count.
+    if (debug || vm->trace != NULL || vm->opProfile != NULL || vm->sampleProfile != NULL || vm->countInstructions) vm->jit.enabled = false;
 
-    for (int i = 0; i <= vm->stack.top; i++) {
-        if (vm->stack.data[i].isRef) {
-            byte8 b = READ_8BYTE(i);
-            void* ref = *(void**)(&b);
-
-            if (isValidReference(&vm->mem, ref)) {
-                markCell(&vm->mem, ref);
-                i += 7;
-            }
-        }
+    if (!prepareProgram(vm)) {
+        vm->hadRuntimeError = true;
+        return false;
     }
 
-#undef READSTACK_8BYTE
-}
+    // The heap collects from inside allocation, so it needs the VM to find its roots.
+    setRootMarker(&vm->mem, markReferences, vm);
+    vm->mem.logCollections = debug;
 
-void run(VM* vm, bool debug) {
-    while (vm->PC >= 0 && !vm->hadRuntimeError) {
-        if (debug) printf("RUNNING instruction %d\n", vm->PC);
-        runInstruction(vm);
-        if (debug) showStack(&vm->stack);
-        advance(vm);
-
-        if (vm->mem.inUse >= vm->mem.memSize * 0.75) {
-            markReferences(vm);
-            size_t memCollected = collectGarbage(&vm->mem);
-            if (debug) printf("GARBAGE COLLECTOR COLLECTED %zu bytes.", memCollected);
-        }
+    DecodedOp* last = vm->code.ops;
+    if (vm->code.maxDepth > vm->stack.capacity) {
+        runtimeError(vm, "Stack overflow.");
+    } else if (!reserveStackGuard(&vm->stack, vm->code.maxFrame)) {
+        fprintf(diagnostics(), "Failed to allocate memory for stack.\n");
+        vm->hadRuntimeError = true;
+        return false;
+    } else {
+        last = runGuarded(vm);
     }
 
-    printf("Program executed correctly.\n");
-}
\ No newline at end of file
+    vm->PC = last->offset;
+    if (vm->hadRuntimeError) reportRuntimeError(vm);
+    if (vm->trace != NULL && (vm->hadRuntimeError || debug)) dumpTrace(vm->trace, vm->program, diagnostics());
+    if (vm->opProfile != NULL) printOpProfile(vm->opProfile, stderr);
+    return true;
+}
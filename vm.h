@@ -2,27 +2,66 @@
 #define PSEUDOCOMPILER_VM_H
 
 #include <math.h>
+#include <setjmp.h>
+#include <stdatomic.h>
 
 #include "common.h"
 #include "bytecode.h"
+#include "decode.h"
+#include "jit.h"
 #include "memory.h"
 #include "stack.h"
 #include "object.h"
+#include "opprofile.h"
+#include "profiler.h"
+#include "trace.h"
+#include "verify.h"
 
-typedef struct {
+typedef struct VM {
     ProgramMemory mem;
     Stack stack;
     CallStack callStack;
     BytecodeStream* program;
+    DecodedProgram code;
     int PC;
     bool hadRuntimeError;
-    int nextCallBase;
-    long callPC;
+    const char* errorMessage;
+    long callPC;            // Instruction index of the latest DO_CALL.
+    FILE* in;               // INPUT reads from here and OUTPUT writes there, stdin and stdout by default.
+    FILE* out;
+    int fileDir;            // Directory OPENFILE resolves relative names in, or -1 for the working directory.
+    Jit jit;
+    OpProfile* opProfile;   // Filled by a profiling run loop instead of the plain one, if set.
+    SampleProfile* sampleProfile;   // Likewise, sampled by SIGPROF.
+    // Instruction the sampled loop is running and the call depth it runs at, stored together by
+    // SAMPLE_POINT so SIGPROF never sees one without the other. 0 outside the sampled loop.
+    _Atomic byte8 sampledAt;
+    TraceBuffer* trace;     // Filled by the traced run loop, if set.
+    bool countInstructions; // Run the counting loop, which adds up executed in place of the plain one.
+    byte8 executed;
+    byte8 instructionLimit; // The counting loop stops the run with a runtime error once executed reaches it.
+    byte8 random;           // RANDOMBETWEEN and RND generator state, seeded per VM.
+#ifdef STACK_GUARD_PAGES
+    sigjmp_buf overflowJump;
+#endif
 } VM;
 
-void initVM(VM* vm, int heapCapacity, int stackCapacity, int callStackCapacity, BytecodeStream* bStream);
+// False, with nothing left allocated, if the stacks or the heap could not be allocated.
+bool initVM(VM* vm, int heapCapacity, int stackCapacity, int callStackCapacity, BytecodeStream* bStream);
 void freeVM(VM* vm);
 
-void run(VM* vm, bool debug);
+// Gets the VM ready to run its program again: frees every heap object and empties both stacks,
+// but keeps their memory, the decoded and verified program and any native code.
+void vmReset(VM* vm);
+
+// Decodes and verifies the program and sets up the JIT for it, unless an earlier call or run
+// already has. False if the bytecode is invalid. run does this itself; calling it first moves
+// the work out of the first run, e.g. to before the VM is copied by fork().
+bool prepareProgram(VM* vm);
+
+// Runs the program to its end or its first runtime error. A VM that has already run must be
+// vmReset first. False if it could not be started at
+// all: the bytecode failed to decode or verify, or the stack could not be reserved.
+bool run(VM* vm, bool debug);
 
 #endif //PSEUDOCOMPILER_VM_H
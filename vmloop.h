@@ -0,0 +1,1522 @@
+// Shared dispatch loop for the VM. This file is not a normal header: vm.c includes it once
+// for every run loop it needs, after defining
+//   LOOP_NAME      the name of the generated function
+//   LOOP_HOOK()    a statement executed before every instruction, or nothing
+//   CALL_HOOK()    a statement executed by DO_CALL once the new frame is pushed, or nothing
+// so that instrumented loops never cost the plain loop an extra branch.
+//
+// The generated function starts at entry and returns the instruction it stopped on: the EXIT
+// that ended the program, or the one that raised a runtime error.
+//
+// The loop walks the decoded program (see decode.h) with a local instruction pointer. Handlers
+// finish with NEXT, or JUMP to a resolved target. With threaded dispatch that is an indirect
+// jump straight to the handler stored in the next record; otherwise it breaks back to the
+// switch. Handlers that bail out early with a plain break land at the bottom of the loop,
+// which stops on the pending error in both modes.
+
+static DecodedOp* LOOP_NAME(VM* vm, DecodedOp* entry) {
+#ifdef VM_THREADED_DISPATCH
+    static void* dispatchTable[256] = {
+        [0 ... 255] = &&OP_DEFAULT,
+        [NOP] = &&op_NOP,
+        [LOAD_INT] = &&op_LOAD_INT,
+        [LOAD_REAL] = &&op_LOAD_REAL,
+        [LOAD_CHAR] = &&op_LOAD_CHAR,
+        [LOAD_BOOL] = &&op_LOAD_BOOL,
+        [LOAD_STRING] = &&op_LOAD_STRING,
+        [CREATE_ARRAY] = &&op_CREATE_ARRAY,
+        [STORE_INT] = &&op_STORE_INT,
+        [STORE_REAL] = &&op_STORE_REAL,
+        [STORE_CHAR] = &&op_STORE_CHAR,
+        [STORE_BOOL] = &&op_STORE_BOOL,
+        [STORE_REF] = &&op_STORE_REF,
+        [FETCH_INT] = &&op_FETCH_INT,
+        [FETCH_REAL] = &&op_FETCH_REAL,
+        [FETCH_CHAR] = &&op_FETCH_CHAR,
+        [FETCH_BOOL] = &&op_FETCH_BOOL,
+        [FETCH_REF] = &&op_FETCH_REF,
+        [ENTER] = &&op_ENTER,
+        [DO_CALL] = &&op_DO_CALL,
+        [TAIL_CALL] = &&op_TAIL_CALL,
+        [RETURN] = &&op_RETURN,
+        [RETURN_NIL] = &&op_RETURN_NIL,
+        [CALL_BUILTIN] = &&op_CALL_BUILTIN,
+        [RSTORE_INT] = &&op_RSTORE_INT,
+        [RSTORE_REAL] = &&op_RSTORE_REAL,
+        [RSTORE_CHAR] = &&op_RSTORE_CHAR,
+        [RSTORE_BOOL] = &&op_RSTORE_BOOL,
+        [RSTORE_REF] = &&op_RSTORE_REF,
+        [RFETCH_INT] = &&op_RFETCH_INT,
+        [RFETCH_REAL] = &&op_RFETCH_REAL,
+        [RFETCH_CHAR] = &&op_RFETCH_CHAR,
+        [RFETCH_BOOL] = &&op_RFETCH_BOOL,
+        [RFETCH_REF] = &&op_RFETCH_REF,
+        [FETCH_ARRAY_ELEM] = &&op_FETCH_ARRAY_ELEM,
+        [STORE_ARRAY_ELEM] = &&op_STORE_ARRAY_ELEM,
+        [STORE_REF_INT] = &&op_STORE_REF_INT,
+        [STORE_REF_REAL] = &&op_STORE_REF_REAL,
+        [STORE_REF_CHAR] = &&op_STORE_REF_CHAR,
+        [STORE_REF_BOOL] = &&op_STORE_REF_BOOL,
+        [FETCH_REF_INT] = &&op_FETCH_REF_INT,
+        [FETCH_REF_REAL] = &&op_FETCH_REF_REAL,
+        [FETCH_REF_CHAR] = &&op_FETCH_REF_CHAR,
+        [FETCH_REF_BOOL] = &&op_FETCH_REF_BOOL,
+        [CAST_INT_REAL] = &&op_CAST_INT_REAL,
+        [CAST_INT_CHAR] = &&op_CAST_INT_CHAR,
+        [CAST_CHAR_INT] = &&op_CAST_CHAR_INT,
+        [ADD_INT] = &&op_ADD_INT,
+        [ADD_REAL] = &&op_ADD_REAL,
+        [MINUS_INT] = &&op_MINUS_INT,
+        [MINUS_REAL] = &&op_MINUS_REAL,
+        [MULT_INT] = &&op_MULT_INT,
+        [MULT_REAL] = &&op_MULT_REAL,
+        [DIV_INT] = &&op_DIV_INT,
+        [DIV_REAL] = &&op_DIV_REAL,
+        [MOD_INT] = &&op_MOD_INT,
+        [MOD_REAL] = &&op_MOD_REAL,
+        [FDIV_INT] = &&op_FDIV_INT,
+        [FDIV_REAL] = &&op_FDIV_REAL,
+        [POW_INT] = &&op_POW_INT,
+        [POW_REAL] = &&op_POW_REAL,
+        [CONCAT] = &&op_CONCAT,
+        [EQ_INT] = &&op_EQ_INT,
+        [EQ_REAL] = &&op_EQ_REAL,
+        [EQ_BOOL] = &&op_EQ_BOOL,
+        [EQ_REF] = &&op_EQ_REF,
+        [EQ_STRING] = &&op_EQ_STRING,
+        [LESS_INT] = &&op_LESS_INT,
+        [LESS_REAL] = &&op_LESS_REAL,
+        [LESS_BOOL] = &&op_LESS_BOOL,
+        [LESS_REF] = &&op_LESS_REF,
+        [LESS_STRING] = &&op_LESS_STRING,
+        [LESS_EQ_INT] = &&op_LESS_EQ_INT,
+        [LESS_EQ_REAL] = &&op_LESS_EQ_REAL,
+        [LESS_EQ_BOOL] = &&op_LESS_EQ_BOOL,
+        [LESS_EQ_REF] = &&op_LESS_EQ_REF,
+        [LESS_EQ_STRING] = &&op_LESS_EQ_STRING,
+        [NEQ_INT] = &&op_NEQ_INT,
+        [NEQ_REAL] = &&op_NEQ_REAL,
+        [NEQ_BOOL] = &&op_NEQ_BOOL,
+        [NEQ_REF] = &&op_NEQ_REF,
+        [NEQ_STRING] = &&op_NEQ_STRING,
+        [GREATER_INT] = &&op_GREATER_INT,
+        [GREATER_REAL] = &&op_GREATER_REAL,
+        [GREATER_BOOL] = &&op_GREATER_BOOL,
+        [GREATER_REF] = &&op_GREATER_REF,
+        [GREATER_STRING] = &&op_GREATER_STRING,
+        [GREATER_EQ_INT] = &&op_GREATER_EQ_INT,
+        [GREATER_EQ_REAL] = &&op_GREATER_EQ_REAL,
+        [GREATER_EQ_BOOL] = &&op_GREATER_EQ_BOOL,
+        [GREATER_EQ_REF] = &&op_GREATER_EQ_REF,
+        [GREATER_EQ_STRING] = &&op_GREATER_EQ_STRING,
+        [AND] = &&op_AND,
+        [OR] = &&op_OR,
+        [NEG_INT] = &&op_NEG_INT,
+        [NEG_REAL] = &&op_NEG_REAL,
+        [NOT] = &&op_NOT,
+        [POP] = &&op_POP,
+        [COPY_INT] = &&op_COPY_INT,
+        [INPUT_INT] = &&op_INPUT_INT,
+        [INPUT_REAL] = &&op_INPUT_REAL,
+        [INPUT_CHAR] = &&op_INPUT_CHAR,
+        [INPUT_BOOL] = &&op_INPUT_BOOL,
+        [INPUT_STRING] = &&op_INPUT_STRING,
+        [OUTPUT_INT] = &&op_OUTPUT_INT,
+        [OUTPUT_REAL] = &&op_OUTPUT_REAL,
+        [OUTPUT_CHAR] = &&op_OUTPUT_CHAR,
+        [OUTPUT_BOOL] = &&op_OUTPUT_BOOL,
+        [OUTPUT_REF] = &&op_OUTPUT_REF,
+        [OUTPUT_STRING] = &&op_OUTPUT_STRING,
+        [OUTPUT_NL] = &&op_OUTPUT_NL,
+        [READ_LINE] = &&op_READ_LINE,
+        [WRITE_INT] = &&op_WRITE_INT,
+        [WRITE_REAL] = &&op_WRITE_REAL,
+        [WRITE_CHAR] = &&op_WRITE_CHAR,
+        [WRITE_BOOL] = &&op_WRITE_BOOL,
+        [WRITE_REF] = &&op_WRITE_REF,
+        [WRITE_STRING] = &&op_WRITE_STRING,
+        [WRITE_NL] = &&op_WRITE_NL,
+        [OPENFILE] = &&op_OPENFILE,
+        [CLOSEFILE] = &&op_CLOSEFILE,
+        [B_FALSE] = &&op_B_FALSE,
+        [BRANCH] = &&op_BRANCH,
+        [GET_REF] = &&op_GET_REF,
+        [RGET_REF] = &&op_RGET_REF,
+        [FETCH_LOCAL_INT] = &&op_FETCH_LOCAL_INT,
+        [FETCH_GLOBAL_INT] = &&op_FETCH_GLOBAL_INT,
+        [STORE_LOCAL_INT_DISCARD] = &&op_STORE_LOCAL_INT_DISCARD,
+        [STORE_GLOBAL_INT_DISCARD] = &&op_STORE_GLOBAL_INT_DISCARD,
+        [BEQ_INT] = &&op_BEQ_INT,
+        [BNE_INT] = &&op_BNE_INT,
+        [BLT_INT] = &&op_BLT_INT,
+        [BLE_INT] = &&op_BLE_INT,
+        [BGT_INT] = &&op_BGT_INT,
+        [BGE_INT] = &&op_BGE_INT,
+        [LOAD_ZEROS] = &&op_LOAD_ZEROS,
+        [MOVE_R] = &&op_MOVE_R,
+        [LOADK_INT_R] = &&op_LOADK_INT_R,
+        [ADD_INT_RR] = &&op_ADD_INT_RR,
+        [MINUS_INT_RR] = &&op_MINUS_INT_RR,
+        [MULT_INT_RR] = &&op_MULT_INT_RR,
+        [MOD_INT_RR] = &&op_MOD_INT_RR,
+        [FDIV_INT_RR] = &&op_FDIV_INT_RR,
+        [ADD_INT_RK] = &&op_ADD_INT_RK,
+        [MINUS_INT_RK] = &&op_MINUS_INT_RK,
+        [MULT_INT_RK] = &&op_MULT_INT_RK,
+        [MOD_INT_RK] = &&op_MOD_INT_RK,
+        [FDIV_INT_RK] = &&op_FDIV_INT_RK,
+        [ADD_REAL_RR] = &&op_ADD_REAL_RR,
+        [MINUS_REAL_RR] = &&op_MINUS_REAL_RR,
+        [MULT_REAL_RR] = &&op_MULT_REAL_RR,
+        [DIV_REAL_RR] = &&op_DIV_REAL_RR,
+        [BEQ_INT_RR] = &&op_BEQ_INT_RR,
+        [BNE_INT_RR] = &&op_BNE_INT_RR,
+        [BLT_INT_RR] = &&op_BLT_INT_RR,
+        [BLE_INT_RR] = &&op_BLE_INT_RR,
+        [BGT_INT_RR] = &&op_BGT_INT_RR,
+        [BGE_INT_RR] = &&op_BGE_INT_RR,
+        [BEQ_INT_RK] = &&op_BEQ_INT_RK,
+        [BNE_INT_RK] = &&op_BNE_INT_RK,
+        [BLT_INT_RK] = &&op_BLT_INT_RK,
+        [BLE_INT_RK] = &&op_BLE_INT_RK,
+        [BGT_INT_RK] = &&op_BGT_INT_RK,
+        [BGE_INT_RK] = &&op_BGE_INT_RK,
+        [EXIT] = &&op_EXIT,
+    };
+
+    for (int i = 0; i < vm->code.count; i++) {
+        vm->code.ops[i].handler = dispatchTable[vm->code.ops[i].op];
+    }
+#endif
+
+    DecodedOp* code = vm->code.ops;
+    DecodedOp* ip = entry;
+    Value* fp = frameSlots(vm);
+
+    for (;;) {
+        LOOP_HOOK();
+
+        switch (ip->op) {
+        CASE(NOP) {
+            NEXT;
+        }
+        CASE(LOAD_INT) {
+            PUSH_INT(ip->operand.asInt);
+            NEXT;
+        }
+        CASE(LOAD_REAL) {
+            PUSH_REAL(ip->operand.asReal);
+            NEXT;
+        }
+        CASE(LOAD_CHAR) {
+            PUSH_CHAR(ip->operand.asChar);
+            NEXT;
+        }
+        CASE(LOAD_BOOL) {
+            PUSH_BOOL(ip->operand.asBool);
+            NEXT;
+        }
+        CASE(LOAD_STRING) {
+            Obj* strPtr = allocString(&vm->mem, ip->operand.chars, ip->a);
+            if (strPtr == NULL) {
+                runtimeError(vm, "String allocation failed in heap.");
+                break;
+            }
+
+            PUSH_REF(strPtr);
+            NEXT;
+        }
+        CASE(CREATE_ARRAY) {
+            int x0, x1, y0, y1, elemSize;
+            POP_INT(elemSize);
+            POP_INT(y1);
+            POP_INT(y0);
+            POP_INT(x1);
+            POP_INT(x0);
+
+            Obj* arrPtr = allocArray(&vm->mem, x1 - x0 + 1, y1 - y0 + 1, x0, y0, elemSize);
+            if (arrPtr == NULL) {
+                runtimeError(vm, "Array allocation failed.");
+                break;
+            }
+
+            PUSH_REF(arrPtr);
+            NEXT;
+        }
+        CASE(STORE_INT)
+        CASE(STORE_REAL)
+        CASE(STORE_CHAR)
+        CASE(STORE_BOOL) {
+            int pos; POP_INT(pos);
+            Value val; POP_VALUE(val);
+            storeSlot(vm, val, false, pos);
+            PUSH_VALUE(val, false);
+            NEXT;
+        }
+        CASE(STORE_REF) {
+            int pos; POP_INT(pos);
+            Value val; POP_VALUE(val);
+            storeSlot(vm, val, true, pos);
+            PUSH_VALUE(val, true);
+            NEXT;
+        }
+        CASE(FETCH_INT)
+        CASE(FETCH_REAL)
+        CASE(FETCH_CHAR)
+        CASE(FETCH_BOOL) {
+            int pos; POP_INT(pos);
+            PUSH_VALUE(loadSlot(vm, pos), false);
+            NEXT;
+        }
+        CASE(FETCH_REF) {
+            int pos; POP_INT(pos);
+            PUSH_VALUE(loadSlot(vm, pos), true);
+            NEXT;
+        }
+        CASE(DO_CALL) {
+            if (!enterCall(vm, ip, (int)(ip - code))) break;
+            fp = frameSlots(vm);
+            CALL_HOOK();
+            JUMP(ip->operand.target);
+        }
+        CASE(TAIL_CALL) {
+            if (!tailCall(vm, ip)) break;
+            JUMP(ip->operand.target);
+        }
+        CASE(RETURN) {
+            bool isRef = topIsRef(vm);
+            Value res; POP_VALUE(res);
+            int base = frameBase(vm);
+            long returnPC = 0;
+            popCallFrame(&vm->callStack, &returnPC);
+            vm->stack.top = base - 1;
+            PUSH_VALUE(res, isRef);
+            fp = frameSlots(vm);
+            JUMP(code + returnPC);
+        }
+        CASE(RETURN_NIL) {
+            int base = frameBase(vm);
+            long returnPC = 0;
+            popCallFrame(&vm->callStack, &returnPC);
+            vm->stack.top = base - 1;
+            fp = frameSlots(vm);
+            JUMP(code + returnPC);
+        }
+        CASE(CALL_BUILTIN) {
+            runBuiltinFunc(vm, ip->operand.asInt);
+            NEXT;
+        }
+        CASE(RSTORE_INT)
+        CASE(RSTORE_REAL)
+        CASE(RSTORE_CHAR)
+        CASE(RSTORE_BOOL) {
+            int base = frameBase(vm);
+            int pos; POP_INT(pos); pos += base;
+            Value val; POP_VALUE(val);
+            storeSlot(vm, val, false, pos);
+            PUSH_VALUE(val, false);
+            NEXT;
+        }
+        CASE(RSTORE_REF) {
+            int base = frameBase(vm);
+            int pos; POP_INT(pos); pos += base;
+            Value val; POP_VALUE(val);
+            storeSlot(vm, val, true, pos);
+            PUSH_VALUE(val, true);
+            NEXT;
+        }
+        CASE(RFETCH_INT)
+        CASE(RFETCH_REAL)
+        CASE(RFETCH_CHAR)
+        CASE(RFETCH_BOOL) {
+            int base = frameBase(vm);
+            int pos; POP_INT(pos); pos += base;
+            PUSH_VALUE(loadSlot(vm, pos), false);
+            NEXT;
+        }
+        CASE(RFETCH_REF) {
+            int base = frameBase(vm);
+            int pos; POP_INT(pos); pos += base;
+            PUSH_VALUE(loadSlot(vm, pos), true);
+            NEXT;
+        }
+        CASE(FETCH_ARRAY_ELEM) {
+            int y; POP_INT(y);
+            int x; POP_INT(x);
+            void* ref; POP_REF(ref);
+
+            Obj* arr = objectOf(vm, ref, OBJ_ARRAY);
+            if (arr == NULL) break;
+#define ARR arr->as.ArrayObj
+            if (x < ARR.x0 || x >= ARR.x0 + ARR.length || y < ARR.y0 || y >= ARR.y0 + ARR.width) {
+                runtimeError(vm, "Array out of bounds access.");
+                break;
+            }
+
+            int idx = (y - ARR.y0) * ARR.length + (x - ARR.x0);
+            Value val = { .raw = 0 };
+
+            switch (ARR.elemSize) {
+                case 1: val.asChar = ((char*)ARR.start)[idx]; break;
+                case 4: val.asInt = ((int*)ARR.start)[idx]; break;
+                case 8: val.raw = ((byte8*)ARR.start)[idx]; break;
+                default: break;
+            }
+
+            PUSH_VALUE(val, false);
+#undef ARR
+            NEXT;
+        }
+        CASE(STORE_ARRAY_ELEM) {
+            int y; POP_INT(y);
+            int x; POP_INT(x);
+            void* ref; POP_REF(ref);
+
+            bool isRef = topIsRef(vm);
+            Value val; POP_VALUE(val);
+
+            Obj* arr = objectOf(vm, ref, OBJ_ARRAY);
+            if (arr == NULL) break;
+#define ARR arr->as.ArrayObj
+            if (x < ARR.x0 || x >= ARR.x0 + ARR.length || y < ARR.y0 || y >= ARR.y0 + ARR.width) {
+                runtimeError(vm, "Array out of bounds access.");
+                break;
+            }
+
+            int idx = (y - ARR.y0) * ARR.length + (x - ARR.x0);
+
+            switch (ARR.elemSize) {
+                case 1: ((char*)ARR.start)[idx] = val.asChar; break;
+                case 4: ((int*)ARR.start)[idx] = val.asInt; break;
+                case 8: ((byte8*)ARR.start)[idx] = val.raw; break;
+                default: break;
+            }
+
+            PUSH_VALUE(val, isRef);
+#undef ARR
+            NEXT;
+        }
+        CASE(STORE_REF_INT)
+        CASE(STORE_REF_REAL)
+        CASE(STORE_REF_CHAR)
+        CASE(STORE_REF_BOOL) {
+            void* ref;
+            POP_REF(ref);
+            Value val; POP_VALUE(val);
+
+            if (!isStackRef(&vm->stack, ref)) {
+                runtimeError(vm, "Segmentation fault.");
+                break;
+            }
+
+            setAt(&vm->stack, val, false, getSlotOf(&vm->stack, ref));
+
+            PUSH_VALUE(val, false);
+            NEXT;
+        }
+        CASE(FETCH_REF_INT)
+        CASE(FETCH_REF_REAL)
+        CASE(FETCH_REF_CHAR)
+        CASE(FETCH_REF_BOOL) {
+            void* ref;
+            POP_REF(ref);
+
+            if (!isStackRef(&vm->stack, ref)) {
+                runtimeError(vm, "Segmentation fault.");
+                break;
+            }
+
+            PUSH_VALUE(*(Value*)ref, false);
+            NEXT;
+        }
+        CASE(CAST_INT_REAL) {
+            int num; POP_INT(num);
+
+            double real = (double)num;
+
+            PUSH_REAL(real);
+            NEXT;
+        }
+        CASE(CAST_INT_CHAR) {
+            int num; POP_INT(num);
+            if (num >= 256) num = 256;
+            else if (num < 0) num = 0;
+
+            char c = (char)num;
+            PUSH_CHAR(c);
+            NEXT;
+        }
+        CASE(CAST_CHAR_INT) {
+            char c;
+            POP_CHAR(c);
+            int num = (int)c;
+            PUSH_INT(num);
+            NEXT;
+        }
+        CASE(ADD_INT) {
+            int a, b;
+            POP_INT(a); POP_INT(b);
+            int res = a + b;
+            PUSH_INT(res);
+            NEXT;
+        }
+        CASE(ADD_REAL) {
+            double a, b;
+            POP_REAL(a); POP_REAL(b);
+            double res = a + b;
+            PUSH_REAL(res);
+            NEXT;
+        }
+        CASE(MINUS_INT) {
+            int a, b;
+            POP_INT(a); POP_INT(b);
+            int res = b - a;
+            PUSH_INT(res);
+            NEXT;
+        }
+        CASE(MINUS_REAL) {
+            double a, b;
+            POP_REAL(a); POP_REAL(b);
+            double res = b - a;
+            PUSH_REAL(res);
+            NEXT;
+        }
+        CASE(MULT_INT) {
+            int a, b;
+            POP_INT(a); POP_INT(b);
+            int res = a * b;
+            PUSH_INT(res);
+            NEXT;
+        }
+        CASE(MULT_REAL) {
+            double a, b;
+            POP_REAL(a); POP_REAL(b);
+            double res = a * b;
+            PUSH_REAL(res);
+            NEXT;
+        }
+        CASE(DIV_INT) {
+            int a, b;
+            POP_INT(a); POP_INT(b);
+            double res = (double)((double)b / (double)a);
+            PUSH_REAL(res);
+            NEXT;
+        }
+        CASE(DIV_REAL) {
+            double a, b;
+            POP_REAL(a); POP_REAL(b);
+            double res = b / a;
+            PUSH_REAL(res);
+            NEXT;
+        }
+        CASE(MOD_INT) {
+            int a, b;
+            POP_INT(a); POP_INT(b);
+            CHECK_DIVISION(b, a, false);
+            int res = INT_MOD(b, a);
+            PUSH_INT(res);
+            NEXT;
+        }
+        CASE(MOD_REAL) {
+            double a, b;
+            POP_REAL(a); POP_REAL(b);
+            double res = dmod(b, a);
+            PUSH_REAL(res);
+            NEXT;
+        }
+        CASE(FDIV_INT) {
+            int a, b;
+            POP_INT(a); POP_INT(b);
+            CHECK_DIVISION(b, a, true);
+            int res = (int)(b / a);
+            PUSH_INT(res);
+            NEXT;
+        }
+        CASE(FDIV_REAL) {
+            double a, b;
+            POP_REAL(a); POP_REAL(b);
+            int res = (int)(b / a);
+            PUSH_INT(res);
+            NEXT;
+        }
+        CASE(POW_INT) {
+            int a, b;
+            POP_INT(a); POP_INT(b);
+            double res = pow(b, a);
+            PUSH_REAL(res);
+            NEXT;
+        }
+        CASE(POW_REAL) {
+            double a, b;
+            POP_REAL(a); POP_REAL(b);
+            double res = pow(b, a);
+            PUSH_REAL(res);
+            NEXT;
+        }
+        CASE(CONCAT) {
+            void* ref1, *ref2;
+            POP_REF(ref1); POP_REF(ref2);
+
+            Obj* str2 = objectOf(vm, ref1, OBJ_STRING);
+            Obj* str1 = str2 != NULL ? objectOf(vm, ref2, OBJ_STRING) : NULL;
+            if (str1 == NULL) break;
+
+            Obj* res = concatStrings(vm, str1, str2);
+            if (res == NULL) {
+                runtimeError(vm, "Not enough memory available for string allocation.");
+                break;
+            }
+
+            //void* resRef = (void*)res;
+
+            PUSH_REF(res);
+            NEXT;
+        }
+        CASE(EQ_INT) {
+            int a, b;
+            POP_INT(a); POP_INT(b);
+            bool res = a==b;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(EQ_REAL) {
+            double a, b;
+            POP_REAL(a); POP_REAL(b);
+            bool res = a==b;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(EQ_BOOL) {
+            bool a, b;
+            POP_BOOL(a); POP_BOOL(b);
+            bool res = a==b;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(EQ_REF) {
+            void* a, *b;
+            POP_REF(a); POP_REF(b);
+            bool res = a==b;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(EQ_STRING) {
+            void* a, *b;
+            POP_REF(a); POP_REF(b);
+
+            Obj* str1 = objectOf(vm, a, OBJ_STRING);
+            Obj* str2 = str1 != NULL ? objectOf(vm, b, OBJ_STRING) : NULL;
+            if (str2 == NULL) break;
+
+            bool res = cmpStrings(str1, str2) == 0;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(LESS_INT) {
+            int a, b;
+            POP_INT(a); POP_INT(b);
+            bool res = b < a;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(LESS_REAL) {
+            double a, b;
+            POP_REAL(a); POP_REAL(b);
+            bool res = b < a;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(LESS_BOOL) {
+            bool a, b;
+            POP_BOOL(a); POP_BOOL(b);
+            bool res = b < a;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(LESS_REF) {
+            void* a, *b;
+            POP_REF(a); POP_REF(b);
+            bool res = b < a;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(LESS_STRING) {
+            void* a, *b;
+            POP_REF(a); POP_REF(b);
+
+            Obj* str1 = objectOf(vm, b, OBJ_STRING);
+            Obj* str2 = str1 != NULL ? objectOf(vm, a, OBJ_STRING) : NULL;
+            if (str2 == NULL) break;
+
+            bool res = cmpStrings(str1, str2) < 0;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(LESS_EQ_INT) {
+            int a, b;
+            POP_INT(a); POP_INT(b);
+            bool res = b <= a;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(LESS_EQ_REAL) {
+            double a, b;
+            POP_REAL(a); POP_REAL(b);
+            bool res = b <= a;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(LESS_EQ_BOOL) {
+            bool a, b;
+            POP_BOOL(a); POP_BOOL(b);
+            bool res = b <= a;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(LESS_EQ_REF) {
+            void* a, *b;
+            POP_REF(a); POP_REF(b);
+            bool res = b <= a;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(LESS_EQ_STRING) {
+            void* a, *b;
+            POP_REF(a); POP_REF(b);
+
+            Obj* str1 = objectOf(vm, b, OBJ_STRING);
+            Obj* str2 = str1 != NULL ? objectOf(vm, a, OBJ_STRING) : NULL;
+            if (str2 == NULL) break;
+
+            bool res = cmpStrings(str1, str2) <= 0;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(NEQ_INT) {
+            int a, b;
+            POP_INT(a); POP_INT(b);
+            bool res = a!=b;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(NEQ_REAL) {
+            double a, b;
+            POP_REAL(a); POP_REAL(b);
+            bool res = a!=b;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(NEQ_BOOL) {
+            bool a, b;
+            POP_BOOL(a); POP_BOOL(b);
+            bool res = a!=b;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(NEQ_REF) {
+            void* a, *b;
+            POP_REF(a); POP_REF(b);
+            bool res = a!=b;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(NEQ_STRING) {
+            void* a, *b;
+            POP_REF(a); POP_REF(b);
+
+            Obj* str1 = objectOf(vm, a, OBJ_STRING);
+            Obj* str2 = str1 != NULL ? objectOf(vm, b, OBJ_STRING) : NULL;
+            if (str2 == NULL) break;
+
+            bool res = cmpStrings(str1, str2) != 0;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(GREATER_INT) {
+            int a, b;
+            POP_INT(a); POP_INT(b);
+            bool res = b > a;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(GREATER_REAL) {
+            double a, b;
+            POP_REAL(a); POP_REAL(b);
+            bool res = b > a;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(GREATER_BOOL) {
+            bool a, b;
+            POP_BOOL(a); POP_BOOL(b);
+            bool res = b > a;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(GREATER_REF) {
+            void* a, *b;
+            POP_REF(a); POP_REF(b);
+            bool res = b > a;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(GREATER_STRING) {
+            void* a, *b;
+            POP_REF(a); POP_REF(b);
+
+            Obj* str1 = objectOf(vm, b, OBJ_STRING);
+            Obj* str2 = str1 != NULL ? objectOf(vm, a, OBJ_STRING) : NULL;
+            if (str2 == NULL) break;
+
+            bool res = cmpStrings(str1, str2) > 0;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(GREATER_EQ_INT) {
+            int a, b;
+            POP_INT(a); POP_INT(b);
+            bool res = b >= a;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(GREATER_EQ_REAL) {
+            double a, b;
+            POP_REAL(a); POP_REAL(b);
+            bool res = b >= a;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(GREATER_EQ_BOOL) {
+            bool a, b;
+            POP_BOOL(a); POP_BOOL(b);
+            bool res = b >= a;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(GREATER_EQ_REF) {
+            void* a, *b;
+            POP_REF(a); POP_REF(b);
+            bool res = b >= a;
+
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(GREATER_EQ_STRING) {
+            void* a, *b;
+            POP_REF(a); POP_REF(b);
+
+            Obj* str1 = objectOf(vm, b, OBJ_STRING);
+            Obj* str2 = str1 != NULL ? objectOf(vm, a, OBJ_STRING) : NULL;
+            if (str2 == NULL) break;
+
+            bool res = cmpStrings(str1, str2) >= 0;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(AND) {
+            bool a, b;
+            POP_BOOL(a); POP_BOOL(b);
+
+            bool res = a && b;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(OR) {
+            bool a, b;
+            POP_BOOL(a); POP_BOOL(b);
+
+            bool res = a || b;
+            PUSH_BOOL(res);
+            NEXT;
+        }
+        CASE(NEG_INT) {
+            int a;
+            POP_INT(a);
+            a *= -1;
+            PUSH_INT(a);
+            NEXT;
+        }
+        CASE(NEG_REAL) {
+            double a;
+            POP_REAL(a);
+            a *= -1;
+            PUSH_REAL(a);
+            NEXT;
+        }
+        CASE(NOT) {
+            bool a;
+            POP_BOOL(a);
+            a = !a;
+            PUSH_BOOL(a);
+            NEXT;
+        }
+        CASE(POP) {
+            popValue(vm);
+            NEXT;
+        }
+        CASE(COPY_INT) {
+            int a;
+            POP_INT(a);
+            PUSH_INT(a);
+            PUSH_INT(a);
+            NEXT;
+        }
+        CASE(INPUT_INT) {
+            //clearInputBuffer();
+            int num;
+            int res = fscanf(vm->in, "%d", &num);
+            clearInputBuffer(vm);
+
+            if (res <= 0) {
+                runtimeError(vm, "I/O error.");
+                break;
+            }
+
+            PUSH_INT(num);
+            NEXT;
+        }
+        CASE(INPUT_REAL) {
+            //clearInputBuffer();
+            double num;
+            int res = fscanf(vm->in, "%lf", &num);
+            clearInputBuffer(vm);
+
+            if (res <= 0) {
+                runtimeError(vm, "I/O error.");
+                break;
+            }
+
+            PUSH_REAL(num);
+            NEXT;
+        }
+        CASE(INPUT_CHAR) {
+            //clearInputBuffer();
+            char c;
+            int res = fscanf(vm->in, "%c", &c);
+            clearInputBuffer(vm);
+
+            if (res <= 0) {
+                runtimeError(vm, "I/O error.");
+                break;
+            }
+
+            PUSH_CHAR(c);
+            NEXT;
+        }
+        CASE(INPUT_BOOL) {
+            //clearInputBuffer();
+            char boolean[10];
+
+            int res = fscanf(vm->in, "%9s", boolean);
+            clearInputBuffer(vm);
+
+            if (res <= 0) {
+                runtimeError(vm, "I/O error.");
+                break;
+            }
+
+            bool b = memcmp(boolean, "TRUE", 4) == 0 || memcmp(boolean, "true", 4) == 0 || memcmp(boolean, "True", 4) == 0;
+
+            PUSH_BOOL(b);
+            NEXT;
+        }
+        CASE(INPUT_STRING) {
+            //clearInputBuffer();
+            int currSize = 128;
+            char* buff = malloc(sizeof(char) * currSize);
+            if (buff == NULL) {
+                runtimeError(vm, "I/O error.");
+                break;
+            }
+
+            int length = 0;
+
+            while (true) {
+                char c;
+                int res = fscanf(vm->in, "%c", &c);
+                if (res <= 0) {
+                    runtimeError(vm, "I/O error.");
+                    free(buff);
+                    length = -1;
+                    break;
+                }
+
+                if (c == '\n') break;
+
+                if (length >= currSize) {
+                    currSize *= 2;
+                    char* orig = buff;
+                    buff = realloc(buff, sizeof(char) * currSize);
+
+                    if (buff == NULL) {
+                        runtimeError(vm , "I/O error.");
+                        length = -1;
+                        free(orig);
+                        break;
+                    }
+                }
+
+                buff[length] = c;
+                length++;
+            }
+
+            if (length < 0) {
+                break;
+            }
+
+            char* strBuff = malloc(sizeof(char) * length);
+
+            if (strBuff == NULL) {
+                runtimeError(vm, "I/O error.");
+                free(buff);
+                break;
+            }
+
+            for (int i = 0; i < length; i++) {
+                strBuff[i] = buff[i];
+            }
+
+            free(buff);
+
+            Obj* strPtr = allocString(&vm->mem, strBuff, length);
+            free(strBuff);
+
+            if (strPtr == NULL) {
+                runtimeError(vm, "I/O error.");
+                break;
+            }
+
+            PUSH_REF(strPtr);
+            NEXT;
+        }
+        CASE(OUTPUT_INT) {
+            int a;
+            POP_INT(a);
+            fprintf(vm->out, "%d", a);
+            NEXT;
+        }
+        CASE(OUTPUT_REAL) {
+            double a;
+            POP_REAL(a);
+            fprintf(vm->out, "%f", a);
+            NEXT;
+        }
+        CASE(OUTPUT_CHAR) {
+            char c;
+            POP_CHAR(c);
+            fputc(c, vm->out);
+            NEXT;
+        }
+        CASE(OUTPUT_BOOL) {
+            bool a;
+            POP_BOOL(a);
+            fputs(a ? "TRUE" : "FALSE", vm->out);
+            NEXT;
+        }
+        CASE(OUTPUT_REF) {
+            void* ref;
+            POP_REF(ref);
+            fprintf(vm->out, "[%p]", ref);
+            NEXT;
+        }
+        CASE(OUTPUT_STRING) {
+            void* a;
+            POP_REF(a);
+
+            Obj* str = objectOf(vm, a, OBJ_STRING);
+            if (str == NULL) break;
+
+            fwrite(str->as.StringObj.start, 1, str->as.StringObj.length, vm->out);
+
+            NEXT;
+        }
+        CASE(OUTPUT_NL) {
+            fputc('\n', vm->out);
+            NEXT;
+        }
+        CASE(READ_LINE) {
+            void* ref;
+            POP_REF(ref);
+
+            Obj* file = objectOf(vm, ref, OBJ_FILE);
+            if (file == NULL) break;
+
+            int currSize = 128;
+            char* buff = malloc(sizeof(char) * currSize);
+            if (buff == NULL) {
+                runtimeError(vm, "I/O error.");
+                break;
+            }
+
+            int length = 0;
+
+            while (true) {
+                int c = fgetc(file->as.FileObj.filePtr);
+                if (c == EOF) {
+                    if (ferror(file->as.FileObj.filePtr)) {
+                        runtimeError(vm, "Error reading file.");
+                        free(buff);
+                        length = -1;
+                        break;
+                    }
+                }
+
+                if (c == '\n' || c == EOF) break;
+
+                if (length >= currSize) {
+                    currSize *= 2;
+                    char* orig = buff;
+                    buff = realloc(buff, sizeof(char) * currSize);
+
+                    if (buff == NULL) {
+                        runtimeError(vm , "I/O error.");
+                        length = -1;
+                        free(orig);
+                        break;
+                    }
+                }
+
+                buff[length] = (char)c;
+                length++;
+            }
+
+            if (length < 0) {
+                break;
+            }
+
+            char* strBuff = malloc(sizeof(char) * length);
+
+            if (strBuff == NULL) {
+                runtimeError(vm, "I/O error.");
+                free(buff);
+                break;
+            }
+
+            for (int i = 0; i < length; i++) {
+                strBuff[i] = buff[i];
+            }
+
+            free(buff);
+
+            Obj* strPtr = allocString(&vm->mem, strBuff, length);
+            free(strBuff);
+
+            if (strPtr == NULL) {
+                runtimeError(vm, "I/O error.");
+                break;
+            }
+
+            PUSH_REF(strPtr);
+            NEXT;
+        }
+        CASE(WRITE_INT) {
+            void* ref;
+            POP_REF(ref);
+
+            Obj* file = objectOf(vm, ref, OBJ_FILE);
+            if (file == NULL) break;
+
+            int a;
+            POP_INT(a);
+
+            fprintf(file->as.FileObj.filePtr, "%d", a);
+
+            NEXT;
+        }
+        CASE(WRITE_REAL) {
+            void* ref;
+            POP_REF(ref);
+
+            Obj* file = objectOf(vm, ref, OBJ_FILE);
+            if (file == NULL) break;
+
+            double a;
+            POP_REAL(a);
+
+            fprintf(file->as.FileObj.filePtr, "%f", a);
+
+            NEXT;
+        }
+        CASE(WRITE_CHAR) {
+            void* ref;
+            POP_REF(ref);
+
+            Obj* file = objectOf(vm, ref, OBJ_FILE);
+            if (file == NULL) break;
+
+            char a;
+            POP_CHAR(a);
+
+            fprintf(file->as.FileObj.filePtr, "%c", a);
+
+            NEXT;
+        }
+        CASE(WRITE_BOOL) {
+            void* ref;
+            POP_REF(ref);
+
+            Obj* file = objectOf(vm, ref, OBJ_FILE);
+            if (file == NULL) break;
+
+            bool a;
+            POP_BOOL(a);
+
+            fprintf(file->as.FileObj.filePtr, a ? "TRUE" : "FALSE");
+
+            NEXT;
+        }
+        CASE(WRITE_REF) {
+            void* ref;
+            POP_REF(ref);
+
+            Obj* file = objectOf(vm, ref, OBJ_FILE);
+            if (file == NULL) break;
+
+            void* a;
+            POP_REF(a);
+
+            fprintf(file->as.FileObj.filePtr, "[%p]", a);
+
+            NEXT;
+        }
+        CASE(WRITE_STRING) {
+            void* ref;
+            POP_REF(ref);
+
+            Obj* file = objectOf(vm, ref, OBJ_FILE);
+            if (file == NULL) break;
+
+            void* a;
+            POP_REF(a);
+
+            Obj* str = objectOf(vm, a, OBJ_STRING);
+            if (str == NULL) break;
+
+            for (int i = 0; i < str->as.StringObj.length; i++) {
+                fprintf(file->as.FileObj.filePtr, "%c", str->as.StringObj.start[i]);
+            }
+
+            NEXT;
+        }
+        CASE(WRITE_NL) {
+            void* ref;
+            POP_REF(ref);
+
+            Obj* file = objectOf(vm, ref, OBJ_FILE);
+            if (file == NULL) break;
+
+            fprintf(file->as.FileObj.filePtr, "\n");
+            NEXT;
+        }
+        CASE(OPENFILE) {
+            int accessType;
+            POP_INT(accessType);
+
+            void* a;
+            POP_REF(a);
+
+            Obj* str = objectOf(vm, a, OBJ_STRING);
+            if (str == NULL) break;
+
+            char* name = extractNullTerminatedString(str->as.StringObj.start, str->as.StringObj.length);
+
+            Obj* file = allocFile(&vm->mem, vm->fileDir, name, accessType);
+
+            free(name);
+
+            if (file == NULL) {
+                runtimeError(vm, "Error opening file.");
+                break;
+            }
+
+            PUSH_REF(file);
+            NEXT;
+        }
+        CASE(CLOSEFILE) {
+            void* ref;
+            POP_REF(ref);
+
+            Obj* file = objectOf(vm, ref, OBJ_FILE);
+            if (file == NULL) break;
+
+            markForceFree(&vm->mem, ref);
+
+            fclose(file->as.FileObj.filePtr);
+            file->as.FileObj.filePtr = NULL;
+            NEXT;
+        }
+        /*case RINPUT_INT: {
+        }
+        case RINPUT_REAL: {
+        }
+        case RINPUT_CHAR: {
+        }
+        case RINPUT_BOOL: {
+        }
+        case RINPUT_STRING: {
+        }*/
+        CASE(B_FALSE) {
+            bool cond;
+            POP_BOOL(cond);
+            if (!cond) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BRANCH) {
+            JUMP(ip->operand.target);
+        }
+        CASE(GET_REF) {
+            int pos;
+            POP_INT(pos);
+
+            void* ref = getMemRefAt(&vm->stack, pos);
+            PUSH_VALUE(((Value){ .asRef = ref }), false);
+            NEXT;
+        }
+        CASE(RGET_REF) {
+            int base = frameBase(vm);
+            int pos; POP_INT(pos);
+
+            void* ref = getMemRefAt(&vm->stack, base + pos);
+            PUSH_VALUE(((Value){ .asRef = ref }), false);
+            NEXT;
+        }
+        CASE(FETCH_LOCAL_INT)
+        CASE(FETCH_GLOBAL_INT) {
+            PUSH_VALUE(*REG(ip->a), false);
+            NEXT;
+        }
+        CASE(STORE_LOCAL_INT_DISCARD)
+        CASE(STORE_GLOBAL_INT_DISCARD) {
+            Value val; POP_VALUE(val);
+            *REG(ip->a) = val;
+            NEXT;
+        }
+        CASE(BEQ_INT) {
+            int b; POP_INT(b);
+            int a; POP_INT(a);
+            if (a == b) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BNE_INT) {
+            int b; POP_INT(b);
+            int a; POP_INT(a);
+            if (a != b) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BLT_INT) {
+            int b; POP_INT(b);
+            int a; POP_INT(a);
+            if (a < b) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BLE_INT) {
+            int b; POP_INT(b);
+            int a; POP_INT(a);
+            if (a <= b) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BGT_INT) {
+            int b; POP_INT(b);
+            int a; POP_INT(a);
+            if (a > b) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BGE_INT) {
+            int b; POP_INT(b);
+            int a; POP_INT(a);
+            if (a >= b) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(ENTER)
+        CASE(LOAD_ZEROS) {
+            pushZeros(vm, ip->operand.asInt);
+            NEXT;
+        }
+        CASE(MOVE_R) {
+            Value val = *REG(ip->a);
+            *REG(ip->operand.asInt) = val;
+            NEXT;
+        }
+        CASE(LOADK_INT_R) {
+            Value val = { .raw = 0 };
+            val.asInt = ip->a;
+            *REG(ip->operand.asInt) = val;
+            NEXT;
+        }
+        CASE(ADD_INT_RR) {
+            INT_RR(a + b);
+            NEXT;
+        }
+        CASE(MINUS_INT_RR) {
+            INT_RR(a - b);
+            NEXT;
+        }
+        CASE(MULT_INT_RR) {
+            INT_RR(a * b);
+            NEXT;
+        }
+        CASE(MOD_INT_RR) {
+            CHECK_DIVISION(REG(ip->a)->asInt, REG(ip->b)->asInt, false);
+            INT_RR(INT_MOD(a, b));
+            NEXT;
+        }
+        CASE(FDIV_INT_RR) {
+            CHECK_DIVISION(REG(ip->a)->asInt, REG(ip->b)->asInt, true);
+            INT_RR(a / b);
+            NEXT;
+        }
+        CASE(ADD_INT_RK) {
+            INT_RK(a + b);
+            NEXT;
+        }
+        CASE(MINUS_INT_RK) {
+            INT_RK(a - b);
+            NEXT;
+        }
+        CASE(MULT_INT_RK) {
+            INT_RK(a * b);
+            NEXT;
+        }
+        CASE(MOD_INT_RK) {
+            CHECK_DIVISION(REG(ip->a)->asInt, ip->b, false);
+            INT_RK(INT_MOD(a, b));
+            NEXT;
+        }
+        CASE(FDIV_INT_RK) {
+            CHECK_DIVISION(REG(ip->a)->asInt, ip->b, true);
+            INT_RK(a / b);
+            NEXT;
+        }
+        CASE(ADD_REAL_RR) {
+            REAL_RR(a + b);
+            NEXT;
+        }
+        CASE(MINUS_REAL_RR) {
+            REAL_RR(a - b);
+            NEXT;
+        }
+        CASE(MULT_REAL_RR) {
+            REAL_RR(a * b);
+            NEXT;
+        }
+        CASE(DIV_REAL_RR) {
+            REAL_RR(a / b);
+            NEXT;
+        }
+        CASE(BEQ_INT_RR) {
+            if (REG(ip->a)->asInt == REG(ip->b)->asInt) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BNE_INT_RR) {
+            if (REG(ip->a)->asInt != REG(ip->b)->asInt) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BLT_INT_RR) {
+            if (REG(ip->a)->asInt < REG(ip->b)->asInt) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BLE_INT_RR) {
+            if (REG(ip->a)->asInt <= REG(ip->b)->asInt) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BGT_INT_RR) {
+            if (REG(ip->a)->asInt > REG(ip->b)->asInt) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BGE_INT_RR) {
+            if (REG(ip->a)->asInt >= REG(ip->b)->asInt) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BEQ_INT_RK) {
+            if (REG(ip->a)->asInt == ip->b) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BNE_INT_RK) {
+            if (REG(ip->a)->asInt != ip->b) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BLT_INT_RK) {
+            if (REG(ip->a)->asInt < ip->b) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BLE_INT_RK) {
+            if (REG(ip->a)->asInt <= ip->b) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BGT_INT_RK) {
+            if (REG(ip->a)->asInt > ip->b) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(BGE_INT_RK) {
+            if (REG(ip->a)->asInt >= ip->b) {
+                JUMP(ip->operand.target);
+            }
+            NEXT;
+        }
+        CASE(EXIT) {
+            return ip;
+        }
+        default:
+#ifdef VM_THREADED_DISPATCH
+        OP_DEFAULT:
+#endif
+            runtimeError(vm, "Unknown instruction.");
+            break;
+        }
+
+        if (vm->hadRuntimeError) break;
+    }
+
+    return ip;
+}